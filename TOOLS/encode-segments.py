@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+
+"""
+Encode a file with several mpv processes in parallel, and join the result.
+
+The timeline is split into segments at video keyframes (as found by ffprobe),
+and each segment is encoded by a separate mpv process using --start/--end, so
+the whole mpv filter and subtitle rendering stack can be used. The encoded
+segments are then joined with ffmpeg's concat demuxer (without re-encoding).
+
+    encode-segments.py [-j JOBS] [-n SEGMENTS] input output [mpv options...]
+
+All mpv options must be passed in the --option=value form, for example:
+
+    encode-segments.py -n 8 in.mkv out.mkv --ovc=libx264 --ovcopts=crf=20 \\
+        --sub-file=subs.ass --vf=scale=1280:-2
+
+Each mpv process logs its progress in the encode/progress module (see
+--osegment). This script shows the progress of all running segments.
+
+Caveats: the segments are encoded independently, so rate control doesn't
+span segment boundaries. Audio encoders with a start delay (e.g. AAC) may
+cause a few milliseconds of audio to be lost at each boundary. Options that
+affect the timeline itself (such as --start, --end, --speed or --loop-file)
+must not be used.
+
+The MPV, FFMPEG and FFPROBE environment variables can be used to select the
+binaries to use.
+"""
+
+import argparse
+import bisect
+import collections
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+MPV = os.getenv("MPV", "mpv")
+FFMPEG = os.getenv("FFMPEG", "ffmpeg")
+FFPROBE = os.getenv("FFPROBE", "ffprobe")
+
+PROGRESS_RE = re.compile(
+    r"^\[encode/progress\] segment (\d+)/(\d+) (\d+)% (.*)$")
+
+# Number of mpv output lines shown if a segment fails.
+MAX_ERROR_LINES = 50
+
+
+def probe(args):
+    return subprocess.run([FFPROBE, "-v", "error"] + args, check=True,
+                          stdout=subprocess.PIPE, universal_newlines=True).stdout
+
+
+def get_format_times(filename):
+    """Return the start time and duration of the file."""
+    out = probe(["-show_entries", "format=start_time,duration",
+                 "-of", "default=noprint_wrappers=1", filename])
+    times = {}
+    for line in out.splitlines():
+        key, _, value = line.partition("=")
+        times[key] = float(value) if value not in ("", "N/A") else 0.0
+    return times.get("start_time", 0.0), times["duration"]
+
+
+def get_keyframes(filename, start_time):
+    """Return the keyframe times relative to the start of the file, like
+    mpv's --start and --end expect them (e.g. MPEG-TS doesn't start at 0)."""
+    # Packet flags only need demuxing, which is much faster than decoding.
+    out = probe(["-select_streams", "v:0", "-show_entries",
+                 "packet=pts_time,flags", "-of", "csv=p=0", filename])
+    keyframes = []
+    for line in out.splitlines():
+        fields = line.split(",")
+        if len(fields) >= 2 and "K" in fields[1] and fields[0] != "N/A":
+            keyframes.append(float(fields[0]) - start_time)
+    return sorted(keyframes)
+
+
+def split_points(duration, keyframes, count):
+    """Return the start times of the segments (the first is always 0)."""
+    points = [0.0]
+    for n in range(1, count):
+        target = duration * n / count
+        if keyframes:
+            i = bisect.bisect_left(keyframes, target)
+            if i == len(keyframes):
+                break
+            target = keyframes[i]
+        if target > points[-1] and target < duration:
+            points.append(target)
+    return points
+
+
+class Segment:
+    def __init__(self, index, start, end, filename):
+        self.index = index
+        self.start = start
+        self.end = end
+        self.filename = filename
+        self.process = None
+        self.status = "waiting"
+        self.percent = 0
+
+    def run(self, count, input, mpv_args):
+        cmd = [MPV, input, "--o=" + self.filename,
+               "--osegment={}/{}".format(self.index, count),
+               "--start={}".format(self.start),
+               "--msg-level=all=error,encode/progress=info"]
+        if self.end is not None:
+            cmd.append("--end={}".format(self.end))
+        cmd += mpv_args
+        # Log messages go to stdout, except with --o=-, so read both.
+        self.process = subprocess.Popen(cmd, stdin=subprocess.DEVNULL,
+                                        stdout=subprocess.PIPE,
+                                        stderr=subprocess.STDOUT,
+                                        universal_newlines=True,
+                                        errors="replace")
+        self.status = "started"
+        errors = collections.deque(maxlen=MAX_ERROR_LINES)
+        for line in self.process.stdout:
+            text = line.strip()
+            m = PROGRESS_RE.match(text)
+            if m:
+                self.percent = int(m.group(3))
+                self.status = m.group(4)
+            elif text:
+                errors.append(text)
+        if self.process.wait() != 0:
+            self.status = "failed"
+            for e in errors:
+                print("segment {}: {}".format(self.index, e), file=sys.stderr)
+        else:
+            self.percent = 100
+            self.status = "done"
+
+
+def show_progress(segments):
+    total = sum(s.percent for s in segments) / len(segments)
+    running = ["{}:{}%".format(s.index, s.percent) for s in segments
+               if s.status not in ("waiting", "done", "failed")]
+    done = sum(s.status == "done" for s in segments)
+    sys.stderr.write("\r\033[K{:3.0f}% ({}/{} done) {}".format(
+                     total, done, len(segments), " ".join(running)))
+    sys.stderr.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Encode a file with several mpv processes in parallel.")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(),
+                        help="number of mpv processes to run at once")
+    parser.add_argument("-n", "--segments", type=int,
+                        help="number of segments (default: same as --jobs)")
+    parser.add_argument("--keep", action="store_true",
+                        help="keep the temporary segment files")
+    parser.add_argument("input")
+    parser.add_argument("output")
+    args, mpv_args = parser.parse_known_args()
+
+    jobs = max(args.jobs or 1, 1)
+    count = max(args.segments or jobs, 1)
+
+    start_time, duration = get_format_times(args.input)
+    points = split_points(duration, get_keyframes(args.input, start_time),
+                          count)
+
+    ext = os.path.splitext(args.output)[1]
+    tmpdir = tempfile.mkdtemp(prefix=".segments-",
+                              dir=os.path.dirname(os.path.abspath(args.output)))
+
+    segments = []
+    for n, start in enumerate(points):
+        end = points[n + 1] if n + 1 < len(points) else None
+        filename = os.path.join(tmpdir, "seg{:04d}{}".format(n + 1, ext))
+        segments.append(Segment(n + 1, start, end, filename))
+
+    pending = list(segments)
+    threads = []
+    try:
+        while pending or any(t.is_alive() for t in threads):
+            threads = [t for t in threads if t.is_alive()]
+            while pending and len(threads) < jobs:
+                s = pending.pop(0)
+                t = threading.Thread(target=s.run,
+                                     args=(len(segments), args.input, mpv_args))
+                t.start()
+                threads.append(t)
+            show_progress(segments)
+            time.sleep(0.5)
+        show_progress(segments)
+        sys.stderr.write("\n")
+
+        failed = [s.index for s in segments if s.status != "done"]
+        if failed:
+            print("segments failed: {}".format(failed), file=sys.stderr)
+            return 1
+
+        listfile = os.path.join(tmpdir, "list.txt")
+        with open(listfile, "w") as f:
+            for s in segments:
+                path = os.path.abspath(s.filename).replace("'", "'\\''")
+                f.write("file '{}'\n".format(path))
+        subprocess.run([FFMPEG, "-v", "error", "-y", "-f", "concat",
+                        "-safe", "0", "-i", listfile, "-map", "0", "-c", "copy",
+                        args.output], check=True)
+    except KeyboardInterrupt:
+        for s in segments:
+            if s.process and s.process.poll() is None:
+                s.process.terminate()
+        raise
+    finally:
+        if not args.keep:
+            shutil.rmtree(tmpdir, ignore_errors=True)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
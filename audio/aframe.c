@@ -15,12 +15,16 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <pthread.h>
+
 #include <libavutil/frame.h>
 #include <libavutil/mem.h>
 
 #include "config.h"
 
 #include "common/common.h"
+#include "common/stats.h"
+#include "osdep/atomic.h"
 
 #include "chmap.h"
 #include "chmap_avchannel.h"
@@ -647,23 +651,94 @@ int mp_aframe_approx_byte_size(struct mp_aframe *frame)
     return plane_size * planes + sizeof(*frame);
 }
 
+#if LIBAVUTIL_VERSION_MAJOR < 57
+typedef int buffer_size_t;
+#else
+typedef size_t buffer_size_t;
+#endif
+
 struct mp_aframe_pool {
+    // Protects avpool and element_size. The pool can be used by filters
+    // running on different threads, and growing it replaces avpool.
+    pthread_mutex_t lock;
     AVBufferPool *avpool;
     int element_size;
+    struct stats_ctx *stats;
+    mp_atomic_uint64 hits, misses;
 };
 
+static void mp_aframe_pool_destructor(void *p)
+{
+    struct mp_aframe_pool *pool = p;
+    av_buffer_pool_uninit(&pool->avpool);
+    pthread_mutex_destroy(&pool->lock);
+}
+
 struct mp_aframe_pool *mp_aframe_pool_create(void *ta_parent)
 {
-    return talloc_zero(ta_parent, struct mp_aframe_pool);
+    struct mp_aframe_pool *pool = talloc_zero(ta_parent, struct mp_aframe_pool);
+    pthread_mutex_init(&pool->lock, NULL);
+    talloc_set_destructor(pool, mp_aframe_pool_destructor);
+    return pool;
 }
 
-static void mp_aframe_pool_destructor(void *p)
+// Report the number of allocations served from the pool ("pool-hit") and the
+// number of new buffers allocated by it ("pool-miss") as stats events.
+// stats must outlive the pool.
+void mp_aframe_pool_set_stats(struct mp_aframe_pool *pool,
+                              struct stats_ctx *stats)
 {
-    struct mp_aframe_pool *pool = p;
-    av_buffer_pool_uninit(&pool->avpool);
+    pool->stats = stats;
+}
+
+// Return the total number of hits and misses (as reported to stats).
+void mp_aframe_pool_get_counters(struct mp_aframe_pool *pool,
+                                 uint64_t *hits, uint64_t *misses)
+{
+    *hits = atomic_load(&pool->hits);
+    *misses = atomic_load(&pool->misses);
+}
+
+// Called by av_buffer_pool_get() if the pool has no free buffer.
+static AVBufferRef *pool_alloc(void *opaque, buffer_size_t size)
+{
+    struct mp_aframe_pool *pool = opaque;
+    atomic_fetch_add(&pool->misses, 1);
+    return av_buffer_alloc(size);
+}
+
+// Return a buffer of at least size bytes, or NULL.
+static AVBufferRef *pool_get(struct mp_aframe_pool *pool, int size, bool *miss)
+{
+    AVBufferRef *buf = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (!pool->avpool || size > pool->element_size) {
+        size_t alloc = ta_calc_prealloc_elems(size);
+        if (alloc >= INT_MAX)
+            goto done;
+        // Buffers still referenced elsewhere keep the old pool alive.
+        av_buffer_pool_uninit(&pool->avpool);
+        pool->element_size = alloc;
+        pool->avpool = av_buffer_pool_init2(pool->element_size, pool,
+                                            pool_alloc, NULL);
+        if (!pool->avpool)
+            goto done;
+    }
+
+    // pool_alloc() runs within this call, so the check is exact.
+    uint64_t misses = atomic_load(&pool->misses);
+    buf = av_buffer_pool_get(pool->avpool);
+    *miss = atomic_load(&pool->misses) != misses;
+
+done:
+    pthread_mutex_unlock(&pool->lock);
+    return buf;
 }
 
 // Like mp_aframe_allocate(), but use the pool to allocate data.
+// The pool can be shared by filters running on different threads.
 int mp_aframe_pool_allocate(struct mp_aframe_pool *pool, struct mp_aframe *frame,
                             int samples)
 {
@@ -679,18 +754,6 @@ int mp_aframe_pool_allocate(struct mp_aframe_pool *pool, struct mp_aframe *frame
     if (size <= 0 || mp_aframe_is_allocated(frame))
         return -1;
 
-    if (!pool->avpool || size > pool->element_size) {
-        size_t alloc = ta_calc_prealloc_elems(size);
-        if (alloc >= INT_MAX)
-            return -1;
-        av_buffer_pool_uninit(&pool->avpool);
-        pool->element_size = alloc;
-        pool->avpool = av_buffer_pool_init(pool->element_size, NULL);
-        if (!pool->avpool)
-            return -1;
-        talloc_set_destructor(pool, mp_aframe_pool_destructor);
-    }
-
     // Yes, you have to do all this shit manually.
     // At least it's less stupid than av_frame_get_buffer(), which just wipes
     // the entire frame struct on error for no reason.
@@ -704,9 +767,18 @@ int mp_aframe_pool_allocate(struct mp_aframe_pool *pool, struct mp_aframe *frame
     } else {
         av_frame->extended_data = av_frame->data;
     }
-    av_frame->buf[0] = av_buffer_pool_get(pool->avpool);
+    bool miss = false;
+    av_frame->buf[0] = pool_get(pool, size, &miss);
     if (!av_frame->buf[0])
         return -1;
+    if (miss) {
+        if (pool->stats)
+            stats_event(pool->stats, "pool-miss");
+    } else {
+        atomic_fetch_add(&pool->hits, 1);
+        if (pool->stats)
+            stats_event(pool->stats, "pool-hit");
+    }
     av_frame->linesize[0] = samples * sstride;
     for (int n = 0; n < planes; n++)
         av_frame->extended_data[n] = av_frame->buf[0]->data + n * plane_size;
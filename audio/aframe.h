@@ -70,6 +70,11 @@ bool mp_aframe_copy_samples(struct mp_aframe *dst, int dst_offset,
 bool mp_aframe_set_silence(struct mp_aframe *f, int offset, int samples);
 
 struct mp_aframe_pool;
+struct stats_ctx;
 struct mp_aframe_pool *mp_aframe_pool_create(void *ta_parent);
 int mp_aframe_pool_allocate(struct mp_aframe_pool *pool, struct mp_aframe *frame,
                             int samples);
+void mp_aframe_pool_set_stats(struct mp_aframe_pool *pool,
+                              struct stats_ctx *stats);
+void mp_aframe_pool_get_counters(struct mp_aframe_pool *pool,
+                                 uint64_t *hits, uint64_t *misses);
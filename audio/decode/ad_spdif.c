@@ -411,7 +411,7 @@ static struct mp_decoder *create(struct mp_filter *parent,
 
     struct spdifContext *spdif_ctx = da->priv;
     spdif_ctx->log = da->log;
-    spdif_ctx->pool = mp_aframe_pool_create(spdif_ctx);
+    spdif_ctx->pool = mp_filter_get_aframe_pool(da);
     spdif_ctx->public.f = da;
 
     if (strcmp(decoder, "spdif_dts_hd") == 0)
@@ -325,7 +325,7 @@ static struct mp_filter *af_lavcac3enc_create(struct mp_filter *parent,
     struct priv *s = f->priv;
     s->opts = talloc_steal(s, options);
     s->cur_format = talloc_steal(s, mp_aframe_create());
-    s->out_pool = mp_aframe_pool_create(s);
+    s->out_pool = mp_filter_get_aframe_pool(f);
 
     s->lavc_acodec = avcodec_find_encoder_by_name(s->opts->encoder);
     if (!s->lavc_acodec) {
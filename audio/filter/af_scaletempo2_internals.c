@@ -1,11 +1,24 @@
 #include <float.h>
 #include <math.h>
 
+#include <libavutil/cpu.h>
+
 #include "audio/chmap.h"
 #include "audio/filter/af_scaletempo2_internals.h"
 
 #include "config.h"
 
+// The SIMD kernels are compiled with per-function target attributes, so no
+// special compiler flags are needed, and the CPU is checked at runtime with
+// av_get_cpu_flags().
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCALETEMPO2_X86 1
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define SCALETEMPO2_X86 0
+#endif
+
 // Algorithm overview (from chromium):
 // Waveform Similarity Overlap-and-add (WSOLA).
 //
@@ -63,39 +76,9 @@ static void zero_2d_partial(float **a, int x, int y)
     }
 }
 
-// Energies of sliding windows of channels are interleaved.
-// The number windows is |input_frames| - (|frames_per_window| - 1), hence,
-// the method assumes |energy| must be, at least, of size
-// (|input_frames| - (|frames_per_window| - 1)) * |channels|.
-static void multi_channel_moving_block_energies(
-    float **input, int input_frames, int channels,
-    int frames_per_block, float *energy)
-{
-    int num_blocks = input_frames - (frames_per_block - 1);
-
-    for (int k = 0; k < channels; ++k) {
-        const float* input_channel = input[k];
-
-        energy[k] = 0;
-
-        // First block of channel |k|.
-        for (int m = 0; m < frames_per_block; ++m) {
-            energy[k] += input_channel[m] * input_channel[m];
-        }
-
-        const float* slide_out = input_channel;
-        const float* slide_in = input_channel + frames_per_block;
-        for (int n = 1; n < num_blocks; ++n, ++slide_in, ++slide_out) {
-            energy[k + n * channels] = energy[k + (n - 1) * channels]
-                - *slide_out * *slide_out + *slide_in * *slide_in;
-        }
-    }
-}
-
-static float multi_channel_similarity_measure(
-    const float* dot_prod_a_b,
-    const float* energy_a, const float* energy_b,
-    int channels)
+static float similarity_c(const float *dot_prod_a_b,
+                          const float *energy_a, const float *energy_b,
+                          int channels)
 {
     const float epsilon = 1e-12f;
     float similarity_measure = 0.0f;
@@ -110,71 +93,145 @@ static float multi_channel_similarity_measure(
 
 typedef float v8sf __attribute__ ((vector_size (32), aligned (1)));
 
-// Dot-product of channels of two AudioBus. For each AudioBus an offset is
-// given. |dot_product[k]| is the dot-product of channel |k|. The caller should
-// allocate sufficient space for |dot_product|.
-static void multi_channel_dot_product(
-    float **a, int frame_offset_a,
-    float **b, int frame_offset_b,
-    int channels,
-    int num_frames, float *dot_product)
-{
-    assert(frame_offset_a >= 0);
-    assert(frame_offset_b >= 0);
-
-    for (int k = 0; k < channels; ++k) {
-        const float* ch_a = a[k] + frame_offset_a;
-        const float* ch_b = b[k] + frame_offset_b;
-        float sum = 0.0;
-        if (num_frames < 32)
-            goto rest;
-
-        const v8sf *va = (const v8sf *) ch_a;
-        const v8sf *vb = (const v8sf *) ch_b;
-        v8sf vsum[4] = {
-            // Initialize to product of first 32 floats
-            va[0] * vb[0],
-            va[1] * vb[1],
-            va[2] * vb[2],
-            va[3] * vb[3],
-        };
+static float dot_product_c(const float *ch_a, const float *ch_b, int num_frames)
+{
+    float sum = 0.0;
+    if (num_frames < 32)
+        goto rest;
+
+    const v8sf *va = (const v8sf *) ch_a;
+    const v8sf *vb = (const v8sf *) ch_b;
+    v8sf vsum[4] = {
+        // Initialize to product of first 32 floats
+        va[0] * vb[0],
+        va[1] * vb[1],
+        va[2] * vb[2],
+        va[3] * vb[3],
+    };
+    va += 4;
+    vb += 4;
+
+    // Process `va` and `vb` across four vertical stripes
+    for (int n = 1; n < num_frames / 32; n++) {
+        vsum[0] += va[0] * vb[0];
+        vsum[1] += va[1] * vb[1];
+        vsum[2] += va[2] * vb[2];
+        vsum[3] += va[3] * vb[3];
         va += 4;
         vb += 4;
+    }
 
-        // Process `va` and `vb` across four vertical stripes
-        for (int n = 1; n < num_frames / 32; n++) {
-            vsum[0] += va[0] * vb[0];
-            vsum[1] += va[1] * vb[1];
-            vsum[2] += va[2] * vb[2];
-            vsum[3] += va[3] * vb[3];
-            va += 4;
-            vb += 4;
-        }
-
-        // Vertical sum across `vsum` entries
-        vsum[0] += vsum[1];
-        vsum[2] += vsum[3];
-        vsum[0] += vsum[2];
+    // Vertical sum across `vsum` entries
+    vsum[0] += vsum[1];
+    vsum[2] += vsum[3];
+    vsum[0] += vsum[2];
 
-        // Horizontal sum across `vsum[0]`, could probably be done better but
-        // this section is not super performance critical
-        float *vf = (float *) &vsum[0];
-        sum = vf[0] + vf[1] + vf[2] + vf[3] + vf[4] + vf[5] + vf[6] + vf[7];
-        ch_a = (const float *) va;
-        ch_b = (const float *) vb;
+    // Horizontal sum across `vsum[0]`, could probably be done better but
+    // this section is not super performance critical
+    float *vf = (float *) &vsum[0];
+    sum = vf[0] + vf[1] + vf[2] + vf[3] + vf[4] + vf[5] + vf[6] + vf[7];
+    ch_a = (const float *) va;
+    ch_b = (const float *) vb;
 
 rest:
-        // Process the remainder
-        for (int n = 0; n < num_frames % 32; n++)
-            sum += *ch_a++ * *ch_b++;
+    // Process the remainder
+    for (int n = 0; n < num_frames % 32; n++)
+        sum += *ch_a++ * *ch_b++;
 
-        dot_product[k] = sum;
-    }
+    return sum;
 }
 
 #else // !HAVE_VECTOR
 
+static float dot_product_c(const float *ch_a, const float *ch_b, int num_frames)
+{
+    float sum = 0.0;
+    for (int n = 0; n < num_frames; n++)
+        sum += *ch_a++ * *ch_b++;
+    return sum;
+}
+
+#endif // HAVE_VECTOR
+
+#if SCALETEMPO2_X86
+
+TARGET_AVX2
+static float hsum_avx2(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+TARGET_AVX2
+static float dot_product_avx2(const float *ch_a, const float *ch_b,
+                              int num_frames)
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+    int n = 0;
+    for (; n + 32 <= num_frames; n += 32) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(ch_a + n + 0),
+                             _mm256_loadu_ps(ch_b + n + 0), s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(ch_a + n + 8),
+                             _mm256_loadu_ps(ch_b + n + 8), s1);
+        s2 = _mm256_fmadd_ps(_mm256_loadu_ps(ch_a + n + 16),
+                             _mm256_loadu_ps(ch_b + n + 16), s2);
+        s3 = _mm256_fmadd_ps(_mm256_loadu_ps(ch_a + n + 24),
+                             _mm256_loadu_ps(ch_b + n + 24), s3);
+    }
+    for (; n + 8 <= num_frames; n += 8) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(ch_a + n),
+                             _mm256_loadu_ps(ch_b + n), s0);
+    }
+    float sum = hsum_avx2(_mm256_add_ps(_mm256_add_ps(s0, s1),
+                                        _mm256_add_ps(s2, s3)));
+    for (; n < num_frames; n++)
+        sum += ch_a[n] * ch_b[n];
+    return sum;
+}
+
+TARGET_AVX2
+static float similarity_avx2(const float *dot_prod_a_b,
+                             const float *energy_a, const float *energy_b,
+                             int channels)
+{
+    const __m256 epsilon = _mm256_set1_ps(1e-12f);
+    __m256 vsum = _mm256_setzero_ps();
+    int n = 0;
+    for (; n + 8 <= channels; n += 8) {
+        __m256 e = _mm256_fmadd_ps(_mm256_loadu_ps(energy_a + n),
+                                   _mm256_loadu_ps(energy_b + n), epsilon);
+        vsum = _mm256_add_ps(vsum, _mm256_div_ps(_mm256_loadu_ps(dot_prod_a_b + n),
+                                                 _mm256_sqrt_ps(e)));
+    }
+    return hsum_avx2(vsum) +
+        similarity_c(dot_prod_a_b + n, energy_a + n, energy_b + n, channels - n);
+}
+
+#endif // SCALETEMPO2_X86
+
+static void setup_kernels(struct mp_scaletempo2 *p)
+{
+    p->dot_product = dot_product_c;
+    p->similarity = similarity_c;
+
+#if SCALETEMPO2_X86
+    int flags = av_get_cpu_flags();
+    if ((flags & AV_CPU_FLAG_AVX2) && (flags & AV_CPU_FLAG_FMA3)) {
+        p->dot_product = dot_product_avx2;
+        p->similarity = similarity_avx2;
+    }
+#endif
+}
+
+// Dot-product of channels of two AudioBus. For each AudioBus an offset is
+// given. |dot_product[k]| is the dot-product of channel |k|. The caller should
+// allocate sufficient space for |dot_product|.
 static void multi_channel_dot_product(
+    struct mp_scaletempo2 *p,
     float **a, int frame_offset_a,
     float **b, int frame_offset_b,
     int channels,
@@ -184,16 +241,82 @@ static void multi_channel_dot_product(
     assert(frame_offset_b >= 0);
 
     for (int k = 0; k < channels; ++k) {
-        const float* ch_a = a[k] + frame_offset_a;
-        const float* ch_b = b[k] + frame_offset_b;
-        float sum = 0.0;
-        for (int n = 0; n < num_frames; n++)
-            sum += *ch_a++ * *ch_b++;
-        dot_product[k] = sum;
+        dot_product[k] = p->dot_product(a[k] + frame_offset_a,
+                                        b[k] + frame_offset_b, num_frames);
     }
 }
 
-#endif // HAVE_VECTOR
+static float multi_channel_similarity_measure(
+    struct mp_scaletempo2 *p,
+    const float* dot_prod_a_b,
+    const float* energy_a, const float* energy_b,
+    int channels)
+{
+    return p->similarity(dot_prod_a_b, energy_a, energy_b, channels);
+}
+
+// Energies of sliding windows of channels are interleaved. This computes the
+// energies of the windows [|first_block|, |first_block| + |num_blocks|), so
+// the method assumes |input| has at least
+// |first_block| + |num_blocks| + |frames_per_block| - 1 frames, and |energy|
+// must be, at least, of size (|first_block| + |num_blocks|) * |channels|.
+static void multi_channel_moving_block_energies(
+    struct mp_scaletempo2 *p,
+    float **input, int first_block, int num_blocks, int channels,
+    int frames_per_block, float *energy)
+{
+    energy += first_block * channels;
+
+    for (int k = 0; k < channels; ++k) {
+        const float* input_channel = input[k] + first_block;
+
+        // First block of channel |k|.
+        energy[k] = p->dot_product(input_channel, input_channel,
+                                   frames_per_block);
+
+        const float* slide_out = input_channel;
+        const float* slide_in = input_channel + frames_per_block;
+        for (int n = 1; n < num_blocks; ++n, ++slide_in, ++slide_out) {
+            energy[k + n * channels] = energy[k + (n - 1) * channels]
+                - *slide_out * *slide_out + *slide_in * *slide_in;
+        }
+    }
+}
+
+// Update |energy_candidate_blocks| for the current |search_block|. Consecutive
+// search blocks usually overlap, so the energies of the blocks that were
+// already computed in the previous iteration are reused. Only the energies of
+// the new blocks are computed, starting with a full dot-product, so rounding
+// errors of the sliding window don't accumulate across iterations.
+static void update_candidate_energies(struct mp_scaletempo2 *p)
+{
+    int num_blocks = p->num_candidate_blocks;
+    int channels = p->channels;
+    float *energy = p->energy_candidate_blocks;
+    int64_t pos = p->input_buffer_offset + p->search_block_index;
+
+    // With a negative index, the search block is partially zero-filled, and
+    // doesn't match the input at this position.
+    bool cacheable = p->search_block_index >= 0;
+
+    int reuse = 0;
+    if (cacheable && p->energy_cache_pos >= 0) {
+        int64_t shift = pos - p->energy_cache_pos;
+        if (shift >= 0 && shift < p->energy_cache_blocks) {
+            reuse = p->energy_cache_blocks - shift;
+            memmove(energy, energy + shift * channels,
+                    sizeof(float) * reuse * channels);
+        }
+    }
+
+    if (reuse < num_blocks) {
+        multi_channel_moving_block_energies(p, p->search_block, reuse,
+            num_blocks - reuse, channels, p->ola_window_size, energy);
+    }
+
+    p->energy_cache_pos = cacheable ? pos : -1;
+    p->energy_cache_blocks = num_blocks;
+}
 
 // Fit the curve f(x) = a * x^2 + b * x + c such that
 //   f(-1) = y[0]
@@ -222,6 +345,7 @@ static void quadratic_interpolation(
 // 1 / |decimation|. A cubic interpolation is used to have a better estimate of
 // the best match.
 static int decimated_search(
+    struct mp_scaletempo2 *p,
     int decimation, struct interval exclude_interval,
     float **target_block, int target_block_frames,
     float **search_segment, int search_segment_frames,
@@ -233,12 +357,12 @@ static int decimated_search(
     float similarity[3];  // Three elements for cubic interpolation.
 
     int n = 0;
-    multi_channel_dot_product(
+    multi_channel_dot_product(p,
         target_block, 0,
         search_segment, n,
         channels,
         target_block_frames, dot_prod);
-    similarity[0] = multi_channel_similarity_measure(
+    similarity[0] = multi_channel_similarity_measure(p,
         dot_prod, energy_target_block,
         &energy_candidate_blocks[n * channels], channels);
 
@@ -251,12 +375,12 @@ static int decimated_search(
         return 0;
     }
 
-    multi_channel_dot_product(
+    multi_channel_dot_product(p,
         target_block, 0,
         search_segment, n,
         channels,
         target_block_frames, dot_prod);
-    similarity[1] = multi_channel_similarity_measure(
+    similarity[1] = multi_channel_similarity_measure(p,
         dot_prod, energy_target_block,
         &energy_candidate_blocks[n * channels], channels);
 
@@ -268,13 +392,13 @@ static int decimated_search(
     }
 
     for (; n < num_candidate_blocks; n += decimation) {
-        multi_channel_dot_product(
+        multi_channel_dot_product(p,
             target_block, 0,
             search_segment, n,
             channels,
             target_block_frames, dot_prod);
 
-        similarity[2] = multi_channel_similarity_measure(
+        similarity[2] = multi_channel_similarity_measure(p,
             dot_prod, energy_target_block,
             &energy_candidate_blocks[n * channels], channels);
 
@@ -314,6 +438,7 @@ static int decimated_search(
 // |target_block|. |energy_candidate_blocks| is the energy of all blocks within
 // |search_block|.
 static int full_search(
+    struct mp_scaletempo2 *p,
     int low_limit, int high_limit,
     struct interval exclude_interval,
     float **target_block, int target_block_frames,
@@ -332,10 +457,10 @@ static int full_search(
         if (in_interval(n, exclude_interval)) {
             continue;
         }
-        multi_channel_dot_product(target_block, 0, search_block, n, channels,
+        multi_channel_dot_product(p, target_block, 0, search_block, n, channels,
             target_block_frames, dot_prod);
 
-        float similarity = multi_channel_similarity_measure(
+        float similarity = multi_channel_similarity_measure(p,
             dot_prod, energy_target_block,
             &energy_candidate_blocks[n * channels], channels);
 
@@ -352,6 +477,7 @@ static int full_search(
 // to |target_block|. Obviously, the returned index is w.r.t. |search_block|.
 // |exclude_interval| is an interval that is excluded from the search.
 static int compute_optimal_index(
+    struct mp_scaletempo2 *p,
     float **search_block, int search_block_frames,
     float **target_block, int target_block_frames,
     float *energy_candidate_blocks,
@@ -373,21 +499,16 @@ static int compute_optimal_index(
     // sizeof(float) * channels * num_candidate_blocks
 
     // Energy of all candid frames.
-    multi_channel_moving_block_energies(
-        search_block,
-        search_block_frames,
-        channels,
-        target_block_frames,
-        energy_candidate_blocks);
+    update_candidate_energies(p);
 
     // Energy of target frame.
-    multi_channel_dot_product(
+    multi_channel_dot_product(p,
         target_block, 0,
         target_block, 0,
         channels,
         target_block_frames, energy_target_block);
 
-    int optimal_index = decimated_search(
+    int optimal_index = decimated_search(p,
         search_decimation, exclude_interval,
         target_block, target_block_frames,
         search_block, search_block_frames,
@@ -398,7 +519,7 @@ static int compute_optimal_index(
     int lim_low = MPMAX(0, optimal_index - search_decimation);
     int lim_high = MPMIN(num_candidate_blocks - 1,
                             optimal_index + search_decimation);
-    return full_search(
+    return full_search(p,
         lim_low, lim_high, exclude_interval,
         target_block, target_block_frames,
         search_block, search_block_frames,
@@ -421,6 +542,7 @@ static void seek_buffer(struct mp_scaletempo2 *p, int frames)
 {
     assert(p->input_buffer_frames >= frames);
     p->input_buffer_frames -= frames;
+    p->input_buffer_offset += frames;
     for (int i = 0; i < p->channels; ++i) {
         memmove(p->input_buffer[i], p->input_buffer[i] + frames,
             p->input_buffer_frames * sizeof(float));
@@ -492,7 +614,7 @@ int mp_scaletempo2_fill_input_buffer(struct mp_scaletempo2 *p,
         memcpy(p->input_buffer[i] + p->input_buffer_frames,
             planes[i], read * sizeof(float));
         for (int j = read; j < total_fill; ++j) {
-            p->input_buffer[p->input_buffer_frames + j] = 0;
+            p->input_buffer[i][p->input_buffer_frames + j] = 0;
         }
     }
 
@@ -552,7 +674,7 @@ static void get_optimal_block(struct mp_scaletempo2 *p)
 
         // |optimal_index| is in frames and it is relative to the beginning of the
         // |search_block|.
-        optimal_index = compute_optimal_index(
+        optimal_index = compute_optimal_index(p,
             p->search_block, p->search_block_size,
             p->target_block, p->ola_window_size,
             p->energy_candidate_blocks,
@@ -714,6 +836,8 @@ void mp_scaletempo2_destroy(struct mp_scaletempo2 *p)
 void mp_scaletempo2_reset(struct mp_scaletempo2 *p)
 {
     p->input_buffer_frames = 0;
+    p->input_buffer_offset = 0;
+    p->energy_cache_pos = -1;
     p->output_time = 0.0;
     p->search_block_index = 0;
     p->target_block_index = 0;
@@ -790,7 +914,12 @@ void mp_scaletempo2_init(struct mp_scaletempo2 *p, int channels, int rate)
 
     resize_input_buffer(p, 4 * MPMAX(p->ola_window_size, p->search_block_size));
     p->input_buffer_frames = 0;
+    p->input_buffer_offset = 0;
 
     p->energy_candidate_blocks = realloc(p->energy_candidate_blocks,
         sizeof(float) * p->channels * p->num_candidate_blocks);
+    p->energy_cache_pos = -1;
+    p->energy_cache_blocks = 0;
+
+    setup_kernels(p);
 }
@@ -108,7 +108,19 @@ struct mp_scaletempo2 {
     float **input_buffer;
     int input_buffer_size;
     int input_buffer_frames;
+    // Number of frames removed from the start of |input_buffer| since the
+    // last reset, i.e. the absolute position of |input_buffer|[0].
+    int64_t input_buffer_offset;
     float *energy_candidate_blocks;
+    // Absolute input position of the first block whose energy is stored in
+    // |energy_candidate_blocks|, or -1 if there are no valid energies. The
+    // energies are reused by the next search if the search blocks overlap.
+    int64_t energy_cache_pos;
+    int energy_cache_blocks;
+    // Kernels selected at runtime, depending on the CPU.
+    float (*dot_product)(const float *a, const float *b, int num_frames);
+    float (*similarity)(const float *dot_prod_a_b, const float *energy_a,
+                        const float *energy_b, int channels);
 };
 
 void mp_scaletempo2_destroy(struct mp_scaletempo2 *p);
@@ -681,7 +681,7 @@ bool ao_need_conversion(struct ao_convert_fmt *fmt)
 #define SHIFT24(x) (((x)+1)*8)
 #endif
 
-static void convert_plane(int type, void *data, int num_samples)
+static void convert_plane(int type, void *dst, void *src, int num_samples)
 {
     switch (type) {
     case 0:
@@ -690,8 +690,8 @@ static void convert_plane(int type, void *data, int num_samples)
     case 2: {
         int bytes = type == 1 ? 3 : 4;
         for (int s = 0; s < num_samples; s++) {
-            uint32_t val = *((uint32_t *)data + s);
-            uint8_t *ptr = (uint8_t *)data + s * bytes;
+            uint32_t val = *((uint32_t *)src + s);
+            uint8_t *ptr = (uint8_t *)dst + s * bytes;
             ptr[0] = val >> SHIFT24(0);
             ptr[1] = val >> SHIFT24(1);
             ptr[2] = val >> SHIFT24(2);
@@ -709,11 +709,24 @@ static void convert_plane(int type, void *data, int num_samples)
 // format implied by fmt->src_fmt. src_fmt also controls whether the data is
 // all in one plane, or if there is a plane per channel.
 void ao_convert_inplace(struct ao_convert_fmt *fmt, void **data, int num_samples)
+{
+    ao_convert(fmt, data, data, num_samples);
+}
+
+// Like ao_convert_inplace(), but write the result to dst, which has the same
+// plane layout as src. dst and src must either be the same or not overlap.
+void ao_convert(struct ao_convert_fmt *fmt, void **dst, void **src,
+                int num_samples)
 {
     int type = get_conv_type(fmt);
     bool planar = af_fmt_is_planar(fmt->src_fmt);
     int planes = planar ? fmt->channels : 1;
     int plane_samples = num_samples * (planar ? 1: fmt->channels);
-    for (int n = 0; n < planes; n++)
-        convert_plane(type, data[n], plane_samples);
+    for (int n = 0; n < planes; n++) {
+        if (type == 0 && dst[n] != src[n]) {
+            memcpy(dst[n], src[n], plane_samples * af_fmt_to_bytes(fmt->src_fmt));
+        } else {
+            convert_plane(type, dst[n], src[n], plane_samples);
+        }
+    }
 }
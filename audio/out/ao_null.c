@@ -32,6 +32,8 @@
 #include "options/m_option.h"
 #include "common/common.h"
 #include "common/msg.h"
+#include "common/stats.h"
+#include "misc/node.h"
 #include "audio/format.h"
 #include "ao.h"
 #include "internal.h"
@@ -58,8 +60,80 @@ struct priv {
 
     struct m_channels channel_layouts;
     int format;
+
+    // --ao-null-benchmark
+    bool benchmark;
+    int64_t bench_samples;      // total samples written
+    double bench_start;         // time of first write
+    double bench_end;           // time of last write
+    double bench_last_poll;
+    struct bench_entry *bench_entries;
+    int num_bench_entries;
+};
+
+struct bench_entry {
+    char *name;
+    double cpu_ms;
 };
 
+// Accumulate the per-stage CPU times recorded with stats_time_start/end().
+// stats_global_query() resets the times on each call, and everything if it's
+// called less often than every 2 seconds, so this polls regularly.
+static void bench_poll(struct ao *ao)
+{
+    struct priv *priv = ao->priv;
+
+    struct mpv_node stats;
+    stats_global_query(ao->global, &stats);
+    for (int n = 0; n < stats.u.list->num; n++) {
+        struct mpv_node *e = &stats.u.list->values[n];
+        struct mpv_node *name = node_map_get(e, "name");
+        struct mpv_node *val = node_map_get(e, "value");
+        if (!name || name->format != MPV_FORMAT_STRING ||
+            !val || val->format != MPV_FORMAT_DOUBLE)
+            continue;
+        bstr stage = bstr0(name->u.string);
+        if (!bstr_eatend0(&stage, "/cpu"))
+            continue;
+        struct bench_entry *be = NULL;
+        for (int i = 0; i < priv->num_bench_entries; i++) {
+            if (bstr_equals0(stage, priv->bench_entries[i].name))
+                be = &priv->bench_entries[i];
+        }
+        if (!be) {
+            MP_TARRAY_APPEND(priv, priv->bench_entries, priv->num_bench_entries,
+                             (struct bench_entry){bstrto0(priv, stage)});
+            be = &priv->bench_entries[priv->num_bench_entries - 1];
+        }
+        be->cpu_ms += val->u.double_;
+    }
+    talloc_free(stats.u.list);
+
+    priv->bench_last_poll = mp_time_sec();
+}
+
+static void bench_report(struct ao *ao)
+{
+    struct priv *priv = ao->priv;
+
+    bench_poll(ao);
+
+    double audio_secs = priv->bench_samples / (double)ao->samplerate;
+    double wall_secs = priv->bench_end - priv->bench_start;
+    if (audio_secs <= 0 || wall_secs <= 0) {
+        MP_INFO(ao, "Benchmark: no audio was played.\n");
+        return;
+    }
+
+    MP_INFO(ao, "Benchmark: %.3f s of audio in %.3f s (%.1fx realtime).\n",
+            audio_secs, wall_secs, audio_secs / wall_secs);
+    MP_INFO(ao, "CPU time per second of audio:\n");
+    for (int n = 0; n < priv->num_bench_entries; n++) {
+        struct bench_entry *be = &priv->bench_entries[n];
+        MP_INFO(ao, "    %-32s %10.3f ms\n", be->name, be->cpu_ms / audio_secs);
+    }
+}
+
 static void drain(struct ao *ao)
 {
     struct priv *priv = ao->priv;
@@ -88,7 +162,7 @@ static int init(struct ao *ao)
     if (priv->format)
         ao->format = priv->format;
 
-    ao->untimed = priv->untimed;
+    ao->untimed = priv->untimed || priv->benchmark;
 
     struct mp_chmap_sel sel = {.tmp = ao};
     if (priv->channel_layouts.num_chmaps) {
@@ -108,12 +182,24 @@ static int init(struct ao *ao)
 
     priv->last_time = mp_time_sec();
 
+    // Enables recording of the stats; discard what was recorded so far.
+    if (priv->benchmark) {
+        struct mpv_node stats;
+        stats_global_query(ao->global, &stats);
+        talloc_free(stats.u.list);
+        priv->bench_last_poll = priv->last_time;
+    }
+
     return 0;
 }
 
 // close audio device
 static void uninit(struct ao *ao)
 {
+    struct priv *priv = ao->priv;
+
+    if (priv->benchmark)
+        bench_report(ao);
 }
 
 // stop playing and empty buffers (for seeking/pause)
@@ -163,6 +249,17 @@ static bool audio_write(struct ao *ao, void **data, int samples)
         priv->buffered = priv->latency; // emulate fixed latency
 
     priv->buffered += samples;
+
+    if (priv->benchmark) {
+        double now = mp_time_sec();
+        if (!priv->bench_samples)
+            priv->bench_start = now;
+        priv->bench_samples += samples;
+        priv->bench_end = now;
+        if (now - priv->bench_last_poll >= 0.5)
+            bench_poll(ao);
+    }
+
     return true;
 }
 
@@ -224,6 +321,7 @@ const struct ao_driver audio_out_null = {
         {"broken-delay", OPT_BOOL(broken_delay)},
         {"channel-layouts", OPT_CHANNELS(channel_layouts)},
         {"format", OPT_AUDIOFORMAT(format)},
+        {"benchmark", OPT_BOOL(benchmark)},
         {0}
     },
     .options_prefix = "ao-null",
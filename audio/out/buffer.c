@@ -30,6 +30,7 @@
 
 #include "common/msg.h"
 #include "common/common.h"
+#include "common/stats.h"
 
 #include "filters/f_async_queue.h"
 #include "filters/filter_internal.h"
@@ -46,17 +47,16 @@ struct buffer_state {
     pthread_mutex_t pt_lock;
     pthread_cond_t pt_wakeup;
 
-    // Access from AO driver's thread only.
-    char *convert_buffer;
-
     // Immutable.
     struct mp_async_queue *queue;
+    struct stats_ctx *stats;
 
     // --- protected by lock
 
     struct mp_filter *filter_root;
     struct mp_filter *input;    // connected to queue
     struct mp_aframe *pending;  // last, not fully consumed output
+    int pending_pos;            // samples of pending already consumed
 
     bool streaming;             // AO streaming active
     bool playing;               // logically playing audio from buffer
@@ -114,39 +114,97 @@ struct mp_async_queue *ao_get_queue(struct ao *ao)
     return p->queue;
 }
 
+static int pending_samples(struct buffer_state *p)
+{
+    return p->pending ? mp_aframe_get_size(p->pending) - p->pending_pos : 0;
+}
+
+static void free_pending(struct buffer_state *p)
+{
+    TA_FREEP(&p->pending);
+    p->pending_pos = 0;
+}
+
+// Make sure p->pending has unconsumed samples. Returns false if no audio is
+// available without blocking. Sets *eof if an EOF frame was read.
+static bool fill_pending(struct ao *ao, bool *eof)
+{
+    struct buffer_state *p = ao->buffer_state;
+
+    while (!pending_samples(p)) {
+        free_pending(p);
+        struct mp_frame frame = mp_pin_out_read(p->input->pins[0]);
+        if (!frame.type)
+            return false; // we can't/don't want to block
+        if (frame.type != MP_FRAME_AUDIO) {
+            if (frame.type == MP_FRAME_EOF)
+                *eof = true;
+            mp_frame_unref(&frame);
+            continue;
+        }
+        p->pending = frame.data;
+    }
+    return true;
+}
+
+// Set planes[] to the first unconsumed sample of p->pending. Samples are
+// consumed by incrementing p->pending_pos, which is cheaper than
+// mp_aframe_skip_samples(), as it doesn't need to move the rest of the data.
+static bool get_pending_planes(struct ao *ao, void **planes, bool writable)
+{
+    struct buffer_state *p = ao->buffer_state;
+
+    uint8_t **data = writable ? mp_aframe_get_data_rw(p->pending)
+                              : mp_aframe_get_data_ro(p->pending);
+    if (!data)
+        return false;
+    for (int n = 0; n < ao->num_planes; n++)
+        planes[n] = data[n] + p->pending_pos * ao->sstride;
+    return true;
+}
+
 // Special behavior with data==NULL: caller uses p->pending.
-static int read_buffer(struct ao *ao, void **data, int samples, bool *eof)
+// If conv is set, the data is converted from the AO format while copying it
+// to data[], and data[] uses the target format.
+static int read_buffer_locked(struct ao *ao, void **data, int samples, bool *eof,
+                              struct ao_convert_fmt *conv)
 {
     struct buffer_state *p = ao->buffer_state;
     int pos = 0;
     *eof = false;
 
+    int dst_sstride = ao->sstride;
+    if (conv)
+        dst_sstride = ao->sstride / af_fmt_to_bytes(ao->format) * conv->dst_bits / 8;
+
     while (p->playing && !p->paused && pos < samples) {
-        if (!p->pending || !mp_aframe_get_size(p->pending)) {
-            TA_FREEP(&p->pending);
-            struct mp_frame frame = mp_pin_out_read(p->input->pins[0]);
-            if (!frame.type)
-                break; // we can't/don't want to block
-            if (frame.type != MP_FRAME_AUDIO) {
-                if (frame.type == MP_FRAME_EOF)
-                    *eof = true;
-                mp_frame_unref(&frame);
-                continue;
-            }
-            p->pending = frame.data;
-        }
+        if (!fill_pending(ao, eof))
+            break;
 
         if (!data)
             break;
 
-        int copy = mp_aframe_get_size(p->pending);
-        uint8_t **fdata = mp_aframe_get_data_ro(p->pending);
-        copy = MPMIN(copy, samples - pos);
-        for (int n = 0; n < ao->num_planes; n++) {
-            memcpy((char *)data[n] + pos * ao->sstride,
-                   fdata[n], copy * ao->sstride);
+        int copy = MPMIN(pending_samples(p), samples - pos);
+        void *src[MP_NUM_CHANNELS];
+        if (!get_pending_planes(ao, src, !!conv))
+            break;
+        if (conv) {
+            // Apply the gain to the source, as the target format is opaque.
+            // The samples are consumed right after this.
+            void *dst[MP_NUM_CHANNELS];
+            for (int n = 0; n < ao->num_planes; n++)
+                dst[n] = (char *)data[n] + pos * dst_sstride;
+            ao_post_process_data(ao, src, copy);
+            stats_time_start(p->stats, "convert");
+            ao_convert(conv, dst, src, copy);
+            stats_time_end(p->stats, "convert");
+        } else {
+            for (int n = 0; n < ao->num_planes; n++) {
+                memcpy((char *)data[n] + pos * ao->sstride, src[n],
+                       copy * ao->sstride);
+            }
         }
-        mp_aframe_skip_samples(p->pending, copy);
+        p->pending_pos += copy;
         pos += copy;
         *eof = false;
     }
@@ -162,31 +220,39 @@ static int read_buffer(struct ao *ao, void **data, int samples, bool *eof)
 
     // pad with silence (underflow/paused/eof)
     for (int n = 0; n < ao->num_planes; n++) {
-        af_fill_silence((char *)data[n] + pos * ao->sstride,
-                        (samples - pos) * ao->sstride,
-                        ao->format);
+        char *dst = (char *)data[n] + pos * dst_sstride;
+        if (conv) {
+            // Only signed formats need conversion, so 0 is silence.
+            memset(dst, 0, (samples - pos) * dst_sstride);
+        } else {
+            af_fill_silence(dst, (samples - pos) * ao->sstride, ao->format);
+        }
     }
 
-    ao_post_process_data(ao, data, pos);
+    if (!conv)
+        ao_post_process_data(ao, data, pos);
     return pos;
 }
 
-// Read the given amount of samples in the user-provided data buffer. Returns
-// the number of samples copied. If there is not enough data (buffer underrun
-// or EOF), return the number of samples that could be copied, and fill the
-// rest of the user-provided buffer with silence.
-// This basically assumes that the audio device doesn't care about underruns.
-// If this is called in paused mode, it will always return 0.
-// The caller should set out_time_us to the expected delay until the last sample
-// reaches the speakers, in microseconds, using mp_time_us() as reference.
-int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
+static int read_buffer(struct ao *ao, void **data, int samples, bool *eof,
+                       struct ao_convert_fmt *conv)
+{
+    struct buffer_state *p = ao->buffer_state;
+    stats_time_start(p->stats, "read");
+    int res = read_buffer_locked(ao, data, samples, eof, conv);
+    stats_time_end(p->stats, "read");
+    return res;
+}
+
+static int read_data(struct ao *ao, void **data, int samples,
+                     int64_t out_time_us, struct ao_convert_fmt *conv)
 {
     struct buffer_state *p = ao->buffer_state;
     assert(!ao->driver->write);
 
     pthread_mutex_lock(&p->lock);
 
-    int pos = read_buffer(ao, data, samples, &(bool){0});
+    int pos = read_buffer(ao, data, samples, &(bool){0}, conv);
 
     if (pos > 0)
         p->end_time_us = out_time_us;
@@ -203,42 +269,33 @@ int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
     return pos;
 }
 
+// Read the given amount of samples in the user-provided data buffer. Returns
+// the number of samples copied. If there is not enough data (buffer underrun
+// or EOF), return the number of samples that could be copied, and fill the
+// rest of the user-provided buffer with silence.
+// This basically assumes that the audio device doesn't care about underruns.
+// If this is called in paused mode, it will always return 0.
+// The caller should set out_time_us to the expected delay until the last sample
+// reaches the speakers, in microseconds, using mp_time_us() as reference.
+int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_us)
+{
+    return read_data(ao, data, samples, out_time_us, NULL);
+}
+
 // Same as ao_read_data(), but convert data according to *fmt.
 // fmt->src_fmt and fmt->channels must be the same as the AO parameters.
+// The data is converted while it's copied to data[], so no intermediate
+// buffer is needed.
 int ao_read_data_converted(struct ao *ao, struct ao_convert_fmt *fmt,
                            void **data, int samples, int64_t out_time_us)
 {
-    struct buffer_state *p = ao->buffer_state;
-    void *ndata[MP_NUM_CHANNELS] = {0};
-
     if (!ao_need_conversion(fmt))
         return ao_read_data(ao, data, samples, out_time_us);
 
     assert(ao->format == fmt->src_fmt);
     assert(ao->channels.num == fmt->channels);
 
-    bool planar = af_fmt_is_planar(fmt->src_fmt);
-    int planes = planar ? fmt->channels : 1;
-    int plane_samples = samples * (planar ? 1: fmt->channels);
-    int src_plane_size = plane_samples * af_fmt_to_bytes(fmt->src_fmt);
-    int dst_plane_size = plane_samples * fmt->dst_bits / 8;
-
-    int needed = src_plane_size * planes;
-    if (needed > talloc_get_size(p->convert_buffer) || !p->convert_buffer) {
-        talloc_free(p->convert_buffer);
-        p->convert_buffer = talloc_size(NULL, needed);
-    }
-
-    for (int n = 0; n < planes; n++)
-        ndata[n] = p->convert_buffer + n * src_plane_size;
-
-    int res = ao_read_data(ao, ndata, samples, out_time_us);
-
-    ao_convert_inplace(fmt, ndata, samples);
-    for (int n = 0; n < planes; n++)
-        memcpy(data[n], ndata[n], dst_plane_size);
-
-    return res;
+    return read_data(ao, data, samples, out_time_us, fmt);
 }
 
 int ao_control(struct ao *ao, enum aocontrol cmd, void *arg)
@@ -275,9 +332,7 @@ double ao_get_delay(struct ao *ao)
         driver_delay = MPMAX(0, (end - now) / (1000.0 * 1000.0));
     }
 
-    int pending = mp_async_queue_get_samples(p->queue);
-    if (p->pending)
-        pending += mp_aframe_get_size(p->pending);
+    int pending = mp_async_queue_get_samples(p->queue) + pending_samples(p);
 
     pthread_mutex_unlock(&p->lock);
     return driver_delay + pending / (double)ao->samplerate;
@@ -292,7 +347,7 @@ void ao_reset(struct ao *ao)
 
     pthread_mutex_lock(&p->lock);
 
-    TA_FREEP(&p->pending);
+    free_pending(p);
     mp_async_queue_reset(p->queue);
     mp_filter_reset(p->filter_root);
     mp_async_queue_resume_reading(p->queue);
@@ -476,7 +531,6 @@ void ao_uninit(struct ao *ao)
         talloc_free(p->filter_root);
         talloc_free(p->queue);
         talloc_free(p->pending);
-        talloc_free(p->convert_buffer);
         talloc_free(p->temp_buf);
 
         pthread_cond_destroy(&p->wakeup);
@@ -510,6 +564,7 @@ bool init_buffer_post(struct ao *ao)
     pthread_mutex_init(&p->pt_lock, NULL);
     pthread_cond_init(&p->pt_wakeup, NULL);
 
+    p->stats = stats_ctx_create(p, ao->global, "ao");
     p->queue = mp_async_queue_create();
     p->filter_root = mp_filter_create_root(ao->global);
     p->input = mp_async_queue_create_filter(p->filter_root, MP_PIN_OUT, p->queue);
@@ -590,10 +645,32 @@ static bool ao_play_data(struct ao *ao)
 
     int samples = 0;
     bool got_eof = false;
+
+    // If the next queued frame covers the whole write, pass its data to the
+    // driver directly instead of copying it to p->temp_buf first. Otherwise,
+    // copy it together with the following frames, so that there is still
+    // only one device write per call.
+    void *direct[MP_NUM_CHANNELS];
+    bool use_direct = false;
+    if (!ao->driver->write_frames && p->playing && !p->paused &&
+        !p->recover_pause && fill_pending(ao, &got_eof))
+    {
+        got_eof = false;
+        // Writable, because drivers may convert the data in place.
+        use_direct = pending_samples(p) >= space &&
+                     get_pending_planes(ao, direct, true);
+    }
+
     if (ao->driver->write_frames) {
-        TA_FREEP(&p->pending);
-        samples = read_buffer(ao, NULL, 1, &got_eof);
+        free_pending(p);
+        samples = read_buffer(ao, NULL, 1, &got_eof, NULL);
         planes = (void **)&p->pending;
+    } else if (use_direct) {
+        planes = direct;
+        samples = space;
+        ao_post_process_data(ao, planes, samples);
+        // The frame stays alive until the next fill_pending().
+        p->pending_pos += samples;
     } else {
         if (!realloc_buf(ao, space)) {
             MP_ERR(ao, "Failed to allocate buffer.\n");
@@ -609,17 +686,20 @@ static bool ao_play_data(struct ao *ao)
         }
 
         if (!samples) {
-            samples = read_buffer(ao, planes, space, &got_eof);
+            // got_eof may have been set by fill_pending() above.
+            bool eof = false;
+            samples = read_buffer(ao, planes, space, &eof, NULL);
+            got_eof |= eof;
             if (p->paused || (ao->stream_silence && !p->playing))
                 samples = space; // read_buffer() sets remainder to silent
         }
     }
 
     if (samples) {
-        MP_STATS(ao, "start ao fill");
+        stats_time_start(p->stats, "write");
         if (!ao->driver->write(ao, planes, samples))
             MP_ERR(ao, "Error writing audio to device.\n");
-        MP_STATS(ao, "end ao fill");
+        stats_time_end(p->stats, "write");
 
         if (!p->streaming) {
             MP_VERBOSE(ao, "starting AO\n");
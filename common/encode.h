@@ -46,6 +46,7 @@ struct encode_opts {
     bool copy_metadata;
     char **set_metadata;
     char **remove_metadata;
+    char *segment;
 };
 
 // interface for player core
@@ -54,6 +55,8 @@ bool encode_lavc_free(struct encode_lavc_context *ctx);
 void encode_lavc_discontinuity(struct encode_lavc_context *ctx);
 bool encode_lavc_showhelp(struct mp_log *log, struct encode_opts *options);
 int encode_lavc_getstatus(struct encode_lavc_context *ctx, char *buf, int bufsize, float relative_position);
+void encode_lavc_report_progress(struct encode_lavc_context *ctx,
+                                 float relative_position);
 bool encode_lavc_stream_type_ok(struct encode_lavc_context *ctx,
                                 enum stream_type type);
 void encode_lavc_expect_stream(struct encode_lavc_context *ctx,
@@ -55,6 +55,11 @@ struct encode_priv {
     // Statistics
     double t0;
 
+    // --osegment, or 0/0 if unset
+    int segment_index, segment_count;
+    int segment_percent;            // last logged progress, or -1
+    struct mp_log *progress_log;
+
     long long abytes;
     long long vbytes;
 
@@ -95,6 +100,7 @@ const struct m_sub_options encode_config = {
         {"ocopy-metadata", OPT_BOOL(copy_metadata)},
         {"oset-metadata", OPT_KEYVALUELIST(set_metadata)},
         {"oremove-metadata", OPT_STRINGLIST(remove_metadata)},
+        {"osegment", OPT_STRING(segment)},
 
         {"ocopyts", OPT_REMOVED("ocopyts is now the default")},
         {"oneverdrop", OPT_REMOVED("no replacement")},
@@ -159,6 +165,22 @@ struct encode_lavc_context *encode_lavc_init(struct mpv_global *global)
     p->muxer->url = av_strdup(filename);
     MP_HANDLE_OOM(p->muxer->url);
 
+    const char *segment = ctx->options->segment;
+    if (segment && segment[0]) {
+        char dummy;
+        if (sscanf(segment, "%d/%d%c", &p->segment_index, &p->segment_count,
+                   &dummy) != 2 || p->segment_index < 1 ||
+            p->segment_index > p->segment_count)
+        {
+            MP_FATAL(ctx, "invalid --osegment value '%s'\n", segment);
+            goto fail;
+        }
+        MP_VERBOSE(ctx, "encoding segment %d of %d\n", p->segment_index,
+                   p->segment_count);
+        p->segment_percent = -1;
+        p->progress_log = mp_log_new(p, ctx->log, "progress");
+    }
+
     return ctx;
 
 fail:
@@ -699,15 +721,23 @@ int encode_lavc_getstatus(struct encode_lavc_context *ctx,
     megabytes = p->muxer->pb ? (avio_size(p->muxer->pb) / 1048576.0 / f) : 0;
     fps = p->frames / (now - p->t0);
     x = p->audioseconds / (now - p->t0);
+
+    // relative_position is relative to --start/--end, i.e. to the segment.
+    char segment[40] = "";
+    if (p->segment_count) {
+        snprintf(segment, sizeof(segment), "seg %d/%d %d%% ", p->segment_index,
+                 p->segment_count, (int)(MPCLAMP(relative_position, 0, 1) * 100));
+    }
+
     if (p->frames) {
-        snprintf(buf, bufsize, "{%.1fmin %.1ffps %.1fMB}",
-                 minutes, fps, megabytes);
+        snprintf(buf, bufsize, "{%s%.1fmin %.1ffps %.1fMB}",
+                 segment, minutes, fps, megabytes);
     } else if (p->audioseconds) {
-        snprintf(buf, bufsize, "{%.1fmin %.2fx %.1fMB}",
-                 minutes, x, megabytes);
+        snprintf(buf, bufsize, "{%s%.1fmin %.2fx %.1fMB}",
+                 segment, minutes, x, megabytes);
     } else {
-        snprintf(buf, bufsize, "{%.1fmin %.1fMB}",
-                 minutes, megabytes);
+        snprintf(buf, bufsize, "{%s%.1fmin %.1fMB}",
+                 segment, minutes, megabytes);
     }
     buf[bufsize - 1] = 0;
 
@@ -716,6 +746,41 @@ done:
     return 0;
 }
 
+// With --osegment, log the progress within the segment each time it changes
+// by a percent. Unlike the status line, this is not cut to the terminal width,
+// and is printed with --msg-level=encode/progress=info even if there is no
+// terminal.
+void encode_lavc_report_progress(struct encode_lavc_context *ctx,
+                                 float relative_position)
+{
+    if (!ctx)
+        return;
+
+    struct encode_priv *p = ctx->priv;
+    if (!p->segment_count)
+        return;
+
+    int percent = MPCLAMP(relative_position, 0, 1) * 100;
+
+    pthread_mutex_lock(&ctx->lock);
+    if (percent != p->segment_percent && !p->failed) {
+        p->segment_percent = percent;
+        double elapsed = mp_time_sec() - p->t0;
+        double megabytes =
+            p->muxer->pb ? avio_size(p->muxer->pb) / 1048576.0 : 0;
+        if (p->frames) {
+            mp_info(p->progress_log, "segment %d/%d %d%% %.1ffps %.1fMB\n",
+                    p->segment_index, p->segment_count, percent,
+                    p->frames / elapsed, megabytes);
+        } else {
+            mp_info(p->progress_log, "segment %d/%d %d%% %.2fx %.1fMB\n",
+                    p->segment_index, p->segment_count, percent,
+                    p->audioseconds / elapsed, megabytes);
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
 bool encode_lavc_didfail(struct encode_lavc_context *ctx)
 {
     if (!ctx)
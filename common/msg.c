@@ -30,6 +30,7 @@
 #include "osdep/atomic.h"
 #include "common/common.h"
 #include "common/global.h"
+#include "common/stats.h"
 #include "misc/bstr.h"
 #include "options/options.h"
 #include "options/path.h"
@@ -44,8 +45,9 @@
 #include "msg_control.h"
 
 // log buffer size (lines) for terminal level and logfile level
+// (the logfile buffer doesn't block anymore if it's full, so it's larger)
 #define TERM_BUF 100
-#define FILE_BUF 100
+#define FILE_BUF 10000
 
 // logfile lines to accumulate during init before we know the log file name.
 // thousands of logfile lines during init can happen (especially with many
@@ -53,8 +55,15 @@
 // overwritten, then the first (virtual) log line indicates how many were lost.
 #define EARLY_FILE_BUF 5000
 
+// Immutable snapshot of mp_log_root.buffers.
+struct buffer_list {
+    struct mp_log_buffer **buffers;
+    int num_buffers;
+};
+
 struct mp_log_root {
     struct mpv_global *global;
+    struct stats_ctx *stats;
     pthread_mutex_t lock;
     pthread_mutex_t log_file_lock;
     pthread_cond_t log_file_wakeup;
@@ -80,6 +89,15 @@ struct mp_log_root {
      * (This is perhaps better than maintaining a globally accessible and
      * synchronized mp_log tree.) */
     atomic_ulong reload_counter;
+    // Total number of messages dropped because a log buffer was full.
+    mp_atomic_uint64 dropped;
+    // Set by log_file_thread before it waits for log_file_wakeup.
+    atomic_bool log_file_idle;
+    // --- lock-free access to the buffer list, see enter_buffers()
+    atomic_ulong buffers_epoch;
+    atomic_int buffers_readers[2];
+    // Indexed by buffers_epoch & 1. Only written by publish_buffers().
+    struct buffer_list *buffer_lists[2];
     // --- owner thread only (caller of mp_msg_init() etc.)
     char *log_path;
     char *stats_path;
@@ -99,20 +117,33 @@ struct mp_log {
     int level;                  // minimum log level for any outputs
     int terminal_level;         // minimum log level for terminal output
     atomic_ulong reload_counter;
-    char *partial;
+    char *partial;              // protected by root->lock
+    atomic_bool has_partial;    // partial[0] != '\0'
+};
+
+struct log_slot {
+    mp_atomic_uint64 seq;
+    struct mp_log_buffer_entry *entry;
 };
 
+// The entries are stored in a bounded lock-free multi-producer/multi-consumer
+// queue. Each slot has a sequence number, which says whether the slot can be
+// written (seq == write position) or read (seq == read position + 1). This
+// allows any thread to append messages without locking; if the buffer is
+// full, the writer removes the oldest entry itself.
 struct mp_log_buffer {
     struct mp_log_root *root;
-    pthread_mutex_t lock;
-    // --- protected by lock
-    struct mp_log_buffer_entry **entries;   // ringbuffer
-    int capacity;                           // total space in entries[]
-    int entry0;                             // first (oldest) entry index
-    int num_entries;                        // number of valid entries after entry0
-    uint64_t dropped;                       // number of skipped entries
-    bool silent;
+    // --- must be accessed atomically
+    struct log_slot *slots;                 // ringbuffer
+    mp_atomic_uint64 read_pos;
+    mp_atomic_uint64 write_pos;
+    mp_atomic_uint64 dropped;               // number of skipped entries
+    atomic_bool silent;
+    // Set after wakeup_cb/wakeup_cb_ctx were set (they can change once for
+    // the early buffer).
+    atomic_bool has_wakeup_cb;
     // --- immutable
+    int capacity;                           // total number of slots
     void (*wakeup_cb)(void *ctx);
     void *wakeup_cb_ctx;
     int level;
@@ -336,68 +367,144 @@ static void print_terminal_line(struct mp_log *log, int lev,
     fflush(stream);
 }
 
+static bool log_buffer_push(struct mp_log_buffer *buffer,
+                            struct mp_log_buffer_entry *entry)
+{
+    uint64_t pos = atomic_load_explicit(&buffer->write_pos, memory_order_relaxed);
+    while (1) {
+        struct log_slot *slot = &buffer->slots[pos % buffer->capacity];
+        int64_t diff = (int64_t)(atomic_load(&slot->seq) - pos);
+        if (diff == 0) {
+            // On failure, pos is set to the current write_pos.
+            if (atomic_compare_exchange_strong(&buffer->write_pos, &pos, pos + 1)) {
+                slot->entry = entry;
+                atomic_store(&slot->seq, pos + 1);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // full
+        } else {
+            pos = atomic_load_explicit(&buffer->write_pos, memory_order_relaxed);
+        }
+    }
+}
+
 static struct mp_log_buffer_entry *log_buffer_read(struct mp_log_buffer *buffer)
 {
-    assert(buffer->num_entries);
-    struct mp_log_buffer_entry *res = buffer->entries[buffer->entry0];
-    buffer->entry0 = (buffer->entry0 + 1) % buffer->capacity;
-    buffer->num_entries -= 1;
-    return res;
+    uint64_t pos = atomic_load_explicit(&buffer->read_pos, memory_order_relaxed);
+    while (1) {
+        struct log_slot *slot = &buffer->slots[pos % buffer->capacity];
+        int64_t diff = (int64_t)(atomic_load(&slot->seq) - (pos + 1));
+        if (diff == 0) {
+            if (atomic_compare_exchange_strong(&buffer->read_pos, &pos, pos + 1)) {
+                struct mp_log_buffer_entry *entry = slot->entry;
+                atomic_store(&slot->seq, pos + buffer->capacity);
+                return entry;
+            }
+        } else if (diff < 0) {
+            return NULL; // empty
+        } else {
+            pos = atomic_load_explicit(&buffer->read_pos, memory_order_relaxed);
+        }
+    }
+}
+
+// Return the current list of log buffers. The list and the buffers in it stay
+// valid until leave_buffers() is called, even if buffers are removed
+// concurrently. This never blocks.
+static struct buffer_list *enter_buffers(struct mp_log_root *root,
+                                         unsigned long *epoch)
+{
+    while (1) {
+        unsigned long e = atomic_load(&root->buffers_epoch);
+        atomic_fetch_add(&root->buffers_readers[e & 1], 1);
+        // If the epoch changed in between, publish_buffers() might not wait
+        // for us, so we must not access the list.
+        if (atomic_load(&root->buffers_epoch) == e) {
+            *epoch = e;
+            return root->buffer_lists[e & 1];
+        }
+        atomic_fetch_add(&root->buffers_readers[e & 1], -1);
+    }
+}
+
+static void leave_buffers(struct mp_log_root *root, unsigned long epoch)
+{
+    atomic_fetch_add(&root->buffers_readers[epoch & 1], -1);
+}
+
+// Make the current root->buffers visible to enter_buffers(), and wait until
+// no thread accesses the previous list anymore. After this, removed buffers
+// can be freed. Must be called with root->lock held.
+static void publish_buffers(struct mp_log_root *root)
+{
+    unsigned long e = atomic_load(&root->buffers_epoch);
+
+    struct buffer_list *list = talloc_zero(NULL, struct buffer_list);
+    for (int n = 0; n < root->num_buffers; n++)
+        MP_TARRAY_APPEND(list, list->buffers, list->num_buffers, root->buffers[n]);
+
+    // No reader can use this slot, because the previous call waited for them.
+    root->buffer_lists[(e + 1) & 1] = list;
+    atomic_store(&root->buffers_epoch, e + 1);
+
+    // Readers never block and hold the list only shortly.
+    while (atomic_load(&root->buffers_readers[e & 1]))
+        mp_sleep_us(100);
+
+    talloc_free(root->buffer_lists[e & 1]);
+    root->buffer_lists[e & 1] = NULL;
+}
+
+static unsigned int get_thread_id(void)
+{
+    // Numbered in the order the threads log their first message.
+    static atomic_uint next_id = ATOMIC_VAR_INIT(1);
+    static __thread unsigned int id;
+    if (!id)
+        id = atomic_fetch_add(&next_id, 1);
+    return id;
 }
 
 static void write_msg_to_buffers(struct mp_log *log, int lev, char *text)
 {
     struct mp_log_root *root = log->root;
-    for (int n = 0; n < root->num_buffers; n++) {
-        struct mp_log_buffer *buffer = root->buffers[n];
-        bool wakeup = false;
-        pthread_mutex_lock(&buffer->lock);
+    int64_t now = 0;
+    unsigned long epoch;
+    struct buffer_list *list = enter_buffers(root, &epoch);
+    for (int n = 0; list && n < list->num_buffers; n++) {
+        struct mp_log_buffer *buffer = list->buffers[n];
         int buffer_level = buffer->level;
         if (buffer_level == MP_LOG_BUFFER_MSGL_TERM)
             buffer_level = log->terminal_level;
         if (buffer_level == MP_LOG_BUFFER_MSGL_LOGFILE)
             buffer_level = MPMAX(log->terminal_level, MSGL_DEBUG);
-        if (lev <= buffer_level && lev != MSGL_STATUS) {
-            if (buffer->level == MP_LOG_BUFFER_MSGL_LOGFILE) {
-                // If the buffer is full, block until we can write again,
-                // unless there's no write thread (died, or early filebuffer)
-                bool dead = false;
-                while (buffer->num_entries == buffer->capacity && !dead) {
-                    // Temporary unlock is OK; buffer->level is immutable, and
-                    // buffer can't go away because the global log lock is held.
-                    pthread_mutex_unlock(&buffer->lock);
-                    pthread_mutex_lock(&root->log_file_lock);
-                    if (root->log_file_thread_active) {
-                        pthread_cond_wait(&root->log_file_wakeup,
-                                          &root->log_file_lock);
-                    } else {
-                        dead = true;
-                    }
-                    pthread_mutex_unlock(&root->log_file_lock);
-                    pthread_mutex_lock(&buffer->lock);
-                }
-            }
-            if (buffer->num_entries == buffer->capacity) {
-                struct mp_log_buffer_entry *skip = log_buffer_read(buffer);
+        if (lev > buffer_level || lev == MSGL_STATUS)
+            continue;
+        if (!now)
+            now = mp_time_us();
+        struct mp_log_buffer_entry *entry = talloc_ptrtype(NULL, entry);
+        *entry = (struct mp_log_buffer_entry) {
+            .prefix = talloc_strdup(entry, log->verbose_prefix),
+            .level = lev,
+            .text = talloc_strdup(entry, text),
+            .time = now,
+            .thread_id = get_thread_id(),
+        };
+        // If the buffer is full, drop the oldest message instead of waiting
+        // for the reader.
+        while (!log_buffer_push(buffer, entry)) {
+            struct mp_log_buffer_entry *skip = log_buffer_read(buffer);
+            if (skip) {
                 talloc_free(skip);
-                buffer->dropped += 1;
+                atomic_fetch_add(&buffer->dropped, 1);
+                atomic_fetch_add(&root->dropped, 1);
             }
-            struct mp_log_buffer_entry *entry = talloc_ptrtype(NULL, entry);
-            *entry = (struct mp_log_buffer_entry) {
-                .prefix = talloc_strdup(entry, log->verbose_prefix),
-                .level = lev,
-                .text = talloc_strdup(entry, text),
-            };
-            int pos = (buffer->entry0 + buffer->num_entries) % buffer->capacity;
-            buffer->entries[pos] = entry;
-            buffer->num_entries += 1;
-            if (buffer->wakeup_cb && !buffer->silent)
-                wakeup = true;
         }
-        pthread_mutex_unlock(&buffer->lock);
-        if (wakeup)
+        if (atomic_load(&buffer->has_wakeup_cb) && !atomic_load(&buffer->silent))
             buffer->wakeup_cb(buffer->wakeup_cb_ctx);
     }
+    leave_buffers(root, epoch);
 }
 
 static void dump_stats(struct mp_log *log, int lev, char *text)
@@ -407,24 +514,39 @@ static void dump_stats(struct mp_log *log, int lev, char *text)
         fprintf(root->stats_file, "%"PRId64" %s\n", mp_time_us(), text);
 }
 
-void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
+// Split away each line. Returns the remaining incomplete line.
+static char *write_lines(struct mp_log *log, int lev, char *text, bool terminal)
 {
-    if (!mp_msg_test(log, lev))
-        return; // do not display
+    while (1) {
+        char *end = strchr(text, '\n');
+        if (!end)
+            break;
+        char *next = &end[1];
+        char saved = next[0];
+        next[0] = '\0';
+        if (terminal)
+            print_terminal_line(log, lev, text, "");
+        write_msg_to_buffers(log, lev, text);
+        next[0] = saved;
+        text = next;
+    }
+    return text;
+}
 
+static void write_msg_locked(struct mp_log *log, int lev, char *text)
+{
     struct mp_log_root *root = log->root;
 
-    pthread_mutex_lock(&root->lock);
-
     root->buffer.len = 0;
 
     if (log->partial[0])
         bstr_xappend_asprintf(root, &root->buffer, "%s", log->partial);
     log->partial[0] = '\0';
+    atomic_store(&log->has_partial, false);
 
-    bstr_xappend_vasprintf(root, &root->buffer, format, va);
+    bstr_xappend_asprintf(root, &root->buffer, "%s", text);
 
-    char *text = root->buffer.start;
+    text = root->buffer.start;
 
     if (lev == MSGL_STATS) {
         dump_stats(log, lev, text);
@@ -434,20 +556,8 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
         if (lev == MSGL_STATUS)
             prepare_status_line(root, text);
 
-        // Split away each line. Normally we require full lines; buffer partial
-        // lines if they happen.
-        while (1) {
-            char *end = strchr(text, '\n');
-            if (!end)
-                break;
-            char *next = &end[1];
-            char saved = next[0];
-            next[0] = '\0';
-            print_terminal_line(log, lev, text, "");
-            write_msg_to_buffers(log, lev, text);
-            next[0] = saved;
-            text = next;
-        }
+        // Normally we require full lines; buffer partial lines if they happen.
+        text = write_lines(log, lev, text, true);
 
         if (lev == MSGL_STATUS) {
             if (text[0])
@@ -457,10 +567,47 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
             if (talloc_get_size(log->partial) < size)
                 log->partial = talloc_realloc(NULL, log->partial, char, size);
             memcpy(log->partial, text, size);
+            atomic_store(&log->has_partial, true);
         }
     }
+}
 
-    pthread_mutex_unlock(&root->lock);
+void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
+{
+    if (!mp_msg_test(log, lev))
+        return; // do not display
+
+    struct mp_log_root *root = log->root;
+
+    // Format the message before taking any locks.
+    char stack_buf[512];
+    char *text = stack_buf;
+    va_list copy;
+    va_copy(copy, va);
+    int len = vsnprintf(stack_buf, sizeof(stack_buf), format, copy);
+    va_end(copy);
+    if (len < 0) {
+        stack_buf[0] = '\0';
+        len = 0;
+    } else if (len >= sizeof(stack_buf)) {
+        text = talloc_vasprintf(NULL, format, va);
+    }
+
+    // Complete lines which are not printed to the terminal only go to the log
+    // buffers, which can be done without the lock. This is the common case for
+    // verbose messages with --log-file or libmpv log message events.
+    if (lev != MSGL_STATS && lev != MSGL_STATUS && len && text[len - 1] == '\n' &&
+        !test_terminal_level(log, lev) && !atomic_load(&log->has_partial))
+    {
+        write_lines(log, lev, text, false);
+    } else {
+        pthread_mutex_lock(&root->lock);
+        write_msg_locked(log, lev, text);
+        pthread_mutex_unlock(&root->lock);
+    }
+
+    if (text != stack_buf)
+        talloc_free(text);
 }
 
 static void destroy_log(void *ptr)
@@ -530,12 +677,20 @@ void mp_msg_init(struct mpv_global *global)
     pthread_mutex_init(&root->log_file_lock, NULL);
     pthread_cond_init(&root->log_file_wakeup, NULL);
 
+    root->stats = stats_ctx_create(root, global, "log");
+
     struct mp_log dummy = { .root = root };
     struct mp_log *log = mp_log_new(root, &dummy, "");
 
     global->log = log;
 }
 
+static void write_log_file_entry(FILE *f, struct mp_log_buffer_entry *e)
+{
+    fprintf(f, "[%8.3f][%c][t%u][%s] %s", (e->time - MP_START_TIME) / 1e6,
+            mp_log_levels[e->level][0], e->thread_id, e->prefix, e->text);
+}
+
 static void *log_file_thread(void *p)
 {
     struct mp_log_root *root = p;
@@ -548,22 +703,32 @@ static void *log_file_thread(void *p)
         struct mp_log_buffer_entry *e =
             mp_msg_log_buffer_read(root->log_file_buffer);
         if (e) {
+            atomic_store(&root->log_file_idle, false);
             pthread_mutex_unlock(&root->log_file_lock);
-            fprintf(root->log_file, "[%8.3f][%c][%s] %s",
-                    (mp_time_us() - MP_START_TIME) / 1e6,
-                    mp_log_levels[e->level][0], e->prefix, e->text);
-            fflush(root->log_file);
-            pthread_mutex_lock(&root->log_file_lock);
+            write_log_file_entry(root->log_file, e);
             talloc_free(e);
-            // Multiple threads might be blocked if the log buffer was full.
-            pthread_cond_broadcast(&root->log_file_wakeup);
+            pthread_mutex_lock(&root->log_file_lock);
+        } else if (!atomic_load(&root->log_file_idle)) {
+            fflush(root->log_file);
+            // Check the buffer again after setting this. A concurrent writer
+            // either sees the flag and wakes us up, or we see its message.
+            atomic_store(&root->log_file_idle, true);
         } else {
             pthread_cond_wait(&root->log_file_wakeup, &root->log_file_lock);
+            atomic_store(&root->log_file_idle, false);
         }
     }
 
     pthread_mutex_unlock(&root->log_file_lock);
 
+    // Write what was logged before termination.
+    struct mp_log_buffer_entry *e;
+    while ((e = mp_msg_log_buffer_read(root->log_file_buffer))) {
+        write_log_file_entry(root->log_file, e);
+        talloc_free(e);
+    }
+    fflush(root->log_file);
+
     return NULL;
 }
 
@@ -571,6 +736,10 @@ static void wakeup_log_file(void *p)
 {
     struct mp_log_root *root = p;
 
+    // Avoid the lock if the thread is busy anyway.
+    if (!atomic_load(&root->log_file_idle))
+        return;
+
     pthread_mutex_lock(&root->log_file_lock);
     pthread_cond_broadcast(&root->log_file_wakeup);
     pthread_mutex_unlock(&root->log_file_lock);
@@ -662,15 +831,11 @@ void mp_msg_update_msglevels(struct mpv_global *global, struct MPOpts *opts)
 
                 if (earlybuf) {
                     // flush, destroy before creating the normal logfile buf,
-                    // as once the new one is created (specifically, its write
-                    // thread), then MSGL_LOGFILE messages become blocking, but
-                    // the early logfile buf is without dequeue - can deadlock.
-                    // note: timestamp is unknown, we use 0.000 as indication.
+                    // so that the early messages come first in the file.
                     // note: new messages while iterating are still flushed.
                     struct mp_log_buffer_entry *e;
                     while ((e = mp_msg_log_buffer_read(earlybuf))) {
-                        fprintf(root->log_file, "[%8.3f][%c][%s] %s", 0.0,
-                                mp_log_levels[e->level][0], e->prefix, e->text);
+                        write_log_file_entry(root->log_file, e);
                         talloc_free(e);
                     }
                     mp_msg_log_buffer_destroy(earlybuf);  // + remove from root
@@ -742,6 +907,8 @@ void mp_msg_uninit(struct mpv_global *global)
     talloc_free(root->stats_path);
     talloc_free(root->log_path);
     m_option_type_msglevels.free(&root->msg_levels);
+    talloc_free(root->buffer_lists[0]);
+    talloc_free(root->buffer_lists[1]);
     pthread_mutex_destroy(&root->lock);
     pthread_mutex_destroy(&root->log_file_lock);
     pthread_cond_destroy(&root->log_file_wakeup);
@@ -764,8 +931,7 @@ void mp_msg_uninit(struct mpv_global *global)
 //   is known are when log-file is set at mpv.conf, or from script/client init.
 //   once a file name is known, the early buffer is flushed and destroyed.
 //   unlike the "proper" log-file buffer, the early filebuffer is not backed by
-//   a write thread, and hence non-blocking (can overwrite old messages).
-//   it's also bigger than the actual file buffer (early: 5000, actual: 100).
+//   a write thread, so if it's full, old messages are overwritten.
 
 static void mp_msg_set_early_logging_raw(struct mpv_global *global, bool enable,
                                          struct mp_log_buffer **root_logbuf,
@@ -825,8 +991,11 @@ struct mp_log_buffer *mp_msg_log_buffer_new(struct mpv_global *global,
         if (root->early_buffer) {
             struct mp_log_buffer *buffer = root->early_buffer;
             root->early_buffer = NULL;
-            buffer->wakeup_cb = wakeup_cb;
-            buffer->wakeup_cb_ctx = wakeup_cb_ctx;
+            if (wakeup_cb) {
+                buffer->wakeup_cb = wakeup_cb;
+                buffer->wakeup_cb_ctx = wakeup_cb_ctx;
+                atomic_store(&buffer->has_wakeup_cb, true);
+            }
             pthread_mutex_unlock(&root->lock);
             return buffer;
         }
@@ -838,15 +1007,18 @@ struct mp_log_buffer *mp_msg_log_buffer_new(struct mpv_global *global,
     *buffer = (struct mp_log_buffer) {
         .root = root,
         .level = level,
-        .entries = talloc_array(buffer, struct mp_log_buffer_entry *, size),
+        .slots = talloc_zero_array(buffer, struct log_slot, size),
         .capacity = size,
         .wakeup_cb = wakeup_cb,
         .wakeup_cb_ctx = wakeup_cb_ctx,
+        .has_wakeup_cb = ATOMIC_VAR_INIT(!!wakeup_cb),
     };
 
-    pthread_mutex_init(&buffer->lock, NULL);
+    for (int n = 0; n < size; n++)
+        atomic_store(&buffer->slots[n].seq, n);
 
     MP_TARRAY_APPEND(root, root->buffers, root->num_buffers, buffer);
+    publish_buffers(root);
 
     atomic_fetch_add(&root->reload_counter, 1);
     pthread_mutex_unlock(&root->lock);
@@ -856,9 +1028,7 @@ struct mp_log_buffer *mp_msg_log_buffer_new(struct mpv_global *global,
 
 void mp_msg_log_buffer_set_silent(struct mp_log_buffer *buffer, bool silent)
 {
-    pthread_mutex_lock(&buffer->lock);
-    buffer->silent = silent;
-    pthread_mutex_unlock(&buffer->lock);
+    atomic_store(&buffer->silent, silent);
 }
 
 void mp_msg_log_buffer_destroy(struct mp_log_buffer *buffer)
@@ -881,10 +1051,13 @@ void mp_msg_log_buffer_destroy(struct mp_log_buffer *buffer)
 
 found:
 
-    while (buffer->num_entries)
-        talloc_free(log_buffer_read(buffer));
+    // Wait until no writer can access the buffer anymore.
+    publish_buffers(root);
+
+    struct mp_log_buffer_entry *e;
+    while ((e = log_buffer_read(buffer)))
+        talloc_free(e);
 
-    pthread_mutex_destroy(&buffer->lock);
     talloc_free(buffer);
 
     atomic_fetch_add(&root->reload_counter, 1);
@@ -895,29 +1068,27 @@ found:
 // Thread-safety: one buffer can be read by a single thread only.
 struct mp_log_buffer_entry *mp_msg_log_buffer_read(struct mp_log_buffer *buffer)
 {
-    struct mp_log_buffer_entry *res = NULL;
-
-    pthread_mutex_lock(&buffer->lock);
-
-    if (!buffer->silent && buffer->num_entries) {
-        if (buffer->dropped) {
-            res = talloc_ptrtype(NULL, res);
-            *res = (struct mp_log_buffer_entry) {
-                .prefix = "overflow",
-                .level = MSGL_FATAL,
-                .text = talloc_asprintf(res,
-                    "log message buffer overflow: %"PRId64" messages skipped\n",
-                    buffer->dropped),
-            };
-            buffer->dropped = 0;
-        } else {
-            res = log_buffer_read(buffer);
-        }
+    if (atomic_load(&buffer->silent))
+        return NULL;
+
+    uint64_t dropped = atomic_exchange(&buffer->dropped, 0);
+    if (dropped) {
+        struct mp_log_root *root = buffer->root;
+        stats_value(root->stats, "dropped", atomic_load(&root->dropped));
+        struct mp_log_buffer_entry *res = talloc_ptrtype(NULL, res);
+        *res = (struct mp_log_buffer_entry) {
+            .prefix = "overflow",
+            .level = MSGL_FATAL,
+            .text = talloc_asprintf(res,
+                "log message buffer overflow: %"PRId64" messages skipped\n",
+                dropped),
+            .time = mp_time_us(),
+            .thread_id = get_thread_id(),
+        };
+        return res;
     }
 
-    pthread_mutex_unlock(&buffer->lock);
-
-    return res;
+    return log_buffer_read(buffer);
 }
 
 // Thread-safety: fully thread-safe, but keep in mind that the lifetime of
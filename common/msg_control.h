@@ -2,6 +2,7 @@
 #define MP_MSG_CONTROL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct mpv_global;
 struct MPOpts;
@@ -20,6 +21,8 @@ struct mp_log_buffer_entry {
     char *prefix;
     int level;
     char *text;
+    int64_t time;               // mp_time_us() when the message was logged
+    unsigned int thread_id;     // small number identifying the logging thread
 };
 
 // Use --msg-level option for log level of this log buffer
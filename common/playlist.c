@@ -51,23 +51,188 @@ void playlist_entry_add_params(struct playlist_entry *e,
         playlist_entry_add_param(e, params[n].name, params[n].value);
 }
 
-static void playlist_update_indexes(struct playlist *pl, int start, int end)
+static int node_size(struct playlist_entry *e)
 {
-    start = MPMAX(start, 0);
-    end = end < 0 ? pl->num_entries : MPMIN(end, pl->num_entries);
+    return e ? e->node.size : 0;
+}
+
+// Recompute e's subtree size and reattach its children.
+static void node_update(struct playlist_entry *e)
+{
+    e->node.size = 1 + node_size(e->node.left) + node_size(e->node.right);
+    if (e->node.left)
+        e->node.left->node.parent = e;
+    if (e->node.right)
+        e->node.right->node.parent = e;
+}
+
+// Concatenate the entry sequences a and b.
+static struct playlist_entry *tree_merge(struct playlist_entry *a,
+                                         struct playlist_entry *b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+    if (a->node.prio > b->node.prio) {
+        a->node.right = tree_merge(a->node.right, b);
+        node_update(a);
+        return a;
+    }
+    b->node.left = tree_merge(a, b->node.left);
+    node_update(b);
+    return b;
+}
+
+// Split t into the first n entries (*l) and the remaining entries (*r).
+static void tree_split(struct playlist_entry *t, int n,
+                       struct playlist_entry **l, struct playlist_entry **r)
+{
+    if (!t) {
+        *l = *r = NULL;
+        return;
+    }
+    int left = node_size(t->node.left);
+    if (left < n) {
+        tree_split(t->node.right, n - left - 1, &t->node.right, r);
+        node_update(t);
+        *l = t;
+    } else {
+        tree_split(t->node.left, n, l, &t->node.left);
+        node_update(t);
+        *r = t;
+    }
+}
+
+static void set_root(struct playlist *pl, struct playlist_entry *root)
+{
+    pl->root = root;
+    if (root)
+        root->node.parent = NULL;
+    pl->num_entries = node_size(root);
+}
+
+// Insert the sequence t (not part of any playlist tree) before index.
+static void tree_insert_at(struct playlist *pl, int index,
+                           struct playlist_entry *t)
+{
+    struct playlist_entry *a, *b;
+    tree_split(pl->root, index, &a, &b);
+    set_root(pl, tree_merge(tree_merge(a, t), b));
+}
+
+// Remove count entries starting at index, and return them as separate tree.
+static struct playlist_entry *tree_remove_at(struct playlist *pl, int index,
+                                             int count)
+{
+    struct playlist_entry *a, *b, *c;
+    tree_split(pl->root, index, &a, &b);
+    tree_split(b, count, &b, &c);
+    set_root(pl, tree_merge(a, c));
+    if (b)
+        b->node.parent = NULL;
+    return b;
+}
+
+// Build a tree from a list of entries in O(num), using their priorities.
+static struct playlist_entry *tree_build(struct playlist_entry **list, int num)
+{
+    // Cartesian tree construction: the stack holds the right spine.
+    struct playlist_entry **stack = talloc_array(NULL, struct playlist_entry *,
+                                                 num);
+    int depth = 0;
+    for (int n = 0; n < num; n++) {
+        struct playlist_entry *e = list[n];
+        struct playlist_entry *last = NULL;
+        while (depth && stack[depth - 1]->node.prio < e->node.prio) {
+            last = stack[--depth];
+            node_update(last);
+        }
+        e->node.left = last;
+        e->node.right = NULL;
+        if (depth)
+            stack[depth - 1]->node.right = e;
+        stack[depth++] = e;
+    }
+    struct playlist_entry *root = depth ? stack[0] : NULL;
+    while (depth)
+        node_update(stack[--depth]);
+    talloc_free(stack);
+    return root;
+}
+
+static struct playlist_entry *tree_first(struct playlist_entry *t)
+{
+    while (t && t->node.left)
+        t = t->node.left;
+    return t;
+}
+
+static struct playlist_entry *tree_last(struct playlist_entry *t)
+{
+    while (t && t->node.right)
+        t = t->node.right;
+    return t;
+}
+
+// Append all entries of t to list in order.
+static void tree_to_list(struct playlist_entry *t, struct playlist_entry **list,
+                         int *num)
+{
+    for (struct playlist_entry *e = tree_first(t); e;) {
+        list[(*num)++] = e;
+        if (e->node.right) {
+            e = tree_first(e->node.right);
+        } else {
+            while (e->node.parent && e->node.parent->node.right == e)
+                e = e->node.parent;
+            e = e->node.parent;
+        }
+    }
+}
+
+static uint32_t entry_prio(uint64_t id)
+{
+    // Any well-distributed hash keeps the tree balanced (on average).
+    uint64_t x = id * 0x9E3779B97F4A7C15ULL;
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 29;
+    return x >> 32;
+}
 
-    for (int n = start; n < end; n++)
-        pl->entries[n]->pl_index = n;
+static void add_change(struct playlist *pl, enum playlist_change_type type,
+                       int index, int count, int to)
+{
+    uint64_t serial = ++pl->change_serial;
+    pl->changes[serial % PLAYLIST_MAX_CHANGES] = (struct playlist_change){
+        .serial = serial,
+        .type = type,
+        .index = index,
+        .count = count,
+        .to = to,
+    };
+}
+
+// Record that the data of e (e.g. its title) was changed.
+void playlist_entry_changed(struct playlist *pl, struct playlist_entry *e)
+{
+    int index = playlist_entry_to_index(pl, e);
+    if (index >= 0)
+        add_change(pl, PLAYLIST_CHANGE_UPDATE, index, 1, 0);
 }
 
 void playlist_add(struct playlist *pl, struct playlist_entry *add)
 {
     assert(add->filename);
-    MP_TARRAY_APPEND(pl, pl->entries, pl->num_entries, add);
     add->pl = pl;
-    add->pl_index = pl->num_entries - 1;
     add->id = ++pl->id_alloc;
+    add->node.prio = entry_prio(add->id);
+    add->node.left = add->node.right = NULL;
+    node_update(add);
+    tree_insert_at(pl, pl->num_entries, add);
     talloc_steal(pl, add);
+    add_change(pl, PLAYLIST_CHANGE_INSERT, pl->num_entries - 1, 1, 0);
 }
 
 void playlist_entry_unref(struct playlist_entry *e)
@@ -79,39 +244,61 @@ void playlist_entry_unref(struct playlist_entry *e)
     }
 }
 
-void playlist_remove(struct playlist *pl, struct playlist_entry *entry)
+// Release all entries in the tree t (already removed from the playlist).
+static void release_tree(struct playlist_entry *t)
 {
-    assert(pl && entry->pl == pl);
+    if (!t)
+        return;
+    release_tree(t->node.left);
+    release_tree(t->node.right);
+
+    t->pl = NULL;
+    t->node.parent = t->node.left = t->node.right = NULL;
+    t->node.size = 0;
+    ta_set_parent(t, NULL);
 
-    if (pl->current == entry) {
-        pl->current = playlist_entry_get_rel(entry, 1);
+    t->removed = true;
+    playlist_entry_unref(t);
+}
+
+// Remove count entries starting at index.
+static void remove_range(struct playlist *pl, int index, int count)
+{
+    if (count <= 0)
+        return;
+
+    int cur = playlist_entry_to_index(pl, pl->current);
+    if (cur >= index && cur < index + count) {
+        pl->current = playlist_entry_from_index(pl, index + count);
         pl->current_was_replaced = true;
     }
 
-    MP_TARRAY_REMOVE_AT(pl->entries, pl->num_entries, entry->pl_index);
-    playlist_update_indexes(pl, entry->pl_index, -1);
+    release_tree(tree_remove_at(pl, index, count));
+    add_change(pl, PLAYLIST_CHANGE_REMOVE, index, count, 0);
+}
 
-    entry->pl = NULL;
-    entry->pl_index = -1;
-    ta_set_parent(entry, NULL);
+void playlist_remove(struct playlist *pl, struct playlist_entry *entry)
+{
+    assert(pl && entry->pl == pl);
 
-    entry->removed = true;
-    playlist_entry_unref(entry);
+    remove_range(pl, playlist_entry_to_index(pl, entry), 1);
 }
 
 void playlist_clear(struct playlist *pl)
 {
-    for (int n = pl->num_entries - 1; n >= 0; n--)
-        playlist_remove(pl, pl->entries[n]);
+    remove_range(pl, 0, pl->num_entries);
     assert(!pl->current);
     pl->current_was_replaced = false;
 }
 
 void playlist_clear_except_current(struct playlist *pl)
 {
-    for (int n = pl->num_entries - 1; n >= 0; n--) {
-        if (pl->entries[n] != pl->current)
-            playlist_remove(pl, pl->entries[n]);
+    int cur = playlist_entry_to_index(pl, pl->current);
+    if (cur < 0) {
+        remove_range(pl, 0, pl->num_entries);
+    } else {
+        remove_range(pl, cur + 1, pl->num_entries - cur - 1);
+        remove_range(pl, 0, cur);
     }
 }
 
@@ -125,16 +312,16 @@ void playlist_move(struct playlist *pl, struct playlist_entry *entry,
     assert(entry && entry->pl == pl);
     assert(!at || at->pl == pl);
 
-    int index = at ? at->pl_index : pl->num_entries;
-    MP_TARRAY_INSERT_AT(pl, pl->entries, pl->num_entries, index, entry);
+    int old_index = playlist_entry_to_index(pl, entry);
+    int index = at ? playlist_entry_to_index(pl, at) : pl->num_entries;
+    if (index > old_index)
+        index -= 1;
 
-    int old_index = entry->pl_index;
-    if (old_index >= index)
-        old_index += 1;
-    MP_TARRAY_REMOVE_AT(pl->entries, pl->num_entries, old_index);
+    struct playlist_entry *t = tree_remove_at(pl, old_index, 1);
+    assert(t == entry);
+    tree_insert_at(pl, index, t);
 
-    playlist_update_indexes(pl, MPMIN(index - 1, old_index - 1),
-                                MPMAX(index + 1, old_index + 1));
+    add_change(pl, PLAYLIST_CHANGE_MOVE, old_index, 1, index);
 }
 
 void playlist_add_file(struct playlist *pl, const char *filename)
@@ -142,46 +329,79 @@ void playlist_add_file(struct playlist *pl, const char *filename)
     playlist_add(pl, playlist_entry_new(filename));
 }
 
+// Return all entries in order (free with talloc_free()).
+static struct playlist_entry **get_entry_list(struct playlist *pl)
+{
+    struct playlist_entry **list =
+        talloc_array(NULL, struct playlist_entry *, pl->num_entries);
+    int num = 0;
+    tree_to_list(pl->root, list, &num);
+    assert(num == pl->num_entries);
+    return list;
+}
+
 void playlist_shuffle(struct playlist *pl)
 {
-    for (int n = 0; n < pl->num_entries; n++)
-        pl->entries[n]->original_index = n;
-    for (int n = 0; n < pl->num_entries - 1; n++) {
-        size_t j = (size_t)((pl->num_entries - n) * mp_rand_next_double());
-        MPSWAP(struct playlist_entry *, pl->entries[n], pl->entries[n + j]);
+    struct playlist_entry **list = get_entry_list(pl);
+    int num = pl->num_entries;
+    for (int n = 0; n < num; n++)
+        list[n]->original_index = n;
+    for (int n = 0; n < num - 1; n++) {
+        size_t j = (size_t)((num - n) * mp_rand_next_double());
+        MPSWAP(struct playlist_entry *, list[n], list[n + j]);
     }
-    playlist_update_indexes(pl, 0, -1);
+    set_root(pl, tree_build(list, num));
+    talloc_free(list);
+    add_change(pl, PLAYLIST_CHANGE_RESET, 0, 0, 0);
 }
 
 #define CMP_INT(a, b) ((a) == (b) ? 0 : ((a) > (b) ? 1 : -1))
 
+struct unshuffle_item {
+    struct playlist_entry *e;
+    int index;
+};
+
 static int cmp_unshuffle(const void *a, const void *b)
 {
-    struct playlist_entry *ea = *(struct playlist_entry **)a;
-    struct playlist_entry *eb = *(struct playlist_entry **)b;
+    const struct unshuffle_item *ia = a;
+    const struct unshuffle_item *ib = b;
+    struct playlist_entry *ea = ia->e;
+    struct playlist_entry *eb = ib->e;
 
     if (ea->original_index >= 0 && ea->original_index != eb->original_index)
         return CMP_INT(ea->original_index, eb->original_index);
-    return CMP_INT(ea->pl_index, eb->pl_index);
+    return CMP_INT(ia->index, ib->index);
 }
 
 void playlist_unshuffle(struct playlist *pl)
 {
-    if (pl->num_entries)
-        qsort(pl->entries, pl->num_entries, sizeof(pl->entries[0]), cmp_unshuffle);
-    playlist_update_indexes(pl, 0, -1);
+    struct playlist_entry **list = get_entry_list(pl);
+    int num = pl->num_entries;
+    struct unshuffle_item *items =
+        talloc_array(NULL, struct unshuffle_item, num);
+    for (int n = 0; n < num; n++)
+        items[n] = (struct unshuffle_item){list[n], n};
+    if (num)
+        qsort(items, num, sizeof(items[0]), cmp_unshuffle);
+    for (int n = 0; n < num; n++)
+        list[n] = items[n].e;
+    set_root(pl, tree_build(list, num));
+    talloc_free(items);
+    talloc_free(list);
+    add_change(pl, PLAYLIST_CHANGE_RESET, 0, 0, 0);
 }
 
 // (Explicitly ignores current_was_replaced.)
 struct playlist_entry *playlist_get_first(struct playlist *pl)
 {
-    return pl->num_entries ? pl->entries[0] : NULL;
+    return tree_first(pl->root);
 }
 
 // (Explicitly ignores current_was_replaced.)
 struct playlist_entry *playlist_get_last(struct playlist *pl)
 {
-    return pl->num_entries ? pl->entries[pl->num_entries - 1] : NULL;
+    return tree_last(pl->root);
 }
 
 struct playlist_entry *playlist_get_next(struct playlist *pl, int direction)
@@ -203,15 +423,27 @@ struct playlist_entry *playlist_entry_get_rel(struct playlist_entry *e,
     assert(direction == -1 || direction == +1);
     if (!e->pl)
         return NULL;
-    return playlist_entry_from_index(e->pl, e->pl_index + direction);
+    if (direction > 0) {
+        if (e->node.right)
+            return tree_first(e->node.right);
+        while (e->node.parent && e->node.parent->node.right == e)
+            e = e->node.parent;
+    } else {
+        if (e->node.left)
+            return tree_last(e->node.left);
+        while (e->node.parent && e->node.parent->node.left == e)
+            e = e->node.parent;
+    }
+    return e->node.parent;
 }
 
 void playlist_add_base_path(struct playlist *pl, bstr base_path)
 {
     if (base_path.len == 0 || bstrcmp0(base_path, ".") == 0)
         return;
-    for (int n = 0; n < pl->num_entries; n++) {
-        struct playlist_entry *e = pl->entries[n];
+    for (struct playlist_entry *e = playlist_get_first(pl); e;
+         e = playlist_entry_get_rel(e, 1))
+    {
         if (!mp_is_url(bstr0(e->filename))) {
             char *new_file = mp_path_join_bstr(e, base_path, bstr0(e->filename));
             talloc_free(e->filename);
@@ -223,8 +455,9 @@ void playlist_add_base_path(struct playlist *pl, bstr base_path)
 // Add redirected_from as new redirect entry to each item in pl.
 void playlist_add_redirect(struct playlist *pl, const char *redirected_from)
 {
-    for (int n = 0; n < pl->num_entries; n++) {
-        struct playlist_entry *e = pl->entries[n];
+    for (struct playlist_entry *e = playlist_get_first(pl); e;
+         e = playlist_entry_get_rel(e, 1))
+    {
         if (e->num_redirects >= 10) // arbitrary limit for sanity
             continue;
         char *s = talloc_strdup(e, redirected_from);
@@ -235,8 +468,9 @@ void playlist_add_redirect(struct playlist *pl, const char *redirected_from)
 
 void playlist_set_stream_flags(struct playlist *pl, int flags)
 {
-    for (int n = 0; n < pl->num_entries; n++)
-        pl->entries[n]->stream_flags = flags;
+    for (struct playlist_entry *e = playlist_get_first(pl); e;
+         e = playlist_entry_get_rel(e, 1))
+        e->stream_flags = flags;
 }
 
 static int64_t playlist_transfer_entries_to(struct playlist *pl, int dst_index,
@@ -246,19 +480,29 @@ static int64_t playlist_transfer_entries_to(struct playlist *pl, int dst_index,
     struct playlist_entry *first = playlist_get_first(source_pl);
 
     int count = source_pl->num_entries;
-    MP_TARRAY_INSERT_N_AT(pl, pl->entries, pl->num_entries, dst_index, count);
 
+    // The priorities depend on the IDs, which change, so rebuild the tree.
+    // Reusing the source tree would make it degenerate if the same source
+    // IDs are transferred repeatedly.
+    struct playlist_entry **list = get_entry_list(source_pl);
     for (int n = 0; n < count; n++) {
-        struct playlist_entry *e = source_pl->entries[n];
+        struct playlist_entry *e = list[n];
         e->pl = pl;
-        e->pl_index = dst_index + n;
         e->id = ++pl->id_alloc;
-        pl->entries[e->pl_index] = e;
+        e->node.prio = entry_prio(e->id);
         talloc_steal(pl, e);
     }
 
-    playlist_update_indexes(pl, dst_index + count, -1);
-    source_pl->num_entries = 0;
+    struct playlist_entry *t = tree_build(list, count);
+    talloc_free(list);
+    set_root(source_pl, NULL);
+    source_pl->current = NULL;
+    tree_insert_at(pl, dst_index, t);
+
+    if (count) {
+        add_change(pl, PLAYLIST_CHANGE_INSERT, dst_index, count, 0);
+        add_change(source_pl, PLAYLIST_CHANGE_REMOVE, 0, count, 0);
+    }
 
     return first ? first->id : 0;
 }
@@ -273,7 +517,7 @@ int64_t playlist_transfer_entries(struct playlist *pl, struct playlist *source_p
 
     int add_at = pl->num_entries;
     if (pl->current) {
-        add_at = pl->current->pl_index + 1;
+        add_at = playlist_entry_to_index(pl, pl->current) + 1;
         if (pl->current_was_replaced)
             add_at += 1;
     }
@@ -294,7 +538,12 @@ int playlist_entry_to_index(struct playlist *pl, struct playlist_entry *e)
 {
     if (!e || e->pl != pl)
         return -1;
-    return e->pl_index;
+    int index = node_size(e->node.left);
+    for (; e->node.parent; e = e->node.parent) {
+        if (e->node.parent->node.right == e)
+            index += node_size(e->node.parent->node.left) + 1;
+    }
+    return index;
 }
 
 int playlist_entry_count(struct playlist *pl)
@@ -306,7 +555,20 @@ int playlist_entry_count(struct playlist *pl)
 // Return NULL if not found.
 struct playlist_entry *playlist_entry_from_index(struct playlist *pl, int index)
 {
-    return index >= 0 && index < pl->num_entries ? pl->entries[index] : NULL;
+    if (index < 0 || index >= pl->num_entries)
+        return NULL;
+    struct playlist_entry *e = pl->root;
+    while (1) {
+        int left = node_size(e->node.left);
+        if (index < left) {
+            e = e->node.left;
+        } else if (index > left) {
+            index -= left + 1;
+            e = e->node.right;
+        } else {
+            return e;
+        }
+    }
 }
 
 struct playlist *playlist_parse_file(const char *file, struct mp_cancel *cancel,
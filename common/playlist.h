@@ -26,9 +26,17 @@ struct playlist_param {
 };
 
 struct playlist_entry {
-    // Invariant: (pl && pl->entries[pl_index] == this) || (!pl && pl_index < 0)
     struct playlist *pl;
-    int pl_index;
+
+    // Node in pl's order-statistic tree (an implicit treap: in-order traversal
+    // gives the playlist order, and each node knows its subtree size). All
+    // fields are unset if pl==NULL. Use the playlist_* functions instead of
+    // accessing this directly.
+    struct {
+        struct playlist_entry *parent, *left, *right;
+        int size;
+        uint32_t prio;
+    } node;
 
     uint64_t id;
 
@@ -44,7 +52,7 @@ struct playlist_entry {
     char **redirects;
     int num_redirects;
 
-    // Used for unshuffling: the pl_index before it was shuffled. -1 => unknown.
+    // Used for unshuffling: the index before it was shuffled. -1 => unknown.
     int original_index;
 
     // Set to true if playback didn't seem to work, or if the file could be
@@ -64,8 +72,26 @@ struct playlist_entry {
     int stream_flags;
 };
 
+enum playlist_change_type {
+    PLAYLIST_CHANGE_INSERT,     // count entries inserted at index
+    PLAYLIST_CHANGE_REMOVE,     // count entries removed at index
+    PLAYLIST_CHANGE_MOVE,       // entry at index moved to index to
+    PLAYLIST_CHANGE_UPDATE,     // entry at index changed (e.g. its title)
+    PLAYLIST_CHANGE_RESET,      // anything could have changed (e.g. shuffle)
+};
+
+struct playlist_change {
+    uint64_t serial;            // pl->change_serial after this change
+    enum playlist_change_type type;
+    int index, count, to;
+};
+
+// Number of most recent changes remembered in struct playlist.changes.
+#define PLAYLIST_MAX_CHANGES 64
+
 struct playlist {
-    struct playlist_entry **entries;
+    // Root of the entry tree (see playlist_entry.node).
+    struct playlist_entry *root;
     int num_entries;
 
     // This provides some sort of stable iterator. If this entry is removed from
@@ -75,6 +101,12 @@ struct playlist {
     bool current_was_replaced;
 
     uint64_t id_alloc;
+
+    // Ring buffer of the last changes. A change with serial S is stored at
+    // changes[S % PLAYLIST_MAX_CHANGES]. Serials start at 1 and increase
+    // without gaps; change_serial is the serial of the last change.
+    struct playlist_change changes[PLAYLIST_MAX_CHANGES];
+    uint64_t change_serial;
 };
 
 void playlist_entry_add_param(struct playlist_entry *e, bstr name, bstr value);
@@ -106,6 +138,8 @@ void playlist_set_stream_flags(struct playlist *pl, int flags);
 int64_t playlist_transfer_entries(struct playlist *pl, struct playlist *source_pl);
 int64_t playlist_append_entries(struct playlist *pl, struct playlist *source_pl);
 
+void playlist_entry_changed(struct playlist *pl, struct playlist_entry *e);
+
 int playlist_entry_to_index(struct playlist *pl, struct playlist_entry *e);
 int playlist_entry_count(struct playlist *pl);
 struct playlist_entry *playlist_entry_from_index(struct playlist *pl, int index);
@@ -82,6 +82,11 @@ static int64_t get_thread_cpu_time_ns(pthread_t thread)
     return 0;
 }
 
+int64_t stats_thread_cpu_time_ns(void)
+{
+    return get_thread_cpu_time_ns(pthread_self());
+}
+
 static void stats_destroy(void *p)
 {
     struct stats_base *stats = p;
@@ -309,6 +314,19 @@ void stats_time_end(struct stats_ctx *ctx, const char *name)
     pthread_mutex_unlock(&ctx->base->lock);
 }
 
+void stats_time_add(struct stats_ctx *ctx, const char *name, int64_t wall_us,
+                    int64_t cpu_ns)
+{
+    if (!IS_ACTIVE(ctx))
+        return;
+    pthread_mutex_lock(&ctx->base->lock);
+    struct stat_entry *e = find_entry(ctx, name);
+    e->type = VAL_TIME;
+    e->val_rt += wall_us;
+    e->val_th += cpu_ns;
+    pthread_mutex_unlock(&ctx->base->lock);
+}
+
 void stats_event(struct stats_ctx *ctx, const char *name)
 {
     if (!IS_ACTIVE(ctx))
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 struct mpv_global;
 struct mpv_node;
 struct stats_ctx;
@@ -22,6 +24,11 @@ void stats_size_value(struct stats_ctx *ctx, const char *name, double val);
 void stats_time_start(struct stats_ctx *ctx, const char *name);
 void stats_time_end(struct stats_ctx *ctx, const char *name);
 
+// Like stats_time_start()/stats_time_end(), for a time span the caller
+// measured itself (real time in microseconds, CPU time in nanoseconds).
+void stats_time_add(struct stats_ctx *ctx, const char *name, int64_t wall_us,
+                    int64_t cpu_ns);
+
 // Display number of events per poll period.
 void stats_event(struct stats_ctx *ctx, const char *name);
 
@@ -32,3 +39,6 @@ void stats_register_thread_cputime(struct stats_ctx *ctx, const char *name);
 
 // Remove reference to pthread_self().
 void stats_unregister_thread(struct stats_ctx *ctx, const char *name);
+
+// CPU time used by the calling thread in nanoseconds, or 0 if unsupported.
+int64_t stats_thread_cpu_time_ns(void);
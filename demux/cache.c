@@ -18,10 +18,19 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "config.h"
+
+#if HAVE_POSIX
+#include <sys/mman.h>
+#endif
+
+#include <libavutil/buffer.h>
+
 #include "cache.h"
 #include "common/msg.h"
 #include "common/av_common.h"
@@ -29,11 +38,13 @@
 #include "options/path.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "osdep/atomic.h"
 #include "osdep/io.h"
 
 struct demux_cache_opts {
     char *cache_dir;
     int unlink_files;
+    bool use_mmap;
 };
 
 #define OPT_BASE_STRUCT struct demux_cache_opts
@@ -44,6 +55,7 @@ const struct m_sub_options demux_cache_conf = {
         {"cache-unlink-files", OPT_CHOICE(unlink_files,
             {"immediate", 2}, {"whendone", 1}, {"no", 0}),
         },
+        {"cache-mmap", OPT_BOOL(use_mmap)},
         {0}
     },
     .size = sizeof(struct demux_cache_opts),
@@ -52,6 +64,17 @@ const struct m_sub_options demux_cache_conf = {
     },
 };
 
+// Size of a single mapping of the cache file. Packets which cross the boundary
+// between two windows are read with the normal read() path instead.
+#define MAP_WINDOW_SIZE (64 * 1024 * 1024)
+
+struct map_window {
+    // 1 reference for demux_cache.windows, plus 1 for each AVBufferRef
+    // pointing into the mapping.
+    atomic_int refcount;
+    void *ptr;
+};
+
 struct demux_cache {
     struct mp_log *log;
     struct demux_cache_opts *opts;
@@ -61,6 +84,15 @@ struct demux_cache {
     int fd;
     int64_t file_pos;
     uint64_t file_size;
+
+    // If mapping is used, this is AV_INPUT_BUFFER_PADDING_SIZE: each packet's
+    // payload is followed by zeroed padding in the file, so the mapped payload
+    // can be passed to decoders directly.
+    int data_padding;
+    bool use_mmap;
+    bool mmap_failed;
+    struct map_window **windows; // indexed by file offset / MAP_WINDOW_SIZE
+    int num_windows;
 };
 
 struct pkt_header {
@@ -74,10 +106,25 @@ struct sd_header {
     uint32_t len;
 };
 
+static void window_unref(struct map_window *w)
+{
+    if (w && atomic_fetch_add(&w->refcount, -1) == 1) {
+#if HAVE_POSIX
+        munmap(w->ptr, MAP_WINDOW_SIZE);
+#endif
+        talloc_free(w);
+    }
+}
+
 static void cache_destroy(void *p)
 {
     struct demux_cache *cache = p;
 
+    // Packets returned by demux_cache_read() may keep some windows mapped
+    // after this (the mappings stay valid even if the fd is closed).
+    for (int n = 0; n < cache->num_windows; n++)
+        window_unref(cache->windows[n]);
+
     if (cache->fd >= 0)
         close(cache->fd);
 
@@ -125,6 +172,13 @@ struct demux_cache *demux_cache_create(struct mpv_global *global,
         }
     }
 
+#if HAVE_POSIX
+    if (cache->opts->use_mmap) {
+        cache->use_mmap = true;
+        cache->data_padding = AV_INPUT_BUFFER_PADDING_SIZE;
+    }
+#endif
+
     return cache;
 fail:
     talloc_free(cache);
@@ -234,6 +288,12 @@ int64_t demux_cache_write(struct demux_cache *cache, struct demux_packet *dp)
     if (!write_raw(cache, dp->buffer, dp->len))
         goto fail;
 
+    if (cache->data_padding) {
+        static const uint8_t zeros[AV_INPUT_BUFFER_PADDING_SIZE];
+        if (!write_raw(cache, (void *)zeros, cache->data_padding))
+            goto fail;
+    }
+
     // The handling of FFmpeg side data requires an extra long comment to
     // explain why this code is fragile and insane.
     // FFmpeg packet side data is per-packet out of band data, that contains
@@ -281,8 +341,127 @@ fail:
     return -1;
 }
 
+#if HAVE_POSIX
+
+// Return a pointer to the file contents at [pos, pos + len), or NULL if the
+// range is not within a single window, or if mapping fails.
+static void *map_range(struct demux_cache *cache, uint64_t pos, uint64_t len,
+                       struct map_window **out_w)
+{
+    if (cache->mmap_failed || pos + len > cache->file_size)
+        return NULL;
+
+    uint64_t idx = pos / MAP_WINDOW_SIZE;
+    if ((pos + MPMAX(len, 1) - 1) / MAP_WINDOW_SIZE != idx || idx >= INT_MAX)
+        return NULL;
+
+    while (cache->num_windows <= idx)
+        MP_TARRAY_APPEND(cache, cache->windows, cache->num_windows, NULL);
+
+    struct map_window *w = cache->windows[idx];
+    if (!w) {
+        // Mapping past the end of the file is fine, as long as we don't
+        // access the pages before the file was extended.
+        void *ptr = mmap(NULL, MAP_WINDOW_SIZE, PROT_READ, MAP_SHARED,
+                         cache->fd, idx * MAP_WINDOW_SIZE);
+        if (ptr == MAP_FAILED) {
+            MP_WARN(cache, "Failed to map cache file: %s\n", mp_strerror(errno));
+            cache->mmap_failed = true;
+            return NULL;
+        }
+        w = talloc_zero(NULL, struct map_window);
+        atomic_store(&w->refcount, 1);
+        w->ptr = ptr;
+        cache->windows[idx] = w;
+    }
+
+    if (out_w)
+        *out_w = w;
+    return (uint8_t *)w->ptr + (pos - idx * MAP_WINDOW_SIZE);
+}
+
+static void free_mapped_buffer(void *opaque, uint8_t *data)
+{
+    window_unref(opaque);
+}
+
+// Return a packet referencing the mapped cache file, without copying the
+// payload. Returns NULL if this is not possible (the caller falls back to
+// reading the packet).
+static struct demux_packet *read_mapped(struct demux_cache *cache, uint64_t pos)
+{
+    struct pkt_header hd;
+    void *p = map_range(cache, pos, sizeof(hd), NULL);
+    if (!p)
+        return NULL;
+    memcpy(&hd, p, sizeof(hd));
+    pos += sizeof(hd);
+
+    if (hd.data_len > INT_MAX)
+        return NULL;
+
+    struct map_window *w = NULL;
+    uint8_t *data = map_range(cache, pos, hd.data_len + cache->data_padding, &w);
+    if (!data)
+        return NULL;
+    pos += hd.data_len + cache->data_padding;
+
+    atomic_fetch_add(&w->refcount, 1);
+    AVBufferRef *buf = av_buffer_create(data, hd.data_len, free_mapped_buffer,
+                                        w, AV_BUFFER_FLAG_READONLY);
+    if (!buf) {
+        window_unref(w);
+        return NULL;
+    }
+    struct demux_packet *dp = new_demux_packet_from_buf(buf);
+    av_buffer_unref(&buf);
+    if (!dp)
+        return NULL;
+
+    dp->avpacket->flags = hd.av_flags;
+
+    for (uint32_t n = 0; n < hd.num_sd; n++) {
+        struct sd_header sd_hd;
+        p = map_range(cache, pos, sizeof(sd_hd), NULL);
+        if (!p)
+            goto fail;
+        memcpy(&sd_hd, p, sizeof(sd_hd));
+        pos += sizeof(sd_hd);
+
+        if (sd_hd.len > INT_MAX)
+            goto fail;
+
+        p = map_range(cache, pos, sd_hd.len, NULL);
+        if (!p)
+            goto fail;
+        pos += sd_hd.len;
+
+        uint8_t *sd = av_packet_new_side_data(dp->avpacket, sd_hd.av_type,
+                                              sd_hd.len);
+        if (!sd)
+            goto fail;
+        memcpy(sd, p, sd_hd.len);
+    }
+
+    return dp;
+
+fail:
+    talloc_free(dp);
+    return NULL;
+}
+
+#endif
+
 struct demux_packet *demux_cache_read(struct demux_cache *cache, uint64_t pos)
 {
+#if HAVE_POSIX
+    if (cache->use_mmap) {
+        struct demux_packet *dp = read_mapped(cache, pos);
+        if (dp)
+            return dp;
+    }
+#endif
+
     if (!do_seek(cache, pos))
         return NULL;
 
@@ -301,6 +480,10 @@ struct demux_packet *demux_cache_read(struct demux_cache *cache, uint64_t pos)
     if (!read_raw(cache, dp->buffer, dp->len))
         goto fail;
 
+    if (cache->data_padding &&
+        !do_seek(cache, cache->file_pos + cache->data_padding))
+        goto fail;
+
     dp->avpacket->flags = hd.av_flags;
 
     for (uint32_t n = 0; n < hd.num_sd; n++) {
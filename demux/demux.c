@@ -216,6 +216,7 @@ struct demux_internal {
     bool hyst_active;
     size_t max_bytes;
     size_t max_bytes_bw;
+    double max_bytes_share;     // fraction of --demuxer-max-bytes to use
     bool seekable_cache;
     bool using_network_cache_opts;
     char *record_filename;
@@ -263,6 +264,9 @@ struct demux_internal {
     int num_ranges;
 
     size_t total_bytes;         // total sum of packet data buffered
+
+    // Memory used by the packet arenas of all ranges.
+    struct demux_packet_arena_stats packet_arena_stats;
     // Range from which decoder is reading, and to which demuxer is appending.
     // This is normally never NULL. This is always ranges[num_ranges - 1].
     // This is can be NULL during initialization or deinitialization.
@@ -322,6 +326,10 @@ struct demux_cached_range {
 
     struct timed_metadata **metadata;
     int num_metadata;
+
+    // Storage for small packets added to this range (lazily created). Packets
+    // moved to other ranges keep referencing it.
+    struct demux_packet_arena *arena;
 };
 
 #define QUEUE_INDEX_SIZE_MASK(queue) ((queue)->index_size - 1)
@@ -468,6 +476,7 @@ static void find_backward_restart_pos(struct demux_stream *ds);
 static struct demux_packet *find_seek_target(struct demux_queue *queue,
                                              double pts, int flags);
 static void prune_old_packets(struct demux_internal *in);
+static void update_opts(struct demux_internal *in);
 static void dumper_close(struct demux_internal *in);
 static void demux_convert_tags_charset(struct demuxer *demuxer);
 
@@ -1257,6 +1266,23 @@ void demux_start_prefetch(struct demuxer *demuxer)
     pthread_mutex_unlock(&in->lock);
 }
 
+// Limit the forward cache of this demuxer to the given fraction of
+// --demuxer-max-bytes (1.0 for no additional limit). Used to bound the
+// memory used by a prefetched playlist entry while another file is playing.
+void demux_set_max_bytes_share(struct demuxer *demuxer, double share)
+{
+    struct demux_internal *in = demuxer->in;
+    assert(demuxer == in->d_user);
+
+    pthread_mutex_lock(&in->lock);
+    if (in->max_bytes_share != share) {
+        in->max_bytes_share = share;
+        update_opts(in);
+        pthread_cond_signal(&in->wakeup);
+    }
+    pthread_mutex_unlock(&in->lock);
+}
+
 const char *stream_type_name(enum stream_type type)
 {
     switch (type) {
@@ -2079,6 +2105,15 @@ static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp)
         }
     }
 
+    if (!dp->is_cached) {
+        struct demux_cached_range *range = queue->range;
+        if (!range->arena) {
+            range->arena =
+                demux_packet_arena_create(range, &in->packet_arena_stats);
+        }
+        demux_packet_arena_store(range->arena, dp);
+    }
+
     queue->correct_pos &= dp->pos >= 0 && dp->pos > queue->last_pos;
     queue->correct_dts &= dp->dts != MP_NOPTS_VALUE && dp->dts > queue->last_dts;
     queue->last_pos = dp->pos;
@@ -2476,7 +2511,7 @@ static void update_opts(struct demux_internal *in)
 
     in->min_secs = opts->min_secs;
     in->hyst_secs = opts->hyst_secs;
-    in->max_bytes = opts->max_bytes;
+    in->max_bytes = MPMAX(opts->max_bytes * in->max_bytes_share, 1);
     in->max_bytes_bw = opts->max_bytes_bw;
 
     int seekable = opts->seekable_cache;
@@ -3309,6 +3344,7 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .stats = stats_ctx_create(in, global, "demuxer"),
         .can_cache = params && params->is_top_level,
         .can_record = params && params->stream_record,
+        .max_bytes_share = 1.0,
         .opts = opts,
         .opts_cache = opts_cache,
         .d_thread = talloc(demuxer, struct demuxer),
@@ -4510,6 +4546,9 @@ void demux_get_reader_state(struct demuxer *demuxer, struct demux_reader_state *
         .bytes_per_second = in->bytes_per_second,
         .byte_level_seeks = in->byte_level_seeks,
         .file_cache_bytes = in->cache ? demux_cache_get_size(in->cache) : -1,
+        .packet_arena_bytes = in->packet_arena_stats.alloc_bytes,
+        .packet_arena_used_bytes = in->packet_arena_stats.used_bytes,
+        .packet_arena_packets = in->packet_arena_stats.num_packets,
     };
     bool any_packets = false;
     for (int n = 0; n < in->num_streams; n++) {
@@ -45,6 +45,9 @@ struct demux_reader_state {
     int64_t total_bytes;
     int64_t fw_bytes;
     int64_t file_cache_bytes;
+    uint64_t packet_arena_bytes; // memory allocated for packet arenas
+    uint64_t packet_arena_used_bytes; // part of it used by live packets
+    uint64_t packet_arena_packets; // number of packets stored in arenas
     double seeking; // current low level seek target, or NOPTS
     int low_level_seeks; // number of started low level seeks
     uint64_t byte_level_seeks; // number of byte stream level seeks
@@ -276,6 +279,7 @@ void demux_start_thread(struct demuxer *demuxer);
 void demux_stop_thread(struct demuxer *demuxer);
 void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *ctx);
 void demux_start_prefetch(struct demuxer *demuxer);
+void demux_set_max_bytes_share(struct demuxer *demuxer, double share);
 
 bool demux_cancel_test(struct demuxer *demuxer);
 
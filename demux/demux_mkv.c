@@ -27,11 +27,13 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include <libavutil/common.h>
 #include <libavutil/lzo.h>
 #include <libavutil/intreadwrite.h>
 #include <libavutil/avstring.h>
+#include <libavutil/sha.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavcodec/version.h>
@@ -46,7 +48,9 @@
 #include "common/av_common.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
+#include "options/path.h"
 #include "misc/bstr.h"
+#include "osdep/io.h"
 #include "stream/stream.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
@@ -188,6 +192,11 @@ typedef struct mkv_demuxer {
     bool index_complete;
     int index_mode;
 
+    // File name for --demuxer-mkv-index-cache, or NULL if not used.
+    char *index_cache_file;
+    // Number of entries loaded from the cache file.
+    size_t num_cached_indexes;
+
     int edition_id;
 
     struct header_elem {
@@ -225,6 +234,8 @@ struct demux_mkv_opts {
     double subtitle_preroll_secs_index;
     int probe_duration;
     bool probe_start_time;
+    bool index_cache;
+    char *index_cache_dir;
 };
 
 const struct m_sub_options demux_mkv_conf = {
@@ -238,6 +249,8 @@ const struct m_sub_options demux_mkv_conf = {
         {"probe-video-duration", OPT_CHOICE(probe_duration,
             {"no", 0}, {"yes", 1}, {"full", 2})},
         {"probe-start-time", OPT_BOOL(probe_start_time)},
+        {"index-cache", OPT_BOOL(index_cache)},
+        {"index-cache-dir", OPT_STRING(index_cache_dir), .flags = M_OPT_FILE},
         {0}
     },
     .size = sizeof(struct demux_mkv_opts),
@@ -2036,6 +2049,183 @@ static int read_mkv_segment_header(demuxer_t *demuxer, int64_t *segment_end)
     return 0;
 }
 
+#define INDEX_CACHE_HEADER "mpv mkv index v1\n"
+// segment_start, segment_end, tc_scale, index_has_durations, entry count
+#define INDEX_CACHE_INFO_SIZE (8 + 8 + 8 + 1 + 8)
+// tnum, timecode, duration, filepos
+#define INDEX_CACHE_ENTRY_SIZE (4 + 8 + 8 + 8)
+
+// Set mkv_d->index_cache_file to the cache file for the opened file. The name
+// is a hash of the absolute path, the file size, and the modification time, so
+// changed files don't use stale entries.
+static void init_index_cache(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    struct stream *s = demuxer->stream;
+
+    if (!mkv_d->opts->index_cache || mkv_d->index_mode != 1 ||
+        !s->is_local_file || !s->path)
+        return;
+
+    void *tmp = talloc_new(NULL);
+
+    char *path = s->path;
+    if (!mp_path_is_absolute(bstr0(path))) {
+        char *cwd = mp_getcwd(tmp);
+        if (!cwd)
+            goto done;
+        path = mp_path_join(tmp, cwd, path);
+    }
+
+    struct stat st;
+    if (stat(path, &st))
+        goto done;
+
+    char *key = talloc_asprintf(tmp, "%s\n%"PRId64"\n%"PRId64"\n", path,
+                                (int64_t)st.st_size, (int64_t)st.st_mtime);
+
+    struct AVSHA *sha = av_sha_alloc();
+    MP_HANDLE_OOM(sha);
+    av_sha_init(sha, 256);
+    av_sha_update(sha, key, strlen(key));
+    uint8_t hash[256 / 8];
+    av_sha_final(sha, hash);
+    av_free(sha);
+
+    char hashstr[256 / 8 * 2 + 1];
+    for (int n = 0; n < 256 / 8; n++)
+        snprintf(hashstr + n * 2, sizeof(hashstr) - n * 2, "%02X", hash[n]);
+
+    char *dir = mkv_d->opts->index_cache_dir;
+    if (dir && dir[0]) {
+        dir = mp_get_user_path(tmp, demuxer->global, dir);
+    } else {
+        dir = mp_find_user_file(tmp, demuxer->global, "cache", "mkv-index");
+    }
+    if (dir && dir[0])
+        mkv_d->index_cache_file = mp_path_join(mkv_d, dir, hashstr);
+
+done:
+    talloc_free(tmp);
+}
+
+// Load the index entries from the cache file (if any). Must be called before
+// any entries are added.
+static void load_index_cache(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    char *fname = mkv_d->index_cache_file;
+
+    if (!fname || mkv_d->num_indexes || !mp_path_exists(fname))
+        return;
+
+    void *tmp = talloc_new(NULL);
+    bstr data = stream_read_file(fname, tmp, demuxer->global, 1000000000);
+    if (!bstr_eatstart0(&data, INDEX_CACHE_HEADER) ||
+        data.len < INDEX_CACHE_INFO_SIZE)
+        goto invalid;
+
+    uint8_t *p = data.start;
+    bool has_durations = p[24];
+    uint64_t count = AV_RL64(p + 25);
+    if (AV_RL64(p) != mkv_d->segment_start ||
+        AV_RL64(p + 8) != mkv_d->segment_end ||
+        (int64_t)AV_RL64(p + 16) != mkv_d->tc_scale ||
+        count > (data.len - INDEX_CACHE_INFO_SIZE) / INDEX_CACHE_ENTRY_SIZE ||
+        data.len != INDEX_CACHE_INFO_SIZE + count * INDEX_CACHE_ENTRY_SIZE)
+        goto invalid;
+    p += INDEX_CACHE_INFO_SIZE;
+
+    int64_t size = stream_get_size(demuxer->stream);
+    for (uint64_t n = 0; n < count; n++) {
+        uint8_t *e = p + n * INDEX_CACHE_ENTRY_SIZE;
+        uint64_t filepos = AV_RL64(e + 20);
+        if (filepos < mkv_d->segment_start || (size >= 0 && filepos >= size)) {
+            mkv_d->num_indexes = 0;
+            goto invalid;
+        }
+        cue_index_add(demuxer, (int32_t)AV_RL32(e), filepos,
+                      (int64_t)AV_RL64(e + 4), (int64_t)AV_RL64(e + 12));
+    }
+
+    // The entries were written in the order they were added, so the last
+    // entry of each track is its highest one.
+    for (int n = 0; n < mkv_d->num_tracks; n++) {
+        struct mkv_track *track = mkv_d->tracks[n];
+        for (size_t i = 0; i < mkv_d->num_indexes; i++) {
+            if (mkv_d->indexes[i].tnum == track->tnum)
+                track->last_index_entry = i;
+        }
+    }
+    mkv_d->index_has_durations = has_durations;
+    mkv_d->num_cached_indexes = mkv_d->num_indexes;
+
+    MP_VERBOSE(demuxer, "Loaded %zu index entries from '%s'.\n",
+               mkv_d->num_indexes, fname);
+    talloc_free(tmp);
+    return;
+
+invalid:
+    MP_WARN(demuxer, "Ignoring invalid index cache file '%s'.\n", fname);
+    talloc_free(tmp);
+}
+
+// Write the incrementally created index to the cache file, if it contains
+// more than what was loaded.
+static void save_index_cache(struct demuxer *demuxer)
+{
+    struct mkv_demuxer *mkv_d = demuxer->priv;
+    char *fname = mkv_d->index_cache_file;
+
+    if (!fname || mkv_d->index_complete ||
+        mkv_d->num_indexes <= mkv_d->num_cached_indexes)
+        return;
+
+    // Don't cache anything if the file has Cues that were never read.
+    for (int n = 0; n < mkv_d->num_headers; n++) {
+        struct header_elem *elem = &mkv_d->headers[n];
+        if (elem->id == MATROSKA_ID_CUES && !elem->parsed)
+            return;
+    }
+
+    size_t size = INDEX_CACHE_INFO_SIZE +
+                  mkv_d->num_indexes * INDEX_CACHE_ENTRY_SIZE;
+    uint8_t *data = talloc_size(NULL, size);
+    AV_WL64(data, mkv_d->segment_start);
+    AV_WL64(data + 8, mkv_d->segment_end);
+    AV_WL64(data + 16, mkv_d->tc_scale);
+    data[24] = mkv_d->index_has_durations;
+    AV_WL64(data + 25, mkv_d->num_indexes);
+    for (size_t n = 0; n < mkv_d->num_indexes; n++) {
+        mkv_index_t *index = &mkv_d->indexes[n];
+        uint8_t *e = data + INDEX_CACHE_INFO_SIZE + n * INDEX_CACHE_ENTRY_SIZE;
+        AV_WL32(e, index->tnum);
+        AV_WL64(e + 4, index->timecode);
+        AV_WL64(e + 12, index->duration);
+        AV_WL64(e + 20, index->filepos);
+    }
+
+    char *dir = bstrto0(data, mp_dirname(fname));
+    mp_mkdirp(dir);
+
+    MP_VERBOSE(demuxer, "Writing %zu index entries to '%s'.\n",
+               mkv_d->num_indexes, fname);
+    FILE *out = fopen(fname, "wb");
+    if (out) {
+        bool ok = fwrite(INDEX_CACHE_HEADER, strlen(INDEX_CACHE_HEADER), 1,
+                         out) == 1;
+        ok &= fwrite(data, size, 1, out) == 1;
+        ok &= fclose(out) == 0;
+        // A truncated file would be rejected when loading it anyway.
+        if (!ok)
+            unlink(fname);
+    } else {
+        MP_WARN(demuxer, "Could not write index cache file '%s'.\n", fname);
+    }
+
+    talloc_free(data);
+}
+
 static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
 {
     stream_t *s = demuxer->stream;
@@ -2152,6 +2342,9 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
 
     MP_VERBOSE(demuxer, "All headers are parsed!\n");
 
+    init_index_cache(demuxer);
+    load_index_cache(demuxer);
+
     display_create_tracks(demuxer);
     add_coverart(demuxer);
     process_tags(demuxer);
@@ -2600,11 +2793,18 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
     /* time (relative to cluster time) */
     if (stream_tell(s) + 3 > endpos)
         goto exit;
-    uint8_t c1 = stream_read_char(s);
-    uint8_t c2 = stream_read_char(s);
-    time = c1 << 8 | c2;
-
-    uint8_t header_flags = stream_read_char(s);
+    uint8_t header_flags;
+    uint8_t *p = stream_peek_buffered(s, 3);
+    if (p) {
+        time = AV_RB16(p);
+        header_flags = p[2];
+        stream_skip_buffered(s, 3);
+    } else {
+        uint8_t c1 = stream_read_char(s);
+        uint8_t c2 = stream_read_char(s);
+        time = c1 << 8 | c2;
+        header_flags = stream_read_char(s);
+    }
 
     block->filepos = stream_tell(s);
 
@@ -3275,6 +3475,7 @@ static void mkv_free(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     if (!mkv_d)
         return;
+    save_index_cache(demuxer);
     mkv_seek_reset(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
@@ -24,10 +24,12 @@
 #include <stdbool.h>
 #include <inttypes.h>
 #include <stddef.h>
+#include <string.h>
 #include <assert.h>
 
 #include <libavutil/intfloat.h>
 #include <libavutil/common.h>
+#include <libavutil/intreadwrite.h>
 #include "mpv_talloc.h"
 #include "ebml.h"
 #include "stream/stream.h"
@@ -53,6 +55,10 @@ bool ebml_is_mkv_level1_id(uint32_t id)
     }
 }
 
+// The ebml_read_* functions below first try to decode the value directly from
+// the stream buffer. They fall back to reading byte by byte if the buffered
+// data at the current position is too short (e.g. at the end of the buffer).
+
 /*
  * Read: the element content data ID.
  * Return: the ID.
@@ -62,6 +68,17 @@ uint32_t ebml_read_id(stream_t *s)
     int i, len_mask = 0x80;
     uint32_t id;
 
+    uint8_t *p = stream_peek_buffered(s, 4);
+    if (p) {
+        if (p[0] < 0x10) {
+            stream_skip_buffered(s, 1);
+            return EBML_ID_INVALID;
+        }
+        int len = 8 - av_log2(p[0]);
+        stream_skip_buffered(s, len);
+        return AV_RB32(p) >> (32 - 8 * len);
+    }
+
     for (i = 0, id = stream_read_char(s); i < 4 && !(id & len_mask); i++)
         len_mask >>= 1;
     if (i >= 4)
@@ -79,6 +96,20 @@ uint64_t ebml_read_length(stream_t *s)
     int i, j, num_ffs = 0, len_mask = 0x80;
     uint64_t len;
 
+    uint8_t *p = stream_peek_buffered(s, 8);
+    if (p) {
+        if (!p[0]) {
+            stream_skip_buffered(s, 1);
+            return EBML_UINT_INVALID;
+        }
+        int size = 8 - av_log2(p[0]);
+        uint64_t mask = (UINT64_C(1) << (7 * size)) - 1;
+        stream_skip_buffered(s, size);
+        len = (AV_RB64(p) >> (64 - 8 * size)) & mask;
+        // All value bits set means "unknown length".
+        return len == mask ? EBML_UINT_INVALID : len;
+    }
+
     for (i = 0, len = stream_read_char(s); i < 8 && !(len & len_mask); i++)
         len_mask >>= 1;
     if (i >= 8)
@@ -128,6 +159,12 @@ uint64_t ebml_read_uint(stream_t *s)
     if (len == EBML_UINT_INVALID || len > 8)
         return EBML_UINT_INVALID;
 
+    uint8_t *p = stream_peek_buffered(s, 8);
+    if (p) {
+        stream_skip_buffered(s, len);
+        return len ? AV_RB64(p) >> (64 - 8 * len) : 0;
+    }
+
     while (len--)
         value = (value << 8) | stream_read_char(s);
 
@@ -149,6 +186,15 @@ int64_t ebml_read_int(stream_t *s)
     if (!len)
         return 0;
 
+    uint8_t *p = stream_peek_buffered(s, 8);
+    if (p) {
+        stream_skip_buffered(s, len);
+        value = AV_RB64(p) >> (64 - 8 * len);
+        if (len < 8 && (value >> (8 * len - 1)) & 1)
+            value |= UINT64_MAX << (8 * len); // sign extension
+        return (int64_t)value; // assume complement of 2
+    }
+
     len--;
     l = stream_read_char(s);
     if (l & 0x80)
@@ -208,6 +254,27 @@ int ebml_resync_cluster(struct mp_log *log, stream_t *s)
             stream_seek(s, pos - 4);
             return 0;
         }
+        // Search the buffered data in bulk, unless the previously read bytes
+        // could be the start of the ID. The last 3 bytes are never skipped,
+        // so an ID crossing the end of the buffer is found bytewise.
+        if (stream_peek_buffered(s, 8) && (last_4_bytes & 0xFF) != 0x1F &&
+            (last_4_bytes & 0xFFFF) != 0x1F43 &&
+            (last_4_bytes & 0xFFFFFF) != 0x1F43B6)
+        {
+            int avail;
+            uint8_t *p = stream_get_buffered(s, &avail);
+            int skip = avail - 3;
+            for (uint8_t *c = p; (c = memchr(c, 0x1F, p + avail - 3 - c)); c++) {
+                if (AV_RB32(c) == MATROSKA_ID_CLUSTER) {
+                    skip = c - p + 4;
+                    break;
+                }
+            }
+            stream_skip_buffered(s, skip);
+            pos += skip;
+            last_4_bytes = AV_RB32(p + skip - 4);
+            continue;
+        }
         last_4_bytes = (last_4_bytes << 8) | stream_read_char(s);
         pos++;
     }
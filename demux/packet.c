@@ -29,6 +29,39 @@
 
 #include "packet.h"
 
+// Size of a single arena block.
+#define ARENA_BLOCK_SIZE (512 * 1024)
+
+// Larger packets are not stored in arenas. Reading a packet from an arena
+// copies it, and the allocation overhead is insignificant for large packets.
+#define ARENA_MAX_PACKET_SIZE (16 * 1024)
+
+struct demux_packet_arena_block {
+    struct demux_packet_arena_stats *stats;
+    size_t refcount;        // 1 per packet, plus 1 for the current block
+    uint32_t size;
+    uint8_t data[];
+};
+
+struct demux_packet_arena {
+    struct demux_packet_arena_stats *stats;
+    struct demux_packet_arena_block *cur;   // block new packets are added to
+    uint32_t cur_pos;
+};
+
+struct arena_sd_header {
+    uint32_t av_type;
+    uint32_t len;
+};
+
+static void arena_block_unref(struct demux_packet_arena_block *block)
+{
+    if (block && --block->refcount == 0) {
+        block->stats->alloc_bytes -= block->size;
+        talloc_free(block);
+    }
+}
+
 // Free any refcounted data dp holds (but don't free dp itself). This does not
 // care about pointers that are _not_ refcounted (like demux_packet.codec).
 // Normally, a user should use talloc_free(dp). This function is only for
@@ -36,11 +69,20 @@
 void demux_packet_unref_contents(struct demux_packet *dp)
 {
     if (dp->avpacket) {
-        assert(!dp->is_cached);
+        assert(!dp->is_cached && !dp->is_arena);
         av_packet_free(&dp->avpacket);
         dp->buffer = NULL;
         dp->len = 0;
     }
+    if (dp->is_arena) {
+        struct demux_packet_arena_block *block = dp->arena_data.block;
+        block->stats->used_bytes -= dp->arena_data.size;
+        block->stats->num_packets -= 1;
+        arena_block_unref(block);
+        dp->is_arena = false;
+        dp->buffer = NULL;
+        dp->len = 0;
+    }
 }
 
 static void packet_destroy(void *ptr)
@@ -167,10 +209,41 @@ void demux_packet_copy_attribs(struct demux_packet *dst, struct demux_packet *sr
     dst->stream = src->stream;
 }
 
+static struct demux_packet *arena_read(struct demux_packet *dp)
+{
+    struct demux_packet *new = new_demux_packet(dp->arena_data.data_len);
+    if (!new)
+        return NULL;
+
+    uint8_t *p = dp->arena_data.block->data + dp->arena_data.offset;
+    memcpy(new->buffer, p, new->len);
+    p += new->len;
+
+    new->avpacket->flags = dp->arena_data.av_flags;
+
+    for (uint32_t n = 0; n < dp->arena_data.num_sd; n++) {
+        struct arena_sd_header hd;
+        memcpy(&hd, p, sizeof(hd));
+        p += sizeof(hd);
+
+        uint8_t *sd = av_packet_new_side_data(new->avpacket, hd.av_type, hd.len);
+        if (!sd) {
+            talloc_free(new);
+            return NULL;
+        }
+        memcpy(sd, p, hd.len);
+        p += hd.len;
+    }
+
+    return new;
+}
+
 struct demux_packet *demux_copy_packet(struct demux_packet *dp)
 {
     struct demux_packet *new = NULL;
-    if (dp->avpacket) {
+    if (dp->is_arena) {
+        new = arena_read(dp);
+    } else if (dp->avpacket) {
         new = new_demux_packet_from_avpacket(dp->avpacket);
     } else {
         // Some packets might be not created by new_demux_packet*().
@@ -197,6 +270,8 @@ size_t demux_packet_estimate_total_size(struct demux_packet *dp)
     size_t size = ROUND_ALLOC(sizeof(struct demux_packet));
     size += 8 * sizeof(void *); // ta  overhead
     size += 10 * sizeof(void *); // additional estimate for ta_ext_header
+    if (dp->is_arena)
+        size += dp->arena_data.size;
     if (dp->avpacket) {
         assert(!dp->is_cached);
         size += ROUND_ALLOC(dp->len);
@@ -242,3 +317,98 @@ int demux_packet_add_blockadditional(struct demux_packet *dp, uint64_t id,
         memcpy(sd + 8, data, size);
     return 0;
 }
+
+static void arena_destroy(void *p)
+{
+    struct demux_packet_arena *arena = p;
+    arena_block_unref(arena->cur);
+}
+
+struct demux_packet_arena *demux_packet_arena_create(void *ta_parent,
+                                    struct demux_packet_arena_stats *stats)
+{
+    struct demux_packet_arena *arena =
+        talloc_zero(ta_parent, struct demux_packet_arena);
+    talloc_set_destructor(arena, arena_destroy);
+    arena->stats = stats;
+    return arena;
+}
+
+// Move the payload and side data of dp into the arena, and free its AVPacket.
+// dp->buffer then points to the (read-only) arena copy of the payload.
+// demux_copy_packet() returns a normal packet with the data again. Returns
+// false and leaves dp unchanged if the packet can't or shouldn't be stored.
+bool demux_packet_arena_store(struct demux_packet_arena *arena,
+                              struct demux_packet *dp)
+{
+    if (!dp->avpacket || dp->is_cached || dp->is_arena)
+        return false;
+
+    // Possibly contains embedded pointers, see demux_cache_write().
+    AVPacket *avpkt = dp->avpacket;
+    if (avpkt->flags & AV_PKT_FLAG_TRUSTED)
+        return false;
+
+    size_t size = dp->len;
+    for (int n = 0; n < avpkt->side_data_elems; n++)
+        size += sizeof(struct arena_sd_header) + avpkt->side_data[n].size;
+    if (size > ARENA_MAX_PACKET_SIZE)
+        return false;
+
+    if (!arena->cur || ARENA_BLOCK_SIZE - arena->cur_pos < size) {
+        struct demux_packet_arena_block *block =
+            talloc_size(NULL, sizeof(*block) + ARENA_BLOCK_SIZE);
+        *block = (struct demux_packet_arena_block){
+            .stats = arena->stats,
+            .refcount = 1,
+            .size = ARENA_BLOCK_SIZE,
+        };
+        arena->stats->alloc_bytes += block->size;
+        arena_block_unref(arena->cur);
+        arena->cur = block;
+        arena->cur_pos = 0;
+    }
+
+    struct demux_packet_arena_block *block = arena->cur;
+    uint32_t offset = arena->cur_pos;
+    uint8_t *p = block->data + offset;
+
+    if (dp->len)
+        memcpy(p, dp->buffer, dp->len);
+    p += dp->len;
+
+    for (int n = 0; n < avpkt->side_data_elems; n++) {
+        AVPacketSideData *sd = &avpkt->side_data[n];
+        struct arena_sd_header hd = {
+            .av_type = sd->type,
+            .len = sd->size,
+        };
+        memcpy(p, &hd, sizeof(hd));
+        p += sizeof(hd);
+        memcpy(p, sd->data, sd->size);
+        p += sd->size;
+    }
+
+    arena->cur_pos += size;
+    block->refcount += 1;
+    arena->stats->used_bytes += size;
+    arena->stats->num_packets += 1;
+
+    uint32_t data_len = dp->len;
+    uint32_t num_sd = avpkt->side_data_elems;
+    int av_flags = avpkt->flags;
+
+    av_packet_free(&dp->avpacket);
+    // Keep buffer/len usable for logging and size checks. The block stays
+    // alive as long as dp references it.
+    dp->buffer = block->data + offset;
+    dp->len = data_len;
+    dp->is_arena = true;
+    dp->arena_data.block = block;
+    dp->arena_data.offset = offset;
+    dp->arena_data.size = size;
+    dp->arena_data.data_len = data_len;
+    dp->arena_data.num_sd = num_sd;
+    dp->arena_data.av_flags = av_flags;
+    return true;
+}
@@ -40,6 +40,16 @@ typedef struct demux_packet {
         struct {
             uint64_t pos;
         } cached_data;
+
+        // Used if is_arena==true, see demux_packet_arena_store().
+        struct {
+            struct demux_packet_arena_block *block;
+            uint32_t offset;    // start of the serialized packet in the block
+            uint32_t size;      // total serialized size (data + side data)
+            uint32_t data_len;  // payload size
+            uint32_t num_sd;    // number of side data entries
+            int av_flags;
+        } arena_data;
     };
 
     int stream;         // source stream index (typically sh_stream.index)
@@ -53,6 +63,10 @@ typedef struct demux_packet {
     // If true, cached_data is valid, while buffer/len are not.
     bool is_cached : 1;
 
+    // If true, arena_data is valid, and buffer/len point to the payload in the
+    // arena block. The data must not be modified.
+    bool is_arena : 1;
+
     // segmentation (ordered chapters, EDL)
     bool segmented;
     struct mp_codec_params *codec;  // set to non-NULL iff segmented is set
@@ -83,4 +97,22 @@ int demux_packet_add_blockadditional(struct demux_packet *dp, uint64_t id,
 
 void demux_packet_unref_contents(struct demux_packet *dp);
 
+// Memory usage of all arenas sharing this struct.
+struct demux_packet_arena_stats {
+    uint64_t alloc_bytes;   // size of all allocated blocks
+    uint64_t used_bytes;    // data still referenced by packets
+    uint64_t num_packets;   // number of packets stored in the blocks
+};
+
+// Packet arenas store the payload and side data of many small packets in
+// large shared blocks, instead of allocating an AVPacket, AVBufferRef, AVBuffer
+// and the data buffer separately for each packet. A block is freed when the
+// last packet stored in it is freed. Not thread-safe: all packets stored in
+// an arena, and the arena itself, must be freed under the same lock.
+struct demux_packet_arena;
+struct demux_packet_arena *demux_packet_arena_create(void *ta_parent,
+                                    struct demux_packet_arena_stats *stats);
+bool demux_packet_arena_store(struct demux_packet_arena *arena,
+                              struct demux_packet *dp);
+
 #endif /* MPLAYER_DEMUX_PACKET_H */
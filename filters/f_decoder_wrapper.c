@@ -39,6 +39,7 @@
 #include "common/codecs.h"
 #include "common/global.h"
 #include "common/recorder.h"
+#include "common/stats.h"
 #include "misc/dispatch.h"
 
 #include "audio/aframe.h"
@@ -1226,6 +1227,16 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
                                &decf_filter);
     p->decf->priv = p;
     p->decf->log = public_f->log = p->log;
+    // Decoding time, as "ad/<filter>" or "vd/<filter>". The actual decoder
+    // filter is created later as child of decf, and inherits this.
+    struct stats_ctx *stats = stats_ctx_create(p->decf, public_f->global,
+        p->header->type == STREAM_VIDEO ? "vd" : "ad");
+    mp_filter_set_stats(p->decf, stats);
+    if (p->header->type == STREAM_AUDIO) {
+        struct mp_aframe_pool *pool = mp_aframe_pool_create(p->decf);
+        mp_aframe_pool_set_stats(pool, stats);
+        mp_filter_set_aframe_pool(p->decf, pool);
+    }
     mp_filter_add_pin(p->decf, MP_PIN_OUT, "out");
 
     struct mp_filter *demux = mp_demux_in_create(p->decf, p->header);
@@ -936,6 +936,39 @@ struct mp_lavfi *mp_lavfi_create_filter(struct mp_filter *parent,
     return do_init(c);
 }
 
+int mp_lavfi_get_graph_stats(struct mp_filter *f, void *ta_parent,
+                             struct mp_lavfi_filter_stats **out)
+{
+    *out = NULL;
+    if (mp_filter_get_info(f) != &lavfi_filter)
+        return -1;
+
+    struct lavfi *c = f->priv;
+    int num = 0;
+    if (!c->graph)
+        return 0;
+
+    for (int n = 0; n < c->graph->nb_filters; n++) {
+        AVFilterContext *filter = c->graph->filters[n];
+        struct mp_lavfi_filter_stats st = {
+            .name = talloc_strdup(ta_parent, filter->name),
+            .filter = talloc_strdup(ta_parent, filter->filter->name),
+            .frames_in = -1,
+            .frames_out = -1,
+        };
+#if LIBAVFILTER_VERSION_MAJOR < 10
+        // The link frame counts were made private in later versions.
+        st.frames_in = st.frames_out = 0;
+        for (int i = 0; i < filter->nb_inputs; i++)
+            st.frames_in += filter->inputs[i]->frame_count_out;
+        for (int i = 0; i < filter->nb_outputs; i++)
+            st.frames_out += filter->outputs[i]->frame_count_in;
+#endif
+        MP_TARRAY_APPEND(ta_parent, *out, num, st);
+    }
+    return num;
+}
+
 struct lavfi_user_opts {
     bool is_bridge;
     enum mp_frame_type type;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "frame.h"
 
 // A wrapped libavfilter filter or filter graph.
@@ -31,6 +33,19 @@ struct mp_lavfi *mp_lavfi_create_filter(struct mp_filter *parent,
                                         char **graph_opts,
                                         const char *filter, char **filter_opts);
 
+struct mp_lavfi_filter_stats {
+    char *name;         // filter instance name within the graph
+    char *filter;       // libavfilter filter name
+    int64_t frames_in;  // frames consumed on all inputs (-1 if unknown)
+    int64_t frames_out; // frames produced on all outputs (-1 if unknown)
+};
+
+// If f is a filter created by mp_lavfi_create_graph/_filter(), return the
+// filters of its current libavfilter graph (0 if not created yet). *out is
+// allocated under ta_parent. Returns -1 if f is not such a filter.
+int mp_lavfi_get_graph_stats(struct mp_filter *f, void *ta_parent,
+                             struct mp_lavfi_filter_stats **out);
+
 // Print libavfilter list for --vf/--af
 void print_lavfi_help_list(struct mp_log *log, int media_type);
 
@@ -1,6 +1,7 @@
 #include "audio/aframe.h"
 #include "audio/out/ao.h"
 #include "common/global.h"
+#include "common/stats.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "video/out/vo.h"
@@ -14,12 +15,36 @@
 #include "f_utils.h"
 #include "user_filters.h"
 
+#define OPT_BASE_STRUCT struct output_chain_opts
+
+struct output_chain_opts {
+    char **vf_thread_filters;
+    char **af_thread_filters;
+    int thread_queue_frames;
+};
+
+const struct m_sub_options output_chain_conf = {
+    .opts = (const struct m_option[]){
+        {"vf-thread-filters", OPT_STRINGLIST(vf_thread_filters)},
+        {"af-thread-filters", OPT_STRINGLIST(af_thread_filters)},
+        {"filter-thread-queue", OPT_INT(thread_queue_frames), M_RANGE(1, 1000)},
+        {0}
+    },
+    .size = sizeof(struct output_chain_opts),
+    .defaults = &(const struct output_chain_opts){
+        .thread_queue_frames = 2,
+    },
+};
+
 struct chain {
     struct mp_filter *f;
     struct mp_log *log;
 
     enum mp_output_chain_type type;
 
+    struct m_config_cache *opt_cache;
+    struct output_chain_opts *opts;
+
     // Expected media type.
     enum mp_frame_type frame_type;
 
@@ -61,6 +86,7 @@ struct mp_user_filter {
     char *label;
     bool generated_label;
     char *name;
+    bool threaded; // f was created with mp_threaded_filter_create()
 
     struct mp_image_params last_in_vformat;
     struct mp_aframe *last_in_aformat;
@@ -507,11 +533,52 @@ double mp_output_get_measured_total_delay(struct mp_output_chain *c)
     return delay;
 }
 
+// If the filter should run on its own thread (--vf-thread-filters), return the
+// queue depth to use for it, otherwise 0.
+static int use_filter_thread(struct chain *p, struct m_obj_settings *entry)
+{
+    char **list = p->type == MP_OUTPUT_CHAIN_VIDEO ? p->opts->vf_thread_filters
+                                                   : p->opts->af_thread_filters;
+    for (int n = 0; list && list[n]; n++) {
+        bstr name = bstr0(list[n]);
+        int frames = p->opts->thread_queue_frames;
+        bstr depth;
+        if (bstr_split_tok(name, ":", &name, &depth)) {
+            bstr rest;
+            long long v = bstrtoll(depth, &rest, 10);
+            if (rest.len || v < 1 || v > 1000) {
+                MP_WARN(p, "Invalid queue depth in thread filter entry '%s'.\n",
+                        list[n]);
+                continue;
+            }
+            frames = v;
+        }
+        if (bstr_equals0(name, "all") || bstr_equals0(name, entry->name) ||
+            (entry->label && bstr_equals0(name, entry->label)))
+            return frames;
+    }
+    return 0;
+}
+
+struct create_user_filter_args {
+    enum mp_output_chain_type type;
+    struct m_obj_settings *entry;
+};
+
+static struct mp_filter *create_user_filter(struct mp_filter *parent, void *arg)
+{
+    struct create_user_filter_args *args = arg;
+    return mp_create_user_filter(parent, args->type, args->entry->name,
+                                 args->entry->attribs);
+}
+
 bool mp_output_chain_update_filters(struct mp_output_chain *c,
                                     struct m_obj_settings *list)
 {
     struct chain *p = c->f->priv;
 
+    m_config_cache_update(p->opt_cache);
+
     struct mp_user_filter **add = NULL;      // new filters
     int num_add = 0;
     struct mp_user_filter **res = NULL;      // new final list
@@ -539,8 +606,15 @@ bool mp_output_chain_update_filters(struct mp_output_chain *c,
             u = create_wrapper_filter(p);
             u->name = talloc_strdup(u, entry->name);
             u->label = talloc_strdup(u, entry->label);
-            u->f = mp_create_user_filter(u->wrapper, p->type, entry->name,
-                                         entry->attribs);
+            struct create_user_filter_args cargs = {p->type, entry};
+            int queue_frames = use_filter_thread(p, entry);
+            if (queue_frames) {
+                u->f = mp_threaded_filter_create(u->wrapper, queue_frames,
+                                                 create_user_filter, &cargs);
+                u->threaded = true;
+            } else {
+                u->f = create_user_filter(u->wrapper, &cargs);
+            }
             if (!u->f) {
                 talloc_free(u->wrapper);
                 goto error;
@@ -662,13 +736,24 @@ struct mp_output_chain *mp_output_chain_create(struct mp_filter *parent,
     case MP_OUTPUT_CHAIN_VIDEO: log_name = "!vf"; break;
     case MP_OUTPUT_CHAIN_AUDIO: log_name = "!af"; break;
     }
-    if (log_name)
+    if (log_name) {
         f->log = mp_log_new(f, parent->global->log, log_name);
+        // Per-filter processing time, as "af/<filter>" or "vf/<filter>".
+        struct stats_ctx *stats = stats_ctx_create(f, f->global, log_name + 1);
+        mp_filter_set_stats(f, stats);
+        if (type == MP_OUTPUT_CHAIN_AUDIO) {
+            struct mp_aframe_pool *pool = mp_aframe_pool_create(f);
+            mp_aframe_pool_set_stats(pool, stats);
+            mp_filter_set_aframe_pool(f, pool);
+        }
+    }
 
     struct chain *p = f->priv;
     p->f = f;
     p->log = f->log;
     p->type = type;
+    p->opt_cache = m_config_cache_alloc(p, f->global, &output_chain_conf);
+    p->opts = p->opt_cache->opts;
 
     struct mp_output_chain *c = &p->public;
     c->f = f;
@@ -715,3 +800,105 @@ struct mp_output_chain *mp_output_chain_create(struct mp_filter *parent,
 
     return c;
 }
+
+int mp_output_chain_get_filter_threads(struct mp_output_chain *c,
+                                       void *ta_parent,
+                                       struct mp_output_chain_thread **out)
+{
+    struct chain *p = c->f->priv;
+
+    *out = NULL;
+    int num = 0;
+    for (int n = 0; n < p->num_user_filters; n++) {
+        struct mp_user_filter *u = p->user_filters[n];
+        if (!u->threaded)
+            continue;
+        struct mp_output_chain_thread t = {
+            .name = talloc_strdup(ta_parent, u->name),
+            .label = talloc_strdup(ta_parent, u->label),
+        };
+        mp_threaded_filter_get_stats(u->f, &t.stats);
+        MP_TARRAY_APPEND(ta_parent, *out, num, t);
+    }
+    return num;
+}
+
+struct filter_stats_list {
+    void *ta_parent;
+    struct mp_output_chain_filter_stats *entries;
+    int num_entries;
+};
+
+static int add_filter_stats(struct filter_stats_list *l, int parent,
+                            struct mp_filter *f);
+
+static void add_child_filter_stats(struct filter_stats_list *l, int parent,
+                                   struct mp_filter *f)
+{
+    int index = add_filter_stats(l, parent, f);
+    l->entries[parent].stats.wall_time += l->entries[index].stats.wall_time;
+    l->entries[parent].stats.cpu_time += l->entries[index].stats.cpu_time;
+}
+
+static int add_filter_stats(struct filter_stats_list *l, int parent,
+                            struct mp_filter *f)
+{
+    const char *name = mp_filter_get_name(f);
+    struct mp_output_chain_filter_stats e = {
+        .parent = parent,
+        .name = talloc_strdup(l->ta_parent,
+                              name ? name : mp_filter_get_info(f)->name),
+    };
+    mp_filter_get_stats(f, &e.stats);
+    int index = l->num_entries;
+    MP_TARRAY_APPEND(l->ta_parent, l->entries, l->num_entries, e);
+
+    struct mp_lavfi_filter_stats *lavfi;
+    int num_lavfi = mp_lavfi_get_graph_stats(f, l->ta_parent, &lavfi);
+    for (int n = 0; n < num_lavfi; n++) {
+        struct mp_output_chain_filter_stats le = {
+            .parent = index,
+            .name = lavfi[n].filter,
+            .label = lavfi[n].name,
+            .lavfi = true,
+            .stats = {
+                .frames_in = lavfi[n].frames_in,
+                .frames_out = lavfi[n].frames_out,
+            },
+        };
+        MP_TARRAY_APPEND(l->ta_parent, l->entries, l->num_entries, le);
+    }
+
+    // The filter run by a mp_threaded_filter_create() filter is not its child.
+    struct mp_filter *inner = mp_threaded_filter_lock_inner(f);
+    if (inner) {
+        // It might have been created before profiling was enabled.
+        mp_filter_enable_profiling(inner);
+        add_child_filter_stats(l, index, inner);
+        mp_threaded_filter_unlock_inner(f);
+    }
+
+    for (int n = 0; mp_filter_get_child(f, n); n++)
+        add_child_filter_stats(l, index, mp_filter_get_child(f, n));
+
+    return index;
+}
+
+int mp_output_chain_get_filter_stats(struct mp_output_chain *c,
+                                     void *ta_parent,
+                                     struct mp_output_chain_filter_stats **out)
+{
+    struct chain *p = c->f->priv;
+
+    mp_filter_enable_profiling(p->f);
+
+    struct filter_stats_list l = {.ta_parent = ta_parent};
+    for (int n = 0; n < p->num_all_filters; n++) {
+        struct mp_user_filter *u = p->all_filters[n];
+        int index = add_filter_stats(&l, -1, u->wrapper);
+        l.entries[index].name = talloc_strdup(ta_parent, u->name);
+        l.entries[index].label = talloc_strdup(ta_parent, u->label);
+    }
+    *out = l.entries;
+    return l.num_entries;
+}
@@ -3,6 +3,7 @@
 #include "options/m_option.h"
 #include "video/mp_image.h"
 
+#include "f_threaded.h"
 #include "filter.h"
 
 enum mp_output_chain_type {
@@ -85,3 +86,35 @@ void mp_output_chain_set_audio_speed(struct mp_output_chain *p,
 // due to the change.
 // Makes sense for audio only.
 double mp_output_get_measured_total_delay(struct mp_output_chain *p);
+
+struct mp_output_chain_thread {
+    char *name;
+    char *label;
+    struct mp_threaded_filter_stats stats;
+};
+
+// Return the user filters which run on their own thread (selected with
+// --vf-thread-filters/--af-thread-filters), and their current stats. *out is
+// allocated with ta_parent. Returns the number of entries in *out.
+int mp_output_chain_get_filter_threads(struct mp_output_chain *p,
+                                       void *ta_parent,
+                                       struct mp_output_chain_thread **out);
+
+struct mp_output_chain_filter_stats {
+    int parent;         // index of the parent entry in the array, or -1
+    char *name;
+    char *label;        // user filter or libavfilter instance name, or NULL
+    bool lavfi;         // filter within a libavfilter graph (only has frame
+                        // counts, which are -1 if unknown)
+    // For lavfi==false: wall_time and cpu_time include all children.
+    struct mp_filter_stats stats;
+};
+
+// Return the filters of the chain as a tree: one entry with parent==-1 per
+// filter in the chain (in order), followed by the filters they consist of.
+// Parents always come before their children. The first call enables profiling
+// (see mp_filter_enable_profiling()), so stats start at 0. *out is allocated
+// with ta_parent. Returns the number of entries in *out.
+int mp_output_chain_get_filter_stats(struct mp_output_chain *p,
+                                     void *ta_parent,
+                                     struct mp_output_chain_filter_stats **out);
@@ -0,0 +1,241 @@
+#include <math.h>
+#include <pthread.h>
+
+#include "common/common.h"
+#include "common/msg.h"
+#include "misc/dispatch.h"
+#include "osdep/atomic.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+
+#include "f_async_queue.h"
+#include "f_threaded.h"
+#include "filter_internal.h"
+
+struct priv {
+    struct mp_filter *public_f;
+
+    struct mp_async_queue *queue_in, *queue_out;
+    int queue_frames;
+
+    struct mp_dispatch_queue *dispatch;
+    struct mp_filter *thread_root;  // root of the graph run by the thread
+    struct mp_filter *inner;        // the wrapped filter, part of thread_root
+    struct mp_stream_info stream_info;
+
+    pthread_t thread;
+    bool thread_valid;
+
+    // --- Accessed by the thread, or with mp_dispatch_lock().
+    bool terminate;
+
+    // --- Accessed from any thread.
+    atomic_bool inner_failed;
+    mp_atomic_int64 busy_us;
+};
+
+static void *filter_thread(void *ptr)
+{
+    struct priv *p = ptr;
+
+    mpthread_set_name("filter");
+
+    while (!p->terminate) {
+        int64_t start = mp_time_us();
+        mp_filter_graph_run(p->thread_root);
+        atomic_fetch_add(&p->busy_us, mp_time_us() - start);
+
+        if (mp_filter_has_failed(p->inner)) {
+            atomic_store(&p->inner_failed, true);
+            mp_filter_wakeup(p->public_f);
+        }
+
+        mp_dispatch_queue_process(p->dispatch, INFINITY);
+    }
+
+    return NULL;
+}
+
+static void wakeup_thread(void *ptr)
+{
+    struct priv *p = ptr;
+
+    mp_dispatch_interrupt(p->dispatch);
+}
+
+static void onlock_thread(void *ptr)
+{
+    struct priv *p = ptr;
+
+    mp_filter_graph_interrupt(p->thread_root);
+}
+
+static void process(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    // The frames themselves are moved by the async queue filters.
+    if (atomic_exchange(&p->inner_failed, false))
+        mp_filter_internal_mark_failed(f);
+}
+
+static void reset(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    // See mp_async_queue_create_filter() for the order.
+    mp_async_queue_reset(p->queue_in);
+    mp_async_queue_reset(p->queue_out);
+    mp_dispatch_lock(p->dispatch);
+    mp_filter_reset(p->thread_root);
+    mp_dispatch_interrupt(p->dispatch);
+    mp_dispatch_unlock(p->dispatch);
+    atomic_store(&p->inner_failed, false);
+    mp_async_queue_resume(p->queue_in);
+    mp_async_queue_resume(p->queue_out);
+}
+
+static bool command(struct mp_filter *f, struct mp_filter_command *cmd)
+{
+    struct priv *p = f->priv;
+
+    mp_dispatch_lock(p->dispatch);
+    bool res = mp_filter_command(p->inner, cmd);
+    mp_dispatch_unlock(p->dispatch);
+    return res;
+}
+
+static void destroy(struct mp_filter *f)
+{
+    struct priv *p = f->priv;
+
+    if (p->thread_valid) {
+        mp_dispatch_lock(p->dispatch);
+        p->terminate = true;
+        mp_dispatch_interrupt(p->dispatch);
+        mp_dispatch_unlock(p->dispatch);
+        pthread_join(p->thread, NULL);
+        p->thread_valid = false;
+    }
+
+    mp_filter_free_children(f);
+
+    talloc_free(p->thread_root);
+    talloc_free(p->queue_in);
+    talloc_free(p->queue_out);
+}
+
+static const struct mp_filter_info threaded_filter = {
+    .name = "threaded",
+    .priv_size = sizeof(struct priv),
+    .process = process,
+    .reset = reset,
+    .command = command,
+    .destroy = destroy,
+};
+
+struct mp_filter *mp_threaded_filter_create(struct mp_filter *parent,
+                    int queue_frames,
+                    struct mp_filter *(*create)(struct mp_filter *parent,
+                                                void *arg),
+                    void *arg)
+{
+    struct mp_filter *f = mp_filter_create(parent, &threaded_filter);
+    if (!f)
+        return NULL;
+
+    struct priv *p = f->priv;
+    p->public_f = f;
+    p->queue_frames = MPMAX(queue_frames, 1);
+
+    mp_filter_add_pin(f, MP_PIN_IN, "in");
+    mp_filter_add_pin(f, MP_PIN_OUT, "out");
+
+    p->dispatch = mp_dispatch_create(p);
+    p->thread_root = mp_filter_create_root(f->global);
+    mp_filter_share_context(p->thread_root, f);
+    mp_filter_graph_set_wakeup_cb(p->thread_root, wakeup_thread, p);
+    mp_dispatch_set_onlock_fn(p->dispatch, onlock_thread, p);
+
+    // The callbacks can't be called from another thread.
+    struct mp_stream_info *sinfo = mp_filter_find_stream_info(parent);
+    if (sinfo) {
+        p->stream_info = *sinfo;
+        p->stream_info.priv = NULL;
+        p->stream_info.get_display_fps = NULL;
+        p->thread_root->stream_info = &p->stream_info;
+    }
+
+    p->inner = create(p->thread_root, arg);
+    if (!p->inner)
+        goto error;
+    assert(p->inner->num_pins == 2);
+
+    struct mp_async_queue_config cfg = {
+        .sample_unit = AQUEUE_UNIT_FRAME,
+        .max_samples = p->queue_frames,
+        .max_bytes = INT64_MAX,
+    };
+    p->queue_in = mp_async_queue_create();
+    p->queue_out = mp_async_queue_create();
+    mp_async_queue_set_config(p->queue_in, cfg);
+    mp_async_queue_set_config(p->queue_out, cfg);
+
+    struct mp_filter *in_w =
+        mp_async_queue_create_filter(f, MP_PIN_IN, p->queue_in);
+    struct mp_filter *in_r =
+        mp_async_queue_create_filter(p->thread_root, MP_PIN_OUT, p->queue_in);
+    struct mp_filter *out_w =
+        mp_async_queue_create_filter(p->thread_root, MP_PIN_IN, p->queue_out);
+    struct mp_filter *out_r =
+        mp_async_queue_create_filter(f, MP_PIN_OUT, p->queue_out);
+    mp_pin_connect(in_w->pins[0], f->ppins[0]);
+    mp_pin_connect(p->inner->pins[0], in_r->pins[0]);
+    mp_pin_connect(out_w->pins[0], p->inner->pins[1]);
+    mp_pin_connect(f->ppins[1], out_r->pins[0]);
+
+    p->thread_valid = true;
+    if (pthread_create(&p->thread, NULL, filter_thread, p)) {
+        p->thread_valid = false;
+        goto error;
+    }
+
+    reset(f);
+
+    return f;
+error:
+    talloc_free(f);
+    return NULL;
+}
+
+void mp_threaded_filter_get_stats(struct mp_filter *f,
+                                  struct mp_threaded_filter_stats *st)
+{
+    assert(mp_filter_get_info(f) == &threaded_filter);
+    struct priv *p = f->priv;
+
+    *st = (struct mp_threaded_filter_stats){
+        .busy_time = atomic_load(&p->busy_us) / 1e6,
+        .queued_in = mp_async_queue_get_frames(p->queue_in),
+        .queued_out = mp_async_queue_get_frames(p->queue_out),
+        .queue_frames = p->queue_frames,
+    };
+}
+
+struct mp_filter *mp_threaded_filter_lock_inner(struct mp_filter *f)
+{
+    if (mp_filter_get_info(f) != &threaded_filter)
+        return NULL;
+    struct priv *p = f->priv;
+
+    mp_dispatch_lock(p->dispatch);
+    return p->inner;
+}
+
+void mp_threaded_filter_unlock_inner(struct mp_filter *f)
+{
+    assert(mp_filter_get_info(f) == &threaded_filter);
+    struct priv *p = f->priv;
+
+    mp_dispatch_unlock(p->dispatch);
+}
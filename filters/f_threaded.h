@@ -0,0 +1,41 @@
+#pragma once
+
+#include "filter.h"
+
+// Create a filter that runs another filter on its own thread. The inner filter
+// is created by calling create(parent, arg), where parent is the root of a
+// separate filter graph driven by the new thread. create() is called on the
+// calling thread, before the thread is started. The inner filter must have
+// exactly 1 input and 1 output pin (like user filters).
+//
+// The returned filter has the same pins. Frames are passed to and from the
+// thread with async queues, which buffer up to queue_frames frames each, so
+// that the inner filter can run in parallel with the rest of the graph.
+//
+// Resetting or destroying the returned filter does the same with the inner
+// filter. Filter commands are forwarded to it. If the inner filter fails,
+// the returned filter is marked as failed too.
+//
+// Returns NULL on failure.
+struct mp_filter *mp_threaded_filter_create(struct mp_filter *parent,
+                    int queue_frames,
+                    struct mp_filter *(*create)(struct mp_filter *parent,
+                                                void *arg),
+                    void *arg);
+
+struct mp_threaded_filter_stats {
+    double busy_time;   // total wall time spent filtering on the thread (secs)
+    int queued_in;      // frames currently buffered before the inner filter
+    int queued_out;     // frames currently buffered after the inner filter
+    int queue_frames;   // configured maximum per queue
+};
+
+// Can be called on any filter created by mp_threaded_filter_create().
+void mp_threaded_filter_get_stats(struct mp_filter *f,
+                                  struct mp_threaded_filter_stats *st);
+
+// If f was created by mp_threaded_filter_create(), pause its thread and return
+// the inner filter, which can then be accessed until
+// mp_threaded_filter_unlock_inner() is called. Returns NULL for other filters.
+struct mp_filter *mp_threaded_filter_lock_inner(struct mp_filter *f);
+void mp_threaded_filter_unlock_inner(struct mp_filter *f);
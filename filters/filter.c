@@ -6,6 +6,8 @@
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "common/stats.h"
+#include "audio/aframe.h"
 #include "osdep/atomic.h"
 #include "osdep/timer.h"
 #include "video/hwdec.h"
@@ -60,6 +62,10 @@ struct mp_pin {
     bool data_requested;            // true if out wants new data
     struct mp_frame data;           // possibly buffered frame (MP_FRAME_NONE if
                                     // empty, usually only temporary)
+
+    // For mp_filter_stats. Set for mp_filter.ppins[] only.
+    bool is_private;
+    int64_t stall_start;            // mp_time_us() of the data request, or 0
 };
 
 // Root filters create this, all other filters reference it.
@@ -115,6 +121,14 @@ struct mp_filter_internal {
     char *name;
     bool high_priority;
 
+    // Inherited from the parent on creation; see mp_filter_set_stats().
+    struct stats_ctx *stats;
+    // Same, for mp_filter_set_aframe_pool().
+    struct mp_aframe_pool *aframe_pool;
+
+    // Set if profiling is enabled; see mp_filter_enable_profiling().
+    struct mp_filter_stats *prof;
+
     bool pending;
     bool async_pending;
     bool failed;
@@ -207,6 +221,36 @@ static void flush_async_notifications(struct filter_runner *r)
     pthread_mutex_unlock(&r->async_lock);
 }
 
+// Call f's process function. If profiling is enabled, the times measured for
+// it are reported to the stats context too, instead of measuring again.
+static void run_process(struct mp_filter *f)
+{
+    struct stats_ctx *stats = f->in->stats;
+    struct mp_filter_stats *prof = f->in->prof;
+    const char *name = f->in->info->name;
+
+    if (!prof) {
+        if (stats)
+            stats_time_start(stats, name);
+        f->in->info->process(f);
+        if (stats)
+            stats_time_end(stats, name);
+        return;
+    }
+
+    int64_t wall = mp_time_us();
+    int64_t cpu = stats_thread_cpu_time_ns();
+    f->in->info->process(f);
+    wall = mp_time_us() - wall;
+    cpu = stats_thread_cpu_time_ns() - cpu;
+
+    prof->process_calls += 1;
+    prof->wall_time += wall / 1e6;
+    prof->cpu_time += cpu / 1e9;
+    if (stats)
+        stats_time_add(stats, name, wall, cpu);
+}
+
 bool mp_filter_graph_run(struct mp_filter *filter)
 {
     struct filter_runner *r = filter->in->runner;
@@ -259,7 +303,7 @@ bool mp_filter_graph_run(struct mp_filter *filter)
 
         next->in->pending = false;
         if (next->in->info->process)
-            next->in->info->process(next);
+            run_process(next);
 
         if (end_time && mp_time_us() >= end_time)
             mp_filter_graph_interrupt(r->root_filter);
@@ -301,6 +345,14 @@ bool mp_pin_in_write(struct mp_pin *p, struct mp_frame frame)
         return false;
     }
     assert(p->conn->data.type == MP_FRAME_NONE);
+    if (p->is_private && p->owner->in->prof && mp_frame_is_data(frame))
+        p->owner->in->prof->frames_out += 1;
+    if (p->conn->stall_start) {
+        struct mp_filter_stats *prof = p->conn->owner->in->prof;
+        if (prof)
+            prof->stall_time += (mp_time_us() - p->conn->stall_start) / 1e6;
+        p->conn->stall_start = 0;
+    }
     p->conn->data = frame;
     p->conn->data_requested = false;
     add_pending_pin(p->conn);
@@ -322,6 +374,8 @@ bool mp_pin_out_request_data(struct mp_pin *p)
     if (p->conn && p->conn->manual_connection) {
         if (!p->data_requested) {
             p->data_requested = true;
+            if (p->is_private && p->owner->in->prof)
+                p->stall_start = mp_time_us();
             add_pending_pin(p->conn);
         }
         filter_recursive(p);
@@ -341,6 +395,8 @@ struct mp_frame mp_pin_out_read(struct mp_pin *p)
         return MP_NO_FRAME;
     struct mp_frame res = p->data;
     p->data = MP_NO_FRAME;
+    if (p->is_private && p->owner->in->prof && mp_frame_is_data(res))
+        p->owner->in->prof->frames_in += 1;
     return res;
 }
 
@@ -547,6 +603,58 @@ void mp_filter_set_name(struct mp_filter *f, const char *name)
     f->in->name = talloc_strdup(f, name);
 }
 
+void mp_filter_set_stats(struct mp_filter *f, struct stats_ctx *stats)
+{
+    f->in->stats = stats;
+}
+
+void mp_filter_set_aframe_pool(struct mp_filter *f, struct mp_aframe_pool *pool)
+{
+    f->in->aframe_pool = pool;
+}
+
+void mp_filter_share_context(struct mp_filter *dst, struct mp_filter *src)
+{
+    dst->in->stats = src->in->stats;
+    // Use a separate pool, so the other thread doesn't contend on src's.
+    if (src->in->aframe_pool) {
+        dst->in->aframe_pool = mp_aframe_pool_create(dst);
+        mp_aframe_pool_set_stats(dst->in->aframe_pool, src->in->stats);
+    }
+    if (src->in->prof)
+        mp_filter_enable_profiling(dst);
+}
+
+void mp_filter_enable_profiling(struct mp_filter *f)
+{
+    if (!f->in->prof)
+        f->in->prof = talloc_zero(f, struct mp_filter_stats);
+    for (int n = 0; n < f->in->num_children; n++)
+        mp_filter_enable_profiling(f->in->children[n]);
+}
+
+bool mp_filter_get_stats(struct mp_filter *f, struct mp_filter_stats *st)
+{
+    if (!f->in->prof)
+        return false;
+    *st = *f->in->prof;
+    return true;
+}
+
+struct mp_filter *mp_filter_get_child(struct mp_filter *f, int index)
+{
+    if (index < 0 || index >= f->in->num_children)
+        return NULL;
+    return f->in->children[index];
+}
+
+struct mp_aframe_pool *mp_filter_get_aframe_pool(struct mp_filter *f)
+{
+    if (!f->in->aframe_pool)
+        f->in->aframe_pool = mp_aframe_pool_create(f);
+    return f->in->aframe_pool;
+}
+
 struct mp_pin *mp_filter_get_named_pin(struct mp_filter *f, const char *name)
 {
     for (int n = 0; n < f->num_pins; n++) {
@@ -588,6 +696,7 @@ static void reset_pin(struct mp_pin *p)
     }
     mp_frame_unref(&p->data);
     p->data_requested = false;
+    p->stall_start = 0;
 }
 
 void mp_filter_reset(struct mp_filter *filter)
@@ -629,6 +738,7 @@ struct mp_pin *mp_filter_add_pin(struct mp_filter *f, enum mp_pin_dir dir,
         .owner = f,
         .other = p,
         .manual_connection = f,
+        .is_private = true,
     };
 
     MP_TARRAY_GROW(f, f->pins, f->num_pins);
@@ -805,8 +915,13 @@ struct mp_filter *mp_filter_create_with_params(struct mp_filter_params *params)
         .info = params->info,
         .parent = params->parent,
         .runner = params->parent ? params->parent->in->runner : NULL,
+        .stats = params->parent ? params->parent->in->stats : NULL,
+        .aframe_pool = params->parent ? params->parent->in->aframe_pool : NULL,
     };
 
+    if (params->parent && params->parent->in->prof)
+        f->in->prof = talloc_zero(f, struct mp_filter_stats);
+
     if (!f->in->runner) {
         assert(params->global);
 
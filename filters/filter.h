@@ -1,11 +1,14 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "frame.h"
 
 struct mpv_global;
+struct mp_aframe_pool;
 struct mp_filter;
+struct stats_ctx;
 
 // A filter input or output. These always come in pairs: one mp_pin is for
 // input, the other is for output. (The separation is mostly for checking
@@ -346,6 +349,49 @@ const char *mp_filter_get_name(struct mp_filter *f);
 // Change mp_filter_get_name() return value.
 void mp_filter_set_name(struct mp_filter *f, const char *name);
 
+// Time the process callback of f and of all filters created as its children
+// afterwards, as "<prefix>/<filter info name>" entries of the given stats
+// context. stats is not owned by the filter and must outlive f. Already
+// existing children are not affected.
+void mp_filter_set_stats(struct mp_filter *f, struct stats_ctx *stats);
+
+// Share the given audio frame pool with f and all filters created as its
+// children afterwards. pool is not owned by the filter and must outlive f.
+void mp_filter_set_aframe_pool(struct mp_filter *f, struct mp_aframe_pool *pool);
+
+// Return the audio frame pool shared with the parent filters. If there is
+// none, a pool owned by f is created, which future children of f share.
+// Filters should use this for their output frames, so that buffers freed by
+// a later filter are reused by an earlier one while still in the cache.
+struct mp_aframe_pool *mp_filter_get_aframe_pool(struct mp_filter *f);
+
+// Make dst use the stats context of src (as set with the functions above), and
+// enable profiling if src has it enabled. If src has an audio frame pool, dst
+// gets a separate pool owned by dst. This is for filter graphs run by another
+// thread on behalf of src, whose root can't be a child of src.
+void mp_filter_share_context(struct mp_filter *dst, struct mp_filter *src);
+
+struct mp_filter_stats {
+    int64_t process_calls;  // number of mp_filter_info.process calls
+    double wall_time;       // real time spent in process (seconds)
+    double cpu_time;        // CPU time of the calling thread spent in process
+    int64_t frames_in;      // data frames read from the filter's input pins
+    int64_t frames_out;     // data frames written to the filter's output pins
+    double stall_time;      // time input pins waited for requested data
+};
+
+// Start collecting mp_filter_stats for f, its current children, and all of
+// its children created afterwards. This can't be disabled again.
+void mp_filter_enable_profiling(struct mp_filter *f);
+
+// Return the stats collected since mp_filter_enable_profiling() was called
+// for f. Returns false (and leaves *st unchanged) if profiling is disabled.
+bool mp_filter_get_stats(struct mp_filter *f, struct mp_filter_stats *st);
+
+// Return the child filter with the given index, or NULL if out of range.
+// The order is the creation order.
+struct mp_filter *mp_filter_get_child(struct mp_filter *f, int index);
+
 // Set filter priority. A higher priority gets processed first. Also, high
 // priority filters disable "interrupting" the filter graph.
 void mp_filter_set_high_priority(struct mp_filter *filter, bool pri);
@@ -236,4 +236,43 @@ char *mp_json_encode_event(struct mpv_event *event);
 struct mpv_handle;
 char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
 
+// Wire formats of IPC connections. All connections start with JSON, and can
+// switch with the "ipc_protocol" request.
+enum mp_ipc_protocol {
+    MP_IPC_PROTOCOL_JSON,   // newline-separated JSON or text commands
+    MP_IPC_PROTOCOL_CBOR,   // CBOR items prefixed with 32 bit big endian size
+    MP_IPC_PROTOCOL_COUNT,
+};
+
+// Maximum size of a CBOR message (larger input is a protocol error).
+#define MP_IPC_MAX_MESSAGE_SIZE (64 * 1024 * 1024)
+
+// Serialize the given mpv_event structure as message in the given protocol,
+// and append it to *out (reallocated with ta_parent). Returns success.
+bool mp_ipc_encode_event(void *ta_parent, bstr *out, struct mpv_event *event,
+                         enum mp_ipc_protocol protocol);
+
+// Like mp_ipc_consume_next_command(), but for any protocol. If buf starts with
+// a complete message, execute it, append the reply (if any) to *out
+// (reallocated with out_parent), and return the number of bytes used from buf.
+// *protocol is the protocol of the connection, and is changed if the message
+// requested it (the reply still uses the old protocol).
+// Returns 0 if buf doesn't contain a complete message yet, and -1 if the input
+// is invalid and the connection should be closed.
+int64_t mp_ipc_execute_next_message(struct mpv_handle *client,
+                                    enum mp_ipc_protocol *protocol, bstr buf,
+                                    bstr *out, void *out_parent);
+
+// Remembers the serialized form of recent events, so that events broadcast to
+// many clients (property changes, playback events) are serialized only once.
+struct mp_ipc_event_cache;
+struct mp_ipc_event_cache *mp_ipc_event_cache_create(void *ta_parent);
+// Like mp_ipc_encode_event(), but may return the result of a previous call
+// for an event with the same contents (*cached is set to true then). The
+// returned data is owned by the cache and valid until the next call. Returns
+// a bstr with start==NULL on errors.
+bstr mp_ipc_event_cache_encode(struct mp_ipc_event_cache *cache,
+                               struct mpv_event *event,
+                               enum mp_ipc_protocol protocol, bool *cached);
+
 #endif /* MPLAYER_INPUT_H */
@@ -26,12 +26,20 @@
 #include <sys/stat.h>
 #include <sys/un.h>
 
+#include "config.h"
+
+#if HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#include "osdep/atomic.h"
 #include "osdep/io.h"
 #include "osdep/threads.h"
 
 #include "common/common.h"
 #include "common/global.h"
 #include "common/msg.h"
+#include "common/stats.h"
 #include "input/input.h"
 #include "libmpv/client.h"
 #include "options/m_config.h"
@@ -43,6 +51,8 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+struct mux_ctx;
+
 struct mp_ipc_ctx {
     struct mp_log *log;
     struct mp_client_api *client_api;
@@ -50,6 +60,7 @@ struct mp_ipc_ctx {
 
     pthread_t thread;
     int death_pipe[2];
+    struct mux_ctx *mux; // set if thread is a mux_thread
 };
 
 struct client_arg {
@@ -64,9 +75,10 @@ struct client_arg {
     bool writable;
 };
 
-static int ipc_write_str(struct client_arg *client, const char *buf)
+static int ipc_write(struct client_arg *client, bstr data)
 {
-    size_t count = strlen(buf);
+    const unsigned char *buf = data.start;
+    size_t count = data.len;
     while (count > 0) {
         ssize_t rc = send(client->client_fd, buf, count, MSG_NOSIGNAL);
         if (rc <= 0) {
@@ -104,6 +116,7 @@ static void *client_thread(void *p)
 
     struct client_arg *arg = p;
     bstr client_msg = { talloc_strdup(NULL, ""), 0 };
+    enum mp_ipc_protocol protocol = MP_IPC_PROTOCOL_JSON;
 
     mpthread_set_name(arg->client_name);
 
@@ -146,14 +159,14 @@ static void *client_thread(void *p)
                 if (!arg->writable)
                     continue;
 
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
+                bstr event_msg = {0};
+                if (!mp_ipc_encode_event(NULL, &event_msg, event, protocol)) {
                     MP_ERR(arg, "Encoding error\n");
                     goto done;
                 }
 
-                rc = ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
+                rc = ipc_write(arg, event_msg);
+                talloc_free(event_msg.start);
                 if (rc < 0) {
                     MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
                     goto done;
@@ -184,20 +197,29 @@ static void *client_thread(void *p)
 
                 bstr_xappend(NULL, &client_msg, append);
 
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
+                while (1) {
+                    bstr reply_msg = {0};
+                    int64_t used = mp_ipc_execute_next_message(arg->client,
+                        &protocol, client_msg, &reply_msg, NULL);
+                    if (used < 0)
+                        goto done;
+                    if (!used)
+                        break;
+
+                    memmove(client_msg.start, client_msg.start + used,
+                            client_msg.len - used);
+                    client_msg.len -= used;
 
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
+                    if (reply_msg.len && arg->writable) {
+                        rc = ipc_write(arg, reply_msg);
                         if (rc < 0) {
                             MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
+                            talloc_free(reply_msg.start);
                             goto done;
                         }
                     }
 
-                    talloc_free(reply_msg);
+                    talloc_free(reply_msg.start);
                 }
             }
         }
@@ -293,35 +315,28 @@ bool mp_ipc_start_anon_client(struct mp_ipc_ctx *ctx, struct mpv_handle *h,
     return true;
 }
 
-static void *ipc_thread(void *p)
+static int ipc_listen(struct mp_log *log, const char *path)
 {
     int rc;
 
-    int ipc_fd;
     struct sockaddr_un ipc_un = {0};
 
-    struct mp_ipc_ctx *arg = p;
-
-    mpthread_set_name("ipc socket listener");
-
-    MP_VERBOSE(arg, "Starting IPC master\n");
-
-    ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (ipc_fd < 0) {
-        MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        mp_err(log, "Could not create IPC socket\n");
+        goto error;
     }
 
     fchmod(ipc_fd, 0600);
 
-    size_t path_len = strlen(arg->path);
+    size_t path_len = strlen(path);
     if (path_len >= sizeof(ipc_un.sun_path) - 1) {
-        MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        mp_err(log, "Could not create IPC socket\n");
+        goto error;
     }
 
     ipc_un.sun_family = AF_UNIX,
-    strncpy(ipc_un.sun_path, arg->path, sizeof(ipc_un.sun_path) - 1);
+    strncpy(ipc_un.sun_path, path, sizeof(ipc_un.sun_path) - 1);
 
     unlink(ipc_un.sun_path);
 
@@ -333,17 +348,38 @@ static void *ipc_thread(void *p)
     size_t addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + path_len;
     rc = bind(ipc_fd, (struct sockaddr *) &ipc_un, addr_len);
     if (rc < 0) {
-        MP_ERR(arg, "Could not bind IPC socket\n");
-        goto done;
+        mp_err(log, "Could not bind IPC socket\n");
+        goto error;
     }
 
     rc = listen(ipc_fd, 10);
     if (rc < 0) {
-        MP_ERR(arg, "Could not listen on IPC socket\n");
-        goto done;
+        mp_err(log, "Could not listen on IPC socket\n");
+        goto error;
     }
 
-    MP_VERBOSE(arg, "Listening to IPC socket.\n");
+    mp_verbose(log, "Listening to IPC socket.\n");
+    return ipc_fd;
+
+error:
+    if (ipc_fd >= 0)
+        close(ipc_fd);
+    return -1;
+}
+
+static void *ipc_thread(void *p)
+{
+    int rc;
+
+    struct mp_ipc_ctx *arg = p;
+
+    mpthread_set_name("ipc socket listener");
+
+    MP_VERBOSE(arg, "Starting IPC master\n");
+
+    int ipc_fd = ipc_listen(arg->log, arg->path);
+    if (ipc_fd < 0)
+        goto done;
 
     int client_num = 0;
 
@@ -380,6 +416,495 @@ done:
     return NULL;
 }
 
+/*
+ * Multiplexed server (--input-ipc-multiplex): a single thread serves the
+ * listening socket and all clients connected to it. Sockets are non-blocking;
+ * output that can't be sent immediately is queued in a per-client buffer, and
+ * the socket is watched for writability until the buffer is drained.
+ *
+ * The thread owns struct mux_ctx. If clients are connected when mp_uninit_ipc()
+ * is called (the socket path was changed at runtime), the thread is detached
+ * and keeps serving them until they disconnect or the core shuts down, because
+ * it may be blocked in a synchronous command waiting for the core, which calls
+ * mp_uninit_ipc() with the core locked. Otherwise the thread is joined.
+ */
+
+// Maximum amount of unsent output per client. A client which doesn't read its
+// socket is disconnected once this is exceeded.
+#define MUX_MAX_BACKLOG (16 * 1024 * 1024)
+
+// Maximum number of bytes read from a client per wakeup, so that a client
+// sending a lot of commands can't starve the others.
+#define MUX_MAX_READ (64 * 1024)
+
+// Amount of queued output at which sending is attempted immediately.
+#define MUX_FLUSH_SIZE (64 * 1024)
+
+#define MUX_MAX_EVENTS 64
+
+struct mux_client;
+
+struct mux_fd {
+    int fd;
+    struct mux_client *client;  // NULL for the death pipe/listening socket
+    short events;               // POLLIN/POLLOUT being watched, 0 if none
+};
+
+struct mux_client {
+    struct mp_log *log;
+    struct mpv_handle *client;
+    struct mux_fd sock;
+    struct mux_fd wakeup;
+    enum mp_ipc_protocol protocol;
+    bstr in;                    // partial command input
+    bstr out;                   // output not sent yet, starting at out_pos
+    size_t out_pos;
+    bool dead;
+};
+
+struct mux_ctx {
+    struct mp_log *log;
+    struct mp_client_api *client_api;
+    struct stats_ctx *stats;
+    char *path;
+
+    struct mux_fd death;
+    struct mux_fd listen;
+
+    // Number of clients, or -1 if mp_uninit_ipc() decided to join the thread.
+    // Modified by mp_uninit_ipc() only if it's 0.
+    atomic_int join_state;
+    // Set after mp_uninit_ipc() if the thread was detached. Must not touch
+    // anything owned by the core after the last client was destroyed then.
+    bool orphan;
+
+    struct mp_ipc_event_cache *cache;
+    struct mux_client **clients;
+    int num_clients;
+    size_t backlog;             // sum of unsent output of all clients
+    int client_num;
+
+#if HAVE_EPOLL
+    int epoll_fd;
+#else
+    struct mux_fd **fds;
+    int num_fds;
+    struct pollfd *pfds;
+#endif
+};
+
+static bool mux_watch(struct mux_ctx *m, struct mux_fd *f, short events)
+{
+    if (f->events == events)
+        return true;
+#if HAVE_EPOLL
+    struct epoll_event ev = {
+        .events = ((events & POLLIN) ? EPOLLIN : 0) |
+                  ((events & POLLOUT) ? EPOLLOUT : 0),
+        .data.ptr = f,
+    };
+    int op = f->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(m->epoll_fd, op, f->fd, &ev) < 0) {
+        MP_ERR(m, "Could not watch FD (%s)\n", mp_strerror(errno));
+        return false;
+    }
+#else
+    if (!f->events)
+        MP_TARRAY_APPEND(m, m->fds, m->num_fds, f);
+#endif
+    f->events = events;
+    return true;
+}
+
+static void mux_unwatch(struct mux_ctx *m, struct mux_fd *f)
+{
+    if (!f->events)
+        return;
+#if HAVE_EPOLL
+    epoll_ctl(m->epoll_fd, EPOLL_CTL_DEL, f->fd, &(struct epoll_event){0});
+#else
+    for (int n = 0; n < m->num_fds; n++) {
+        if (m->fds[n] == f) {
+            MP_TARRAY_REMOVE_AT(m->fds, m->num_fds, n);
+            break;
+        }
+    }
+#endif
+    f->events = 0;
+}
+
+// Wait until at least one watched FD is ready. Return the number of entries
+// written to out/revents (revents uses POLL* flags), or -1 on error.
+static int mux_wait(struct mux_ctx *m, struct mux_fd **out, short *revents)
+{
+#if HAVE_EPOLL
+    struct epoll_event evs[MUX_MAX_EVENTS];
+    int num = epoll_wait(m->epoll_fd, evs, MUX_MAX_EVENTS, -1);
+    for (int n = 0; n < num; n++) {
+        uint32_t e = evs[n].events;
+        out[n] = evs[n].data.ptr;
+        revents[n] = ((e & EPOLLIN) ? POLLIN : 0) |
+                     ((e & EPOLLOUT) ? POLLOUT : 0) |
+                     ((e & EPOLLHUP) ? POLLHUP : 0) |
+                     ((e & EPOLLERR) ? POLLERR : 0);
+    }
+    return num;
+#else
+    m->pfds = talloc_realloc(m, m->pfds, struct pollfd, m->num_fds);
+    for (int n = 0; n < m->num_fds; n++)
+        m->pfds[n] = (struct pollfd){.fd = m->fds[n]->fd, .events = m->fds[n]->events};
+    if (poll(m->pfds, m->num_fds, -1) < 0)
+        return -1;
+    // Level-triggered: FDs not returned now are returned on the next call.
+    int num = 0;
+    for (int n = 0; n < m->num_fds && num < MUX_MAX_EVENTS; n++) {
+        if (m->pfds[n].revents) {
+            out[num] = m->fds[n];
+            revents[num] = m->pfds[n].revents;
+            num++;
+        }
+    }
+    return num;
+#endif
+}
+
+static void mux_kill_client(struct mux_ctx *m, struct mux_client *c)
+{
+    if (c->dead)
+        return;
+    c->dead = true;
+    mux_unwatch(m, &c->sock);
+    mux_unwatch(m, &c->wakeup);
+    m->backlog -= c->out.len - c->out_pos;
+    c->out.len = c->out_pos = 0;
+}
+
+static void mux_destroy_client(struct mux_ctx *m, struct mux_client *c)
+{
+    mux_kill_client(m, c);
+    if (c->in.len > 0)
+        MP_WARN(c, "Ignoring unterminated command on disconnect.\n");
+    close(c->sock.fd);
+    struct mpv_handle *h = c->client;
+    talloc_free(c);
+    atomic_fetch_add(&m->join_state, -1);
+    mpv_destroy(h);
+}
+
+static void mux_send(struct mux_ctx *m, struct mux_client *c)
+{
+    while (c->out_pos < c->out.len) {
+        ssize_t rc = send(c->sock.fd, c->out.start + c->out_pos,
+                          c->out.len - c->out_pos, MSG_NOSIGNAL);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            MP_ERR(c, "Write error (%s)\n", mp_strerror(errno));
+            mux_kill_client(m, c);
+            return;
+        }
+        c->out_pos += rc;
+        m->backlog -= rc;
+    }
+
+    if (c->out_pos == c->out.len) {
+        c->out.len = c->out_pos = 0;
+    } else if (c->out_pos > 0) {
+        memmove(c->out.start, c->out.start + c->out_pos, c->out.len - c->out_pos);
+        c->out.len -= c->out_pos;
+        c->out_pos = 0;
+    }
+
+    short events = POLLIN | (c->out.len ? POLLOUT : 0);
+    if (!mux_watch(m, &c->sock, events))
+        mux_kill_client(m, c);
+}
+
+// Account for len bytes that were appended to c->out.
+static void mux_output_added(struct mux_ctx *m, struct mux_client *c,
+                             size_t len)
+{
+    m->backlog += len;
+    if (c->out.len - c->out_pos > MUX_MAX_BACKLOG) {
+        MP_ERR(c, "Client does not read its socket, disconnecting.\n");
+        if (m->stats)
+            stats_event(m->stats, "clients-dropped");
+        mux_kill_client(m, c);
+        return;
+    }
+    // Don't wait for the end of the event loop iteration if a lot of output
+    // is queued (e.g. when draining a long event queue).
+    if (c->out.len - c->out_pos >= MUX_FLUSH_SIZE)
+        mux_send(m, c);
+}
+
+static void mux_queue_output(struct mux_ctx *m, struct mux_client *c,
+                             bstr data)
+{
+    if (c->dead)
+        return;
+    bstr_xappend(c, &c->out, data);
+    mux_output_added(m, c, data.len);
+}
+
+static void mux_handle_events(struct mux_ctx *m, struct mux_client *c)
+{
+    mp_flush_wakeup_pipe(c->wakeup.fd);
+
+    while (!c->dead) {
+        mpv_event *event = mpv_wait_event(c->client, 0);
+
+        if (event->event_id == MPV_EVENT_NONE)
+            break;
+
+        if (event->event_id == MPV_EVENT_SHUTDOWN) {
+            mux_kill_client(m, c);
+            break;
+        }
+
+        bool cached;
+        bstr event_msg =
+            mp_ipc_event_cache_encode(m->cache, event, c->protocol, &cached);
+        if (!event_msg.start) {
+            MP_ERR(c, "Encoding error\n");
+            mux_kill_client(m, c);
+            break;
+        }
+        if (m->stats)
+            stats_event(m->stats, cached ? "events-reused" : "events-encoded");
+
+        mux_queue_output(m, c, event_msg);
+    }
+}
+
+static void mux_handle_input(struct mux_ctx *m, struct mux_client *c)
+{
+    size_t total = 0;
+    while (!c->dead && total < MUX_MAX_READ) {
+        char buf[4096];
+        ssize_t bytes = read(c->sock.fd, buf, sizeof(buf));
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            MP_ERR(c, "Read error (%s)\n", mp_strerror(errno));
+            mux_kill_client(m, c);
+            break;
+        }
+
+        if (bytes == 0) {
+            MP_VERBOSE(c, "Client disconnected\n");
+            mux_kill_client(m, c);
+            break;
+        }
+        total += bytes;
+
+        bstr_xappend(c, &c->in, (bstr){(unsigned char *)buf, bytes});
+
+        // Replies are appended to the output buffer directly.
+        size_t pos = 0;
+        while (!c->dead) {
+            size_t out_len = c->out.len;
+            int64_t used = mp_ipc_execute_next_message(c->client, &c->protocol,
+                                    bstr_cut(c->in, pos), &c->out, c);
+            if (used < 0) {
+                mux_kill_client(m, c);
+                break;
+            }
+            mux_output_added(m, c, c->out.len - out_len);
+            if (!used)
+                break;
+            pos += used;
+        }
+        memmove(c->in.start, c->in.start + pos, c->in.len - pos);
+        c->in.len -= pos;
+    }
+}
+
+static void mux_accept(struct mux_ctx *m)
+{
+    int fd = accept(m->listen.fd, NULL, NULL);
+    if (fd < 0) {
+        if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+            MP_ERR(m, "Could not accept IPC client\n");
+        return;
+    }
+    mp_set_cloexec(fd);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    // Don't add clients if mp_uninit_ipc() is about to join the thread.
+    int state = atomic_load(&m->join_state);
+    do {
+        if (state < 0) {
+            close(fd);
+            return;
+        }
+    } while (!atomic_compare_exchange_strong(&m->join_state, &state, state + 1));
+
+    char *name = talloc_asprintf(NULL, "ipc-%d", m->client_num++);
+    struct mpv_handle *h = mp_new_client(m->client_api, name);
+    talloc_free(name);
+    if (!h) {
+        atomic_fetch_add(&m->join_state, -1);
+        close(fd);
+        return;
+    }
+
+    struct mux_client *c = talloc_ptrtype(NULL, c);
+    *c = (struct mux_client){
+        .log = mp_client_get_log(h),
+        .client = h,
+        .sock = {.fd = fd},
+        .wakeup = {.fd = mpv_get_wakeup_pipe(h)},
+    };
+    c->sock.client = c->wakeup.client = c;
+
+    if (c->wakeup.fd < 0 || !mux_watch(m, &c->sock, POLLIN) ||
+        !mux_watch(m, &c->wakeup, POLLIN))
+    {
+        MP_ERR(c, "Could not start client\n");
+        mux_destroy_client(m, c);
+        return;
+    }
+
+    MP_TARRAY_APPEND(m, m->clients, m->num_clients, c);
+    MP_VERBOSE(c, "Client connected\n");
+}
+
+static void *mux_thread(void *p)
+{
+    struct mux_ctx *m = p;
+
+    mpthread_set_name("ipc multiplexer");
+
+    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
+    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
+    sigfillset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, NULL);
+
+    MP_VERBOSE(m, "Starting multiplexed IPC server\n");
+
+    m->cache = mp_ipc_event_cache_create(m);
+
+#if HAVE_EPOLL
+    m->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m->epoll_fd < 0) {
+        MP_ERR(m, "Could not create epoll instance\n");
+        goto error;
+    }
+#endif
+
+    m->listen.fd = ipc_listen(m->log, m->path);
+    if (m->listen.fd < 0)
+        goto error;
+    fcntl(m->listen.fd, F_SETFL, fcntl(m->listen.fd, F_GETFL, 0) | O_NONBLOCK);
+
+    if (!mux_watch(m, &m->death, POLLIN) || !mux_watch(m, &m->listen, POLLIN))
+        goto error;
+
+    // Runs until asked to stop and all clients are gone.
+    while (m->listen.fd >= 0 || m->num_clients) {
+        struct mux_fd *ready[MUX_MAX_EVENTS];
+        short revents[MUX_MAX_EVENTS];
+        int num = mux_wait(m, ready, revents);
+        if (num < 0) {
+            if (errno != EINTR)
+                MP_ERR(m, "Poll error\n");
+            continue;
+        }
+
+        for (int n = 0; n < num; n++) {
+            struct mux_fd *f = ready[n];
+            struct mux_client *c = f->client;
+
+            if (f == &m->death) {
+                mp_flush_wakeup_pipe(m->death.fd);
+                mux_unwatch(m, &m->death);
+                mux_unwatch(m, &m->listen);
+                close(m->listen.fd);
+                m->listen.fd = -1;
+                m->orphan = atomic_load(&m->join_state) >= 0;
+                if (m->orphan) {
+                    MP_VERBOSE(m, "No longer accepting new IPC clients.\n");
+                    TA_FREEP(&m->stats);
+                }
+            } else if (f == &m->listen) {
+                if (m->listen.fd >= 0)
+                    mux_accept(m);
+            } else if (c->dead) {
+                // Killed by an earlier entry; freed below.
+            } else if (f == &c->wakeup) {
+                mux_handle_events(m, c);
+            } else if (revents[n] & (POLLIN | POLLHUP | POLLERR)) {
+                mux_handle_input(m, c);
+            }
+        }
+
+        // Flush output and free dead clients only after processing all
+        // entries, as they may reference the same client.
+        for (int n = m->num_clients - 1; n >= 0; n--) {
+            struct mux_client *c = m->clients[n];
+            if (!c->dead)
+                mux_send(m, c);
+            if (c->dead) {
+                MP_TARRAY_REMOVE_AT(m->clients, m->num_clients, n);
+                mux_destroy_client(m, c);
+            }
+        }
+
+        if (m->stats) {
+            stats_value(m->stats, "clients", m->num_clients);
+            stats_size_value(m->stats, "backlog", m->backlog);
+        }
+    }
+    goto done;
+
+error:
+    // mp_uninit_ipc() expects the thread to run until it's told to exit.
+    poll(&(struct pollfd){.fd = m->death.fd, .events = POLLIN}, 1, -1);
+    mp_flush_wakeup_pipe(m->death.fd);
+
+done:
+    assert(!m->num_clients);
+    if (m->listen.fd >= 0)
+        close(m->listen.fd);
+#if HAVE_EPOLL
+    if (m->epoll_fd >= 0)
+        close(m->epoll_fd);
+#endif
+    close(m->death.fd);
+    if (!m->orphan)
+        MP_VERBOSE(m, "Multiplexed IPC server exited\n");
+    talloc_free(m);
+    return NULL;
+}
+
+static bool mux_start(struct mp_ipc_ctx *arg, struct mpv_global *global)
+{
+    struct mux_ctx *m = talloc_ptrtype(NULL, m);
+    *m = (struct mux_ctx){
+        .log        = mp_log_new(m, global->log, "ipc"),
+        .client_api = arg->client_api,
+        .stats      = stats_ctx_create(m, global, "ipc"),
+        .path       = talloc_strdup(m, arg->path),
+        .death      = {.fd = arg->death_pipe[0]},
+        .listen     = {.fd = -1},
+#if HAVE_EPOLL
+        .epoll_fd   = -1,
+#endif
+    };
+
+    if (pthread_create(&arg->thread, NULL, mux_thread, m)) {
+        talloc_free(m);
+        return false;
+    }
+    arg->mux = m;
+    return true;
+}
+
 struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
                                struct mpv_global *global)
 {
@@ -408,6 +933,7 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
         }
     }
 
+    bool multiplex = opts->ipc_multiplex;
     talloc_free(opts);
 
     if (!arg->path || !arg->path[0])
@@ -416,8 +942,13 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
     if (mp_make_wakeup_pipe(arg->death_pipe) < 0)
         goto out;
 
-    if (pthread_create(&arg->thread, NULL, ipc_thread, arg))
-        goto out;
+    if (multiplex) {
+        if (!mux_start(arg, global))
+            goto out;
+    } else {
+        if (pthread_create(&arg->thread, NULL, ipc_thread, arg))
+            goto out;
+    }
 
     return arg;
 
@@ -435,6 +966,22 @@ void mp_uninit_ipc(struct mp_ipc_ctx *arg)
     if (!arg)
         return;
 
+    if (arg->mux) {
+        // The mux_thread owns and closes the read end of the pipe. It can't
+        // exit before it gets the signal, so arg->mux is valid until then.
+        int no_clients = 0;
+        bool join = atomic_compare_exchange_strong(&arg->mux->join_state,
+                                                   &no_clients, -1);
+        if (!join)
+            pthread_detach(arg->thread);
+        (void)write(arg->death_pipe[1], &(char){0}, 1);
+        close(arg->death_pipe[1]);
+        if (join)
+            pthread_join(arg->thread, NULL);
+        talloc_free(arg);
+        return;
+    }
+
     (void)write(arg->death_pipe[1], &(char){0}, 1);
     pthread_join(arg->thread, NULL);
 
@@ -17,6 +17,7 @@
 
 #include "common/msg.h"
 #include "input/input.h"
+#include "misc/cbor.h"
 #include "misc/json.h"
 #include "misc/node.h"
 #include "options/m_option.h"
@@ -87,19 +88,24 @@ static void mpv_format_command_reply(void *ta_parent, mpv_event *event,
     mpv_node_map_add(ta_parent, dst, "data", &cmd->result);
 }
 
-char *mp_json_encode_event(mpv_event *event)
+static void event_to_node(void *ta_parent, mpv_event *event, mpv_node *dst)
 {
-    void *ta_parent = talloc_new(NULL);
-
-    struct mpv_node event_node;
     if (event->event_id == MPV_EVENT_COMMAND_REPLY) {
-        event_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
-        mpv_format_command_reply(ta_parent, event, &event_node);
+        *dst = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+        mpv_format_command_reply(ta_parent, event, dst);
     } else {
-        mpv_event_to_node(&event_node, event);
+        mpv_event_to_node(dst, event);
         // Abuse mpv_event_to_node() internals.
-        talloc_steal(ta_parent, node_get_alloc(&event_node));
+        talloc_steal(ta_parent, node_get_alloc(dst));
     }
+}
+
+char *mp_json_encode_event(mpv_event *event)
+{
+    void *ta_parent = talloc_new(NULL);
+
+    struct mpv_node event_node;
+    event_to_node(ta_parent, event, &event_node);
 
     char *output = talloc_strdup(NULL, "");
     json_write(&output, &event_node);
@@ -110,35 +116,258 @@ char *mp_json_encode_event(mpv_event *event)
     return output;
 }
 
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+// Append src as message in the given protocol to *out.
+static bool write_message(void *ta_parent, bstr *out, mpv_node *src,
+                          enum mp_ipc_protocol protocol)
+{
+    size_t start = out->len;
+
+    switch (protocol) {
+    case MP_IPC_PROTOCOL_JSON: {
+        char *json = talloc_strdup(NULL, "");
+        bool ok = json_write(&json, src) >= 0;
+        if (ok) {
+            bstr_xappend(ta_parent, out, bstr0(json));
+            bstr_xappend(ta_parent, out, bstr0("\n"));
+        }
+        talloc_free(json);
+        return ok;
+    }
+    case MP_IPC_PROTOCOL_CBOR: {
+        // Reserve the length prefix, and fill it in after writing the item.
+        bstr_xappend(ta_parent, out, (bstr){(unsigned char[4]){0}, 4});
+        if (cbor_write(ta_parent, out, src) < 0 ||
+            out->len - start - 4 > MP_IPC_MAX_MESSAGE_SIZE)
+        {
+            out->len = start;
+            return false;
+        }
+        uint32_t size = out->len - start - 4;
+        for (int n = 0; n < 4; n++)
+            out->start[start + n] = size >> (8 * (3 - n));
+        return true;
+    }
+    }
+    return false;
+}
+
+bool mp_ipc_encode_event(void *ta_parent, bstr *out, struct mpv_event *event,
+                         enum mp_ipc_protocol protocol)
+{
+    void *tmp = talloc_new(NULL);
+
+    struct mpv_node event_node;
+    event_to_node(tmp, event, &event_node);
+    bool ok = write_message(ta_parent, out, &event_node, protocol);
+
+    talloc_free(tmp);
+    return ok;
+}
+
+// Number of recently encoded events remembered by mp_ipc_event_cache. Events
+// broadcast to all clients arrive at each client's queue at roughly the same
+// time, so a small window is enough.
+#define EVENT_CACHE_SIZE 16
+
+struct cached_event {
+    void *ta;               // owns all allocations below, NULL if unused
+    mpv_event_id event_id;
+    int error;
+    uint64_t reply_userdata;
+    char *prop_name;        // MPV_EVENT_PROPERTY_CHANGE
+    struct mpv_node prop_value;
+    mpv_event_start_file start_file;
+    mpv_event_end_file end_file;
+    bstr encoded[MP_IPC_PROTOCOL_COUNT]; // start==NULL if not encoded yet
+};
+
+struct mp_ipc_event_cache {
+    struct cached_event entries[EVENT_CACHE_SIZE];
+    int next;
+    bstr uncached;          // result for an event that is not cached
+};
+
+static const struct m_option node_type = { .type = CONF_TYPE_NODE };
+
+static void free_cached_event(struct cached_event *e)
+{
+    m_option_free(&node_type, &e->prop_value);
+    talloc_free(e->ta);
+    *e = (struct cached_event){0};
+}
+
+static void destroy_event_cache(void *p)
+{
+    struct mp_ipc_event_cache *cache = p;
+    for (int n = 0; n < EVENT_CACHE_SIZE; n++)
+        free_cached_event(&cache->entries[n]);
+    talloc_free(cache->uncached.start);
+}
+
+struct mp_ipc_event_cache *mp_ipc_event_cache_create(void *ta_parent)
+{
+    struct mp_ipc_event_cache *cache =
+        talloc_zero(ta_parent, struct mp_ipc_event_cache);
+    talloc_set_destructor(cache, destroy_event_cache);
+    return cache;
+}
+
+// Reference the property value of a property change event as mpv_node (no
+// copy). Returns false if the format can't be represented.
+static bool get_property_node(mpv_event_property *prop, struct mpv_node *dst)
+{
+    *dst = (struct mpv_node){.format = prop->format};
+    switch (prop->format) {
+    case MPV_FORMAT_NONE:                                            break;
+    case MPV_FORMAT_STRING: dst->u.string = *(char **)prop->data;    break;
+    case MPV_FORMAT_FLAG:   dst->u.flag = *(int *)prop->data;        break;
+    case MPV_FORMAT_INT64:  dst->u.int64 = *(int64_t *)prop->data;   break;
+    case MPV_FORMAT_DOUBLE: dst->u.double_ = *(double *)prop->data;  break;
+    case MPV_FORMAT_NODE:   *dst = *(struct mpv_node *)prop->data;   break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+// Events which contain only data that is the same for every client. Replies
+// and messages addressed to a specific client are never cached.
+static bool is_cacheable_event(mpv_event *event)
+{
+    switch (event->event_id) {
+    case MPV_EVENT_PROPERTY_CHANGE:
+    case MPV_EVENT_START_FILE:
+    case MPV_EVENT_END_FILE:
+        return true;
+    case MPV_EVENT_COMMAND_REPLY:
+    case MPV_EVENT_GET_PROPERTY_REPLY:
+    case MPV_EVENT_SET_PROPERTY_REPLY:
+        return false;
+    default:
+        return !event->data;
+    }
+}
+
+static bool cached_event_matches(struct cached_event *e, mpv_event *event)
+{
+    if (!e->ta || e->event_id != event->event_id || e->error != event->error ||
+        e->reply_userdata != event->reply_userdata)
+        return false;
+
+    switch (event->event_id) {
+    case MPV_EVENT_PROPERTY_CHANGE: {
+        mpv_event_property *prop = event->data;
+        struct mpv_node val;
+        return strcmp(e->prop_name, prop->name) == 0 &&
+               get_property_node(prop, &val) &&
+               equal_mpv_node(&e->prop_value, &val);
+    }
+    case MPV_EVENT_START_FILE: {
+        mpv_event_start_file *ev = event->data;
+        return e->start_file.playlist_entry_id == ev->playlist_entry_id;
+    }
+    case MPV_EVENT_END_FILE: {
+        mpv_event_end_file *ev = event->data;
+        return e->end_file.reason == ev->reason &&
+               e->end_file.error == ev->error &&
+               e->end_file.playlist_entry_id == ev->playlist_entry_id &&
+               e->end_file.playlist_insert_id == ev->playlist_insert_id &&
+               e->end_file.playlist_insert_num_entries ==
+                    ev->playlist_insert_num_entries;
+    }
+    default:
+        return true;
+    }
+}
+
+bstr mp_ipc_event_cache_encode(struct mp_ipc_event_cache *cache,
+                               struct mpv_event *event,
+                               enum mp_ipc_protocol protocol, bool *cached)
+{
+    *cached = false;
+
+    talloc_free(cache->uncached.start);
+    cache->uncached = (bstr){0};
+    if (!is_cacheable_event(event)) {
+        if (!mp_ipc_encode_event(NULL, &cache->uncached, event, protocol))
+            return (bstr){0};
+        return cache->uncached;
+    }
+
+    struct cached_event *e = NULL;
+    for (int n = 0; n < EVENT_CACHE_SIZE; n++) {
+        if (cached_event_matches(&cache->entries[n], event)) {
+            e = &cache->entries[n];
+            break;
+        }
+    }
+
+    if (!e) {
+        struct mpv_node val = {0};
+        if (event->event_id == MPV_EVENT_PROPERTY_CHANGE &&
+            !get_property_node(event->data, &val))
+            return (bstr){0};
+
+        e = &cache->entries[cache->next];
+        cache->next = (cache->next + 1) % EVENT_CACHE_SIZE;
+        free_cached_event(e);
+
+        e->ta = talloc_new(NULL);
+        e->event_id = event->event_id;
+        e->error = event->error;
+        e->reply_userdata = event->reply_userdata;
+        switch (event->event_id) {
+        case MPV_EVENT_PROPERTY_CHANGE:
+            e->prop_name = talloc_strdup(e->ta,
+                                ((mpv_event_property *)event->data)->name);
+            m_option_copy(&node_type, &e->prop_value, &val);
+            break;
+        case MPV_EVENT_START_FILE:
+            e->start_file = *(mpv_event_start_file *)event->data;
+            break;
+        case MPV_EVENT_END_FILE:
+            e->end_file = *(mpv_event_end_file *)event->data;
+            break;
+        default: ;
+        }
+    }
+
+    bstr *encoded = &e->encoded[protocol];
+    if (encoded->start) {
+        *cached = true;
+    } else if (!mp_ipc_encode_event(e->ta, encoded, event, protocol)) {
+        free_cached_event(e);
+        return (bstr){0};
+    }
+    return *encoded;
+}
+
+// Execute the request in msg_node (NULL if it couldn't be parsed), and write
+// the reply to reply_node. Returns false if no reply should be sent. protocol
+// is NULL if the connection doesn't support changing the protocol, otherwise
+// it's set to the protocol used after sending the reply.
+static bool execute_request(struct mpv_handle *client, void *ta_parent,
+                            mpv_node *msg_node, mpv_node *reply_node,
+                            enum mp_ipc_protocol *protocol)
 {
     int rc;
     const char *cmd = NULL;
     struct mp_log *log = mp_client_get_log(client);
 
-    mpv_node msg_node;
-    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
     mpv_node *reqid_node = NULL;
     int64_t reqid = 0;
     mpv_node *async_node = NULL;
     bool async = false;
     bool send_reply = true;
 
-    rc = json_parse(ta_parent, &msg_node, &src, MAX_JSON_DEPTH);
-    if (rc < 0) {
-        mp_err(log, "malformed JSON received: '%s'\n", src);
-        rc = MPV_ERROR_INVALID_PARAMETER;
-        goto error;
-    }
+    *reply_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
 
-    if (msg_node.format != MPV_FORMAT_NODE_MAP) {
+    if (!msg_node || msg_node->format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    async_node = node_map_get(&msg_node, "async");
+    async_node = node_map_get(msg_node, "async");
     if (async_node) {
         if (async_node->format != MPV_FORMAT_FLAG) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -147,7 +376,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         async = async_node->u.flag;
     }
 
-    reqid_node = node_map_get(&msg_node, "request_id");
+    reqid_node = node_map_get(msg_node, "request_id");
     if (reqid_node) {
         if (reqid_node->format == MPV_FORMAT_INT64) {
             reqid = reqid_node->u.int64;
@@ -161,7 +390,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         }
     }
 
-    mpv_node *cmd_node = node_map_get(&msg_node, "command");
+    mpv_node *cmd_node = node_map_get(msg_node, "command");
     if (!cmd_node) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
@@ -177,17 +406,40 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         cmd = cmd_str_node->u.string;
     }
 
-    if (cmd && !strcmp("client_name", cmd)) {
+    if (cmd && !strcmp("ipc_protocol", cmd)) {
+        if (cmd_node->u.list->num != 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        const char *name = cmd_node->u.list->values[1].u.string;
+        if (!protocol) {
+            rc = MPV_ERROR_NOT_IMPLEMENTED;
+        } else if (!strcmp(name, "json")) {
+            *protocol = MP_IPC_PROTOCOL_JSON;
+            rc = MPV_ERROR_SUCCESS;
+        } else if (!strcmp(name, "cbor")) {
+            *protocol = MP_IPC_PROTOCOL_CBOR;
+            rc = MPV_ERROR_SUCCESS;
+        } else {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+        }
+    } else if (cmd && !strcmp("client_name", cmd)) {
         const char *client_name = mpv_client_name(client);
-        mpv_node_map_add_string(ta_parent, &reply_node, "data", client_name);
+        mpv_node_map_add_string(ta_parent, reply_node, "data", client_name);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_time_us", cmd)) {
         int64_t time_us = mpv_get_time_us(client);
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", time_us);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", time_us);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_version", cmd)) {
         int64_t ver = mpv_client_api_version();
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", ver);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", ver);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_property", cmd)) {
         mpv_node result_node;
@@ -205,7 +457,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         rc = mpv_get_property(client, cmd_node->u.list->values[1].u.string,
                               MPV_FORMAT_NODE, &result_node);
         if (rc >= 0) {
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
             mpv_free_node_contents(&result_node);
         }
     } else if (cmd && !strcmp("get_property_string", cmd)) {
@@ -222,10 +474,10 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         char *result = mpv_get_property_string(client,
                                         cmd_node->u.list->values[1].u.string);
         if (result) {
-            mpv_node_map_add_string(ta_parent, &reply_node, "data", result);
+            mpv_node_map_add_string(ta_parent, reply_node, "data", result);
             mpv_free(result);
         } else {
-            mpv_node_map_add_null(ta_parent, &reply_node, "data");
+            mpv_node_map_add_null(ta_parent, reply_node, "data");
         }
     } else if (cmd && (!strcmp("set_property", cmd) ||
                        !strcmp("set_property_string", cmd)))
@@ -351,7 +603,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         } else {
             rc = mpv_command_node(client, cmd_node, &result_node);
             if (rc >= 0)
-                mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+                mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
         }
 
         mpv_free_node_contents(&result_node);
@@ -363,28 +615,75 @@ error:
      * the original requests.
      */
     if (reqid_node) {
-        mpv_node_map_add(ta_parent, &reply_node, "request_id", reqid_node);
+        mpv_node_map_add(ta_parent, reply_node, "request_id", reqid_node);
     } else {
-        mpv_node_map_add_int64(ta_parent, &reply_node, "request_id", 0);
+        mpv_node_map_add_int64(ta_parent, reply_node, "request_id", 0);
     }
 
-    mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
+    mpv_node_map_add_string(ta_parent, reply_node, "error", mpv_error_string(rc));
+
+    return send_reply;
+}
 
-    char *output = talloc_strdup(ta_parent, "");
+// Function is allowed to modify src[n].
+static void json_execute_command(struct mpv_handle *client, void *ta_parent,
+                                 char *src, enum mp_ipc_protocol *protocol,
+                                 bstr *out, void *out_parent)
+{
+    struct mp_log *log = mp_client_get_log(client);
 
-    if (send_reply) {
-        json_write(&output, &reply_node);
-        output = ta_talloc_strdup_append(output, "\n");
+    mpv_node msg_node;
+    if (json_parse(ta_parent, &msg_node, &src, MAX_JSON_DEPTH) < 0) {
+        mp_err(log, "malformed JSON received: '%s'\n", src);
+        msg_node = (mpv_node){.format = MPV_FORMAT_NONE};
     }
 
-    return output;
+    mpv_node reply_node;
+    if (execute_request(client, ta_parent, &msg_node, &reply_node, protocol))
+        write_message(out_parent, out, &reply_node, MP_IPC_PROTOCOL_JSON);
+}
+
+static void cbor_execute_command(struct mpv_handle *client, void *ta_parent,
+                                 bstr src, enum mp_ipc_protocol *protocol,
+                                 bstr *out, void *out_parent)
+{
+    struct mp_log *log = mp_client_get_log(client);
+
+    mpv_node msg_node;
+    if (cbor_parse(ta_parent, &msg_node, &src, MAX_CBOR_DEPTH) < 0 || src.len) {
+        mp_err(log, "malformed CBOR message received\n");
+        msg_node = (mpv_node){.format = MPV_FORMAT_NONE};
+    } else if (msg_node.format == MPV_FORMAT_STRING) {
+        // Same as a text line with the JSON protocol.
+        mpv_command_string(client, msg_node.u.string);
+        return;
+    }
+
+    mpv_node reply_node;
+    if (execute_request(client, ta_parent, &msg_node, &reply_node, protocol))
+        write_message(out_parent, out, &reply_node, MP_IPC_PROTOCOL_CBOR);
 }
 
-static char *text_execute_command(struct mpv_handle *client, void *tmp, char *src)
+static void text_execute_command(struct mpv_handle *client, void *tmp, char *src)
 {
     mpv_command_string(client, src);
+}
+
+static void execute_line(struct mpv_handle *client, void *tmp, bstr line,
+                         enum mp_ipc_protocol *protocol, bstr *out,
+                         void *out_parent)
+{
+    char *line0 = bstrto0(tmp, line);
 
-    return NULL;
+    json_skip_whitespace(&line0);
+
+    if (line0[0] == '\0' || line0[0] == '#') {
+        // skip
+    } else if (line0[0] == '{') {
+        json_execute_command(client, tmp, line0, protocol, out, out_parent);
+    } else {
+        text_execute_command(client, tmp, line0);
+    }
 }
 
 char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
@@ -393,22 +692,55 @@ char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *bu
 
     bstr rest;
     bstr line = bstr_getline(*buf, &rest);
-    char *line0 = bstrto0(tmp, line);
     talloc_steal(tmp, buf->start);
     *buf = bstrdup(NULL, rest);
 
-    json_skip_whitespace(&line0);
+    bstr reply = {0};
+    execute_line(client, tmp, line, NULL, &reply, ctx);
 
-    char *reply_msg = NULL;
-    if (line0[0] == '\0' || line0[0] == '#') {
-        // skip
-    } else if (line0[0] == '{') {
-        reply_msg = json_execute_command(client, tmp, line0);
-    } else {
-        reply_msg = text_execute_command(client, tmp, line0);
+    talloc_free(tmp);
+    return (char *)reply.start;
+}
+
+int64_t mp_ipc_execute_next_message(struct mpv_handle *client,
+                                    enum mp_ipc_protocol *protocol, bstr buf,
+                                    bstr *out, void *out_parent)
+{
+    bstr msg;
+    switch (*protocol) {
+    case MP_IPC_PROTOCOL_JSON: {
+        int end = bstrchr(buf, '\n');
+        if (end < 0)
+            return 0;
+        msg = bstr_splice(buf, 0, end + 1);
+        break;
+    }
+    case MP_IPC_PROTOCOL_CBOR: {
+        if (buf.len < 4)
+            return 0;
+        uint32_t size = 0;
+        for (int n = 0; n < 4; n++)
+            size = (size << 8) | buf.start[n];
+        if (size > MP_IPC_MAX_MESSAGE_SIZE) {
+            mp_err(mp_client_get_log(client), "IPC message too large.\n");
+            return -1;
+        }
+        if (buf.len - 4 < size)
+            return 0;
+        msg = bstr_splice(buf, 4, 4 + size);
+        break;
+    }
+    default:
+        return -1;
     }
 
-    talloc_steal(ctx, reply_msg);
+    void *tmp = talloc_new(NULL);
+    if (*protocol == MP_IPC_PROTOCOL_CBOR) {
+        cbor_execute_command(client, tmp, msg, protocol, out, out_parent);
+    } else {
+        execute_line(client, tmp, msg, protocol, out, out_parent);
+    }
     talloc_free(tmp);
-    return reply_msg;
+
+    return msg.start + msg.len - buf.start;
 }
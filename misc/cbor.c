@@ -0,0 +1,334 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* CBOR parser and writer for mpv_node.
+ *
+ * Data items map to mpv_node as follows:
+ *  - unsigned and negative integers: MPV_FORMAT_INT64 (the parser rejects
+ *    values outside of the int64_t range)
+ *  - half, single and double precision floats: MPV_FORMAT_DOUBLE (the writer
+ *    uses single precision if that is lossless)
+ *  - text strings: MPV_FORMAT_STRING (the parser rejects embedded 0 bytes)
+ *  - byte strings: MPV_FORMAT_BYTE_ARRAY
+ *  - arrays: MPV_FORMAT_NODE_ARRAY
+ *  - maps: MPV_FORMAT_NODE_MAP (keys must be text strings)
+ *  - false/true: MPV_FORMAT_FLAG
+ *  - null/undefined: MPV_FORMAT_NONE (the writer uses null)
+ *
+ * Tags are skipped by the parser. Indefinite length items are not supported,
+ * and the writer uses the shortest argument encoding. Text strings are not
+ * checked for valid UTF-8 (same as with JSON).
+ *
+ * Also see: https://www.rfc-editor.org/rfc/rfc8949
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "common/common.h"
+
+#include "cbor.h"
+
+enum {
+    MAJOR_UINT      = 0,
+    MAJOR_NINT      = 1,
+    MAJOR_BYTES     = 2,
+    MAJOR_TEXT      = 3,
+    MAJOR_ARRAY     = 4,
+    MAJOR_MAP       = 5,
+    MAJOR_TAG       = 6,
+    MAJOR_SIMPLE    = 7,
+};
+
+enum {
+    SIMPLE_FALSE    = 20,
+    SIMPLE_TRUE     = 21,
+    SIMPLE_NULL     = 22,
+    SIMPLE_UNDEF    = 23,
+    SIMPLE_HALF     = 25,
+    SIMPLE_FLOAT    = 26,
+    SIMPLE_DOUBLE   = 27,
+};
+
+// Read the initial byte and the argument of a data item. For floats, *arg is
+// set to the raw bits.
+static int read_head(bstr *src, int *major, int *info, uint64_t *arg)
+{
+    if (!src->len)
+        return -1; // early EOF
+    *major = src->start[0] >> 5;
+    *info = src->start[0] & 31;
+    *src = bstr_cut(*src, 1);
+
+    if (*info < 24) {
+        *arg = *info;
+        return 0;
+    }
+    if (*info > 27)
+        return -1; // reserved, or indefinite length (not supported)
+
+    int size = 1 << (*info - 24);
+    if (src->len < size)
+        return -1; // early EOF
+    uint64_t v = 0;
+    for (int n = 0; n < size; n++)
+        v = (v << 8) | src->start[n];
+    *src = bstr_cut(*src, size);
+    *arg = v;
+    return 0;
+}
+
+static double half_to_double(uint16_t half)
+{
+    int exp = (half >> 10) & 0x1f;
+    int mant = half & 0x3ff;
+    double val;
+    if (exp == 0) {
+        val = ldexp(mant, -24);
+    } else if (exp != 31) {
+        val = ldexp(mant + 1024, exp - 25);
+    } else {
+        val = mant == 0 ? INFINITY : NAN;
+    }
+    return (half & 0x8000) ? -val : val;
+}
+
+static int read_simple(struct mpv_node *dst, int info, uint64_t arg)
+{
+    switch (info) {
+    case SIMPLE_FALSE:
+    case SIMPLE_TRUE:
+        dst->format = MPV_FORMAT_FLAG;
+        dst->u.flag = info == SIMPLE_TRUE;
+        return 0;
+    case SIMPLE_NULL:
+    case SIMPLE_UNDEF:
+        dst->format = MPV_FORMAT_NONE;
+        return 0;
+    case SIMPLE_HALF:
+        dst->format = MPV_FORMAT_DOUBLE;
+        dst->u.double_ = half_to_double(arg);
+        return 0;
+    case SIMPLE_FLOAT: {
+        uint32_t bits = arg;
+        float val;
+        memcpy(&val, &bits, sizeof(val));
+        dst->format = MPV_FORMAT_DOUBLE;
+        dst->u.double_ = val;
+        return 0;
+    }
+    case SIMPLE_DOUBLE:
+        dst->format = MPV_FORMAT_DOUBLE;
+        memcpy(&dst->u.double_, &arg, sizeof(double));
+        return 0;
+    }
+    return -1; // unassigned simple value
+}
+
+static int read_list(void *ta_parent, struct mpv_node *dst, bstr *src,
+                     uint64_t num, bool is_map, int max_depth)
+{
+    // Each item takes at least 1 byte. This also avoids allocating huge
+    // arrays for broken input.
+    if (num > src->len)
+        return -1;
+    struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+    list->values = talloc_array(list, struct mpv_node, num);
+    if (is_map)
+        list->keys = talloc_array(list, char *, num);
+    for (uint64_t n = 0; n < num; n++) {
+        if (is_map) {
+            struct mpv_node keynode;
+            if (cbor_parse(list, &keynode, src, max_depth) < 0 ||
+                keynode.format != MPV_FORMAT_STRING)
+                return -1; // key is not a string
+            list->keys[n] = keynode.u.string;
+        }
+        if (cbor_parse(ta_parent, &list->values[n], src, max_depth) < 0)
+            return -1;
+        list->num++;
+    }
+    dst->format = is_map ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
+    dst->u.list = list;
+    return 0;
+}
+
+/* Parse the data item at the start of *src as CBOR, and write the result into
+ * *dst. max_depth limits the recursion and tree depth.
+ * Returns:
+ *   0: success, *dst is valid, *src is advanced past the data item (the caller
+ *      must check whether there is trailing data)
+ *  -1: failure, *dst is invalid, there may be dead allocs under ta_parent
+ *      (ta_free_children(ta_parent) is the only way to free them)
+ * Unlike json_parse(), the input is not modified, and *dst does not point
+ * into it.
+ */
+int cbor_parse(void *ta_parent, struct mpv_node *dst, bstr *src, int max_depth)
+{
+    max_depth -= 1;
+    if (max_depth < 0)
+        return -1;
+
+    int major, info;
+    uint64_t arg;
+    if (read_head(src, &major, &info, &arg) < 0)
+        return -1;
+
+    switch (major) {
+    case MAJOR_UINT:
+    case MAJOR_NINT:
+        if (arg > INT64_MAX)
+            return -1; // not representable
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = major == MAJOR_UINT ? (int64_t)arg : -1 - (int64_t)arg;
+        return 0;
+    case MAJOR_BYTES: {
+        if (arg > src->len)
+            return -1; // early EOF
+        struct mpv_byte_array *ba = talloc_zero(ta_parent, struct mpv_byte_array);
+        ba->data = talloc_memdup(ba, src->start, arg);
+        ba->size = arg;
+        *src = bstr_cut(*src, arg);
+        dst->format = MPV_FORMAT_BYTE_ARRAY;
+        dst->u.ba = ba;
+        return 0;
+    }
+    case MAJOR_TEXT:
+        if (arg > src->len)
+            return -1; // early EOF
+        if (memchr(src->start, '\0', arg))
+            return -1; // can't be represented as C string
+        dst->format = MPV_FORMAT_STRING;
+        dst->u.string = talloc_strndup(ta_parent, (char *)src->start, arg);
+        *src = bstr_cut(*src, arg);
+        return 0;
+    case MAJOR_ARRAY:
+    case MAJOR_MAP:
+        return read_list(ta_parent, dst, src, arg, major == MAJOR_MAP,
+                         max_depth);
+    case MAJOR_TAG:
+        // Semantic tags are not interpreted; use the tagged item as-is.
+        return cbor_parse(ta_parent, dst, src, max_depth);
+    case MAJOR_SIMPLE:
+        return read_simple(dst, info, arg);
+    }
+    return -1;
+}
+
+static void write_head(void *ta_parent, bstr *b, int major, uint64_t arg)
+{
+    unsigned char buf[9];
+    int size;
+    if (arg < 24) {
+        buf[0] = arg;
+        size = 1;
+    } else if (arg <= UINT8_MAX) {
+        buf[0] = 24;
+        size = 2;
+    } else if (arg <= UINT16_MAX) {
+        buf[0] = 25;
+        size = 3;
+    } else if (arg <= UINT32_MAX) {
+        buf[0] = 26;
+        size = 5;
+    } else {
+        buf[0] = 27;
+        size = 9;
+    }
+    buf[0] |= major << 5;
+    for (int n = 1; n < size; n++)
+        buf[n] = arg >> (8 * (size - 1 - n));
+    bstr_xappend(ta_parent, b, (bstr){buf, size});
+}
+
+static void write_double(void *ta_parent, bstr *b, double val)
+{
+    float valf = val;
+    if (valf == val || isnan(val)) {
+        uint32_t bits;
+        memcpy(&bits, &valf, sizeof(bits));
+        bstr_xappend(ta_parent, b, (bstr){(unsigned char[]){0xE0 | SIMPLE_FLOAT,
+                     bits >> 24, bits >> 16, bits >> 8, bits}, 5});
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &val, sizeof(bits));
+        unsigned char buf[9] = {0xE0 | SIMPLE_DOUBLE};
+        for (int n = 1; n < 9; n++)
+            buf[n] = bits >> (8 * (8 - n));
+        bstr_xappend(ta_parent, b, (bstr){buf, 9});
+    }
+}
+
+static int write_node(void *ta_parent, bstr *b, const struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_NONE:
+        write_head(ta_parent, b, MAJOR_SIMPLE, SIMPLE_NULL);
+        return 0;
+    case MPV_FORMAT_FLAG:
+        write_head(ta_parent, b, MAJOR_SIMPLE,
+                   src->u.flag ? SIMPLE_TRUE : SIMPLE_FALSE);
+        return 0;
+    case MPV_FORMAT_INT64:
+        if (src->u.int64 >= 0) {
+            write_head(ta_parent, b, MAJOR_UINT, src->u.int64);
+        } else {
+            write_head(ta_parent, b, MAJOR_NINT, -(src->u.int64 + 1));
+        }
+        return 0;
+    case MPV_FORMAT_DOUBLE:
+        write_double(ta_parent, b, src->u.double_);
+        return 0;
+    case MPV_FORMAT_STRING: {
+        size_t len = strlen(src->u.string);
+        write_head(ta_parent, b, MAJOR_TEXT, len);
+        bstr_xappend(ta_parent, b, (bstr){(unsigned char *)src->u.string, len});
+        return 0;
+    }
+    case MPV_FORMAT_BYTE_ARRAY:
+        write_head(ta_parent, b, MAJOR_BYTES, src->u.ba->size);
+        bstr_xappend(ta_parent, b, (bstr){src->u.ba->data, src->u.ba->size});
+        return 0;
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        bool is_map = src->format == MPV_FORMAT_NODE_MAP;
+        write_head(ta_parent, b, is_map ? MAJOR_MAP : MAJOR_ARRAY, list->num);
+        for (int n = 0; n < list->num; n++) {
+            if (is_map) {
+                struct mpv_node key = {.format = MPV_FORMAT_STRING,
+                                       .u.string = list->keys[n]};
+                write_node(ta_parent, b, &key);
+            }
+            if (write_node(ta_parent, b, &list->values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    }
+    return -1; // unknown format
+}
+
+/* Write the contents of *src as CBOR data item, and append it to *dst. *dst
+ * must be a talloc allocation (or NULL), and is reallocated with ta_parent as
+ * parent.
+ * Returns: 0 on success, <0 on failure (*dst may contain a partial item).
+ */
+int cbor_write(void *ta_parent, bstr *dst, struct mpv_node *src)
+{
+    return write_node(ta_parent, dst, src);
+}
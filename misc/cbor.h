@@ -0,0 +1,30 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_CBOR_H
+#define MP_CBOR_H
+
+// We reuse mpv_node.
+#include "libmpv/client.h"
+#include "misc/bstr.h"
+
+#define MAX_CBOR_DEPTH 50
+
+int cbor_parse(void *ta_parent, struct mpv_node *dst, bstr *src, int max_depth);
+int cbor_write(void *ta_parent, bstr *dst, struct mpv_node *src);
+
+#endif
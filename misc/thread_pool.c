@@ -16,6 +16,7 @@
 #include <pthread.h>
 
 #include "common/common.h"
+#include "osdep/atomic.h"
 #include "osdep/threads.h"
 #include "osdep/timer.h"
 
@@ -30,85 +31,198 @@ struct work {
     void *fn_ctx;
 };
 
+// Double-ended queue of work items (ring buffer). The owning worker pushes and
+// pops at the back, other workers steal from the front. Each queue has its own
+// lock, so the owner only contends with the occasional thief.
+struct work_queue {
+    pthread_mutex_t lock;
+    struct work *items;
+    int alloc;
+    int head;       // index of the front item
+    int num;
+};
+
+struct worker {
+    struct mp_thread_pool *pool;
+    struct work_queue queue;
+
+    // --- the following fields are protected by pool->lock
+    pthread_t thread;
+    bool active;    // a thread is running in this slot
+};
+
 struct mp_thread_pool {
     int min_threads, max_threads;
+    double idle_timeout;
+
+    // Work queued from threads which are not workers of this pool.
+    struct work_queue global;
+
+    // Fixed array of max_threads slots, so that thieves can iterate it without
+    // locking the pool.
+    struct worker *workers;
+
+    // Number of work items in all queues. Incremented before an item becomes
+    // visible, so it never underestimates the amount of queued work.
+    atomic_int pending;
+
+    // Number of threads which have taken up work and are still processing it.
+    atomic_int busy_threads;
+
+    // Number of threads waiting on the wakeup condition.
+    atomic_int sleeping;
+
+    atomic_int num_threads;
 
     pthread_mutex_t lock;
     pthread_cond_t wakeup;
 
     // --- the following fields are protected by lock
 
-    pthread_t *threads;
-    int num_threads;
+    bool terminate;
+};
 
-    // Number of threads which have taken up work and are still processing it.
-    int busy_threads;
+// The worker the current thread is running, if any.
+static __thread struct worker *current_worker;
 
-    bool terminate;
+static void queue_push(struct mp_thread_pool *pool, struct work_queue *q,
+                       struct work work)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->num == q->alloc) {
+        // Grow and linearize the ring buffer.
+        int alloc = MPMAX(16, q->alloc * 2);
+        struct work *items = talloc_array(pool, struct work, alloc);
+        for (int n = 0; n < q->num; n++)
+            items[n] = q->items[(q->head + n) % q->alloc];
+        talloc_free(q->items);
+        q->items = items;
+        q->alloc = alloc;
+        q->head = 0;
+    }
+    atomic_fetch_add(&pool->pending, 1);
+    q->items[(q->head + q->num) % q->alloc] = work;
+    q->num += 1;
+    pthread_mutex_unlock(&q->lock);
+}
 
-    struct work *work;
-    int num_work;
-};
+// Remove an item from the back (LIFO, owner) or front (FIFO, thief) of the
+// queue. On success, the caller is accounted as busy thread.
+static bool queue_pop(struct mp_thread_pool *pool, struct work_queue *q,
+                      bool back, struct work *out)
+{
+    bool ok = false;
+    pthread_mutex_lock(&q->lock);
+    if (q->num) {
+        if (back) {
+            *out = q->items[(q->head + q->num - 1) % q->alloc];
+        } else {
+            *out = q->items[q->head];
+            q->head = (q->head + 1) % q->alloc;
+        }
+        q->num -= 1;
+        // Increment busy_threads first, so that busy_threads + pending (read
+        // in this order) never underestimates the load.
+        atomic_fetch_add(&pool->busy_threads, 1);
+        atomic_fetch_add(&pool->pending, -1);
+        ok = true;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok;
+}
+
+static bool get_work(struct worker *w, struct work *out)
+{
+    struct mp_thread_pool *pool = w->pool;
+
+    if (queue_pop(pool, &w->queue, true, out))
+        return true;
+
+    if (queue_pop(pool, &pool->global, false, out))
+        return true;
+
+    int self = w - pool->workers;
+    for (int n = 1; n < pool->max_threads; n++) {
+        struct worker *victim = &pool->workers[(self + n) % pool->max_threads];
+        if (queue_pop(pool, &victim->queue, false, out))
+            return true;
+    }
+
+    return false;
+}
 
 static void *worker_thread(void *arg)
 {
-    struct mp_thread_pool *pool = arg;
+    struct worker *w = arg;
+    struct mp_thread_pool *pool = w->pool;
 
     mpthread_set_name("worker");
 
-    pthread_mutex_lock(&pool->lock);
+    current_worker = w;
 
-    struct timespec ts = {0};
-    bool got_timeout = false;
     while (1) {
-        struct work work = {0};
-        if (pool->num_work > 0) {
-            work = pool->work[pool->num_work - 1];
-            pool->num_work -= 1;
+        struct work work;
+        if (get_work(w, &work)) {
+            work.fn(work.fn_ctx);
+            atomic_fetch_add(&pool->busy_threads, -1);
+            continue;
         }
 
-        if (!work.fn) {
-            if (got_timeout || pool->terminate)
+        pthread_mutex_lock(&pool->lock);
+
+        // Producers increment pending before they check sleeping (all
+        // seq_cst): either we see the new work here, or the producer sees us
+        // sleeping and signals us (it takes the lock to do so, so we can't
+        // miss the signal).
+        atomic_fetch_add(&pool->sleeping, 1);
+
+        struct timespec ts = {0};
+        bool exit = false, got_timeout = false;
+        while (atomic_load(&pool->pending) <= 0) {
+            if (got_timeout || pool->terminate) {
+                exit = true;
                 break;
+            }
 
-            if (pool->num_threads > pool->min_threads) {
+            if (atomic_load(&pool->num_threads) > pool->min_threads) {
                 if (!ts.tv_sec && !ts.tv_nsec)
-                    ts = mp_rel_time_to_timespec(DESTROY_TIMEOUT);
-                if (pthread_cond_timedwait(&pool->wakeup, &pool->lock, &ts))
-                    got_timeout = pool->num_threads > pool->min_threads;
+                    ts = mp_rel_time_to_timespec(pool->idle_timeout);
+                if (pthread_cond_timedwait(&pool->wakeup, &pool->lock, &ts)) {
+                    got_timeout =
+                        atomic_load(&pool->num_threads) > pool->min_threads;
+                }
             } else {
                 pthread_cond_wait(&pool->wakeup, &pool->lock);
             }
-            continue;
         }
 
-        pool->busy_threads += 1;
-        pthread_mutex_unlock(&pool->lock);
-
-        work.fn(work.fn_ctx);
-
-        pthread_mutex_lock(&pool->lock);
-        pool->busy_threads -= 1;
-
-        ts = (struct timespec){0};
-        got_timeout = false;
-    }
-
-    // If no termination signal was given, it must mean we died because of a
-    // timeout, and nobody is waiting for us. We have to remove ourselves.
-    if (!pool->terminate) {
-        for (int n = 0; n < pool->num_threads; n++) {
-            if (pthread_equal(pool->threads[n], pthread_self())) {
+        atomic_fetch_add(&pool->sleeping, -1);
+
+        if (exit && !pool->terminate) {
+            // No termination signal was given, so we died because of a
+            // timeout, and nobody is waiting for us. We have to remove
+            // ourselves. Our queue is empty, because only we push to it.
+            // A producer may have pushed work after our last check, and seen
+            // us as alive, so it didn't start a new thread. Check again after
+            // decrementing the thread count: either we see the work and stay,
+            // or the producer sees the new count (see thread_pool_add()).
+            atomic_fetch_add(&pool->num_threads, -1);
+            if (atomic_load(&pool->pending) > 0) {
+                atomic_fetch_add(&pool->num_threads, 1);
+                exit = false;
+            } else {
                 pthread_detach(pthread_self());
-                MP_TARRAY_REMOVE_AT(pool->threads, pool->num_threads, n);
-                pthread_mutex_unlock(&pool->lock);
-                return NULL;
+                w->active = false;
             }
         }
-        MP_ASSERT_UNREACHABLE();
+
+        pthread_mutex_unlock(&pool->lock);
+
+        if (exit)
+            break;
     }
 
-    pthread_mutex_unlock(&pool->lock);
+    current_worker = NULL;
     return NULL;
 }
 
@@ -116,38 +230,48 @@ static void thread_pool_dtor(void *ctx)
 {
     struct mp_thread_pool *pool = ctx;
 
-
     pthread_mutex_lock(&pool->lock);
 
     pool->terminate = true;
     pthread_cond_broadcast(&pool->wakeup);
 
-    pthread_t *threads = pool->threads;
-    int num_threads = pool->num_threads;
-
-    pool->threads = NULL;
-    pool->num_threads = 0;
+    pthread_t *threads = talloc_array(NULL, pthread_t, pool->max_threads);
+    int num_threads = 0;
+    for (int n = 0; n < pool->max_threads; n++) {
+        struct worker *w = &pool->workers[n];
+        if (w->active)
+            threads[num_threads++] = w->thread;
+        w->active = false;
+    }
 
     pthread_mutex_unlock(&pool->lock);
 
     for (int n = 0; n < num_threads; n++)
         pthread_join(threads[n], NULL);
+    talloc_free(threads);
 
-    assert(pool->num_work == 0);
-    assert(pool->num_threads == 0);
+    assert(atomic_load(&pool->pending) == 0);
+    for (int n = 0; n < pool->max_threads; n++)
+        pthread_mutex_destroy(&pool->workers[n].queue.lock);
+    pthread_mutex_destroy(&pool->global.lock);
     pthread_cond_destroy(&pool->wakeup);
     pthread_mutex_destroy(&pool->lock);
 }
 
+// Must be called with pool->lock held.
 static bool add_thread(struct mp_thread_pool *pool)
 {
-    pthread_t thread;
-
-    if (pthread_create(&thread, NULL, worker_thread, pool) != 0)
-        return false;
-
-    MP_TARRAY_APPEND(pool, pool->threads, pool->num_threads, thread);
-    return true;
+    for (int n = 0; n < pool->max_threads; n++) {
+        struct worker *w = &pool->workers[n];
+        if (w->active)
+            continue;
+        if (pthread_create(&w->thread, NULL, worker_thread, w) != 0)
+            return false;
+        w->active = true;
+        atomic_fetch_add(&pool->num_threads, 1);
+        return true;
+    }
+    return false;
 }
 
 struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int init_threads,
@@ -162,14 +286,22 @@ struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int init_threads,
 
     pthread_mutex_init(&pool->lock, NULL);
     pthread_cond_init(&pool->wakeup, NULL);
+    pthread_mutex_init(&pool->global.lock, NULL);
 
     pool->min_threads = min_threads;
     pool->max_threads = max_threads;
+    pool->idle_timeout = DESTROY_TIMEOUT;
+
+    pool->workers = talloc_zero_array(pool, struct worker, max_threads);
+    for (int n = 0; n < max_threads; n++) {
+        pool->workers[n].pool = pool;
+        pthread_mutex_init(&pool->workers[n].queue.lock, NULL);
+    }
 
     pthread_mutex_lock(&pool->lock);
     for (int n = 0; n < init_threads; n++)
         add_thread(pool);
-    bool ok = pool->num_threads >= init_threads;
+    bool ok = atomic_load(&pool->num_threads) >= init_threads;
     pthread_mutex_unlock(&pool->lock);
 
     if (!ok)
@@ -178,36 +310,67 @@ struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int init_threads,
     return pool;
 }
 
+// If there are not enough threads to process all at once, but we can create a
+// new thread, then do so. If work is queued quickly, it can happen that not all
+// available threads have picked up work yet (up to num_threads - busy_threads
+// threads), which has to be accounted for.
+static bool need_thread(struct mp_thread_pool *pool)
+{
+    int pending = atomic_load(&pool->pending);
+    int busy = atomic_load(&pool->busy_threads);
+    int num_threads = atomic_load(&pool->num_threads);
+    return busy + pending + 1 > num_threads && num_threads < pool->max_threads;
+}
+
 static bool thread_pool_add(struct mp_thread_pool *pool, void (*fn)(void *ctx),
                             void *fn_ctx, bool allow_queue)
 {
-    bool ok = true;
-
     assert(fn);
 
-    pthread_mutex_lock(&pool->lock);
-    struct work work = {fn, fn_ctx};
-
-    // If there are not enough threads to process all at once, but we can
-    // create a new thread, then do so. If work is queued quickly, it can
-    // happen that not all available threads have picked up work yet (up to
-    // num_threads - busy_threads threads), which has to be accounted for.
-    if (pool->busy_threads + pool->num_work + 1 > pool->num_threads &&
-        pool->num_threads < pool->max_threads)
-    {
-        if (!add_thread(pool)) {
-            // If we can queue it, it'll get done as long as there is 1 thread.
-            ok = allow_queue && pool->num_threads > 0;
+    // The pool lock is only taken to spawn threads and to wake up sleeping
+    // ones. Once all threads are busy or running, queuing is lock-free
+    // (except for the queue's own lock).
+    if (need_thread(pool)) {
+        bool ok = true;
+        pthread_mutex_lock(&pool->lock);
+        if (need_thread(pool) && !add_thread(pool)) {
+            // If we can queue it, it'll get done as long as there is 1
+            // thread.
+            ok = allow_queue && atomic_load(&pool->num_threads) > 0;
         }
+        pthread_mutex_unlock(&pool->lock);
+        if (!ok)
+            return false;
     }
 
-    if (ok) {
-        MP_TARRAY_INSERT_AT(pool, pool->work, pool->num_work, 0, work);
+    struct worker *w = current_worker;
+    struct work_queue *q = w && w->pool == pool ? &w->queue : &pool->global;
+    queue_push(pool, q, (struct work){fn, fn_ctx});
+
+    // pending was incremented by the push. Workers that go to sleep or exit
+    // check it after incrementing sleeping or decrementing num_threads, so if
+    // they missed the new item, we see them here (see worker_thread()). The
+    // last worker might have exited since the check above, so this may have
+    // to start a thread again.
+    if (atomic_load(&pool->sleeping) > 0 ||
+        atomic_load(&pool->num_threads) == 0)
+    {
+        pthread_mutex_lock(&pool->lock);
+        if (atomic_load(&pool->num_threads) == 0 && !pool->terminate)
+            add_thread(pool);
         pthread_cond_signal(&pool->wakeup);
+        pthread_mutex_unlock(&pool->lock);
     }
 
+    return true;
+}
+
+void mp_thread_pool_set_idle_timeout(struct mp_thread_pool *pool,
+                                     double seconds)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->idle_timeout = seconds;
     pthread_mutex_unlock(&pool->lock);
-    return ok;
 }
 
 bool mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
@@ -221,3 +384,92 @@ bool mp_thread_pool_run(struct mp_thread_pool *pool, void (*fn)(void *ctx),
 {
     return thread_pool_add(pool, fn, fn_ctx, false);
 }
+
+struct parallel_for {
+    void (*fn)(void *ctx, int index);
+    void *fn_ctx;
+    int count;
+
+    atomic_int next;        // next index to claim
+    atomic_int done;        // number of indices processed
+    atomic_int refs;        // caller + queued helpers
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+};
+
+static void parallel_for_unref(struct parallel_for *pf)
+{
+    if (atomic_fetch_add(&pf->refs, -1) == 1) {
+        pthread_cond_destroy(&pf->wakeup);
+        pthread_mutex_destroy(&pf->lock);
+        talloc_free(pf);
+    }
+}
+
+static void parallel_for_work(struct parallel_for *pf)
+{
+    while (1) {
+        int index = atomic_fetch_add(&pf->next, 1);
+        if (index >= pf->count)
+            break;
+
+        pf->fn(pf->fn_ctx, index);
+
+        if (atomic_fetch_add(&pf->done, 1) + 1 == pf->count) {
+            pthread_mutex_lock(&pf->lock);
+            pthread_cond_broadcast(&pf->wakeup);
+            pthread_mutex_unlock(&pf->lock);
+        }
+    }
+}
+
+static void parallel_for_helper(void *ctx)
+{
+    struct parallel_for *pf = ctx;
+
+    parallel_for_work(pf);
+    parallel_for_unref(pf);
+}
+
+void mp_thread_pool_parallel_for(struct mp_thread_pool *pool, int count,
+                                 void (*fn)(void *ctx, int index),
+                                 void *fn_ctx)
+{
+    if (!pool || count < 2) {
+        for (int n = 0; n < count; n++)
+            fn(fn_ctx, n);
+        return;
+    }
+
+    // The state is refcounted, because helpers may start running only after
+    // the caller has processed all indices and returned.
+    struct parallel_for *pf = talloc_ptrtype(NULL, pf);
+    *pf = (struct parallel_for){
+        .fn = fn,
+        .fn_ctx = fn_ctx,
+        .count = count,
+    };
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->wakeup, NULL);
+
+    int helpers = MPMIN(count - 1, pool->max_threads);
+    atomic_store(&pf->refs, 1 + helpers);
+    for (int n = 0; n < helpers; n++) {
+        if (!thread_pool_add(pool, parallel_for_helper, pf, true)) {
+            atomic_fetch_add(&pf->refs, -(helpers - n));
+            break;
+        }
+    }
+
+    // The caller takes part, so this makes progress even if all workers are
+    // busy (or if this is called from a worker thread).
+    parallel_for_work(pf);
+
+    pthread_mutex_lock(&pf->lock);
+    while (atomic_load(&pf->done) < count)
+        pthread_cond_wait(&pf->wakeup, &pf->lock);
+    pthread_mutex_unlock(&pf->lock);
+
+    parallel_for_unref(pf);
+}
@@ -16,6 +16,11 @@ struct mp_thread_pool;
 struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int init_threads,
                                              int min_threads, int max_threads);
 
+// Set how long threads above min_threads wait for new work before they exit
+// (default: 10 seconds). Affects only threads which start waiting afterwards.
+void mp_thread_pool_set_idle_timeout(struct mp_thread_pool *pool,
+                                     double seconds);
+
 // Queue a function to be run on a worker thread: fn(fn_ctx)
 // If no worker thread is currently available, it's appended to a list in memory
 // with unbounded size. This function always returns immediately.
@@ -31,4 +36,15 @@ bool mp_thread_pool_queue(struct mp_thread_pool *pool, void (*fn)(void *ctx),
 bool mp_thread_pool_run(struct mp_thread_pool *pool, void (*fn)(void *ctx),
                         void *fn_ctx);
 
+// Run fn(fn_ctx, index) for each index in [0, count), and return once all
+// calls have returned. The calls are distributed over the pool's worker
+// threads and the calling thread, in unspecified order. The calling thread
+// always takes part, so this never fails and makes progress even if all
+// workers are busy, or if it is called from a worker thread (nesting is
+// allowed). pool can be NULL, in which case everything runs on the caller.
+// This function is explicitly thread-safe.
+void mp_thread_pool_parallel_for(struct mp_thread_pool *pool, int count,
+                                 void (*fn)(void *ctx, int index),
+                                 void *fn_ctx);
+
 #endif
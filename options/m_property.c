@@ -35,14 +35,14 @@
 #include "common/common.h"
 
 static int m_property_multiply(struct mp_log *log,
-                               const struct m_property *prop_list,
+                               const struct m_property_index *props,
                                const char *property, double f, void *ctx)
 {
     union m_option_value val = {0};
     struct m_option opt = {0};
     int r;
 
-    r = m_property_do(log, prop_list, property, M_PROPERTY_GET_CONSTRICTED_TYPE,
+    r = m_property_do(log, props, property, M_PROPERTY_GET_CONSTRICTED_TYPE,
                       &opt, ctx);
     if (r != M_PROPERTY_OK)
         return r;
@@ -51,11 +51,11 @@ static int m_property_multiply(struct mp_log *log,
     if (!opt.type->multiply)
         return M_PROPERTY_NOT_IMPLEMENTED;
 
-    r = m_property_do(log, prop_list, property, M_PROPERTY_GET, &val, ctx);
+    r = m_property_do(log, props, property, M_PROPERTY_GET, &val, ctx);
     if (r != M_PROPERTY_OK)
         return r;
     opt.type->multiply(&opt, &val, f);
-    r = m_property_do(log, prop_list, property, M_PROPERTY_SET, &val, ctx);
+    r = m_property_do(log, props, property, M_PROPERTY_SET, &val, ctx);
     m_option_free(&opt, &val);
     return r;
 }
@@ -70,16 +70,82 @@ struct m_property *m_property_list_find(const struct m_property *list,
     return NULL;
 }
 
-static int do_action(const struct m_property *prop_list, const char *name,
+struct m_property_index {
+    const struct m_property *list;
+    int num_props;
+    // Open addressing hash table. Each slot contains the index of the
+    // property in list plus 1, or 0 if the slot is unused.
+    int *slots;
+    uint32_t mask;      // number of slots minus 1 (power of 2)
+};
+
+// FNV-1a
+static uint32_t prop_hash(bstr name)
+{
+    uint32_t h = 2166136261u;
+    for (int n = 0; n < name.len; n++) {
+        h ^= name.start[n];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+struct m_property_index *m_property_index_create(void *ta_parent,
+                                                 const struct m_property *list)
+{
+    struct m_property_index *index = talloc_zero(ta_parent, struct m_property_index);
+    index->list = list;
+    while (list[index->num_props].name)
+        index->num_props++;
+
+    // Keep the load factor below 50%, so that probe sequences stay short.
+    uint32_t size = 16;
+    while (size < index->num_props * 2)
+        size *= 2;
+    index->mask = size - 1;
+    index->slots = talloc_zero_array(index, int, size);
+
+    for (int n = 0; n < index->num_props; n++) {
+        uint32_t slot = prop_hash(bstr0(list[n].name)) & index->mask;
+        while (index->slots[slot]) {
+            // Duplicate names are not allowed; the first entry would win.
+            assert(strcmp(list[index->slots[slot] - 1].name, list[n].name) != 0);
+            slot = (slot + 1) & index->mask;
+        }
+        index->slots[slot] = n + 1;
+    }
+
+    return index;
+}
+
+int m_property_index_find_id(const struct m_property_index *index, bstr name)
+{
+    uint32_t slot = prop_hash(name) & index->mask;
+    while (index->slots[slot]) {
+        int id = index->slots[slot] - 1;
+        if (bstr_equals0(name, index->list[id].name))
+            return id;
+        slot = (slot + 1) & index->mask;
+    }
+    return -1;
+}
+
+struct m_property *m_property_index_find(const struct m_property_index *index,
+                                         bstr name)
+{
+    int id = m_property_index_find_id(index, name);
+    return id >= 0 ? (struct m_property *)&index->list[id] : NULL;
+}
+
+static int do_action(const struct m_property_index *props, const char *name,
                      int action, void *arg, void *ctx)
 {
     struct m_property *prop;
     struct m_property_action_arg ka;
     const char *sep = strchr(name, '/');
     if (sep && sep[1]) {
-        char base[128];
-        snprintf(base, sizeof(base), "%.*s", (int)(sep - name), name);
-        prop = m_property_list_find(prop_list, base);
+        bstr base = bstr_splice(bstr0(name), 0, sep - name);
+        prop = m_property_index_find(props, base);
         ka = (struct m_property_action_arg) {
             .key = sep + 1,
             .action = action,
@@ -88,31 +154,31 @@ static int do_action(const struct m_property *prop_list, const char *name,
         action = M_PROPERTY_KEY_ACTION;
         arg = &ka;
     } else
-        prop = m_property_list_find(prop_list, name);
+        prop = m_property_index_find(props, bstr0(name));
     if (!prop)
         return M_PROPERTY_UNKNOWN;
     return prop->call(ctx, prop, action, arg);
 }
 
 // (as a hack, log can be NULL on read-only paths)
-int m_property_do(struct mp_log *log, const struct m_property *prop_list,
+int m_property_do(struct mp_log *log, const struct m_property_index *props,
                   const char *name, int action, void *arg, void *ctx)
 {
     union m_option_value val = {0};
     int r;
 
     struct m_option opt = {0};
-    r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, &opt, ctx);
+    r = do_action(props, name, M_PROPERTY_GET_TYPE, &opt, ctx);
     if (r <= 0)
         return r;
     assert(opt.type);
 
     switch (action) {
     case M_PROPERTY_PRINT: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_PRINT, arg, ctx)) >= 0)
+        if ((r = do_action(props, name, M_PROPERTY_PRINT, arg, ctx)) >= 0)
             return r;
         // Fallback to m_option
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(props, name, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_pretty_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -120,7 +186,7 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
         return str != NULL;
     }
     case M_PROPERTY_GET_STRING: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(props, name, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         char *str = m_option_print(&opt, &val);
         m_option_free(&opt, &val);
@@ -129,49 +195,49 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     }
     case M_PROPERTY_SET_STRING: {
         struct mpv_node node = { .format = MPV_FORMAT_STRING, .u.string = arg };
-        return m_property_do(log, prop_list, name, M_PROPERTY_SET_NODE, &node, ctx);
+        return m_property_do(log, props, name, M_PROPERTY_SET_NODE, &node, ctx);
     }
     case M_PROPERTY_MULTIPLY: {
-        return m_property_multiply(log, prop_list, name, *(double *)arg, ctx);
+        return m_property_multiply(log, props, name, *(double *)arg, ctx);
     }
     case M_PROPERTY_SWITCH: {
         if (!log)
             return M_PROPERTY_ERROR;
         struct m_property_switch_arg *sarg = arg;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SWITCH, arg, ctx)) !=
+        if ((r = do_action(props, name, M_PROPERTY_SWITCH, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
         // Fallback to m_option
-        r = m_property_do(log, prop_list, name, M_PROPERTY_GET_CONSTRICTED_TYPE,
+        r = m_property_do(log, props, name, M_PROPERTY_GET_CONSTRICTED_TYPE,
                           &opt, ctx);
         if (r <= 0)
             return r;
         assert(opt.type);
         if (!opt.type->add)
             return M_PROPERTY_NOT_IMPLEMENTED;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(props, name, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         opt.type->add(&opt, &val, sarg->inc, sarg->wrap);
-        r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+        r = do_action(props, name, M_PROPERTY_SET, &val, ctx);
         m_option_free(&opt, &val);
         return r;
     }
     case M_PROPERTY_GET_CONSTRICTED_TYPE: {
-        r = do_action(prop_list, name, action, arg, ctx);
+        r = do_action(props, name, action, arg, ctx);
         if (r >= 0 || r == M_PROPERTY_UNAVAILABLE)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_TYPE, arg, ctx)) >= 0)
+        if ((r = do_action(props, name, M_PROPERTY_GET_TYPE, arg, ctx)) >= 0)
             return r;
         return M_PROPERTY_NOT_IMPLEMENTED;
     }
     case M_PROPERTY_SET: {
-        return do_action(prop_list, name, M_PROPERTY_SET, arg, ctx);
+        return do_action(props, name, M_PROPERTY_SET, arg, ctx);
     }
     case M_PROPERTY_GET_NODE: {
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET_NODE, arg, ctx)) !=
+        if ((r = do_action(props, name, M_PROPERTY_GET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
-        if ((r = do_action(prop_list, name, M_PROPERTY_GET, &val, ctx)) <= 0)
+        if ((r = do_action(props, name, M_PROPERTY_GET, &val, ctx)) <= 0)
             return r;
         struct mpv_node *node = arg;
         int err = m_option_get_node(&opt, NULL, node, &val);
@@ -188,7 +254,7 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
     case M_PROPERTY_SET_NODE: {
         if (!log)
             return M_PROPERTY_ERROR;
-        if ((r = do_action(prop_list, name, M_PROPERTY_SET_NODE, arg, ctx)) !=
+        if ((r = do_action(props, name, M_PROPERTY_SET_NODE, arg, ctx)) !=
             M_PROPERTY_NOT_IMPLEMENTED)
             return r;
         int err = m_option_set_node_or_string(log, &opt, name, &val, arg);
@@ -197,13 +263,13 @@ int m_property_do(struct mp_log *log, const struct m_property *prop_list,
         } else if (err < 0) {
             r = M_PROPERTY_INVALID_FORMAT;
         } else {
-            r = do_action(prop_list, name, M_PROPERTY_SET, &val, ctx);
+            r = do_action(props, name, M_PROPERTY_SET, &val, ctx);
         }
         m_option_free(&opt, &val);
         return r;
     }
     default:
-        return do_action(prop_list, name, action, arg, ctx);
+        return do_action(props, name, action, arg, ctx);
     }
 }
 
@@ -234,11 +300,11 @@ static void m_property_unkey(int *action, void **arg)
     }
 }
 
-static int m_property_do_bstr(const struct m_property *prop_list, bstr name,
+static int m_property_do_bstr(const struct m_property_index *props, bstr name,
                               int action, void *arg, void *ctx)
 {
     char *name0 = bstrdup0(NULL, name);
-    int ret = m_property_do(NULL, prop_list, name0, action, arg, ctx);
+    int ret = m_property_do(NULL, props, name0, action, arg, ctx);
     talloc_free(name0);
     return ret;
 }
@@ -251,7 +317,7 @@ static void append_str(char **s, int *len, bstr append)
     *len = *len + append.len;
 }
 
-static int expand_property(const struct m_property *prop_list, char **ret,
+static int expand_property(const struct m_property_index *props, char **ret,
                            int *ret_len, bstr prop, bool silent_error, void *ctx)
 {
     bool cond_yes = bstr_eatstart0(&prop, "?");
@@ -265,7 +331,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     int method = raw ? M_PROPERTY_GET_STRING : M_PROPERTY_PRINT;
 
     char *s = NULL;
-    int r = m_property_do_bstr(prop_list, prop, method, &s, ctx);
+    int r = m_property_do_bstr(props, prop, method, &s, ctx);
     bool skip;
     if (comp) {
         skip = ((s && bstr_equals0(comp_with, s)) != cond_yes);
@@ -282,7 +348,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     return skip;
 }
 
-char *m_properties_expand_string(const struct m_property *prop_list,
+char *m_properties_expand_string(const struct m_property_index *props,
                                  const char *str0, void *ctx)
 {
     char *ret = NULL;
@@ -308,7 +374,7 @@ char *m_properties_expand_string(const struct m_property *prop_list,
             bool have_fallback = bstr_eatstart0(&str, ":");
 
             if (!skip) {
-                skip = expand_property(prop_list, &ret, &ret_len, name,
+                skip = expand_property(props, &ret, &ret_len, name,
                                        have_fallback, ctx);
                 if (skip)
                     skip_level = level;
@@ -77,6 +77,7 @@ extern const struct m_sub_options ao_alsa_conf;
 
 extern const struct m_sub_options demux_conf;
 extern const struct m_sub_options demux_cache_conf;
+extern const struct m_sub_options stream_file_conf;
 
 extern const struct m_obj_list vf_obj_list;
 extern const struct m_obj_list af_obj_list;
@@ -547,6 +548,8 @@ static const m_option_t mp_opts[] = {
     {"demuxer-termination-timeout", OPT_DOUBLE(demux_termination_timeout)},
     {"demuxer-cache-wait", OPT_BOOL(demuxer_cache_wait)},
     {"prefetch-playlist", OPT_BOOL(prefetch_open)},
+    {"prefetch-playlist-cache-share", OPT_DOUBLE(prefetch_cache_share),
+        M_RANGE(0.0, 1.0)},
     {"cache-pause", OPT_BOOL(cache_pause)},
     {"cache-pause-initial", OPT_BOOL(cache_pause_initial)},
     {"cache-pause-wait", OPT_FLOAT(cache_pause_wait), M_RANGE(0, DBL_MAX)},
@@ -584,6 +587,7 @@ static const m_option_t mp_opts[] = {
     {"vf", OPT_SETTINGSLIST(vf_settings, &vf_obj_list)},
 
     {"", OPT_SUBSTRUCT(filter_opts, filter_conf)},
+    {"", OPT_SUBSTRUCT(output_chain, output_chain_conf)},
 
     {"", OPT_SUBSTRUCT(dec_wrapper, dec_wrapper_conf)},
     {"", OPT_SUBSTRUCT(vd_lavc_params, vd_lavc_conf)},
@@ -774,6 +778,7 @@ static const m_option_t mp_opts[] = {
     {"input-ipc-server", OPT_STRING(ipc_path), .flags = M_OPT_FILE},
 #if HAVE_POSIX
     {"input-ipc-client", OPT_STRING(ipc_client)},
+    {"input-ipc-multiplex", OPT_BOOL(ipc_multiplex)},
 #endif
 
     {"screenshot", OPT_SUBSTRUCT(screenshot_image_opts, screenshot_conf)},
@@ -781,6 +786,10 @@ static const m_option_t mp_opts[] = {
     {"screenshot-directory", OPT_STRING(screenshot_directory),
         .flags = M_OPT_FILE},
     {"screenshot-sw", OPT_BOOL(screenshot_sw)},
+    {"screenshot-queue-size", OPT_INT(screenshot_queue_size), M_RANGE(1, 1000)},
+    {"screenshot-threads", OPT_CHOICE(screenshot_threads, {"auto", 0}),
+        M_RANGE(1, 64)},
+    {"screenshot-queue-drop", OPT_BOOL(screenshot_queue_drop)},
 
     {"record-file", OPT_STRING(record_file), .flags = M_OPT_FILE,
         .deprecation_message = "use --stream-record or the dump-cache command"},
@@ -793,6 +802,7 @@ static const m_option_t mp_opts[] = {
     {"", OPT_SUBSTRUCT(demux_opts, demux_conf)},
     {"", OPT_SUBSTRUCT(demux_cache_opts, demux_cache_conf)},
     {"", OPT_SUBSTRUCT(stream_opts, stream_conf)},
+    {"", OPT_SUBSTRUCT(stream_file_opts, stream_file_conf)},
 
     {"", OPT_SUBSTRUCT(ra_ctx_opts, ra_ctx_conf)},
     {"", OPT_SUBSTRUCT(gl_video_opts, gl_video_conf)},
@@ -1013,6 +1023,7 @@ static const struct MPOpts mp_default_opts = {
     .autoload_files = true,
     .demuxer_thread = true,
     .demux_termination_timeout = 0.1,
+    .prefetch_cache_share = 0.5,
     .hls_bitrate = INT_MAX,
     .cache_pause = true,
     .cache_pause_wait = 1.0,
@@ -1050,6 +1061,7 @@ static const struct MPOpts mp_default_opts = {
     .coverart_whitelist = true,
     .osd_bar_visible = true,
     .screenshot_template = "mpv-shot%n",
+    .screenshot_queue_size = 8,
     .play_dir = 1,
 
     .audio_output_channels = {
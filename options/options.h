@@ -277,6 +277,7 @@ typedef struct MPOpts {
     double demux_termination_timeout;
     bool demuxer_cache_wait;
     bool prefetch_open;
+    double prefetch_cache_share;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
 
@@ -288,6 +289,9 @@ typedef struct MPOpts {
     char *screenshot_template;
     char *screenshot_directory;
     bool screenshot_sw;
+    int screenshot_queue_size;
+    int screenshot_threads;
+    bool screenshot_queue_drop;
 
     int index_mode;
 
@@ -299,6 +303,7 @@ typedef struct MPOpts {
     struct m_obj_settings *vf_settings, *vf_defs;
     struct m_obj_settings *af_settings, *af_defs;
     struct filter_opts *filter_opts;
+    struct output_chain_opts *output_chain;
     struct dec_wrapper_opts *dec_wrapper;
     char **sub_name;
     char **sub_paths;
@@ -334,6 +339,7 @@ typedef struct MPOpts {
     struct demux_opts *demux_opts;
     struct demux_cache_opts *demux_cache_opts;
     struct stream_opts *stream_opts;
+    struct stream_file_opts *stream_file_opts;
 
     struct vd_lavc_params *vd_lavc_params;
     struct ad_lavc_params *ad_lavc_params;
@@ -345,6 +351,7 @@ typedef struct MPOpts {
 
     char *ipc_path;
     char *ipc_client;
+    bool ipc_multiplex;
 
     int wingl_dwm_flush;
 
@@ -390,6 +397,7 @@ extern const struct m_sub_options filter_conf;
 extern const struct m_sub_options resample_conf;
 extern const struct m_sub_options stream_conf;
 extern const struct m_sub_options dec_wrapper_conf;
+extern const struct m_sub_options output_chain_conf;
 extern const struct m_sub_options mp_opt_root;
 
 #endif
@@ -27,6 +27,7 @@
 #include "common/msg.h"
 #include "common/msg_control.h"
 #include "common/global.h"
+#include "common/stats.h"
 #include "input/input.h"
 #include "input/cmd.h"
 #include "misc/ctype.h"
@@ -83,6 +84,30 @@ struct mp_client_api {
     int num_custom_protocols;
 
     struct mpv_render_context *render_context;
+
+    // Incremented on every property change notification. Used to invalidate
+    // property values shared between clients in send_client_property_changes().
+    mp_atomic_uint64 property_notify_ts;
+
+    struct stats_ctx *stats;
+};
+
+// A property value read by send_client_property_changes(). Within a single
+// mp_client_send_property_changes() call, clients observing the same property
+// with the same format reuse the value instead of calling the getter again,
+// as long as no change notification happened in between.
+struct shared_prop_value {
+    bool valid;
+    mpv_format format;
+    uint64_t notify_ts;     // property_notify_ts before the value was read
+    int status;
+    union m_option_value value;
+};
+
+// Indexed by observe_property.id (only for properties with shareable set).
+struct shared_prop_cache {
+    struct shared_prop_value *entries;
+    int num_entries;
 };
 
 struct observe_property {
@@ -90,6 +115,7 @@ struct observe_property {
     struct mpv_handle *owner;
     char *name;
     int id;                 // ==mp_get_property_id(name)
+    bool shareable;         // value can be shared by id (see shared_prop_cache)
     uint64_t event_mask;    // ==mp_get_property_event_mask(name)
     int64_t reply_id;
     mpv_format format;
@@ -184,6 +210,8 @@ void mp_clients_init(struct MPContext *mpctx)
     *mpctx->clients = (struct mp_client_api) {
         .mpctx = mpctx,
     };
+    mpctx->clients->stats =
+        stats_ctx_create(mpctx->clients, mpctx->global, "client");
     mpctx->global->client_api = mpctx->clients;
     pthread_mutex_init(&mpctx->clients->lock, NULL);
 }
@@ -1554,6 +1582,8 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
         .owner = ctx,
         .name = talloc_strdup(prop, name),
         .id = mp_get_property_id(ctx->mpctx, name),
+        // Sub-properties and options/ have the same ID as the property.
+        .shareable = !strchr(name, '/'),
         .event_mask = mp_get_property_event_mask(name),
         .reply_id = userdata,
         .format = format,
@@ -1623,6 +1653,8 @@ void mp_client_property_change(struct MPContext *mpctx, const char *name)
     int id = mp_get_property_id(mpctx, name);
     bool any_pending = false;
 
+    atomic_fetch_add(&clients->property_notify_ts, 1);
+
     pthread_mutex_lock(&clients->lock);
 
     for (int n = 0; n < clients->num_clients; n++) {
@@ -1654,6 +1686,8 @@ void mp_client_property_change(struct MPContext *mpctx, const char *name)
 static void notify_property_events(struct mpv_handle *ctx, int event)
 {
     uint64_t mask = 1ULL << event;
+    if (ctx->property_event_masks & mask)
+        atomic_fetch_add(&ctx->clients->property_notify_ts, 1);
     for (int i = 0; i < ctx->num_properties; i++) {
         if (ctx->properties[i]->event_mask & mask) {
             ctx->properties[i]->change_ts += 1;
@@ -1666,9 +1700,52 @@ static void notify_property_events(struct mpv_handle *ctx, int event)
         mp_dispatch_adjust_timeout(ctx->mpctx->dispatch, 0);
 }
 
+static struct shared_prop_value *
+find_shared_value(struct mp_client_api *clients, struct shared_prop_cache *cache,
+                  struct observe_property *prop)
+{
+    if (!prop->shareable || prop->id < 0 || prop->id >= cache->num_entries)
+        return NULL;
+    struct shared_prop_value *e = &cache->entries[prop->id];
+    if (e->valid && e->format == prop->format &&
+        e->notify_ts == atomic_load(&clients->property_notify_ts))
+        return e;
+    return NULL;
+}
+
+static void add_shared_value(struct shared_prop_cache *cache,
+                             struct observe_property *prop, uint64_t notify_ts,
+                             int status, union m_option_value *val)
+{
+    if (!prop->shareable || prop->id < 0)
+        return;
+    if (prop->id >= cache->num_entries) {
+        int num = prop->id + 1;
+        cache->entries = talloc_realloc(NULL, cache->entries,
+                                        struct shared_prop_value, num);
+        memset(&cache->entries[cache->num_entries], 0,
+               (num - cache->num_entries) * sizeof(cache->entries[0]));
+        cache->num_entries = num;
+    }
+    struct shared_prop_value *e = &cache->entries[prop->id];
+    // Replace the stale entry, or one with another format.
+    if (e->valid)
+        m_option_free(get_mp_type_get(e->format), &e->value);
+    *e = (struct shared_prop_value){
+        .valid = true,
+        .format = prop->format,
+        .notify_ts = notify_ts,
+        .status = status,
+    };
+    if (status >= 0)
+        m_option_copy(prop->type, &e->value, val);
+}
+
 // Call with ctx->lock held (only). May temporarily drop the lock.
-static void send_client_property_changes(struct mpv_handle *ctx)
+static void send_client_property_changes(struct mpv_handle *ctx,
+                                         struct shared_prop_cache *cache)
 {
+    struct mp_client_api *clients = ctx->clients;
     uint64_t cur_ts = ctx->properties_change_ts;
 
     ctx->has_pending_properties = false;
@@ -1683,36 +1760,52 @@ static void send_client_property_changes(struct mpv_handle *ctx)
         if (prop->format) {
             const struct m_option *type = prop->type;
             union m_option_value val = {0};
-            struct getproperty_request req = {
-                .mpctx = ctx->mpctx,
-                .name = prop->name,
-                .format = prop->format,
-                .data = &val,
-            };
-
-            // Temporarily unlock and read the property. The very important
-            // thing is that property getters can do whatever they want, _and_
-            // that they may wait on the client API user thread (if vo_libmpv
-            // or similar things are involved).
-            prop->refcount += 1; // keep prop alive (esp. prop->name)
-            ctx->async_counter += 1; // keep ctx alive
-            pthread_mutex_unlock(&ctx->lock);
-            getproperty_fn(&req);
-            pthread_mutex_lock(&ctx->lock);
-            ctx->async_counter -= 1;
-            prop_unref(prop);
-
-            // Set if observed properties was changed or something similar
-            // => start over, retry next time.
-            if (cur_ts != ctx->properties_change_ts || ctx->destroying) {
-                m_option_free(type, &val);
-                mp_wakeup_core(ctx->mpctx);
-                ctx->has_pending_properties = true;
-                break;
+            int status;
+
+            struct shared_prop_value *shared =
+                find_shared_value(clients, cache, prop);
+            if (shared) {
+                status = shared->status;
+                if (status >= 0)
+                    m_option_copy(type, &val, &shared->value);
+                stats_event(clients->stats, "property-reads-saved");
+            } else {
+                struct getproperty_request req = {
+                    .mpctx = ctx->mpctx,
+                    .name = prop->name,
+                    .format = prop->format,
+                    .data = &val,
+                };
+                uint64_t notify_ts = atomic_load(&clients->property_notify_ts);
+
+                // Temporarily unlock and read the property. The very important
+                // thing is that property getters can do whatever they want,
+                // _and_ that they may wait on the client API user thread (if
+                // vo_libmpv or similar things are involved).
+                prop->refcount += 1; // keep prop alive (esp. prop->name)
+                ctx->async_counter += 1; // keep ctx alive
+                pthread_mutex_unlock(&ctx->lock);
+                getproperty_fn(&req);
+                pthread_mutex_lock(&ctx->lock);
+                ctx->async_counter -= 1;
+                prop_unref(prop);
+                stats_event(clients->stats, "property-reads");
+
+                // Set if observed properties was changed or something similar
+                // => start over, retry next time.
+                if (cur_ts != ctx->properties_change_ts || ctx->destroying) {
+                    m_option_free(type, &val);
+                    mp_wakeup_core(ctx->mpctx);
+                    ctx->has_pending_properties = true;
+                    break;
+                }
+                assert(prop->refcount > 0);
+
+                status = req.status;
+                add_shared_value(cache, prop, notify_ts, status, &val);
             }
-            assert(prop->refcount > 0);
 
-            bool val_valid = req.status >= 0;
+            bool val_valid = status >= 0;
             changed = prop->value_valid != val_valid;
             if (prop->value_valid && val_valid)
                 changed = !equal_mpv_value(&prop->value, &val, prop->format);
@@ -1755,6 +1848,8 @@ void mp_client_send_property_changes(struct MPContext *mpctx)
 {
     struct mp_client_api *clients = mpctx->clients;
 
+    struct shared_prop_cache cache = {0};
+
     pthread_mutex_lock(&clients->lock);
     uint64_t cur_ts = clients->clients_list_change_ts;
 
@@ -1768,7 +1863,7 @@ void mp_client_send_property_changes(struct MPContext *mpctx)
         }
         // Keep ctx->lock locked (unlock order does not matter).
         pthread_mutex_unlock(&clients->lock);
-        send_client_property_changes(ctx);
+        send_client_property_changes(ctx, &cache);
         pthread_mutex_unlock(&ctx->lock);
         pthread_mutex_lock(&clients->lock);
         if (cur_ts != clients->clients_list_change_ts) {
@@ -1779,6 +1874,13 @@ void mp_client_send_property_changes(struct MPContext *mpctx)
     }
 
     pthread_mutex_unlock(&clients->lock);
+
+    for (int n = 0; n < cache.num_entries; n++) {
+        struct shared_prop_value *e = &cache.entries[n];
+        if (e->valid)
+            m_option_free(get_mp_type_get(e->format), &e->value);
+    }
+    talloc_free(cache.entries);
 }
 
 // Set ctx->cur_event to a generated property change event, if there is any
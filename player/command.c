@@ -80,6 +80,8 @@
 struct command_ctx {
     // All properties, terminated with a {0} item.
     struct m_property *properties;
+    // Lookup table for properties, built once in command_init().
+    struct m_property_index *properties_index;
 
     double last_seek_time;
     double last_seek_pts;
@@ -732,6 +734,27 @@ static int mp_property_vo_delayed_frame_count(void *ctx, struct m_property *prop
     return m_property_int_ro(action, arg, vo_get_delayed_count(mpctx->video_out));
 }
 
+static int mp_property_screenshot_queue_depth(void *ctx, struct m_property *prop,
+                                              int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    int pending;
+    int64_t dropped;
+    screenshot_get_queue_state(mpctx, &pending, &dropped);
+    return m_property_int_ro(action, arg, pending);
+}
+
+static int mp_property_screenshot_queue_dropped(void *ctx,
+                                                struct m_property *prop,
+                                                int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    int pending;
+    int64_t dropped;
+    screenshot_get_queue_state(mpctx, &pending, &dropped);
+    return m_property_int64_ro(action, arg, dropped);
+}
+
 /// Current position in percent (RW)
 static int mp_property_percent_pos(void *ctx, struct m_property *prop,
                                    int action, void *arg)
@@ -1340,6 +1363,122 @@ static int mp_property_filter_metadata(void *ctx, struct m_property *prop,
     return M_PROPERTY_NOT_IMPLEMENTED;
 }
 
+static int mp_property_filter_threads(void *ctx, struct m_property *prop,
+                                      int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_ARRAY, NULL);
+
+    struct mp_output_chain *chains[] = {
+        mpctx->vo_chain ? mpctx->vo_chain->filter : NULL,
+        mpctx->ao_chain ? mpctx->ao_chain->filter : NULL,
+    };
+    const char *chain_names[] = {"vf", "af"};
+    void *tmp = talloc_new(NULL);
+    for (int n = 0; n < MP_ARRAY_SIZE(chains); n++) {
+        if (!chains[n])
+            continue;
+        struct mp_output_chain_thread *threads;
+        int num = mp_output_chain_get_filter_threads(chains[n], tmp, &threads);
+        for (int i = 0; i < num; i++) {
+            struct mp_output_chain_thread *t = &threads[i];
+            struct mpv_node *e = node_array_add(r, MPV_FORMAT_NODE_MAP);
+            node_map_add_string(e, "chain", chain_names[n]);
+            node_map_add_string(e, "name", t->name);
+            if (t->label)
+                node_map_add_string(e, "label", t->label);
+            node_map_add_double(e, "busy-time", t->stats.busy_time);
+            node_map_add_int64(e, "queued-in", t->stats.queued_in);
+            node_map_add_int64(e, "queued-out", t->stats.queued_out);
+            node_map_add_int64(e, "queue-size", t->stats.queue_frames);
+        }
+    }
+    talloc_free(tmp);
+    return M_PROPERTY_OK;
+}
+
+// Add the entries with the given parent index to the node array dst.
+static void add_filter_stats_nodes(struct mpv_node *dst,
+                                   struct mp_output_chain_filter_stats *entries,
+                                   int num_entries, int parent)
+{
+    for (int n = 0; n < num_entries; n++) {
+        struct mp_output_chain_filter_stats *e = &entries[n];
+        if (e->parent != parent)
+            continue;
+        struct mpv_node *m = node_array_add(dst, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(m, "name", e->name);
+        if (e->label)
+            node_map_add_string(m, "label", e->label);
+        if (e->lavfi) {
+            node_map_add_flag(m, "lavfi", true);
+            if (e->stats.frames_in >= 0)
+                node_map_add_int64(m, "frames-in", e->stats.frames_in);
+            if (e->stats.frames_out >= 0)
+                node_map_add_int64(m, "frames-out", e->stats.frames_out);
+        } else {
+            node_map_add_int64(m, "process-calls", e->stats.process_calls);
+            node_map_add_double(m, "wall-time", e->stats.wall_time);
+            node_map_add_double(m, "cpu-time", e->stats.cpu_time);
+            node_map_add_int64(m, "frames-in", e->stats.frames_in);
+            node_map_add_int64(m, "frames-out", e->stats.frames_out);
+            node_map_add_double(m, "stall-time", e->stats.stall_time);
+        }
+        // Children always come after their parent.
+        for (int i = n + 1; i < num_entries; i++) {
+            if (entries[i].parent == n) {
+                struct mpv_node *c =
+                    node_map_add(m, "children", MPV_FORMAT_NODE_ARRAY);
+                add_filter_stats_nodes(c, entries, num_entries, n);
+                break;
+            }
+        }
+    }
+}
+
+static int mp_property_filter_stats(void *ctx, struct m_property *prop,
+                                    int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+
+    struct mp_output_chain *chains[] = {
+        mpctx->vo_chain ? mpctx->vo_chain->filter : NULL,
+        mpctx->ao_chain ? mpctx->ao_chain->filter : NULL,
+    };
+    const char *chain_names[] = {"vf", "af"};
+    void *tmp = talloc_new(NULL);
+    for (int n = 0; n < MP_ARRAY_SIZE(chains); n++) {
+        if (!chains[n])
+            continue;
+        struct mp_output_chain_filter_stats *entries;
+        int num = mp_output_chain_get_filter_stats(chains[n], tmp, &entries);
+        struct mpv_node *list =
+            node_map_add(r, chain_names[n], MPV_FORMAT_NODE_ARRAY);
+        add_filter_stats_nodes(list, entries, num, -1);
+    }
+    talloc_free(tmp);
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_core_idle(void *ctx, struct m_property *prop,
                                  int action, void *arg)
 {
@@ -1498,6 +1637,10 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
         node_map_add_double(r, "debug-seeking", s.seeking);
     node_map_add_int64(r, "debug-low-level-seeks", s.low_level_seeks);
     node_map_add_int64(r, "debug-byte-level-seeks", s.byte_level_seeks);
+    node_map_add_int64(r, "debug-packet-arena-bytes", s.packet_arena_bytes);
+    node_map_add_int64(r, "debug-packet-arena-unused-bytes",
+                       s.packet_arena_bytes - s.packet_arena_used_bytes);
+    node_map_add_int64(r, "debug-packet-arena-packets", s.packet_arena_packets);
     if (s.ts_last != MP_NOPTS_VALUE)
         node_map_add_double(r, "debug-ts-last", s.ts_last);
 
@@ -1516,6 +1659,48 @@ static int mp_property_demuxer_cache_state(void *ctx, struct m_property *prop,
     return M_PROPERTY_OK;
 }
 
+static int mp_property_prefetch_state(void *ctx, struct m_property *prop,
+                                      int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->open_active || !mpctx->open_for_prefetch)
+        return M_PROPERTY_UNAVAILABLE;
+
+    if (action == M_PROPERTY_GET_TYPE) {
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    }
+    if (action != M_PROPERTY_GET)
+        return M_PROPERTY_NOT_IMPLEMENTED;
+
+    struct mpv_node *r = (struct mpv_node *)arg;
+    node_init(r, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_string(r, "filename", mpctx->open_url);
+
+    // open_res_demuxer is owned by the opener thread until open_done is set.
+    struct demuxer *demux = NULL;
+    const char *state = "opening";
+    if (atomic_load(&mpctx->open_done)) {
+        demux = mpctx->open_res_demuxer;
+        state = demux ? "done" : "failed";
+    }
+
+    if (demux && mpctx->open_read_ahead && !demux->fully_read) {
+        struct demux_reader_state s;
+        demux_get_reader_state(demux, &s);
+        if (!s.idle)
+            state = "reading";
+        node_map_add_flag(r, "eof", s.eof);
+        node_map_add_int64(r, "total-bytes", s.total_bytes);
+        node_map_add_int64(r, "fw-bytes", s.fw_bytes);
+        if (s.ts_duration >= 0)
+            node_map_add_double(r, "cache-duration", s.ts_duration);
+    }
+
+    node_map_add_string(r, "state", state);
+    return M_PROPERTY_OK;
+}
+
 static int mp_property_demuxer_start_time(void *ctx, struct m_property *prop,
                                           int action, void *arg)
 {
@@ -3060,6 +3245,55 @@ static int get_playlist_entry(int item, int action, void *arg, void *ctx)
     return m_property_read_sub(props, action, arg);
 }
 
+struct playlist_range {
+    struct MPContext *mpctx;
+    int start;
+};
+
+static int get_playlist_range_entry(int item, int action, void *arg, void *ctx)
+{
+    struct playlist_range *r = ctx;
+    return get_playlist_entry(r->start + item, action, arg, r->mpctx);
+}
+
+// Handle "playlist/range/START/COUNT[/...]" (key is the part after "range/").
+// This returns the same as "playlist", but limited to the given range, so
+// clients can read huge playlists in pieces.
+static int playlist_range_action(struct MPContext *mpctx, bstr key, int action,
+                                 void *arg)
+{
+    bstr rest;
+    long long start = bstrtoll(key, &rest, 10);
+    if (rest.len == key.len || !bstr_eatstart0(&rest, "/"))
+        return M_PROPERTY_UNKNOWN;
+    bstr count_str = rest;
+    long long count = bstrtoll(count_str, &rest, 10);
+    if (rest.len == count_str.len || (rest.len && rest.start[0] != '/'))
+        return M_PROPERTY_UNKNOWN;
+    if (start < 0 || count < 0)
+        return M_PROPERTY_UNKNOWN;
+
+    int num = playlist_entry_count(mpctx->playlist);
+    start = MPMIN(start, num);
+    count = MPMIN(count, num - start);
+
+    struct playlist_range r = {mpctx, start};
+    if (!bstr_eatstart0(&rest, "/"))
+        return m_property_read_list(action, arg, count,
+                                    get_playlist_range_entry, &r);
+
+    char *sub_key = bstrto0(NULL, rest);
+    struct m_property_action_arg ka = {
+        .key = sub_key,
+        .action = action,
+        .arg = arg,
+    };
+    int ret = m_property_read_list(M_PROPERTY_KEY_ACTION, &ka, count,
+                                   get_playlist_range_entry, &r);
+    talloc_free(sub_key);
+    return ret;
+}
+
 static int mp_property_playlist(void *ctx, struct m_property *prop,
                                 int action, void *arg)
 {
@@ -3068,8 +3302,9 @@ static int mp_property_playlist(void *ctx, struct m_property *prop,
         struct playlist *pl = mpctx->playlist;
         char *res = talloc_strdup(NULL, "");
 
-        for (int n = 0; n < pl->num_entries; n++) {
-            struct playlist_entry *e = pl->entries[n];
+        for (struct playlist_entry *e = playlist_get_first(pl); e;
+             e = playlist_entry_get_rel(e, 1))
+        {
             char *p = e->title;
             if (!p) {
                 p = e->filename;
@@ -3088,10 +3323,64 @@ static int mp_property_playlist(void *ctx, struct m_property *prop,
         return M_PROPERTY_OK;
     }
 
+    if (action == M_PROPERTY_KEY_ACTION) {
+        struct m_property_action_arg *ka = arg;
+        bstr key = bstr0(ka->key);
+        if (bstr_eatstart0(&key, "range/"))
+            return playlist_range_action(mpctx, key, ka->action, ka->arg);
+    }
+
     return m_property_read_list(action, arg, playlist_entry_count(mpctx->playlist),
                                 get_playlist_entry, mpctx);
 }
 
+static const char *const playlist_change_names[] = {
+    [PLAYLIST_CHANGE_INSERT] = "insert",
+    [PLAYLIST_CHANGE_REMOVE] = "remove",
+    [PLAYLIST_CHANGE_MOVE]   = "move",
+    [PLAYLIST_CHANGE_UPDATE] = "update",
+    [PLAYLIST_CHANGE_RESET]  = "reset",
+};
+
+static int mp_property_playlist_changes(void *ctx, struct m_property *prop,
+                                        int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    struct playlist *pl = mpctx->playlist;
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET: {
+        struct mpv_node *node = arg;
+        node_init(node, MPV_FORMAT_NODE_MAP, NULL);
+        node_map_add_int64(node, "serial", pl->change_serial);
+        struct mpv_node *list =
+            node_map_add(node, "changes", MPV_FORMAT_NODE_ARRAY);
+        uint64_t first = 1;
+        if (pl->change_serial > PLAYLIST_MAX_CHANGES)
+            first = pl->change_serial - PLAYLIST_MAX_CHANGES + 1;
+        for (uint64_t s = first; s <= pl->change_serial; s++) {
+            struct playlist_change *c = &pl->changes[s % PLAYLIST_MAX_CHANGES];
+            struct mpv_node *e = node_array_add(list, MPV_FORMAT_NODE_MAP);
+            node_map_add_int64(e, "serial", c->serial);
+            node_map_add_string(e, "type", playlist_change_names[c->type]);
+            if (c->type == PLAYLIST_CHANGE_RESET)
+                continue;
+            node_map_add_int64(e, "index", c->index);
+            if (c->type == PLAYLIST_CHANGE_MOVE) {
+                node_map_add_int64(e, "to", c->to);
+            } else {
+                node_map_add_int64(e, "count", c->count);
+            }
+        }
+        return M_PROPERTY_OK;
+    }
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 static char *print_obj_osd_list(struct m_obj_settings *list)
 {
     char *res = NULL;
@@ -3790,6 +4079,8 @@ static const struct m_property mp_properties_base[] = {
     {"decoder-frame-drop-count", mp_property_frame_drop_dec},
     {"frame-drop-count", mp_property_frame_drop_vo},
     {"vo-delayed-frame-count", mp_property_vo_delayed_frame_count},
+    {"screenshot-queue-depth", mp_property_screenshot_queue_depth},
+    {"screenshot-queue-dropped", mp_property_screenshot_queue_dropped},
     {"percent-pos", mp_property_percent_pos},
     {"time-start", mp_property_time_start},
     {"time-pos", mp_property_time_pos},
@@ -3807,6 +4098,8 @@ static const struct m_property mp_properties_base[] = {
     {"chapter-metadata", mp_property_chapter_metadata},
     {"vf-metadata", mp_property_filter_metadata, .priv = "vf"},
     {"af-metadata", mp_property_filter_metadata, .priv = "af"},
+    {"filter-threads", mp_property_filter_threads},
+    {"filter-stats", mp_property_filter_stats},
     {"core-idle", mp_property_core_idle},
     {"eof-reached", mp_property_eof_reached},
     {"seeking", mp_property_seeking},
@@ -3817,6 +4110,7 @@ static const struct m_property mp_properties_base[] = {
     {"demuxer-cache-idle", mp_property_demuxer_cache_idle},
     {"demuxer-start-time", mp_property_demuxer_start_time},
     {"demuxer-cache-state", mp_property_demuxer_cache_state},
+    {"prefetch-playlist-state", mp_property_prefetch_state},
     {"cache-buffering-state", mp_property_cache_buffering},
     {"paused-for-cache", mp_property_paused_for_cache},
     {"demuxer-via-network", mp_property_demuxer_is_network},
@@ -3832,6 +4126,7 @@ static const struct m_property mp_properties_base[] = {
     {"edition-list", property_list_editions},
 
     {"playlist", mp_property_playlist},
+    {"playlist-changes", mp_property_playlist_changes},
     {"playlist-pos", mp_property_playlist_pos},
     {"playlist-pos-1", mp_property_playlist_pos_1},
     {"playlist-current-pos", mp_property_playlist_current_pos},
@@ -4011,7 +4306,7 @@ static const char *const *const mp_event_property_change[] = {
     E(MP_EVENT_CACHE_UPDATE,
       "demuxer-cache-duration", "demuxer-cache-idle", "paused-for-cache",
       "demuxer-cache-time", "cache-buffering-state", "cache-speed",
-      "demuxer-cache-state"),
+      "demuxer-cache-state", "prefetch-playlist-state"),
     E(MP_EVENT_WIN_RESIZE, "current-window-scale", "osd-width", "osd-height",
       "osd-par", "osd-dimensions"),
     E(MP_EVENT_WIN_STATE, "display-names", "display-fps", "display-width",
@@ -4020,7 +4315,7 @@ static const char *const *const mp_event_property_change[] = {
     E(MP_EVENT_FOCUS, "focused"),
     E(MP_EVENT_CHANGE_PLAYLIST, "playlist", "playlist-pos", "playlist-pos-1",
       "playlist-count", "playlist/count", "playlist-current-pos",
-      "playlist-playing-pos"),
+      "playlist-playing-pos", "playlist-changes"),
     E(MP_EVENT_INPUT_PROCESSED, "mouse-pos"),
     E(MP_EVENT_CORE_IDLE, "core-idle", "eof-reached"),
 };
@@ -4067,11 +4362,13 @@ uint64_t mp_get_property_event_mask(const char *name)
 int mp_get_property_id(struct MPContext *mpctx, const char *name)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    for (int n = 0; ctx->properties[n].name; n++) {
-        if (match_property(ctx->properties[n].name, name))
-            return n;
-    }
-    return -1;
+    // Give options and properties the same ID each, like match_property().
+    if (strncmp(name, "options/", 8) == 0)
+        name += 8;
+    bstr base;
+    char *rem;
+    m_property_split_path(name, &base, &rem);
+    return m_property_index_find_id(ctx->properties_index, base);
 }
 
 static bool is_property_set(int action, void *val)
@@ -4096,7 +4393,8 @@ int mp_property_do(const char *name, int action, void *val,
                    struct MPContext *ctx)
 {
     struct command_ctx *cmd = ctx->command_ctx;
-    int r = m_property_do(ctx->log, cmd->properties, name, action, val, ctx);
+    int r = m_property_do(ctx->log, cmd->properties_index, name, action, val,
+                          ctx);
 
     if (mp_msg_test(ctx->log, MSGL_V) && is_property_set(action, val)) {
         struct m_option ot = {0};
@@ -4121,7 +4419,7 @@ int mp_property_do(const char *name, int action, void *val,
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    return m_properties_expand_string(ctx->properties, str, mpctx);
+    return m_properties_expand_string(ctx->properties_index, str, mpctx);
 }
 
 // Before expanding properties, parse C-style escapes like "\n"
@@ -6755,6 +7053,8 @@ void command_init(struct MPContext *mpctx)
         ctx->properties[count++] = prop;
     }
 
+    ctx->properties_index = m_property_index_create(ctx, ctx->properties);
+
     node_init(&ctx->udata, MPV_FORMAT_NODE_MAP, NULL);
     talloc_steal(ctx, ctx->udata.u.list);
 }
@@ -6788,7 +7088,9 @@ static void command_event(struct MPContext *mpctx, int event, void *arg)
             const char *const name = find_non_filename_media_title(mpctx);
             if (name && name[0]) {
                 pe->title = talloc_strdup(pe, name);
+                playlist_entry_changed(mpctx->playlist, pe);
                 mp_notify_property(mpctx, "playlist");
+                mp_notify_property(mpctx, "playlist-changes");
             }
         }
     }
@@ -6893,7 +7195,9 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
     if (flags & UPDATE_INPUT)
         mp_input_update_opts(mpctx->input);
 
-    if (init || opt_ptr == &opts->ipc_path || opt_ptr == &opts->ipc_client) {
+    if (init || opt_ptr == &opts->ipc_path || opt_ptr == &opts->ipc_client ||
+        opt_ptr == &opts->ipc_multiplex)
+    {
         mp_uninit_ipc(mpctx->ipc_ctx);
         mpctx->ipc_ctx = mp_init_ipc(mpctx->clients, mpctx->global);
     }
@@ -450,7 +450,9 @@ typedef struct MPContext {
     char *open_url;
     char *open_format;
     int open_url_flags;
-    bool open_for_prefetch;
+    bool open_for_prefetch; // started by prefetch_next()
+    bool open_read_ahead;   // start reading packets once opened
+    double open_max_bytes_share;
     // --- All fields below are owned by open_thread, unless open_done was set
     //     to true.
     struct demuxer *open_res_demuxer;
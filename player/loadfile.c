@@ -1151,13 +1151,16 @@ static void *open_demux_thread(void *ctx)
     if (demux) {
         MP_VERBOSE(mpctx, "Opening done: %s\n", mpctx->open_url);
 
-        if (mpctx->open_for_prefetch && !demux->fully_read) {
+        if (mpctx->open_read_ahead && !demux->fully_read) {
             int num_streams = demux_get_num_stream(demux);
             for (int n = 0; n < num_streams; n++) {
                 struct sh_stream *sh = demux_get_stream(demux, n);
                 demuxer_select_track(demux, sh, MP_NOPTS_VALUE, true);
             }
 
+            // The current file still uses its own cache, so don't let the
+            // next file take the full --demuxer-max-bytes as well.
+            demux_set_max_bytes_share(demux, mpctx->open_max_bytes_share);
             demux_set_wakeup_cb(demux, wakeup_demux, mpctx);
             demux_start_thread(demux);
             demux_start_prefetch(demux);
@@ -1212,7 +1215,9 @@ static void start_open(struct MPContext *mpctx, char *url, int url_flags,
     mpctx->open_url = talloc_strdup(NULL, url);
     mpctx->open_format = talloc_strdup(NULL, mpctx->opts->demuxer_name);
     mpctx->open_url_flags = url_flags;
-    mpctx->open_for_prefetch = for_prefetch && mpctx->opts->demuxer_thread;
+    mpctx->open_for_prefetch = for_prefetch;
+    mpctx->open_read_ahead = for_prefetch && mpctx->opts->demuxer_thread;
+    mpctx->open_max_bytes_share = mpctx->opts->prefetch_cache_share;
 
     if (pthread_create(&mpctx->open_thread, NULL, open_demux_thread, mpctx)) {
         cancel_open(mpctx);
@@ -1262,6 +1267,8 @@ static void open_demux_reentrant(struct MPContext *mpctx)
     if (mpctx->open_res_demuxer) {
         mpctx->demuxer = mpctx->open_res_demuxer;
         mpctx->open_res_demuxer = NULL;
+        // Lift the prefetch limit, if any. It is the current file now.
+        demux_set_max_bytes_share(mpctx->demuxer, 1.0);
         mp_cancel_set_parent(mpctx->demuxer->cancel, mpctx->playback_abort);
     } else {
         mpctx->error_playing = mpctx->open_res_error;
@@ -1279,6 +1286,7 @@ void prefetch_next(struct MPContext *mpctx)
     if (new_entry && !mpctx->open_active && new_entry->filename) {
         MP_VERBOSE(mpctx, "Prefetching: %s\n", new_entry->filename);
         start_open(mpctx, new_entry->filename, new_entry->stream_flags, true);
+        mp_notify_property(mpctx, "prefetch-playlist-state");
     }
 }
 
@@ -1635,6 +1643,7 @@ static void play_current_file(struct MPContext *mpctx)
         transfer_playlist(mpctx, pl, &end_event.playlist_insert_id,
                           &end_event.playlist_insert_num_entries);
         mp_notify_property(mpctx, "playlist");
+        mp_notify_property(mpctx, "playlist-changes");
         mpctx->error_playing = 2;
         goto terminate_playback;
     }
@@ -1930,11 +1939,9 @@ struct playlist_entry *mp_next_file(struct MPContext *mpctx, int direction,
         if (!force && next && next->init_failed && !ignore_failures) {
             // Don't endless loop if no file in playlist is playable
             bool all_failed = true;
-            for (int n = 0; n < mpctx->playlist->num_entries; n++) {
-                all_failed &= mpctx->playlist->entries[n]->init_failed;
-                if (!all_failed)
-                    break;
-            }
+            for (struct playlist_entry *e = playlist_get_first(mpctx->playlist);
+                 e && all_failed; e = playlist_entry_get_rel(e, 1))
+                all_failed &= e->init_failed;
             if (all_failed)
                 next = NULL;
         }
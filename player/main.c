@@ -177,6 +177,8 @@ void mp_destroy(struct MPContext *mpctx)
     uninit_audio_out(mpctx);
     uninit_video_out(mpctx);
 
+    screenshot_uninit(mpctx);
+
     // If it's still set here, it's an error.
     encode_lavc_free(mpctx->encode_lavc_ctx);
     mpctx->encode_lavc_ctx = NULL;
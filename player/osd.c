@@ -278,6 +278,11 @@ static void term_osd_print_status_lazy(struct MPContext *mpctx)
     update_window_title(mpctx, false);
     update_vo_playback_state(mpctx);
 
+    if (mpctx->encode_lavc_ctx) {
+        encode_lavc_report_progress(mpctx->encode_lavc_ctx,
+                                    get_current_pos_ratio(mpctx, true));
+    }
+
     if (!opts->use_terminal)
         return;
 
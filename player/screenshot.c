@@ -15,11 +15,15 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include <pthread.h>
+
 #include <libavcodec/avcodec.h>
+#include <libavutil/cpu.h>
 
 #include "common/global.h"
 #include "osdep/io.h"
@@ -32,6 +36,7 @@
 #include "misc/bstr.h"
 #include "misc/dispatch.h"
 #include "misc/node.h"
+#include "misc/thread_pool.h"
 #include "misc/thread_tools.h"
 #include "common/msg.h"
 #include "options/path.h"
@@ -47,6 +52,16 @@
 #define MODE_FULL_WINDOW 1
 #define MODE_SUBTITLES 2
 
+// Upper bound for --screenshot-threads=auto.
+#define MAX_AUTO_THREADS 16
+
+struct screenshot_job {
+    struct screenshot_ctx *ctx;
+    struct mp_image *image;
+    char *filename;
+    struct image_writer_opts opts;
+};
+
 typedef struct screenshot_ctx {
     struct MPContext *mpctx;
     struct mp_log *log;
@@ -56,6 +71,22 @@ typedef struct screenshot_ctx {
 
     int frameno;
     uint64_t last_frame_count;
+
+    // Encoder threads for each-frame mode.
+    struct mp_thread_pool *pool;
+    int pool_threads;
+
+    // Last values passed to mp_notify_property().
+    int notified_pending;
+    int64_t notified_dropped;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // --- protected by lock
+    int num_pending;            // queued + being written + reserved slots
+    int64_t dropped;            // frames skipped because the queue was full
+    struct screenshot_job **jobs;
+    int num_jobs;
 } screenshot_ctx;
 
 void screenshot_init(struct MPContext *mpctx)
@@ -66,6 +97,33 @@ void screenshot_init(struct MPContext *mpctx)
         .frameno = 1,
         .log = mp_log_new(mpctx, mpctx->log, "screenshot")
     };
+    pthread_mutex_init(&mpctx->screenshot_ctx->lock, NULL);
+    pthread_cond_init(&mpctx->screenshot_ctx->wakeup, NULL);
+}
+
+void screenshot_uninit(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+    if (!ctx)
+        return;
+
+    // Blocks until all queued screenshots were written.
+    TA_FREEP(&ctx->pool);
+    assert(!ctx->num_pending);
+
+    pthread_cond_destroy(&ctx->wakeup);
+    pthread_mutex_destroy(&ctx->lock);
+    TA_FREEP(&mpctx->screenshot_ctx);
+}
+
+void screenshot_get_queue_state(struct MPContext *mpctx, int *pending,
+                                int64_t *dropped)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+    pthread_mutex_lock(&ctx->lock);
+    *pending = ctx->num_pending;
+    *dropped = ctx->dropped;
+    pthread_mutex_unlock(&ctx->lock);
 }
 
 static char *stripext(void *talloc_ctx, const char *s)
@@ -273,6 +331,17 @@ error_exit:
     return NULL;
 }
 
+// Whether a queued screenshot is going to be written to the given file.
+static bool filename_pending(screenshot_ctx *ctx, const char *fname)
+{
+    bool found = false;
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_jobs; n++)
+        found |= strcmp(ctx->jobs[n]->filename, fname) == 0;
+    pthread_mutex_unlock(&ctx->lock);
+    return found;
+}
+
 static char *gen_fname(struct mp_cmd_ctx *cmd, const char *file_ext)
 {
     struct MPContext *mpctx = cmd->mpctx;
@@ -310,7 +379,7 @@ static char *gen_fname(struct mp_cmd_ctx *cmd, const char *file_ext)
             mp_mkdirp(full_dir);
         }
 
-        if (!mp_path_exists(fname))
+        if (!mp_path_exists(fname) && !filename_pending(ctx, fname))
             return fname;
 
         if (sequence == prev_sequence) {
@@ -459,6 +528,141 @@ void cmd_screenshot_to_file(void *p)
     talloc_free(image);
 }
 
+static void encode_job_fn(void *p)
+{
+    struct screenshot_job *job = p;
+    screenshot_ctx *ctx = job->ctx;
+
+    bool ok = write_image(job->image, &job->opts, job->filename,
+                          ctx->mpctx->global, ctx->log);
+    if (ok) {
+        MP_INFO(ctx, "Screenshot: '%s'\n", job->filename);
+    } else {
+        MP_ERR(ctx, "Error writing screenshot '%s'!\n", job->filename);
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    for (int n = 0; n < ctx->num_jobs; n++) {
+        if (ctx->jobs[n] == job) {
+            MP_TARRAY_REMOVE_AT(ctx->jobs, ctx->num_jobs, n);
+            break;
+        }
+    }
+    ctx->num_pending -= 1;
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+
+    // Update the queue properties.
+    mp_wakeup_core(ctx->mpctx);
+
+    talloc_free(job);
+}
+
+static struct mp_thread_pool *get_encode_pool(screenshot_ctx *ctx)
+{
+    int threads = ctx->mpctx->opts->screenshot_threads;
+    if (!threads)
+        threads = MPCLAMP(av_cpu_count(), 1, MAX_AUTO_THREADS);
+
+    if (ctx->pool && ctx->pool_threads != threads) {
+        // Waits until the old pool is idle. Jobs never need the core lock.
+        TA_FREEP(&ctx->pool);
+    }
+
+    if (!ctx->pool) {
+        // Threads are created on demand, and exit when idle for a while.
+        ctx->pool = mp_thread_pool_create(ctx, 0, 0, threads);
+        ctx->pool_threads = threads;
+    }
+
+    return ctx->pool;
+}
+
+// Take a screenshot and write it asynchronously on the encoder threads. This
+// is used by each-frame mode, where writing each image before the next frame
+// is displayed would limit playback to the encoding speed. If the queue is
+// full, wait until a slot becomes free (which slows down playback), or drop
+// the frame if --screenshot-queue-drop is set.
+static void queue_screenshot(struct mp_cmd_ctx *cmd, int mode)
+{
+    struct MPContext *mpctx = cmd->mpctx;
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+    struct MPOpts *opts = mpctx->opts;
+
+    cmd->success = false;
+
+    int queue_size = opts->screenshot_queue_size;
+    bool drop = opts->screenshot_queue_drop;
+
+    pthread_mutex_lock(&ctx->lock);
+    bool full = ctx->num_pending >= queue_size;
+    if (full && drop)
+        ctx->dropped += 1;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (full && drop) {
+        mp_cmd_msg(cmd, MSGL_V, "Screenshot queue full, dropping frame.");
+        return;
+    }
+
+    // Never hold ctx->lock while (re)acquiring the core lock.
+    mp_core_unlock(mpctx);
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->num_pending >= queue_size)
+        pthread_cond_wait(&ctx->wakeup, &ctx->lock);
+    ctx->num_pending += 1; // reserve a slot
+    pthread_mutex_unlock(&ctx->lock);
+    mp_core_lock(mpctx);
+
+    struct image_writer_opts *gopts = opts->screenshot_image_opts;
+    struct mp_image *image =
+        screenshot_get(mpctx, mode, image_writer_high_depth(gopts));
+    char *filename = NULL;
+    if (image) {
+        filename = gen_fname(cmd, image_writer_file_ext(gopts));
+    } else {
+        mp_cmd_msg(cmd, MSGL_ERR, "Taking screenshot failed.");
+    }
+
+    struct screenshot_job *job = NULL;
+    if (filename) {
+        job = talloc_ptrtype(NULL, job);
+        *job = (struct screenshot_job){
+            .ctx = ctx,
+            .image = talloc_steal(job, image),
+            .filename = talloc_steal(job, filename),
+            .opts = *gopts,
+        };
+        // The option strings can change while the job is running.
+        job->opts.avif_encoder = talloc_strdup(job, gopts->avif_encoder);
+        job->opts.avif_pixfmt = talloc_strdup(job, gopts->avif_pixfmt);
+        job->opts.avif_opts = mp_dup_str_array(job, gopts->avif_opts);
+        image = NULL;
+
+        mp_cmd_msg(cmd, MSGL_V, "Queuing screenshot: '%s'", job->filename);
+
+        pthread_mutex_lock(&ctx->lock);
+        MP_TARRAY_APPEND(ctx, ctx->jobs, ctx->num_jobs, job);
+        pthread_mutex_unlock(&ctx->lock);
+
+        struct mp_thread_pool *pool = get_encode_pool(ctx);
+        if (!mp_thread_pool_queue(pool, encode_job_fn, job)) {
+            // Could not start a thread; write it on this thread instead.
+            mp_core_unlock(mpctx);
+            encode_job_fn(job);
+            mp_core_lock(mpctx);
+        }
+        cmd->success = true;
+        return;
+    }
+
+    talloc_free(image);
+    pthread_mutex_lock(&ctx->lock);
+    ctx->num_pending -= 1;
+    pthread_cond_broadcast(&ctx->wakeup);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
 void cmd_screenshot(void *p)
 {
     struct mp_cmd_ctx *cmd = p;
@@ -486,6 +690,11 @@ void cmd_screenshot(void *p)
         }
     }
 
+    if (each_frame_mode) {
+        queue_screenshot(cmd, mode);
+        return;
+    }
+
     cmd->success = false;
 
     struct image_writer_opts *opts = mpctx->opts->screenshot_image_opts;
@@ -546,10 +755,30 @@ static void screenshot_fin(struct mp_cmd_ctx *cmd)
     mp_wakeup_core(mpctx);
 }
 
+static void update_queue_properties(struct MPContext *mpctx)
+{
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
+
+    int pending;
+    int64_t dropped;
+    screenshot_get_queue_state(mpctx, &pending, &dropped);
+
+    if (pending != ctx->notified_pending) {
+        ctx->notified_pending = pending;
+        mp_notify_property(mpctx, "screenshot-queue-depth");
+    }
+    if (dropped != ctx->notified_dropped) {
+        ctx->notified_dropped = dropped;
+        mp_notify_property(mpctx, "screenshot-queue-dropped");
+    }
+}
+
 void handle_each_frame_screenshot(struct MPContext *mpctx)
 {
     screenshot_ctx *ctx = mpctx->screenshot_ctx;
 
+    update_queue_properties(mpctx);
+
     if (!ctx->each_frame)
         return;
 
@@ -561,8 +790,8 @@ void handle_each_frame_screenshot(struct MPContext *mpctx)
     void *a[] = {mpctx, &wait};
     run_command(mpctx, mp_cmd_clone(ctx->each_frame), NULL, screenshot_fin, a);
 
-    // Block (in a reentrant way) until the screenshot was written. Otherwise,
-    // we could pile up screenshot requests forever.
+    // Block (in a reentrant way) until the screenshot was queued. The command
+    // waits for a free queue slot, so we can't pile up screenshots forever.
     while (!mp_waiter_poll(&wait))
         mp_idle(mpctx);
 
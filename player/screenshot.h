@@ -19,6 +19,7 @@
 #define MPLAYER_SCREENSHOT_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct MPContext;
 struct mp_image;
@@ -28,6 +29,14 @@ struct mpv_global;
 // One time initialization at program start.
 void screenshot_init(struct MPContext *mpctx);
 
+// Wait until all queued screenshots are written, and free the context.
+void screenshot_uninit(struct MPContext *mpctx);
+
+// Number of screenshots queued or being written in each-frame mode, and the
+// number of frames skipped because the queue was full.
+void screenshot_get_queue_state(struct MPContext *mpctx, int *pending,
+                                int64_t *dropped);
+
 // Called by the playback core on each iteration.
 void handle_each_frame_screenshot(struct MPContext *mpctx);
 
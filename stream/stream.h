@@ -201,6 +201,36 @@ inline static int stream_read_char(stream_t *s)
         : stream_read_char_fallback(s);
 }
 
+// Return a pointer to the buffered data at the current position, and set *len
+// to the number of bytes that can be accessed there without wrapping around
+// or reading more data (can be 0). Use stream_skip_buffered() to consume it.
+inline static uint8_t *stream_get_buffered(stream_t *s, int *len)
+{
+    unsigned int pos = s->buf_cur & s->buffer_mask;
+    unsigned int avail = s->buf_end - s->buf_cur;
+    unsigned int contiguous = s->buffer_mask + 1 - pos;
+    *len = avail < contiguous ? avail : contiguous;
+    return s->buffer + pos;
+}
+
+// Return a pointer to the buffered data at the current position, if at least
+// len bytes can be accessed there without wrapping around or reading more
+// data. Otherwise return NULL.
+inline static uint8_t *stream_peek_buffered(stream_t *s, unsigned int len)
+{
+    unsigned int pos = s->buf_cur & s->buffer_mask;
+    if (s->buf_end - s->buf_cur < len || pos + len > s->buffer_mask + 1)
+        return NULL;
+    return s->buffer + pos;
+}
+
+// Advance the read position by len bytes, which must be at most the number
+// of bytes returned by stream_get_buffered().
+inline static void stream_skip_buffered(stream_t *s, int len)
+{
+    s->buf_cur += len;
+}
+
 int stream_skip_bom(struct stream *s);
 
 inline static int64_t stream_tell(stream_t *s)
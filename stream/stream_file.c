@@ -25,17 +25,21 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 
 #ifndef __MINGW32__
 #include <poll.h>
 #endif
 
 #include "osdep/io.h"
+#include "osdep/threads.h"
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "common/stats.h"
 #include "misc/thread_tools.h"
 #include "stream.h"
+#include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/path.h"
 
@@ -58,6 +62,68 @@
 #endif
 #endif
 
+struct stream_file_opts {
+    int readahead;
+    int64_t readahead_size;
+};
+
+#define OPT_BASE_STRUCT struct stream_file_opts
+
+const struct m_sub_options stream_file_conf = {
+    .opts = (const struct m_option[]){
+        {"stream-file-readahead", OPT_INT(readahead), M_RANGE(0, 64)},
+        {"stream-file-readahead-size", OPT_BYTE_SIZE(readahead_size),
+            M_RANGE(64 * 1024, 64 * 1024 * 1024)},
+        {0}
+    },
+    .size = sizeof(struct stream_file_opts),
+    .defaults = &(const struct stream_file_opts){
+        .readahead_size = 1024 * 1024,
+    },
+};
+
+enum ra_state {
+    RA_FREE,        // unused
+    RA_QUEUED,      // waiting for the read thread
+    RA_READING,     // read in progress
+    RA_DONE,        // read finished, result valid
+};
+
+struct ra_request {
+    enum ra_state state;
+    int64_t pos;        // file offset of the read
+    int64_t len;        // read result (<=0 on EOF or error)
+    uint8_t *buf;
+};
+
+// Asynchronous read-ahead. A helper thread performs pread() calls ahead of the
+// current read position, so that the stream thread doesn't have to wait for
+// slow storage. The active requests form a ring in file order.
+struct readahead {
+    // -- immutable
+    int fd;
+    int64_t req_size;
+    int num_reqs;
+    pthread_t thread;
+    struct mp_cancel *cancel;
+    struct stats_ctx *stats;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+
+    // -- protected by lock
+    struct ra_request *reqs;
+    int first;          // reqs[first] contains the current read position
+    int num_active;     // number of requests in the ring starting at first
+    int64_t bytes_in_flight;
+    bool terminate;
+
+    // -- accessed by the stream thread only
+    int64_t pos;        // current read position
+    int64_t next_pos;   // file offset of the next request to queue
+    bool eof;           // don't read ahead until the next seek
+};
+
 struct priv {
     int fd;
     bool close;
@@ -66,6 +132,7 @@ struct priv {
     bool appending;
     int64_t orig_size;
     struct mp_cancel *cancel;
+    struct readahead *ra;
 };
 
 // Total timeout = RETRY_TIMEOUT * MAX_RETRIES
@@ -85,10 +152,210 @@ static int64_t get_size(stream_t *s)
     return -1;
 }
 
+#ifndef __MINGW32__
+
+static void *ra_thread(void *arg)
+{
+    struct readahead *ra = arg;
+    mpthread_set_name("file-readahead");
+
+    pthread_mutex_lock(&ra->lock);
+    while (!ra->terminate) {
+        struct ra_request *req = NULL;
+        for (int n = 0; n < ra->num_active; n++) {
+            struct ra_request *r = &ra->reqs[(ra->first + n) % ra->num_reqs];
+            if (r->state == RA_QUEUED) {
+                req = r;
+                break;
+            }
+        }
+        if (!req) {
+            pthread_cond_wait(&ra->wakeup, &ra->lock);
+            continue;
+        }
+
+        req->state = RA_READING;
+        int64_t pos = req->pos;
+        pthread_mutex_unlock(&ra->lock);
+
+        ssize_t r;
+        do {
+            r = pread(ra->fd, req->buf, ra->req_size, pos);
+        } while (r < 0 && errno == EINTR);
+
+        pthread_mutex_lock(&ra->lock);
+        req->len = r;
+        req->state = RA_DONE;
+        ra->bytes_in_flight -= ra->req_size;
+        pthread_cond_broadcast(&ra->wakeup);
+    }
+    pthread_mutex_unlock(&ra->lock);
+
+    return NULL;
+}
+
+// Fill the ring with requests. Called with ra->lock held.
+static void ra_queue(struct readahead *ra)
+{
+    while (ra->num_active < ra->num_reqs) {
+        int idx = (ra->first + ra->num_active) % ra->num_reqs;
+        struct ra_request *req = &ra->reqs[idx];
+        assert(req->state == RA_FREE);
+        req->state = RA_QUEUED;
+        req->pos = ra->next_pos;
+        req->len = 0;
+        ra->next_pos += ra->req_size;
+        ra->num_active += 1;
+        ra->bytes_in_flight += ra->req_size;
+    }
+    pthread_cond_broadcast(&ra->wakeup);
+}
+
+// Drop all requests, and restart at ra->pos. If a read is in progress, wait
+// until it's done, since its buffer can't be reused before that.
+// Called with ra->lock held.
+static void ra_flush(struct readahead *ra)
+{
+    while (1) {
+        bool busy = false;
+        for (int n = 0; n < ra->num_reqs; n++) {
+            struct ra_request *req = &ra->reqs[n];
+            if (req->state == RA_QUEUED)
+                ra->bytes_in_flight -= ra->req_size;
+            if (req->state == RA_QUEUED || req->state == RA_DONE)
+                req->state = RA_FREE;
+            busy |= req->state == RA_READING;
+        }
+        if (!busy)
+            break;
+        pthread_cond_wait(&ra->wakeup, &ra->lock);
+    }
+    ra->first = 0;
+    ra->num_active = 0;
+    ra->next_pos = ra->pos;
+}
+
+// Returns the number of bytes read, -1 if cancelled, or 0 if the normal read
+// path has to be used (EOF, read errors).
+static int ra_read(struct readahead *ra, void *buffer, int max_len)
+{
+    if (ra->eof)
+        return 0;
+
+    pthread_mutex_lock(&ra->lock);
+    ra_queue(ra);
+
+    struct ra_request *req = &ra->reqs[ra->first];
+    while (req->state != RA_DONE && !mp_cancel_test(ra->cancel))
+        pthread_cond_wait(&ra->wakeup, &ra->lock);
+
+    int res = 0;
+    if (req->state != RA_DONE) {
+        res = -1;
+    } else if (req->len > ra->pos - req->pos) {
+        int64_t offset = ra->pos - req->pos;
+        res = MPMIN(max_len, req->len - offset);
+        memcpy(buffer, req->buf + offset, res);
+        ra->pos += res;
+        if (ra->pos - req->pos >= req->len) {
+            bool short_read = req->len < ra->req_size;
+            req->state = RA_FREE;
+            ra->first = (ra->first + 1) % ra->num_reqs;
+            ra->num_active -= 1;
+            // Probably EOF; the following requests are useless.
+            if (short_read)
+                ra->eof = true;
+        }
+    } else {
+        ra->eof = true;
+    }
+
+    if (ra->eof) {
+        ra_flush(ra);
+        // Continue with read() from the current position.
+        lseek(ra->fd, ra->pos, SEEK_SET);
+    }
+
+    stats_value(ra->stats, "readahead-queue-depth", ra->num_active);
+    stats_size_value(ra->stats, "readahead-in-flight", ra->bytes_in_flight);
+
+    pthread_mutex_unlock(&ra->lock);
+    return res;
+}
+
+static void ra_wakeup_cb(void *ctx)
+{
+    struct readahead *ra = ctx;
+    pthread_mutex_lock(&ra->lock);
+    pthread_cond_broadcast(&ra->wakeup);
+    pthread_mutex_unlock(&ra->lock);
+}
+
+static void ra_init(stream_t *s, struct stream_file_opts *opts)
+{
+    struct priv *p = s->priv;
+
+    struct readahead *ra = talloc_ptrtype(p, ra);
+    *ra = (struct readahead){
+        .fd = p->fd,
+        .req_size = opts->readahead_size,
+        .num_reqs = opts->readahead,
+        .cancel = mp_cancel_new(ra),
+        .stats = stats_ctx_create(ra, s->global, "stream-file"),
+    };
+    ra->reqs = talloc_zero_array(ra, struct ra_request, ra->num_reqs);
+    for (int n = 0; n < ra->num_reqs; n++)
+        ra->reqs[n].buf = talloc_size(ra, ra->req_size);
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->wakeup, NULL);
+    mp_cancel_set_parent(ra->cancel, p->cancel);
+    mp_cancel_set_cb(ra->cancel, ra_wakeup_cb, ra);
+
+    if (pthread_create(&ra->thread, NULL, ra_thread, ra)) {
+        MP_WARN(s, "Failed to start read-ahead thread.\n");
+        mp_cancel_set_parent(ra->cancel, NULL);
+        pthread_cond_destroy(&ra->wakeup);
+        pthread_mutex_destroy(&ra->lock);
+        talloc_free(ra);
+        return;
+    }
+
+    MP_VERBOSE(s, "Reading ahead %d x %"PRId64" bytes.\n", ra->num_reqs,
+               ra->req_size);
+    p->ra = ra;
+}
+
+static void ra_destroy(struct readahead *ra)
+{
+    if (!ra)
+        return;
+
+    pthread_mutex_lock(&ra->lock);
+    ra->terminate = true;
+    pthread_cond_broadcast(&ra->wakeup);
+    pthread_mutex_unlock(&ra->lock);
+    pthread_join(ra->thread, NULL);
+
+    mp_cancel_set_parent(ra->cancel, NULL);
+    pthread_cond_destroy(&ra->wakeup);
+    pthread_mutex_destroy(&ra->lock);
+    talloc_free(ra);
+}
+
+#endif
+
 static int fill_buffer(stream_t *s, void *buffer, int max_len)
 {
     struct priv *p = s->priv;
 
+#ifndef __MINGW32__
+    if (p->ra) {
+        int r = ra_read(p->ra, buffer, max_len);
+        if (r)
+            return r;
+    }
+#endif
+
 #ifndef __MINGW32__
     if (p->use_poll) {
         int c = mp_cancel_get_fd(p->cancel);
@@ -104,8 +371,13 @@ static int fill_buffer(stream_t *s, void *buffer, int max_len)
 
     for (int retries = 0; retries < MAX_RETRIES; retries++) {
         int r = read(p->fd, buffer, max_len);
-        if (r > 0)
+        if (r > 0) {
+#ifndef __MINGW32__
+            if (p->ra)
+                p->ra->pos += r;
+#endif
             return r;
+        }
 
         // Try to detect and handle files being appended during playback.
         int64_t size = get_size(s);
@@ -134,12 +406,26 @@ static int write_buffer(stream_t *s, void *buffer, int len)
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
+#ifndef __MINGW32__
+    if (p->ra) {
+        struct readahead *ra = p->ra;
+        pthread_mutex_lock(&ra->lock);
+        ra->pos = newpos;
+        ra->eof = false;
+        ra_flush(ra);
+        pthread_mutex_unlock(&ra->lock);
+    }
+#endif
     return lseek(p->fd, newpos, SEEK_SET) != (off_t)-1;
 }
 
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+#ifndef __MINGW32__
+    ra_destroy(p->ra);
+    p->ra = NULL;
+#endif
     if (p->close)
         close(p->fd);
 }
@@ -356,6 +642,15 @@ static int open_f(stream_t *stream, const struct stream_open_args *args)
     if (stream->cancel)
         mp_cancel_set_parent(p->cancel, stream->cancel);
 
+#ifndef __MINGW32__
+    struct stream_file_opts *opts =
+        mp_get_config_group(stream, stream->global, &stream_file_conf);
+    if (opts->readahead > 0 && !write && p->regular_file && !p->appending &&
+        stream->seekable)
+        ra_init(stream, opts);
+    talloc_free(opts);
+#endif
+
     return STREAM_OK;
 }
 
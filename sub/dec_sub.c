@@ -32,6 +32,7 @@
 #include "common/recorder.h"
 #include "misc/dispatch.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 extern const struct sd_functions sd_ass;
 extern const struct sd_functions sd_lavc;
@@ -245,6 +246,14 @@ void sub_preload(struct dec_sub *sub)
 
     sub->preload_attempted = true;
 
+    double start = mp_time_sec();
+
+    // If the decoder supports it, pass all packets at once, so it can
+    // decode them in parallel.
+    void *tmp = talloc_new(NULL);
+    struct demux_packet **pkts = NULL;
+    int num_pkts = 0;
+
     for (;;) {
         struct demux_packet *pkt = NULL;
         int r = demux_read_packet_async(sub->sh, &pkt);
@@ -254,10 +263,20 @@ void sub_preload(struct dec_sub *sub)
         }
         if (!pkt)
             break;
-        sub->sd->driver->decode(sub->sd, pkt);
-        talloc_free(pkt);
+        if (sub->sd->driver->decode_batch) {
+            MP_TARRAY_APPEND(tmp, pkts, num_pkts, talloc_steal(tmp, pkt));
+        } else {
+            sub->sd->driver->decode(sub->sd, pkt);
+            talloc_free(pkt);
+        }
     }
 
+    if (num_pkts)
+        sub->sd->driver->decode_batch(sub->sd, pkts, num_pkts);
+    talloc_free(tmp);
+
+    MP_VERBOSE(sub, "Preloading took %.3f seconds.\n", mp_time_sec() - start);
+
     demux_set_stream_wakeup_cb(sub->sh, NULL, NULL);
     talloc_free(demux_waiter);
 
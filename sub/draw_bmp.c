@@ -21,9 +21,12 @@
 #include <math.h>
 #include <inttypes.h>
 
+#include <libavutil/cpu.h>
+
 #include "common/common.h"
 #include "draw_bmp.h"
 #include "img_convert.h"
+#include "misc/thread_pool.h"
 #include "video/mp_image.h"
 #include "video/repack.h"
 #include "video/sws_utils.h"
@@ -58,6 +61,31 @@ struct slice {
     uint16_t x0, x1;
 };
 
+// Minimum number of dirty pixels per thread for parallel blending, to avoid
+// wasting more time on synchronization than on blending small subtitles.
+#define MIN_BLEND_PIXELS (64 * 1024)
+#define MAX_BLEND_THREADS 16
+
+// State needed to blend a range of lines. Each thread uses its own instance,
+// because the repackers keep pointers to their temporary buffers.
+struct blend_state {
+    struct mp_repack *overlay_to_f32;
+    struct mp_image *overlay_tmp;
+    struct mp_repack *calpha_to_f32;
+    struct mp_image *calpha_tmp;
+    struct mp_repack *video_to_f32;
+    struct mp_repack *video_from_f32;
+    struct mp_image *video_tmp;
+
+    // For the current blend_overlay_with_video() call.
+    struct mp_draw_sub_cache *p;
+    struct mp_image *dst;
+    int y0, y1;                     // range of lines to blend
+    bool ok;
+};
+
+typedef void (*blend_line_fn)(void *dst, void *src, void *src_a, int w);
+
 struct mp_draw_sub_cache
 {
     struct mpv_global *global;
@@ -101,7 +129,16 @@ struct mp_draw_sub_cache
     struct mp_image *premul_tmp;
 
     // Function that works on the _f32 data.
-    void (*blend_line)(void *dst, void *src, void *src_a, int w);
+    blend_line_fn blend_line;
+
+    int rflags;                     // flags used to create the repackers
+
+    // blend_states[0] refers to the repackers and buffers above; the others
+    // are created on demand for parallel blending.
+    struct blend_state **blend_states;
+    int num_blend_states;
+    struct mp_thread_pool *tp;
+    int current_thread_count;
 
     struct mp_image res_overlay;    // returned by mp_draw_sub_overlay()
 };
@@ -126,11 +163,178 @@ static void blend_line_u8(void *dst, void *src, void *src_a, int w)
         dst_i[x] = src_i[x] + dst_i[x] * (255u - src_a_i[x]) / 255u;
 }
 
-static void blend_slice(struct mp_draw_sub_cache *p)
+// SIMD versions of the blend functions above, with identical results. They
+// use per-function target attributes and are selected at runtime.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static void blend_line_f32_avx2(void *dst, void *src, void *src_a, int w)
+{
+    float *dst_f = dst;
+    float *src_f = src;
+    float *src_a_f = src_a;
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256 d = _mm256_loadu_ps(dst_f + x);
+        __m256 ia = _mm256_sub_ps(one, _mm256_loadu_ps(src_a_f + x));
+        __m256 r = _mm256_add_ps(_mm256_loadu_ps(src_f + x), _mm256_mul_ps(d, ia));
+        _mm256_storeu_ps(dst_f + x, r);
+    }
+    blend_line_f32(dst_f + x, src_f + x, src_a_f + x, w - x);
+}
+
+__attribute__((target("avx2")))
+static void blend_line_u8_avx2(void *dst, void *src, void *src_a, int w)
 {
-    struct mp_image *ov = p->overlay_tmp;
-    struct mp_image *ca = p->calpha_tmp;
-    struct mp_image *vid = p->video_tmp;
+    uint8_t *dst_i = dst;
+    uint8_t *src_i = src;
+    uint8_t *src_a_i = src_a;
+    const __m256i c255 = _mm256_set1_epi16(255);
+    const __m256i div = _mm256_set1_epi16((short)0x8081);
+    const __m256i lo8 = _mm256_set1_epi16(0xFF);
+
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m256i d = _mm256_cvtepu8_epi16(_mm_loadu_si128((void *)(dst_i + x)));
+        __m256i s = _mm256_cvtepu8_epi16(_mm_loadu_si128((void *)(src_i + x)));
+        __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((void *)(src_a_i + x)));
+        __m256i t = _mm256_mullo_epi16(d, _mm256_sub_epi16(c255, a));
+        // t / 255 == (t * 0x8081) >> 23 for all t <= 255 * 255.
+        t = _mm256_srli_epi16(_mm256_mulhi_epu16(t, div), 7);
+        // Wrap around on overflow, like the C version.
+        __m256i r = _mm256_and_si256(_mm256_add_epi16(s, t), lo8);
+        r = _mm256_permute4x64_epi64(_mm256_packus_epi16(r, r),
+                                     _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((void *)(dst_i + x), _mm256_castsi256_si128(r));
+    }
+    blend_line_u8(dst_i + x, src_i + x, src_a_i + x, w - x);
+}
+
+__attribute__((target("sse4.1")))
+static void blend_line_f32_sse4(void *dst, void *src, void *src_a, int w)
+{
+    float *dst_f = dst;
+    float *src_f = src;
+    float *src_a_f = src_a;
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        __m128 d = _mm_loadu_ps(dst_f + x);
+        __m128 ia = _mm_sub_ps(one, _mm_loadu_ps(src_a_f + x));
+        __m128 r = _mm_add_ps(_mm_loadu_ps(src_f + x), _mm_mul_ps(d, ia));
+        _mm_storeu_ps(dst_f + x, r);
+    }
+    blend_line_f32(dst_f + x, src_f + x, src_a_f + x, w - x);
+}
+
+__attribute__((target("sse4.1")))
+static void blend_line_u8_sse4(void *dst, void *src, void *src_a, int w)
+{
+    uint8_t *dst_i = dst;
+    uint8_t *src_i = src;
+    uint8_t *src_a_i = src_a;
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i div = _mm_set1_epi16((short)0x8081);
+    const __m128i lo8 = _mm_set1_epi16(0xFF);
+
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i d = _mm_cvtepu8_epi16(_mm_loadl_epi64((void *)(dst_i + x)));
+        __m128i s = _mm_cvtepu8_epi16(_mm_loadl_epi64((void *)(src_i + x)));
+        __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64((void *)(src_a_i + x)));
+        __m128i t = _mm_mullo_epi16(d, _mm_sub_epi16(c255, a));
+        t = _mm_srli_epi16(_mm_mulhi_epu16(t, div), 7);
+        __m128i r = _mm_and_si128(_mm_add_epi16(s, t), lo8);
+        _mm_storel_epi64((void *)(dst_i + x), _mm_packus_epi16(r, r));
+    }
+    blend_line_u8(dst_i + x, src_i + x, src_a_i + x, w - x);
+}
+
+static blend_line_fn select_blend_line(blend_line_fn fn)
+{
+    int flags = av_get_cpu_flags();
+    if (fn == blend_line_f32) {
+        if (flags & AV_CPU_FLAG_AVX2)
+            return blend_line_f32_avx2;
+        if (flags & AV_CPU_FLAG_SSE4)
+            return blend_line_f32_sse4;
+    } else if (fn == blend_line_u8) {
+        if (flags & AV_CPU_FLAG_AVX2)
+            return blend_line_u8_avx2;
+        if (flags & AV_CPU_FLAG_SSE4)
+            return blend_line_u8_sse4;
+    }
+    return fn;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+
+static void blend_line_f32_neon(void *dst, void *src, void *src_a, int w)
+{
+    float *dst_f = dst;
+    float *src_f = src;
+    float *src_a_f = src_a;
+    const float32x4_t one = vdupq_n_f32(1.0f);
+
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        float32x4_t d = vld1q_f32(dst_f + x);
+        float32x4_t ia = vsubq_f32(one, vld1q_f32(src_a_f + x));
+        vst1q_f32(dst_f + x, vaddq_f32(vld1q_f32(src_f + x), vmulq_f32(d, ia)));
+    }
+    blend_line_f32(dst_f + x, src_f + x, src_a_f + x, w - x);
+}
+
+static void blend_line_u8_neon(void *dst, void *src, void *src_a, int w)
+{
+    uint8_t *dst_i = dst;
+    uint8_t *src_i = src;
+    uint8_t *src_a_i = src_a;
+
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint8x8_t ia = vsub_u8(vdup_n_u8(255), vld1_u8(src_a_i + x));
+        uint16x8_t t = vmull_u8(vld1_u8(dst_i + x), ia);
+        // t / 255 == (t + 1 + (t >> 8)) >> 8 for all t <= 255 * 255.
+        t = vshrq_n_u16(vaddq_u16(vaddq_u16(t, vdupq_n_u16(1)),
+                                  vshrq_n_u16(t, 8)), 8);
+        // Wrap around on overflow, like the C version.
+        uint8x8_t r = vadd_u8(vld1_u8(src_i + x), vmovn_u16(t));
+        vst1_u8(dst_i + x, r);
+    }
+    blend_line_u8(dst_i + x, src_i + x, src_a_i + x, w - x);
+}
+
+static blend_line_fn select_blend_line(blend_line_fn fn)
+{
+    if (!(av_get_cpu_flags() & AV_CPU_FLAG_NEON))
+        return fn;
+    if (fn == blend_line_f32)
+        return blend_line_f32_neon;
+    if (fn == blend_line_u8)
+        return blend_line_u8_neon;
+    return fn;
+}
+
+#else
+
+static blend_line_fn select_blend_line(blend_line_fn fn)
+{
+    return fn;
+}
+
+#endif
+
+static void blend_slice(struct mp_draw_sub_cache *p, struct blend_state *st)
+{
+    struct mp_image *ov = st->overlay_tmp;
+    struct mp_image *ca = st->calpha_tmp;
+    struct mp_image *vid = st->video_tmp;
 
     for (int plane = 0; plane < vid->num_planes; plane++) {
         int xs = vid->fmt.xs[plane];
@@ -147,18 +351,20 @@ static void blend_slice(struct mp_draw_sub_cache *p)
     }
 }
 
-static bool blend_overlay_with_video(struct mp_draw_sub_cache *p,
-                                     struct mp_image *dst)
+static bool blend_lines(struct blend_state *st)
 {
-    if (!repack_config_buffers(p->video_to_f32, 0, p->video_tmp, 0, dst, NULL))
+    struct mp_draw_sub_cache *p = st->p;
+    struct mp_image *dst = st->dst;
+
+    if (!repack_config_buffers(st->video_to_f32, 0, st->video_tmp, 0, dst, NULL))
         return false;
-    if (!repack_config_buffers(p->video_from_f32, 0, dst, 0, p->video_tmp, NULL))
+    if (!repack_config_buffers(st->video_from_f32, 0, dst, 0, st->video_tmp, NULL))
         return false;
 
     int xs = dst->fmt.chroma_xs;
     int ys = dst->fmt.chroma_ys;
 
-    for (int y = 0; y < dst->h; y += p->align_y) {
+    for (int y = st->y0; y < st->y1; y += p->align_y) {
         struct slice *line = &p->slices[y * p->s_w];
 
         for (int sx = 0; sx < p->s_w; sx++) {
@@ -173,20 +379,151 @@ static bool blend_overlay_with_video(struct mp_draw_sub_cache *p,
             assert(MP_IS_ALIGNED(w, p->align_x));
             assert(x + w <= p->w);
 
-            repack_line(p->overlay_to_f32, 0, 0, x, y, w);
-            repack_line(p->video_to_f32, 0, 0, x, y, w);
-            if (p->calpha_to_f32)
-                repack_line(p->calpha_to_f32, 0, 0, x >> xs, y >> ys, w >> xs);
+            repack_line(st->overlay_to_f32, 0, 0, x, y, w);
+            repack_line(st->video_to_f32, 0, 0, x, y, w);
+            if (st->calpha_to_f32)
+                repack_line(st->calpha_to_f32, 0, 0, x >> xs, y >> ys, w >> xs);
 
-            blend_slice(p);
+            blend_slice(p, st);
 
-            repack_line(p->video_from_f32, x, y, 0, 0, w);
+            repack_line(st->video_from_f32, x, y, 0, 0, w);
         }
     }
 
     return true;
 }
 
+static void blend_lines_thread(void *ptr, int index)
+{
+    struct mp_draw_sub_cache *p = ptr;
+    struct blend_state *st = p->blend_states[index];
+
+    st->ok = blend_lines(st);
+}
+
+// Create a blend_state equivalent to blend_states[0], for use by another
+// thread.
+static struct blend_state *create_blend_state(struct mp_draw_sub_cache *p)
+{
+    struct blend_state *st0 = p->blend_states[0];
+    struct blend_state *st = talloc_zero(p, struct blend_state);
+
+    int vid_fmt = mp_repack_get_format_src(st0->video_to_f32);
+    int ov_fmt = mp_repack_get_format_src(st0->overlay_to_f32);
+    st->video_to_f32 = mp_repack_create_planar(vid_fmt, false, p->rflags);
+    st->video_from_f32 = mp_repack_create_planar(vid_fmt, true, p->rflags);
+    st->overlay_to_f32 = mp_repack_create_planar(ov_fmt, false, p->rflags);
+    talloc_steal(st, st->video_to_f32);
+    talloc_steal(st, st->video_from_f32);
+    talloc_steal(st, st->overlay_to_f32);
+    st->video_tmp = talloc_steal(st, mp_image_alloc(st0->video_tmp->imgfmt,
+                                     st0->video_tmp->w, st0->video_tmp->h));
+    st->overlay_tmp = talloc_steal(st, mp_image_alloc(st0->overlay_tmp->imgfmt,
+                                     st0->overlay_tmp->w, st0->overlay_tmp->h));
+    if (!st->video_to_f32 || !st->video_from_f32 || !st->overlay_to_f32 ||
+        !st->video_tmp || !st->overlay_tmp)
+        goto fail;
+
+    st->video_tmp->params.color = st0->video_tmp->params.color;
+    st->overlay_tmp->params.color = st0->overlay_tmp->params.color;
+
+    struct mp_image *ov = p->video_overlay ? p->video_overlay : p->rgba_overlay;
+    if (!repack_config_buffers(st->overlay_to_f32, 0, st->overlay_tmp,
+                               0, ov, NULL))
+        goto fail;
+
+    if (st0->calpha_to_f32) {
+        int ca_fmt = mp_repack_get_format_src(st0->calpha_to_f32);
+        st->calpha_to_f32 = mp_repack_create_planar(ca_fmt, false, p->rflags);
+        talloc_steal(st, st->calpha_to_f32);
+        st->calpha_tmp = talloc_steal(st, mp_image_alloc(st0->calpha_tmp->imgfmt,
+                                          st0->calpha_tmp->w, st0->calpha_tmp->h));
+        if (!st->calpha_to_f32 || !st->calpha_tmp)
+            goto fail;
+        if (!repack_config_buffers(st->calpha_to_f32, 0, st->calpha_tmp,
+                                   0, p->calpha_overlay, NULL))
+            goto fail;
+    }
+
+    return st;
+
+fail:
+    talloc_free(st);
+    return NULL;
+}
+
+// Split the lines with dirty slices into ranges with about the same number of
+// dirty pixels, and return the number of ranges (each set in a blend_state).
+static int setup_blend_ranges(struct mp_draw_sub_cache *p, struct mp_image *dst)
+{
+    int64_t total = 0;
+    for (int y = 0; y < dst->h; y += p->align_y) {
+        struct slice *line = &p->slices[y * p->s_w];
+        for (int sx = 0; sx < p->s_w; sx++)
+            total += MPMAX(line[sx].x1 - line[sx].x0, 0);
+    }
+
+    int num = MPCLAMP(av_cpu_count(), 1, MAX_BLEND_THREADS);
+    num = MPCLAMP(total / MIN_BLEND_PIXELS, 1, num);
+
+    int threads = num - 1;
+    if (threads > p->current_thread_count) {
+        // Just destroy and recreate all - dumb and costly, but rarely happens.
+        TA_FREEP(&p->tp);
+        p->current_thread_count = 0;
+        p->tp = mp_thread_pool_create(p, threads, threads, threads);
+        if (p->tp)
+            p->current_thread_count = threads;
+    }
+    num = MPMIN(num, p->current_thread_count + 1);
+
+    while (p->num_blend_states < num) {
+        struct blend_state *st = create_blend_state(p);
+        if (!st)
+            break;
+        MP_TARRAY_APPEND(p, p->blend_states, p->num_blend_states, st);
+    }
+    num = MPMIN(num, p->num_blend_states);
+
+    int64_t acc = 0;
+    int cur = 0;
+    p->blend_states[0]->y0 = 0;
+    for (int y = 0; y < dst->h; y += p->align_y) {
+        struct slice *line = &p->slices[y * p->s_w];
+        for (int sx = 0; sx < p->s_w; sx++)
+            acc += MPMAX(line[sx].x1 - line[sx].x0, 0);
+        if (cur + 1 < num && acc >= total * (cur + 1) / num) {
+            p->blend_states[cur]->y1 = y + p->align_y;
+            cur++;
+            p->blend_states[cur]->y0 = y + p->align_y;
+        }
+    }
+    p->blend_states[cur]->y1 = dst->h;
+
+    return cur + 1;
+}
+
+static bool blend_overlay_with_video(struct mp_draw_sub_cache *p,
+                                     struct mp_image *dst)
+{
+    int num = setup_blend_ranges(p, dst);
+
+    for (int n = 0; n < num; n++) {
+        struct blend_state *st = p->blend_states[n];
+        st->p = p;
+        st->dst = dst;
+        st->ok = false;
+    }
+
+    mp_thread_pool_parallel_for(p->tp, num, blend_lines_thread, p);
+
+    bool ok = true;
+    for (int n = 0; n < num; n++)
+        ok &= p->blend_states[n]->ok;
+
+    return ok;
+}
+
 static bool convert_overlay_part(struct mp_draw_sub_cache *p,
                                  int x0, int y0, int w, int h)
 {
@@ -571,6 +908,9 @@ static bool reinit_to_video(struct mp_draw_sub_cache *p)
         p->blend_line = blend_line_f32;
     }
 
+    p->blend_line = select_blend_line(p->blend_line);
+    p->rflags = rflags;
+
     p->scale_in_tiles = SCALE_IN_TILES;
 
     int vid_f32_fmt = mp_repack_get_format_dst(p->video_to_f32);
@@ -769,6 +1109,18 @@ static bool reinit_to_video(struct mp_draw_sub_cache *p)
         p->unpremul->force_scaler = MP_SWS_ZIMG;
     }
 
+    struct blend_state *st = talloc_zero(p, struct blend_state);
+    *st = (struct blend_state){
+        .overlay_to_f32 = p->overlay_to_f32,
+        .overlay_tmp = p->overlay_tmp,
+        .calpha_to_f32 = p->calpha_to_f32,
+        .calpha_tmp = p->calpha_tmp,
+        .video_to_f32 = p->video_to_f32,
+        .video_from_f32 = p->video_from_f32,
+        .video_tmp = p->video_tmp,
+    };
+    MP_TARRAY_APPEND(p, p->blend_states, p->num_blend_states, st);
+
     init_general(p);
 
     return true;
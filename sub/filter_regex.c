@@ -86,4 +86,5 @@ const struct sd_filter_functions sd_filter_regex = {
     .init   = rf_init,
     .uninit = rf_uninit,
     .filter = rf_filter,
+    .thread_safe = true,
 };
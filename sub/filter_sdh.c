@@ -479,4 +479,5 @@ static struct demux_packet *sdh_filter(struct sd_filter *ft,
 const struct sd_filter_functions sd_filter_sdh = {
     .init   = sdh_init,
     .filter = sdh_filter,
+    .thread_safe = true,
 };
@@ -33,6 +33,11 @@ struct sd_functions {
     bool accept_packets_in_advance;
     int  (*init)(struct sd *sd);
     void (*decode)(struct sd *sd, struct demux_packet *packet);
+    // Optional. Same as calling decode() on each packet in order, but the
+    // decoder may distribute the work over multiple threads. Used for
+    // preloading. The packets are owned by the caller.
+    void (*decode_batch)(struct sd *sd, struct demux_packet **packets,
+                         int num_packets);
     void (*reset)(struct sd *sd);
     void (*select)(struct sd *sd, bool selected);
     void (*uninit)(struct sd *sd);
@@ -86,6 +91,10 @@ struct sd_filter_functions {
                                    struct demux_packet *pkt);
 
     void (*uninit)(struct sd_filter *ft);
+
+    // If true, filter() can be called concurrently from multiple threads on
+    // the same sd_filter (e.g. when preloading).
+    bool thread_safe;
 };
 
 extern const struct sd_filter_functions sd_filter_sdh;
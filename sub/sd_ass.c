@@ -22,6 +22,7 @@
 #include <limits.h>
 
 #include <libavutil/common.h>
+#include <libavutil/cpu.h>
 #include <ass/ass.h>
 
 #include "mpv_talloc.h"
@@ -32,12 +33,20 @@
 #include "common/common.h"
 #include "common/msg.h"
 #include "demux/demux.h"
+#include "misc/thread_pool.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
 #include "dec_sub.h"
 #include "ass_mp.h"
 #include "sd.h"
 
+// Open addressing hash set of int64_t values. INT64_MIN can't be stored.
+struct seen_set {
+    int64_t *slots;
+    size_t num_slots;   // 0 or power of 2
+    size_t count;
+};
+
 struct sd_ass_priv {
     struct ass_library *ass_library;
     struct ass_renderer *ass_renderer;
@@ -54,13 +63,14 @@ struct sd_ass_priv {
     char last_text[500];
     struct mp_image_params video_params;
     struct mp_image_params last_params;
-    int64_t *seen_packets;
-    int num_seen_packets;
+    struct seen_set seen_packets;
     bool duration_unknown;
+    struct mp_thread_pool *preload_pool;
 };
 
 static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts);
 static void fill_plaintext(struct sd *sd, double pts);
+static void seen_set_clear(struct seen_set *set);
 
 static const struct sd_filter_functions *const filters[] = {
     // Note: list order defines filter order.
@@ -278,7 +288,8 @@ static int init(struct sd *sd)
 }
 
 // Note: pkt is not necessarily a fully valid refcounted packet.
-static void filter_and_add(struct sd *sd, struct demux_packet *pkt)
+static void filter_and_add_to(struct sd *sd, ASS_Track *track,
+                              struct demux_packet *pkt)
 {
     struct sd_ass_priv *ctx = sd->priv;
     struct demux_packet *orig_pkt = pkt;
@@ -293,7 +304,7 @@ static void filter_and_add(struct sd *sd, struct demux_packet *pkt)
             return;
     }
 
-    ass_process_chunk(ctx->ass_track, pkt->buffer, pkt->len,
+    ass_process_chunk(track, pkt->buffer, pkt->len,
                       llrint(pkt->pts * 1000),
                       llrint(pkt->duration * 1000));
 
@@ -301,27 +312,65 @@ static void filter_and_add(struct sd *sd, struct demux_packet *pkt)
         talloc_free(pkt);
 }
 
+static void filter_and_add(struct sd *sd, struct demux_packet *pkt)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    filter_and_add_to(sd, ctx->ass_track, pkt);
+}
+
+static uint64_t seen_set_hash(int64_t val)
+{
+    // splitmix64 finalizer
+    uint64_t h = val;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+static void seen_set_clear(struct seen_set *set)
+{
+    TA_FREEP(&set->slots);
+    set->num_slots = 0;
+    set->count = 0;
+}
+
+// Add val to the set. Return true if it was already in the set.
+static bool seen_set_add(void *ta_parent, struct seen_set *set, int64_t val)
+{
+    assert(val != INT64_MIN);
+    if ((set->count + 1) * 2 > set->num_slots) {
+        struct seen_set new = {
+            .num_slots = MPMAX(set->num_slots * 2, 64),
+        };
+        new.slots = talloc_array(ta_parent, int64_t, new.num_slots);
+        for (size_t n = 0; n < new.num_slots; n++)
+            new.slots[n] = INT64_MIN;
+        for (size_t n = 0; n < set->num_slots; n++) {
+            if (set->slots[n] != INT64_MIN)
+                seen_set_add(ta_parent, &new, set->slots[n]);
+        }
+        talloc_free(set->slots);
+        *set = new;
+    }
+    size_t mask = set->num_slots - 1;
+    for (size_t n = seen_set_hash(val) & mask; ; n = (n + 1) & mask) {
+        if (set->slots[n] == val)
+            return true;
+        if (set->slots[n] == INT64_MIN) {
+            set->slots[n] = val;
+            set->count++;
+            return false;
+        }
+    }
+}
+
 // Test if the packet with the given file position (used as unique ID) was
 // already consumed. Return false if the packet is new (and add it to the
-// internal list), and return true if it was already seen.
+// internal set), and return true if it was already seen.
 static bool check_packet_seen(struct sd *sd, int64_t pos)
 {
     struct sd_ass_priv *priv = sd->priv;
-    int a = 0;
-    int b = priv->num_seen_packets;
-    while (a < b) {
-        int mid = a + (b - a) / 2;
-        int64_t val = priv->seen_packets[mid];
-        if (pos == val)
-            return true;
-        if (pos > val) {
-            a = mid + 1;
-        } else {
-            b = mid;
-        }
-    }
-    MP_TARRAY_INSERT_AT(priv, priv->seen_packets, priv->num_seen_packets, a, pos);
-    return false;
+    return seen_set_add(priv, &priv->seen_packets, pos);
 }
 
 #define UNKNOWN_DURATION (INT_MAX / 1000)
@@ -375,6 +424,129 @@ static void decode(struct sd *sd, struct demux_packet *packet)
     }
 }
 
+#define MAX_PRELOAD_THREADS 16
+// Minimum number of packets each preload thread handles.
+#define MIN_PRELOAD_PACKETS 1000
+
+struct preload_ctx {
+    struct sd *sd;
+    struct demux_packet **packets;
+    int num_packets;
+    ASS_Track **tracks;
+    int num_tracks;
+};
+
+// Create an empty track with the same event format and styles as the main
+// track, so events parsed into it use the same style indexes.
+static ASS_Track *new_preload_track(struct sd *sd)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    ASS_Track *src = ctx->ass_track;
+    ASS_Track *track = ass_new_track(ctx->ass_library);
+    track->track_type = src->track_type;
+    if (src->event_format)
+        track->event_format = strdup(src->event_format);
+    for (int n = 0; n < src->n_styles; n++) {
+        ASS_Style *style = &track->styles[ass_alloc_style(track)];
+        *style = src->styles[n];
+        if (style->Name)
+            style->Name = strdup(style->Name);
+        if (style->FontName)
+            style->FontName = strdup(style->FontName);
+    }
+    track->default_style = src->default_style;
+#if LIBASS_VERSION >= 0x01302000
+    ass_set_check_readorder(track, sd->opts->sub_clear_on_seek ? 0 : 1);
+#endif
+    return track;
+}
+
+static void preload_range(void *ptr, int index)
+{
+    struct preload_ctx *p = ptr;
+    int start = (int64_t)p->num_packets * index / p->num_tracks;
+    int end = (int64_t)p->num_packets * (index + 1) / p->num_tracks;
+    for (int n = start; n < end; n++)
+        filter_and_add_to(p->sd, p->tracks[index], p->packets[n]);
+}
+
+// Move all events from src to the main track. If seen is not NULL, skip
+// events with a ReadOrder that was already added, like libass does.
+static void merge_preload_track(struct sd *sd, ASS_Track *src,
+                                struct seen_set *seen, void *ta_parent)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    ASS_Track *track = ctx->ass_track;
+    for (int n = 0; n < src->n_events; n++) {
+        ASS_Event *event = &src->events[n];
+        if (seen && seen_set_add(ta_parent, seen, event->ReadOrder))
+            continue;
+        track->events[ass_alloc_event(track)] = *event;
+        // Now owned by the main track.
+        event->Name = event->Effect = event->Text = NULL;
+        event->render_priv = NULL;
+    }
+}
+
+// Native ASS packets are filtered and parsed in parallel, each thread on its
+// own track with a contiguous range of packets. The events are then moved to
+// the main track in packet order. Converted subtitles are decoded serially,
+// because the converter is stateful.
+static void decode_batch(struct sd *sd, struct demux_packet **packets,
+                         int num_packets)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+
+    bool parallel = !ctx->converter;
+    for (int n = 0; n < ctx->num_filters; n++)
+        parallel &= ctx->filters[n]->driver->thread_safe;
+    int threads = MPMIN(MPCLAMP(av_cpu_count(), 1, MAX_PRELOAD_THREADS),
+                        num_packets / MIN_PRELOAD_PACKETS);
+    if (!parallel || threads < 2) {
+        for (int n = 0; n < num_packets; n++)
+            decode(sd, packets[n]);
+        return;
+    }
+
+    void *tmp = talloc_new(NULL);
+    struct preload_ctx p = {
+        .sd = sd,
+        .packets = packets,
+        .num_packets = num_packets,
+        .tracks = talloc_array(tmp, ASS_Track *, threads),
+        .num_tracks = threads,
+    };
+    for (int n = 0; n < threads; n++)
+        p.tracks[n] = new_preload_track(sd);
+
+    // The calling thread takes part too. The workers are only created on
+    // demand, and exit again when they have been idle for a while. If they
+    // cannot be created, this runs everything on the calling thread.
+    if (!ctx->preload_pool) {
+        ctx->preload_pool =
+            mp_thread_pool_create(ctx, 0, 0, MAX_PRELOAD_THREADS - 1);
+    }
+    mp_thread_pool_parallel_for(ctx->preload_pool, threads, preload_range, &p);
+
+    // libass only drops duplicate ReadOrders within each range.
+    struct seen_set readorders = {0};
+    struct seen_set *seen = NULL;
+    if (!sd->opts->sub_clear_on_seek) {
+        seen = &readorders;
+        for (int n = 0; n < ctx->ass_track->n_events; n++)
+            seen_set_add(tmp, seen, ctx->ass_track->events[n].ReadOrder);
+    }
+    int num_events = ctx->ass_track->n_events;
+    for (int n = 0; n < threads; n++) {
+        merge_preload_track(sd, p.tracks[n], seen, tmp);
+        ass_free_track(p.tracks[n]);
+    }
+    MP_VERBOSE(sd, "Preloaded %d events from %d packets using %d threads.\n",
+               ctx->ass_track->n_events - num_events, num_packets, threads);
+
+    talloc_free(tmp);
+}
+
 static void configure_ass(struct sd *sd, struct mp_osd_res *dim,
                           bool converted, ASS_Track *track)
 {
@@ -567,7 +739,7 @@ static struct sub_bitmaps *get_bitmaps(struct sd *sd, struct mp_osd_res dim,
     long long ts = find_timestamp(sd, pts);
     if (ctx->duration_unknown && pts != MP_NOPTS_VALUE) {
         mp_ass_flush_old_events(track, ts);
-        ctx->num_seen_packets = 0;
+        seen_set_clear(&ctx->seen_packets);
         sd->preload_ok = false;
     }
 
@@ -778,7 +950,7 @@ static void reset(struct sd *sd)
     struct sd_ass_priv *ctx = sd->priv;
     if (sd->opts->sub_clear_on_seek || ctx->duration_unknown || ctx->clear_once) {
         ass_flush_events(ctx->ass_track);
-        ctx->num_seen_packets = 0;
+        seen_set_clear(&ctx->seen_packets);
         sd->preload_ok = false;
         ctx->clear_once = false;
     }
@@ -795,6 +967,7 @@ static void uninit(struct sd *sd)
         lavc_conv_uninit(ctx->converter);
     assobjects_destroy(sd);
     talloc_free(ctx->copy_cache);
+    talloc_free(ctx->preload_pool);
 }
 
 static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
@@ -843,6 +1016,7 @@ const struct sd_functions sd_ass = {
     .accept_packets_in_advance = true,
     .init = init,
     .decode = decode,
+    .decode_batch = decode_batch,
     .get_bitmaps = get_bitmaps,
     .get_text = get_text,
     .get_times = get_times,
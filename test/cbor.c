@@ -0,0 +1,133 @@
+#include <math.h>
+
+#include "misc/cbor.h"
+#include "misc/node.h"
+#include "test_utils.h"
+
+struct entry {
+    bstr src;
+    bstr out;   // re-encoded data; if not set, same as src
+    struct mpv_node out_data;
+    bool expect_fail;
+};
+
+#define B(s) {(unsigned char *)(s), sizeof(s) - 1}
+
+#define VAL_LIST(...) (struct mpv_node[]){__VA_ARGS__}
+
+#define L(...) __VA_ARGS__
+
+#define NODE_INT64(v) {.format = MPV_FORMAT_INT64,  .u = { .int64 = (v) }}
+#define NODE_STR(v)   {.format = MPV_FORMAT_STRING, .u = { .string = (v) }}
+#define NODE_BOOL(v)  {.format = MPV_FORMAT_FLAG,   .u = { .flag = (bool)(v) }}
+#define NODE_FLOAT(v) {.format = MPV_FORMAT_DOUBLE, .u = { .double_ = (v) }}
+#define NODE_NONE()   {.format = MPV_FORMAT_NONE }
+#define NODE_BYTES(v) {.format = MPV_FORMAT_BYTE_ARRAY, .u = { .ba =        \
+    &(struct mpv_byte_array) {.data = (v), .size = sizeof(v) - 1}}}
+#define NODE_ARRAY(...) {.format = MPV_FORMAT_NODE_ARRAY, .u = { .list =    \
+    &(struct mpv_node_list) {                                               \
+        .num = sizeof(VAL_LIST(__VA_ARGS__)) / sizeof(struct mpv_node),     \
+        .values = VAL_LIST(__VA_ARGS__)}}}
+#define NODE_MAP(k, v) {.format = MPV_FORMAT_NODE_MAP, .u = { .list =       \
+    &(struct mpv_node_list) {                                               \
+        .num = sizeof(VAL_LIST(v)) / sizeof(struct mpv_node),               \
+        .values = VAL_LIST(v),                                              \
+        .keys = (char**)(const char *[]){k}}}}
+
+// Examples mostly from RFC 8949 appendix A.
+static const struct entry entries[] = {
+    { B("\x00"), .out_data = NODE_INT64(0)},
+    { B("\x17"), .out_data = NODE_INT64(23)},
+    { B("\x18\x18"), .out_data = NODE_INT64(24)},
+    { B("\x19\x03\xe8"), .out_data = NODE_INT64(1000)},
+    { B("\x1a\x00\x0f\x42\x40"), .out_data = NODE_INT64(1000000)},
+    { B("\x1b\x00\x00\x00\xe8\xd4\xa5\x10\x00"),
+        .out_data = NODE_INT64(1000000000000)},
+    { B("\x1b\x7f\xff\xff\xff\xff\xff\xff\xff"),
+        .out_data = NODE_INT64(INT64_MAX)},
+    { B("\x1b\xff\xff\xff\xff\xff\xff\xff\xff"), .expect_fail = true},
+    { B("\x20"), .out_data = NODE_INT64(-1)},
+    { B("\x38\x63"), .out_data = NODE_INT64(-100)},
+    { B("\x3b\x7f\xff\xff\xff\xff\xff\xff\xff"),
+        .out_data = NODE_INT64(INT64_MIN)},
+    // non-shortest argument encoding is accepted
+    { B("\x19\x00\x01"), B("\x01"), NODE_INT64(1)},
+    { B("\xf9\x3c\x00"), B("\xfa\x3f\x80\x00\x00"), NODE_FLOAT(1.0)},
+    { B("\xf9\xc4\x00"), B("\xfa\xc0\x80\x00\x00"), NODE_FLOAT(-4.0)},
+    { B("\xf9\x00\x01"), B("\xfa\x33\x80\x00\x00"), NODE_FLOAT(5.960464477539063e-8)},
+    { B("\xfa\x47\xc3\x50\x00"), .out_data = NODE_FLOAT(100000.0)},
+    { B("\xfb\x3f\xf1\x99\x99\x99\x99\x99\x9a"), .out_data = NODE_FLOAT(1.1)},
+    { B("\xf4"), .out_data = NODE_BOOL(false)},
+    { B("\xf5"), .out_data = NODE_BOOL(true)},
+    { B("\xf6"), .out_data = NODE_NONE()},
+    { B("\xf7"), B("\xf6"), NODE_NONE()},
+    { B("\xf0"), .expect_fail = true},
+    { B("\x60"), .out_data = NODE_STR("")},
+    { B("\x64\x49\x45\x54\x46"), .out_data = NODE_STR("IETF")},
+    { B("\x62\xc3\xbc"), .out_data = NODE_STR("\xc3\xbc")},
+    { B("\x62\x61\x00"), .expect_fail = true},
+    { B("\x64\x49\x45"), .expect_fail = true},
+    { B("\x44\x01\x02\x03\x04"), .out_data = NODE_BYTES("\x01\x02\x03\x04")},
+    { B("\x80"), .out_data = NODE_ARRAY()},
+    { B("\x83\x01\x02\x03"),
+        .out_data = NODE_ARRAY(NODE_INT64(1), NODE_INT64(2), NODE_INT64(3))},
+    { B("\x83\x01\x82\x02\x03\x82\x04\x05"),
+        .out_data = NODE_ARRAY(NODE_INT64(1),
+                               NODE_ARRAY(NODE_INT64(2), NODE_INT64(3)),
+                               NODE_ARRAY(NODE_INT64(4), NODE_INT64(5)))},
+    { B("\x83\x01\x02"), .expect_fail = true},
+    { B("\x9b\x00\x00\x00\x01\x00\x00\x00\x00"), .expect_fail = true},
+    { B("\xa0"), .out_data = NODE_MAP(L(), L())},
+    { B("\xa2\x61\x61\x01\x61\x62\x82\x02\x03"),
+        .out_data = NODE_MAP(L("a", "b"),
+                             L(NODE_INT64(1),
+                               NODE_ARRAY(NODE_INT64(2), NODE_INT64(3))))},
+    { B("\xa1\x01\x02"), .expect_fail = true},
+    // tags are skipped
+    { B("\xc1\x1a\x51\x4b\x67\xb0"), B("\x1a\x51\x4b\x67\xb0"),
+        NODE_INT64(1363896240)},
+    // indefinite length items are not supported
+    { B("\x9f\x01\x02\xff"), .expect_fail = true},
+    { B("\x7f\x61\x61\xff"), .expect_fail = true},
+    { B(""), .expect_fail = true},
+};
+
+int main(void)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(entries); n++) {
+        const struct entry *e = &entries[n];
+        void *tmp = talloc_new(NULL);
+        bstr s = e->src;
+        struct mpv_node res;
+        bool ok = cbor_parse(tmp, &res, &s, MAX_CBOR_DEPTH) >= 0;
+        assert_true(ok != e->expect_fail);
+        if (!ok) {
+            talloc_free(tmp);
+            continue;
+        }
+        assert_int_equal(s.len, 0);
+        assert_true(equal_mpv_node(&e->out_data, &res));
+        bstr d = {0};
+        assert_true(cbor_write(tmp, &d, &res) >= 0);
+        bstr expected = e->out.start ? e->out : e->src;
+        assert_true(bstr_equals(d, expected));
+        talloc_free(tmp);
+    }
+
+    // Limit nesting depth.
+    void *tmp = talloc_new(NULL);
+    bstr deep = {talloc_zero_size(tmp, MAX_CBOR_DEPTH + 1), MAX_CBOR_DEPTH + 1};
+    memset(deep.start, 0x81, MAX_CBOR_DEPTH);
+    struct mpv_node res;
+    assert_true(cbor_parse(tmp, &res, &deep, MAX_CBOR_DEPTH) < 0);
+
+    // NaN and infinity can be represented, unlike with JSON.
+    struct mpv_node nan_node = NODE_FLOAT(NAN);
+    bstr d = {0};
+    assert_true(cbor_write(tmp, &d, &nan_node) >= 0);
+    assert_true(cbor_parse(tmp, &res, &d, MAX_CBOR_DEPTH) >= 0);
+    assert_true(res.format == MPV_FORMAT_DOUBLE && isnan(res.u.double_));
+    talloc_free(tmp);
+
+    return 0;
+}
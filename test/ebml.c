@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/common.h"
+#include "demux/ebml.h"
+#include "stream/stream.h"
+#include "test_utils.h"
+
+// Minimal memory stream, implementing the stream functions used by ebml.c.
+// The data is put into a ring buffer in chunks of the given size, starting at
+// varying offsets, so that the buffered data is split at arbitrary positions
+// and wraps around at the end of the ring buffer.
+struct mem_stream {
+    const uint8_t *data;
+    int64_t size;
+    int chunk;
+};
+
+static int fill_buffer(stream_t *s)
+{
+    struct mem_stream *m = s->priv;
+    int64_t pos = stream_tell(s);
+    int len = MPCLAMP(m->size - pos, 0, m->chunk);
+    unsigned int start = (pos * 7) & s->buffer_mask;
+    int part = MPMIN(len, s->buffer_mask + 1 - start);
+    memcpy(s->buffer + start, m->data + pos, part);
+    memcpy(s->buffer, m->data + pos + part, len - part);
+    s->buf_start = s->buf_cur = start;
+    s->buf_end = start + len;
+    s->pos = pos + len;
+    if (!len)
+        s->eof = 1;
+    return len;
+}
+
+int stream_read_char_fallback(stream_t *s)
+{
+    if (s->buf_cur == s->buf_end && !fill_buffer(s))
+        return -256;
+    return s->buffer[(s->buf_cur++) & s->buffer_mask];
+}
+
+int stream_read(stream_t *s, void *mem, int total)
+{
+    int len = 0;
+    for (; len < total; len++) {
+        int c = stream_read_char(s);
+        if (c < 0)
+            break;
+        ((uint8_t *)mem)[len] = c;
+    }
+    return len;
+}
+
+int stream_read_peek(stream_t *s, void *buf, int buf_size)
+{
+    struct mem_stream *m = s->priv;
+    int64_t pos = stream_tell(s);
+    int len = MPCLAMP(m->size - pos, 0, buf_size);
+    memcpy(buf, m->data + pos, len);
+    if (!len)
+        s->eof = 1;
+    return len;
+}
+
+bool stream_seek(stream_t *s, int64_t pos)
+{
+    struct mem_stream *m = s->priv;
+    // Seek within the buffer if possible, like the real stream code.
+    if (pos >= s->pos - (s->buf_end - s->buf_start) && pos <= s->pos) {
+        s->buf_cur = s->buf_end - (s->pos - pos);
+        return true;
+    }
+    s->buf_start = s->buf_cur = s->buf_end = 0;
+    s->pos = pos;
+    s->eof = 0;
+    return pos >= 0 && pos <= m->size;
+}
+
+bool stream_seek_skip(stream_t *s, int64_t pos)
+{
+    return stream_seek(s, pos);
+}
+
+static stream_t *open_mem_stream(void *ta_parent, const uint8_t *data,
+                                 int64_t size, int buffer_size, int chunk)
+{
+    stream_t *s = talloc_zero(ta_parent, stream_t);
+    struct mem_stream *m = talloc_zero(s, struct mem_stream);
+    *m = (struct mem_stream){data, size, MPMIN(chunk, buffer_size)};
+    s->priv = m;
+    s->buffer = talloc_size(s, buffer_size);
+    s->buffer_mask = buffer_size - 1;
+    return s;
+}
+
+// (buffer size, chunk size) pairs. Small chunks make the ebml functions use
+// the bytewise code, large chunks the buffered code.
+static const int sizes[][2] = {
+    {1, 1}, {4, 3}, {8, 5}, {8, 8}, {16, 9}, {16, 16}, {64, 61}, {4096, 4096},
+};
+
+static int put_bytes(uint8_t *dst, uint64_t val, int size)
+{
+    for (int n = 0; n < size; n++)
+        dst[n] = val >> (8 * (size - 1 - n));
+    return size;
+}
+
+// Encode an EBML length with the given size in bytes.
+static int put_length(uint8_t *dst, uint64_t len, int size)
+{
+    return put_bytes(dst, len | (UINT64_C(1) << (7 * size)), size);
+}
+
+struct item {
+    int type; // 0: id, 1: length, 2: uint, 3: int
+    uint64_t val;
+    int end_pos; // position after the item
+};
+
+#define MAX_ITEMS 256
+
+static void check_items(void)
+{
+    void *tmp = talloc_new(NULL);
+    struct item items[MAX_ITEMS];
+    int num_items = 0;
+    uint8_t data[4096];
+    int len = 0;
+
+    static const uint32_t ids[] = {0xEC, 0x4286, 0x2AD7B1, 0x1F43B675};
+    for (int n = 0; n < MP_ARRAY_SIZE(ids); n++) {
+        len += put_bytes(data + len, ids[n], n + 1);
+        items[num_items++] = (struct item){0, ids[n], len};
+    }
+    for (int size = 1; size <= 8; size++) {
+        uint64_t max = (UINT64_C(1) << (7 * size)) - 1;
+        uint64_t vals[] = {0, 1, max / 3, max - 1, max};
+        for (int n = 0; n < MP_ARRAY_SIZE(vals); n++) {
+            len += put_length(data + len, vals[n], size);
+            // All bits set is "unknown length".
+            uint64_t v = vals[n] == max ? EBML_UINT_INVALID : vals[n];
+            items[num_items++] = (struct item){1, v, len};
+        }
+    }
+    for (int size = 0; size <= 8; size++) {
+        uint64_t vals[] = {0, 1, 0x7F, 0x80, UINT64_MAX};
+        for (int n = 0; n < MP_ARRAY_SIZE(vals); n++) {
+            uint64_t v = size == 8 ? vals[n] : vals[n] & ((UINT64_C(1) << (8 * size)) - 1);
+            len += put_length(data + len, size, 1);
+            len += put_bytes(data + len, v, size);
+            items[num_items++] = (struct item){2, v, len};
+
+            // Same bytes as signed value.
+            uint64_t sv = v;
+            if (size && size < 8 && (v >> (8 * size - 1)) & 1)
+                sv |= UINT64_MAX << (8 * size);
+            len += put_length(data + len, size, 1);
+            len += put_bytes(data + len, v, size);
+            items[num_items++] = (struct item){3, sv, len};
+        }
+    }
+    assert_true(num_items <= MAX_ITEMS && len <= sizeof(data));
+
+    for (int i = 0; i < MP_ARRAY_SIZE(sizes); i++) {
+        // Start at every offset, so every item is at a buffer edge once.
+        for (int start = 0; start < sizes[i][1] + 1; start++) {
+            uint8_t *buf = talloc_size(tmp, len + start);
+            memset(buf, 0xFF, start);
+            memcpy(buf + start, data, len);
+            stream_t *s = open_mem_stream(tmp, buf, len + start, sizes[i][0],
+                                          sizes[i][1]);
+            stream_seek(s, start);
+            for (int n = 0; n < num_items; n++) {
+                struct item *it = &items[n];
+                switch (it->type) {
+                case 0: assert_int_equal(ebml_read_id(s), it->val); break;
+                case 1: assert_int_equal(ebml_read_length(s), it->val); break;
+                case 2: assert_int_equal(ebml_read_uint(s), it->val); break;
+                case 3: assert_int_equal(ebml_read_int(s), it->val); break;
+                }
+                assert_int_equal(stream_tell(s), start + it->end_pos);
+            }
+        }
+    }
+    talloc_free(tmp);
+}
+
+static void check_resync(void)
+{
+    void *tmp = talloc_new(NULL);
+    int size = 2000;
+    uint8_t *data = talloc_size(tmp, size);
+    // Junk with many partial matches.
+    static const uint8_t junk[] = {0x1F, 0x43, 0xB6, 0x1F, 0x43, 0x1F, 0x00};
+    for (int n = 0; n < size; n++)
+        data[n] = junk[n % MP_ARRAY_SIZE(junk)];
+
+    for (int pos = 0; pos < 100; pos += 3) {
+        put_bytes(data + size - 4 - pos * 17, 0x1F43B675, 4);
+        int64_t expect = size - 4 - pos * 17;
+        for (int i = 0; i < MP_ARRAY_SIZE(sizes); i++) {
+            stream_t *s = open_mem_stream(tmp, data, size, sizes[i][0],
+                                          sizes[i][1]);
+            assert_int_equal(ebml_resync_cluster(NULL, s), 0);
+            assert_int_equal(stream_tell(s), expect);
+        }
+    }
+
+    // No cluster ID at all.
+    memset(data, 0x1F, size);
+    for (int i = 0; i < MP_ARRAY_SIZE(sizes); i++) {
+        stream_t *s = open_mem_stream(tmp, data, size, sizes[i][0],
+                                      sizes[i][1]);
+        assert_int_equal(ebml_resync_cluster(NULL, s), -1);
+    }
+    talloc_free(tmp);
+}
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Walk all elements of a Matroska file, and parse the headers of all blocks,
+// like the mkv demuxer does when reading packets. Returns the number of
+// packets (laces).
+static int64_t walk_file(stream_t *s, int64_t size)
+{
+    int64_t packets = 0;
+    while (stream_tell(s) < size && !s->eof) {
+        uint32_t id = ebml_read_id(s);
+        if (id == EBML_ID_INVALID)
+            break;
+        if (id == MATROSKA_ID_TIMECODE) {
+            ebml_read_uint(s);
+            continue;
+        }
+        uint64_t len = ebml_read_length(s);
+        // Enter these elements (also works with unknown length).
+        if (id == MATROSKA_ID_SEGMENT || id == MATROSKA_ID_CLUSTER ||
+            id == MATROSKA_ID_BLOCKGROUP)
+            continue;
+        if (len == EBML_UINT_INVALID)
+            break;
+        int64_t end = stream_tell(s) + len;
+        if (id == MATROSKA_ID_SIMPLEBLOCK || id == MATROSKA_ID_BLOCK) {
+            ebml_read_length(s); // track number
+            stream_read_char(s); // timecode
+            stream_read_char(s);
+            int flags = stream_read_char(s);
+            packets += (flags & 6) ? stream_read_char(s) + 1 : 1;
+        }
+        stream_seek_skip(s, end);
+    }
+    return packets;
+}
+
+// Find all clusters by resyncing, like the mkv demuxer does after errors or
+// when seeking in files without index. Returns the number of clusters.
+static int64_t resync_file(stream_t *s)
+{
+    int64_t clusters = 0;
+    while (ebml_resync_cluster(NULL, s) == 0) {
+        clusters++;
+        stream_seek_skip(s, stream_tell(s) + 1);
+    }
+    return clusters;
+}
+
+static void run_benchmark(const char *filename)
+{
+    void *tmp = talloc_new(NULL);
+    FILE *f = fopen(filename, "rb");
+    assert_true(f);
+    fseek(f, 0, SEEK_END);
+    int64_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = talloc_size(tmp, size);
+    assert_int_equal(fread(data, 1, size, f), size);
+    fclose(f);
+
+    static const int chunks[] = {7, 1500, 64 * 1024};
+    for (int mode = 0; mode < 2; mode++) {
+        for (int n = 0; n < MP_ARRAY_SIZE(chunks); n++) {
+            int64_t count = 0;
+            int rounds = 0;
+            double t0 = get_time(), t1;
+            do {
+                stream_t *s = open_mem_stream(tmp, data, size, 1 << 20,
+                                              chunks[n]);
+                count += mode ? resync_file(s) : walk_file(s, size);
+                talloc_free(s);
+                rounds++;
+                t1 = get_time();
+            } while (t1 - t0 < 1.0);
+            double secs = t1 - t0;
+            printf("%s, chunks of %6d bytes: %10.0f %s/s, %8.1f MB/s\n",
+                   mode ? "resync" : "walk  ", chunks[n], count / secs,
+                   mode ? "clusters" : "packets",
+                   size * (double)rounds / secs / 1e6);
+        }
+    }
+    talloc_free(tmp);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2 && strcmp(argv[1], "--benchmark") == 0) {
+        run_benchmark(argv[2]);
+        return 0;
+    }
+
+    check_items();
+    check_resync();
+    return 0;
+}
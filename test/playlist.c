@@ -0,0 +1,97 @@
+#include "common/common.h"
+#include "common/msg.h"
+#include "common/playlist.h"
+#include "demux/demux.h"
+#include "test_utils.h"
+
+// playlist_parse_file() is not tested here.
+struct mp_log *mp_log_new(void *talloc_ctx, struct mp_log *parent,
+                          const char *name) { return NULL; }
+struct demuxer *demux_open_url(const char *url, struct demuxer_params *params,
+                               struct mp_cancel *cancel,
+                               struct mpv_global *global) { return NULL; }
+void demux_free(struct demuxer *demuxer) {}
+
+// Check the tree invariants of t, and return its depth.
+static int check_tree(struct playlist_entry *t, struct playlist_entry *parent)
+{
+    if (!t)
+        return 0;
+    assert_true(t->node.parent == parent);
+    if (parent)
+        assert_true(t->node.prio <= parent->node.prio);
+    int l = check_tree(t->node.left, t);
+    int r = check_tree(t->node.right, t);
+    int size = 1 + (t->node.left ? t->node.left->node.size : 0) +
+                   (t->node.right ? t->node.right->node.size : 0);
+    assert_int_equal(t->node.size, size);
+    return 1 + MPMAX(l, r);
+}
+
+static int check_playlist(struct playlist *pl)
+{
+    int depth = check_tree(pl->root, NULL);
+    int index = 0;
+    uint64_t last_id = 0;
+    for (struct playlist_entry *e = playlist_get_first(pl); e;
+         e = playlist_entry_get_rel(e, 1))
+    {
+        assert_true(e->pl == pl);
+        assert_int_equal(playlist_entry_to_index(pl, e), index);
+        assert_true(playlist_entry_from_index(pl, index) == e);
+        // All tests below only append, so IDs are in playlist order.
+        assert_true(e->id > last_id);
+        last_id = e->id;
+        index++;
+    }
+    assert_int_equal(index, playlist_entry_count(pl));
+    return depth;
+}
+
+// Create a new playlist with num entries.
+static struct playlist *new_playlist(void *ta_parent, int num)
+{
+    struct playlist *pl = talloc_zero(ta_parent, struct playlist);
+    for (int n = 0; n < num; n++)
+        playlist_add(pl, playlist_entry_new("file"));
+    return pl;
+}
+
+// Transferring many small playlists (whose entries all have the same IDs
+// within their source playlist) must not degenerate the tree.
+static void check_transfer_depth(int transfers, int entries)
+{
+    void *ctx = talloc_new(NULL);
+    struct playlist *pl = new_playlist(ctx, 0);
+    for (int n = 0; n < transfers; n++) {
+        struct playlist *src = new_playlist(ctx, entries);
+        int64_t id = playlist_append_entries(pl, src);
+        assert_int_equal(id, entries ? (int64_t)n * entries + 1 : 0);
+        assert_int_equal(playlist_entry_count(src), 0);
+        assert_true(!src->root);
+    }
+    int num = transfers * entries;
+    assert_int_equal(playlist_entry_count(pl), num);
+    int depth = check_playlist(pl);
+    // A random treap is about 3*log2(num) deep at most, with high probability.
+    int max_depth = 4;
+    for (int n = num; n > 1; n /= 2)
+        max_depth += 4;
+    if (depth > max_depth) {
+        printf("%d transfers of %d entries: depth %d, expected <= %d\n",
+               transfers, entries, depth, max_depth);
+        fflush(stdout);
+        abort();
+    }
+    talloc_free(ctx);
+}
+
+int main(void)
+{
+    check_transfer_depth(0, 1);
+    check_transfer_depth(1, 0);
+    check_transfer_depth(1, 1000);
+    check_transfer_depth(5000, 1);
+    check_transfer_depth(2000, 3);
+    return 0;
+}
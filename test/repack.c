@@ -1,10 +1,13 @@
 #include <limits.h>
+#include <string.h>
+#include <time.h>
 
 #include <libavutil/pixfmt.h>
 
 #include "common/common.h"
 #include "common/global.h"
 #include "img_utils.h"
+#include "misc/random.h"
 #include "sub/draw_bmp.h"
 #include "sub/osd.h"
 #include "test_utils.h"
@@ -433,6 +436,153 @@ static void check_float_repack(int imgfmt, enum mp_csp csp,
     talloc_free(from_f);
 }
 
+// Fill with random data, or zeros if random==false.
+static void fill_image(struct mp_image *img, bool random)
+{
+    bool is_float = random && (img->fmt.flags & MP_IMGFLAG_TYPE_FLOAT);
+    for (int p = 0; p < img->num_planes; p++) {
+        int wb = mp_image_plane_bytes(img, p, 0, img->w);
+        for (int y = 0; y < mp_image_plane_h(img, p); y++) {
+            uint8_t *ptr = img->planes[p] + img->stride[p] * y;
+            for (int x = 0; x < wb; x++)
+                ptr[x] = random ? mp_rand_next() : 0;
+            // Keep floats in a range that can be sensibly converted back.
+            for (int x = 0; is_float && x < wb / 4; x++)
+                ((float *)ptr)[x] = mp_rand_next_double() * 1.5 - 0.25;
+        }
+    }
+}
+
+// Replace some pixels with values that are out of range for any integer
+// format, which the float->int conversion must clamp.
+static void add_special_floats(struct mp_image *img)
+{
+    static const float vals[] = {NAN, 1e10, -1e10, 3e9, -3e9, 65536.0};
+    for (int p = 0; p < img->num_planes; p++) {
+        int w = mp_image_plane_bytes(img, p, 0, img->w) / 4;
+        for (int y = 0; y < mp_image_plane_h(img, p); y++) {
+            float *ptr = (float *)(img->planes[p] + img->stride[p] * y);
+            for (int x = 3; x < w; x += 7)
+                ptr[x] = vals[(x / 7 + y + p) % MP_ARRAY_SIZE(vals)];
+        }
+    }
+}
+
+// Compare the SIMD code paths (if any) with the C code paths on random data.
+static void check_simd_repack(int imgfmt, int flags)
+{
+    for (int pack = 0; pack < 2; pack++) {
+        struct mp_repack *rc =
+            mp_repack_create_planar(imgfmt, pack, flags | REPACK_CREATE_NO_SIMD);
+        struct mp_repack *rs = mp_repack_create_planar(imgfmt, pack, flags);
+        assert_true(!rc == !rs);
+        if (!rc) {
+            talloc_free(rs);
+            continue;
+        }
+
+        // Odd size, so that the scalar fallback for the tail is tested too.
+        int w = MP_ALIGN_UP(133, mp_repack_get_align_x(rc));
+        int h = mp_repack_get_align_y(rc);
+        struct mp_image *src = mp_image_alloc(mp_repack_get_format_src(rc), w, h);
+        struct mp_image *dc = mp_image_alloc(mp_repack_get_format_dst(rc), w, h);
+        struct mp_image *ds = mp_image_alloc(mp_repack_get_format_dst(rc), w, h);
+        assert_true(src && dc && ds);
+        fill_image(src, true);
+        fill_image(dc, false);
+        fill_image(ds, false);
+        if (src->fmt.flags & MP_IMGFLAG_TYPE_FLOAT)
+            add_special_floats(src);
+
+        repack_config_buffers(rc, 0, dc, 0, src, NULL);
+        repack_config_buffers(rs, 0, ds, 0, src, NULL);
+        repack_line(rc, 0, 0, 0, 0, w);
+        repack_line(rs, 0, 0, 0, 0, w);
+
+        bool is_float = dc->fmt.flags & MP_IMGFLAG_TYPE_FLOAT;
+        for (int p = 0; p < dc->num_planes; p++) {
+            int wb = mp_image_plane_bytes(dc, p, 0, w);
+            for (int y = 0; y < mp_image_plane_h(dc, p); y++) {
+                uint8_t *pc = dc->planes[p] + dc->stride[p] * y;
+                uint8_t *ps = ds->planes[p] + ds->stride[p] * y;
+                if (!is_float) {
+                    assert_memcmp(pc, ps, wb);
+                    continue;
+                }
+                // The compiler may contract the C version into FMA.
+                for (int x = 0; x < wb / 4; x++)
+                    assert_float_equal(((float *)pc)[x], ((float *)ps)[x], 1e-6);
+            }
+        }
+
+        talloc_free(src);
+        talloc_free(dc);
+        talloc_free(ds);
+        talloc_free(rc);
+        talloc_free(rs);
+    }
+}
+
+static double bench_repack(int imgfmt, bool pack, int flags)
+{
+    struct mp_repack *rp = mp_repack_create_planar(imgfmt, pack, flags);
+    if (!rp)
+        return -1;
+
+    int w = 3840, h = 2160;
+    struct mp_image *src = mp_image_alloc(mp_repack_get_format_src(rp), w, h);
+    struct mp_image *dst = mp_image_alloc(mp_repack_get_format_dst(rp), w, h);
+    assert_true(src && dst);
+    fill_image(src, true);
+    repack_config_buffers(rp, 0, dst, 0, src, NULL);
+
+    int align_y = mp_repack_get_align_y(rp);
+    int64_t pixels = 0;
+    clock_t start = clock();
+    clock_t end = start;
+    while (end - start < CLOCKS_PER_SEC / 2) {
+        for (int y = 0; y < h; y += align_y)
+            repack_line(rp, 0, y, 0, y, w);
+        pixels += (int64_t)w * h;
+        end = clock();
+    }
+
+    talloc_free(src);
+    talloc_free(dst);
+    talloc_free(rp);
+    return pixels / ((double)(end - start) / CLOCKS_PER_SEC);
+}
+
+// Print repack throughput for some common formats, with and without SIMD.
+static void run_benchmark(void)
+{
+    static const char *const fmts[] = {
+        "nv12", "nv21", "p010", "p016", "rgba", "bgra", "yuv420p10be",
+        "gbrp16be", "yuyv422",
+    };
+    static const int flags[] = {0, REPACK_CREATE_PLANAR_F32};
+
+    printf("%-12s %-6s %-5s %14s %14s\n", "format", "dir", "f32", "C px/s",
+           "SIMD px/s");
+    for (int n = 0; n < MP_ARRAY_SIZE(fmts); n++) {
+        int imgfmt = mp_imgfmt_from_name(bstr0(fmts[n]));
+        if (!imgfmt)
+            continue;
+        for (int f = 0; f < MP_ARRAY_SIZE(flags); f++) {
+            for (int pack = 0; pack < 2; pack++) {
+                double c = bench_repack(imgfmt, pack,
+                                        flags[f] | REPACK_CREATE_NO_SIMD);
+                if (c < 0)
+                    continue;
+                double simd = bench_repack(imgfmt, pack, flags[f]);
+                printf("%-12s %-6s %-5s %14.0f %14.0f (%.2fx)\n", fmts[n],
+                       pack ? "pack" : "unpack", flags[f] ? "yes" : "no",
+                       c, simd, simd / c);
+            }
+        }
+    }
+}
+
 static bool try_draw_bmp(FILE *f, int imgfmt)
 {
     bool ok = false;
@@ -484,6 +634,12 @@ done:
 
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0) {
+        init_imgfmts_list();
+        run_benchmark();
+        return 0;
+    }
+
     const char *refdir = argv[1];
     const char *outdir = argv[2];
     FILE *f = test_open_out(outdir, "repack.txt");
@@ -513,6 +669,11 @@ int main(int argc, char *argv[])
     check_float_repack(-AV_PIX_FMT_YUVA444P16, MP_CSP_BT_709, MP_CSP_LEVELS_PC);
     check_float_repack(-AV_PIX_FMT_YUVA444P16, MP_CSP_BT_709, MP_CSP_LEVELS_TV);
 
+    for (int n = 0; n < num_imgfmts; n++) {
+        check_simd_repack(imgfmts[n], 0);
+        check_simd_repack(imgfmts[n], REPACK_CREATE_PLANAR_F32);
+    }
+
     // Determine the list of possible draw_bmp input formats. Do this here
     // because it mostly depends on repack and imgformat stuff.
     f = test_open_out(outdir, "draw_bmp.txt");
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <libavutil/cpu.h>
+
+#include "audio/chmap.h"
+#include "audio/filter/af_scaletempo2_internals.h"
+#include "common/common.h"
+#include "test_utils.h"
+
+#define RATE 48000
+
+// Same defaults as af_scaletempo2.c.
+static struct mp_scaletempo2_opts opts = {
+    .min_playback_rate = 0.25,
+    .max_playback_rate = 4.0,
+    .ola_window_size_ms = 20,
+    .wsola_search_interval_ms = 30,
+};
+
+struct audio {
+    float *planes[MP_NUM_CHANNELS];
+    int frames;
+};
+
+static void alloc_audio(void *ta_parent, struct audio *a, int channels,
+                        int frames)
+{
+    a->frames = frames;
+    for (int c = 0; c < channels; c++)
+        a->planes[c] = talloc_zero_array(ta_parent, float, frames);
+}
+
+// A sine with a different frequency on each channel, optionally with noise.
+static void gen_input(struct audio *a, int channels, bool noise)
+{
+    uint32_t seed = 1;
+    for (int c = 0; c < channels; c++) {
+        double freq = 220.0 * (c + 2) / 2;
+        for (int n = 0; n < a->frames; n++) {
+            float v = 0.5 * sin(2 * M_PI * freq * n / RATE);
+            if (noise) {
+                seed = seed * 1664525 + 1013904223;
+                v += (seed >> 8) / (float)(1 << 24) * 0.2f - 0.1f;
+            }
+            a->planes[c][n] = v;
+        }
+    }
+}
+
+// Compare the energies of the candidate blocks, which are partially reused
+// across iterations, with the energies computed from the last search block.
+static void check_energies(struct mp_scaletempo2 *st)
+{
+    if (st->energy_cache_pos < 0)
+        return;
+    // Checking all blocks would be too slow.
+    int last = st->energy_cache_blocks - 1;
+    for (int c = 0; c < st->channels; c++) {
+        for (int n = last % 97; n <= last; n += 97) {
+            double energy = 0;
+            for (int i = 0; i < st->ola_window_size; i++)
+                energy += st->search_block[c][n + i] * st->search_block[c][n + i];
+            assert_float_equal(st->energy_candidate_blocks[n * st->channels + c],
+                               energy, 1e-3 * MPMAX(energy, 1));
+        }
+    }
+}
+
+// Feed the input in chunks, like af_scaletempo2.c does, and return the
+// number of output frames.
+static int run(struct mp_scaletempo2 *st, int channels, struct audio *in,
+               struct audio *out, float speed, bool check)
+{
+    int in_pos = 0, out_pos = 0;
+    while (out_pos < out->frames) {
+        if (mp_scaletempo2_frames_available(st)) {
+            float *dst[MP_NUM_CHANNELS];
+            for (int c = 0; c < channels; c++)
+                dst[c] = out->planes[c] + out_pos;
+            int r = mp_scaletempo2_fill_buffer(st, dst,
+                MPMIN(1024, out->frames - out_pos), speed);
+            if (!r)
+                break;
+            out_pos += r;
+            if (check)
+                check_energies(st);
+            continue;
+        }
+        if (in_pos >= in->frames)
+            break;
+        uint8_t *planes[MP_NUM_CHANNELS];
+        for (int c = 0; c < channels; c++)
+            planes[c] = (uint8_t *)(in->planes[c] + in_pos);
+        in_pos += mp_scaletempo2_fill_input_buffer(st, planes,
+            MPMIN(1024, in->frames - in_pos), false);
+    }
+    return out_pos;
+}
+
+static double rms(const float *d, int frames)
+{
+    double sum = 0;
+    for (int n = 0; n < frames; n++)
+        sum += d[n] * d[n];
+    return sqrt(sum / frames);
+}
+
+static void check_speed(int channels, float speed, bool noise)
+{
+    void *tmp = talloc_new(NULL);
+    struct audio in, out;
+    alloc_audio(tmp, &in, channels, RATE * 2);
+    alloc_audio(tmp, &out, channels, RATE * 8);
+    gen_input(&in, channels, noise);
+
+    struct mp_scaletempo2 st = {.opts = &opts};
+    mp_scaletempo2_init(&st, channels, RATE);
+    int frames = run(&st, channels, &in, &out, speed, true);
+
+    // The output lags behind by about a search block.
+    double expected = in.frames / speed;
+    assert_true(frames <= expected + 1 && frames >= expected - RATE / 10);
+
+    // WSOLA on a stationary signal shouldn't change its level. Skip the
+    // initial fade-in from the overlap-add with silence.
+    int skip = RATE / 10;
+    for (int c = 0; c < channels && !noise; c++) {
+        assert_float_equal(rms(out.planes[c] + skip, frames - skip),
+                           0.5 / sqrt(2), 0.05);
+    }
+
+    mp_scaletempo2_destroy(&st);
+    talloc_free(tmp);
+}
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_layout(const char *name, int channels, float speed)
+{
+    void *tmp = talloc_new(NULL);
+    struct audio in, out;
+    alloc_audio(tmp, &in, channels, RATE * 10);
+    alloc_audio(tmp, &out, channels, RATE * 40);
+    gen_input(&in, channels, true);
+
+    double factor[2];
+    for (int simd = 0; simd < 2; simd++) {
+        av_force_cpu_flags(simd ? -1 : 0);
+        struct mp_scaletempo2 st = {.opts = &opts};
+        mp_scaletempo2_init(&st, channels, RATE);
+        double t0 = get_time();
+        run(&st, channels, &in, &out, speed, false);
+        factor[simd] = in.frames / (double)RATE / (get_time() - t0);
+        mp_scaletempo2_destroy(&st);
+    }
+    av_force_cpu_flags(-1);
+
+    printf("%-8s speed=%.2f: C %8.1fx realtime, SIMD %8.1fx realtime\n",
+           name, speed, factor[0], factor[1]);
+    talloc_free(tmp);
+}
+
+static void run_benchmark(void)
+{
+    static const struct { const char *name; int channels; } layouts[] = {
+        {"mono", 1}, {"stereo", 2}, {"5.1", 6}, {"7.1", 8}, {"16ch", 16},
+    };
+    static const float speeds[] = {0.75, 1.5, 2.0, 3.0};
+    for (int l = 0; l < MP_ARRAY_SIZE(layouts); l++) {
+        for (int s = 0; s < MP_ARRAY_SIZE(speeds); s++)
+            bench_layout(layouts[l].name, layouts[l].channels, speeds[s]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0) {
+        run_benchmark();
+        return 0;
+    }
+
+    static const int channels[] = {1, 2, 6, 8, 11};
+    static const float speeds[] = {0.5, 0.8, 1.25, 1.5, 2.0, 3.0};
+    // Run with the C kernels, and with the SIMD kernels (if available).
+    for (int simd = 0; simd < 2; simd++) {
+        av_force_cpu_flags(simd ? -1 : 0);
+        for (int c = 0; c < MP_ARRAY_SIZE(channels); c++) {
+            for (int s = 0; s < MP_ARRAY_SIZE(speeds); s++) {
+                check_speed(channels[c], speeds[s], false);
+                check_speed(channels[c], speeds[s], true);
+            }
+        }
+    }
+    av_force_cpu_flags(-1);
+    return 0;
+}
@@ -108,8 +108,9 @@ void mp_write_console_ansi(void) {};
 void mp_set_avdict(AVDictionary **dict, char **kv) {};
 
 #ifndef WIN32_TESTS
-void mp_add_timeout(void) {};
-void mp_rel_time_to_timespec(void) {};
-void mp_time_us(void) {};
-void mp_time_us_to_timespec(void) {};
+// Weak, so tests which need the real timer code can link it.
+__attribute__((weak)) void mp_add_timeout(void) {};
+__attribute__((weak)) void mp_rel_time_to_timespec(void) {};
+__attribute__((weak)) void mp_time_us(void) {};
+__attribute__((weak)) void mp_time_us_to_timespec(void) {};
 #endif
@@ -0,0 +1,269 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/common.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
+#include "osdep/atomic.h"
+#include "test_utils.h"
+
+#define MAX_ITEMS 1000
+
+struct counters {
+    struct mp_thread_pool *pool;
+    atomic_int hits[MAX_ITEMS];
+    atomic_int total;
+};
+
+static void count_index(void *ctx, int index)
+{
+    struct counters *c = ctx;
+    atomic_fetch_add(&c->hits[index], 1);
+}
+
+static void count_item(void *ctx)
+{
+    struct counters *c = ctx;
+    atomic_fetch_add(&c->total, 1);
+}
+
+static void check_parallel_for(struct mp_thread_pool *pool, int count)
+{
+    struct counters *c = talloc_zero(NULL, struct counters);
+    mp_thread_pool_parallel_for(pool, count, count_index, c);
+    for (int n = 0; n < MAX_ITEMS; n++)
+        assert_int_equal(atomic_load(&c->hits[n]), n < count);
+    talloc_free(c);
+}
+
+static void nested_index(void *ctx, int index)
+{
+    struct counters *c = ctx;
+    struct counters *inner = talloc_zero(NULL, struct counters);
+    mp_thread_pool_parallel_for(c->pool, 16, count_index, inner);
+    for (int n = 0; n < 16; n++)
+        assert_int_equal(atomic_load(&inner->hits[n]), 1);
+    talloc_free(inner);
+    atomic_fetch_add(&c->hits[index], 1);
+}
+
+static void check_nested(struct mp_thread_pool *pool)
+{
+    struct counters *c = talloc_zero(NULL, struct counters);
+    c->pool = pool;
+    mp_thread_pool_parallel_for(pool, 32, nested_index, c);
+    for (int n = 0; n < 32; n++)
+        assert_int_equal(atomic_load(&c->hits[n]), 1);
+    talloc_free(c);
+}
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Queue work on a pool without permanent threads, right around the time its
+// last idle thread times out. Queued work must never be stranded.
+static void check_queue_after_idle(void)
+{
+    const int num_items = 5000;
+    struct counters *c = talloc_zero(NULL, struct counters);
+    struct mp_thread_pool *pool = mp_thread_pool_create(NULL, 0, 0, 1);
+    assert_true(pool);
+    mp_thread_pool_set_idle_timeout(pool, 0.0005);
+    for (int n = 0; n < num_items; n++) {
+        // Vary the idle time around the timeout.
+        struct timespec ts = {.tv_nsec = 450000 + (n % 20) * 5000};
+        nanosleep(&ts, NULL);
+        assert_true(mp_thread_pool_queue(pool, count_item, c));
+        double deadline = get_time() + 5;
+        while (atomic_load(&c->total) < n + 1) {
+            assert_true(get_time() < deadline);
+            sched_yield();
+        }
+    }
+    talloc_free(pool);
+    assert_int_equal(atomic_load(&c->total), num_items);
+    talloc_free(c);
+}
+
+static void check_queue(int threads)
+{
+    struct counters *c = talloc_zero(NULL, struct counters);
+    struct mp_thread_pool *pool =
+        mp_thread_pool_create(NULL, threads, threads, threads);
+    assert_true(pool);
+    for (int n = 0; n < MAX_ITEMS; n++) {
+        // Can't fail with a pool that has all its threads created upfront.
+        if (n & 1) {
+            assert_true(mp_thread_pool_run(pool, count_item, c));
+        } else {
+            assert_true(mp_thread_pool_queue(pool, count_item, c));
+        }
+    }
+    // Destruction waits until all work items are done.
+    talloc_free(pool);
+    assert_int_equal(atomic_load(&c->total), MAX_ITEMS);
+    talloc_free(c);
+}
+
+
+struct bench_item {
+    struct mp_waiter waiter;
+    int iterations;
+    volatile unsigned result;
+};
+
+static void bench_work(struct bench_item *item)
+{
+    unsigned v = 1;
+    for (int n = 0; n < item->iterations; n++)
+        v = v * 1664525u + 1013904223u;
+    item->result = v;
+}
+
+static void bench_run_item(void *ctx)
+{
+    struct bench_item *item = ctx;
+    bench_work(item);
+    mp_waiter_wakeup(&item->waiter, 0);
+}
+
+static void bench_for_item(void *ctx, int index)
+{
+    struct bench_item *items = ctx;
+    bench_work(&items[index]);
+}
+
+// Fork/join with one mp_thread_pool_run() and mp_waiter per item (the pattern
+// used before mp_thread_pool_parallel_for() existed) vs. parallel_for.
+static void bench_pool(int threads, int num_items, int iterations)
+{
+    struct mp_thread_pool *pool =
+        mp_thread_pool_create(NULL, threads, threads, threads);
+    assert_true(pool);
+    struct bench_item *items = talloc_zero_array(NULL, struct bench_item,
+                                                 num_items);
+    for (int n = 0; n < num_items; n++)
+        items[n].iterations = iterations;
+
+    int rounds = MPMAX(1, 20000000 / (num_items * (iterations + 100)));
+
+    double t0 = get_time();
+    for (int r = 0; r < rounds; r++) {
+        for (int n = 1; n < num_items; n++) {
+            items[n].waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
+            assert_true(mp_thread_pool_run(pool, bench_run_item, &items[n]));
+        }
+        bench_work(&items[0]);
+        for (int n = 1; n < num_items; n++)
+            mp_waiter_wait(&items[n].waiter);
+    }
+    double t1 = get_time();
+    for (int r = 0; r < rounds; r++)
+        mp_thread_pool_parallel_for(pool, num_items, bench_for_item, items);
+    double t2 = get_time();
+
+    printf("threads=%2d items=%5d work=%6d: run+wait %9.0f ns/round, "
+           "parallel_for %9.0f ns/round\n", threads, num_items, iterations,
+           (t1 - t0) / rounds * 1e9, (t2 - t1) / rounds * 1e9);
+
+    talloc_free(items);
+    talloc_free(pool);
+}
+
+struct bench_submitter {
+    struct mp_thread_pool *pool;
+    struct counters *c;
+    int num_items;
+};
+
+static void *bench_submit_thread(void *ctx)
+{
+    struct bench_submitter *s = ctx;
+    for (int n = 0; n < s->num_items; n++)
+        assert_true(mp_thread_pool_queue(s->pool, count_item, s->c));
+    return NULL;
+}
+
+// Many threads queuing small items at once. This is mostly a test of how much
+// the submitters contend with each other and with the workers.
+static void bench_submitters(int threads, int submitters)
+{
+    const int num_items = 200000 / submitters;
+    struct mp_thread_pool *pool =
+        mp_thread_pool_create(NULL, threads, threads, threads);
+    assert_true(pool);
+    struct counters *c = talloc_zero(NULL, struct counters);
+    struct bench_submitter s = {pool, c, num_items};
+    pthread_t *th = talloc_array(NULL, pthread_t, submitters);
+
+    double t0 = get_time();
+    for (int n = 0; n < submitters; n++) {
+        int r = pthread_create(&th[n], NULL, bench_submit_thread, &s);
+        assert_int_equal(r, 0);
+    }
+    for (int n = 0; n < submitters; n++)
+        pthread_join(th[n], NULL);
+    while (atomic_load(&c->total) < num_items * submitters)
+        sched_yield();
+    double t1 = get_time();
+
+    printf("threads=%2d submitters=%2d: %6.0f ns/item\n", threads, submitters,
+           (t1 - t0) / (num_items * submitters) * 1e9);
+
+    talloc_free(th);
+    talloc_free(pool);
+    talloc_free(c);
+}
+
+static void run_benchmark(void)
+{
+    static const int threads[] = {1, 2, 4, 8, 16};
+    static const int items[] = {4, 64, 1024};
+    static const int work[] = {0, 1000, 100000};
+    for (int t = 0; t < MP_ARRAY_SIZE(threads); t++) {
+        for (int i = 0; i < MP_ARRAY_SIZE(items); i++) {
+            for (int w = 0; w < MP_ARRAY_SIZE(work); w++)
+                bench_pool(threads[t], items[i], work[w]);
+        }
+    }
+    static const int submitters[] = {1, 4, 16};
+    for (int t = 0; t < MP_ARRAY_SIZE(threads); t++) {
+        for (int s = 0; s < MP_ARRAY_SIZE(submitters); s++)
+            bench_submitters(threads[t], submitters[s]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0) {
+        run_benchmark();
+        return 0;
+    }
+
+    static const int counts[] = {0, 1, 2, 7, 100, MAX_ITEMS};
+    for (int n = 0; n < MP_ARRAY_SIZE(counts); n++)
+        check_parallel_for(NULL, counts[n]);
+
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        struct mp_thread_pool *pool =
+            mp_thread_pool_create(NULL, threads, threads, threads);
+        assert_true(pool);
+        for (int n = 0; n < MP_ARRAY_SIZE(counts); n++)
+            check_parallel_for(pool, counts[n]);
+        check_nested(pool);
+        talloc_free(pool);
+
+        check_queue(threads);
+    }
+
+    check_queue_after_idle();
+
+    return 0;
+}
@@ -22,6 +22,7 @@
 
 #include "common/common.h"
 #include "repack.h"
+#include "repack_simd.h"
 #include "video/csputils.h"
 #include "video/fmt-conversion.h"
 #include "video/img_format.h"
@@ -58,12 +59,15 @@ struct mp_repack {
 
     bool passthrough_y;         // possible luma plane optimization for e.g. nv12
     int endian_size;            // endian swap; 0=none, 2/4=swap word size
+    mp_repack_bswap_fn bswap;   // optional SIMD endian swap for endian_size
 
     // For packed_repack.
     int components[4];          // b[n] = mp_image.planes[components[n]]
     //  pack:   a is dst, b is src
     //  unpack: a is src, b is dst
     void (*packed_repack_scanline)(void *a, void *b[], int w);
+    const struct regular_repacker *regular; // entry packed_repack_scanline
+                                            // was taken from
 
     // Fringe RGB/YUV.
     uint8_t comp_size;
@@ -74,6 +78,7 @@ struct mp_repack {
 
     // F32 repacking.
     int f32_comp_size;
+    mp_repack_float_fn f32_packer;
     float f32_m[4], f32_o[4];
     uint32_t f32_pmax[4];
     enum mp_csp f32_csp_space;
@@ -142,7 +147,7 @@ static void copy_plane(struct mp_image *dst, int dst_x, int dst_y,
 // Swap endian for one line.
 static void swap_endian(struct mp_image *dst, int dst_x, int dst_y,
                         struct mp_image *src, int src_x, int src_y,
-                        int w, int endian_size)
+                        int w, int endian_size, mp_repack_bswap_fn bswap)
 {
     assert(src->fmt.num_planes == dst->fmt.num_planes);
 
@@ -159,6 +164,10 @@ static void swap_endian(struct mp_image *dst, int dst_x, int dst_y,
         for (int y = 0; y < h; y++) {
             void *s = mp_image_pixel_ptr_ny(src, p, src_x, src_y + y);
             void *d = mp_image_pixel_ptr_ny(dst, p, dst_x, dst_y + y);
+            if (bswap) {
+                bswap(d, s, num_words);
+                continue;
+            }
             switch (endian_size) {
             case 2:
                 for (int x = 0; x < num_words; x++)
@@ -396,6 +405,7 @@ static void setup_packed_packer(struct mp_repack *rp)
 
         rp->repack = packed_repack;
         rp->packed_repack_scanline = repack_cb;
+        rp->regular = pa;
         rp->imgfmt_b = planar_fmt;
         for (int n = 0; n < num_real_components; n++) {
             // Determine permutation that maps component order between the two
@@ -786,6 +796,7 @@ static void setup_nv_packer(struct mp_repack *rp)
         rp->repack = repack_nv;
         rp->passthrough_y = true;
         rp->packed_repack_scanline = repack_cb;
+        rp->regular = pa;
         rp->imgfmt_b = planar_fmt;
         rp->components[0] = desc.planes[1].components[0] - 1;
         rp->components[1] = desc.planes[1].components[1] - 1;
@@ -819,11 +830,8 @@ static void repack_float(struct mp_repack *rp,
                          struct mp_image *a, int a_x, int a_y,
                          struct mp_image *b, int b_x, int b_y, int w)
 {
-    assert(rp->f32_comp_size == 1 || rp->f32_comp_size == 2);
-
-    void (*packer)(void *a, float *b, int w, float fm, float fb, uint32_t max)
-        = rp->pack ? (rp->f32_comp_size == 1 ? pa_f32_8 : pa_f32_16)
-                   : (rp->f32_comp_size == 1 ? un_f32_8 : un_f32_16);
+    mp_repack_float_fn packer = rp->f32_packer;
+    assert(packer);
 
     for (int p = 0; p < b->num_planes; p++) {
         int h = (1 << b->fmt.chroma_ys) - (1 << b->fmt.ys[p]) + 1;
@@ -918,7 +926,7 @@ void repack_line(struct mp_repack *rp, int dst_x, int dst_y,
         }
         case REPACK_STEP_ENDIAN:
             swap_endian(rs->buf[1], dx, dy, rs->buf[0], sx, sy, w,
-                        rp->endian_size);
+                        rp->endian_size, rp->bswap);
             break;
         case REPACK_STEP_FLOAT:
             repack_float(rp, buf_a, a_x, a_y, buf_b, b_x, b_y, w);
@@ -927,6 +935,31 @@ void repack_line(struct mp_repack *rp, int dst_x, int dst_y,
     }
 }
 
+// Replace the scalar C functions selected so far with SIMD versions, if the
+// CPU supports them.
+static void setup_simd(struct mp_repack *rp)
+{
+    if (rp->regular) {
+        const struct regular_repacker *pa = rp->regular;
+        mp_repack_scanline_fn fn =
+            mp_repack_simd_get_scanline(rp->pack, pa->packed_width,
+                                        pa->component_width,
+                                        pa->num_components, pa->prepadding);
+        if (fn)
+            rp->packed_repack_scanline = fn;
+    }
+
+    if (rp->f32_comp_size) {
+        mp_repack_float_fn fn =
+            mp_repack_simd_get_float(rp->pack, rp->f32_comp_size);
+        if (fn)
+            rp->f32_packer = fn;
+    }
+
+    if (rp->endian_size)
+        rp->bswap = mp_repack_simd_get_bswap(rp->endian_size);
+}
+
 static bool setup_format_ne(struct mp_repack *rp)
 {
     if (!rp->imgfmt_b)
@@ -989,6 +1022,9 @@ static bool setup_format_ne(struct mp_repack *rp)
                 (desc.component_size != 1 && desc.component_size != 2))
                 return false;
             rp->f32_comp_size = desc.component_size;
+            rp->f32_packer =
+                rp->pack ? (rp->f32_comp_size == 1 ? pa_f32_8 : pa_f32_16)
+                         : (rp->f32_comp_size == 1 ? un_f32_8 : un_f32_16);
             rp->f32_csp_space = MP_CSP_COUNT;
             rp->f32_csp_levels = MP_CSP_LEVELS_COUNT;
             rp->steps[rp->num_steps++] = (struct repack_step) {
@@ -1031,6 +1067,9 @@ static bool setup_format_ne(struct mp_repack *rp)
     for (int n = 0; n < rp->num_steps - 1; n++)
         assert(rp->steps[n].fmt[1].id == rp->steps[n + 1].fmt[0].id);
 
+    if (!(rp->flags & REPACK_CREATE_NO_SIMD))
+        setup_simd(rp);
+
     return true;
 }
 
@@ -1041,7 +1080,11 @@ static void reset_params(struct mp_repack *rp)
     rp->repack = NULL;
     rp->passthrough_y = false;
     rp->endian_size = 0;
+    rp->bswap = NULL;
     rp->packed_repack_scanline = NULL;
+    rp->regular = NULL;
+    rp->f32_comp_size = 0;
+    rp->f32_packer = NULL;
     rp->comp_size = 0;
     talloc_free(rp->comp_lut);
     rp->comp_lut = NULL;
@@ -14,6 +14,10 @@ enum {
     // For mp_repack_create_planar(). If specified, the planar format uses a
     // float 32 bit sample format. No range expansion is done.
     REPACK_CREATE_PLANAR_F32    = (1 << 2),
+
+    // Don't use SIMD optimized code paths, even if the CPU supports them. This
+    // is mostly for testing and benchmarking.
+    REPACK_CREATE_NO_SIMD       = (1 << 3),
 };
 
 struct mp_repack;
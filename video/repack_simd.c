@@ -0,0 +1,778 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
+
+#include "common/common.h"
+#include "repack_simd.h"
+
+// The functions are compiled with per-function target attributes, so no
+// special compiler flags are needed, and the CPU is checked at runtime with
+// av_get_cpu_flags(). All of this assumes little endian (like the scalar
+// code, which uses word access).
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define REPACK_X86 1
+#include <immintrin.h>
+#define TARGET_SSE4 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define REPACK_X86 0
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#define REPACK_NEON 1
+#include <arm_neon.h>
+#else
+#define REPACK_NEON 0
+#endif
+
+// Scalar code for the remaining pixels that don't fill a full vector. The
+// naming is the same as in repack.c.
+
+static inline void tail_un_cc8(uint8_t *s, uint8_t *d0, uint8_t *d1,
+                               int x, int w)
+{
+    for (; x < w; x++) {
+        d0[x] = s[x * 2 + 0];
+        d1[x] = s[x * 2 + 1];
+    }
+}
+
+static inline void tail_pa_cc8(uint8_t *d, uint8_t *s0, uint8_t *s1,
+                               int x, int w)
+{
+    for (; x < w; x++) {
+        d[x * 2 + 0] = s0[x];
+        d[x * 2 + 1] = s1[x];
+    }
+}
+
+static inline void tail_un_cc16(uint16_t *s, uint16_t *d0, uint16_t *d1,
+                                int x, int w)
+{
+    for (; x < w; x++) {
+        d0[x] = s[x * 2 + 0];
+        d1[x] = s[x * 2 + 1];
+    }
+}
+
+static inline void tail_pa_cc16(uint16_t *d, uint16_t *s0, uint16_t *s1,
+                                int x, int w)
+{
+    for (; x < w; x++) {
+        d[x * 2 + 0] = s0[x];
+        d[x * 2 + 1] = s1[x];
+    }
+}
+
+static inline void tail_un_cccc8(uint8_t *s, void *dst[], int x, int w)
+{
+    for (; x < w; x++) {
+        for (int c = 0; c < 4; c++)
+            ((uint8_t *)dst[c])[x] = s[x * 4 + c];
+    }
+}
+
+static inline void tail_pa_cccc8(uint8_t *d, void *src[], int x, int w)
+{
+    for (; x < w; x++) {
+        for (int c = 0; c < 4; c++)
+            d[x * 4 + c] = ((uint8_t *)src[c])[x];
+    }
+}
+
+static inline void tail_bswap16(uint16_t *d, uint16_t *s, int x, int w)
+{
+    for (; x < w; x++)
+        d[x] = av_bswap16(s[x]);
+}
+
+static inline void tail_bswap32(uint32_t *d, uint32_t *s, int x, int w)
+{
+    for (; x < w; x++)
+        d[x] = av_bswap32(s[x]);
+}
+
+#define TAIL_UN_F32(name, packed_t)                                         \
+    static inline void name(packed_t *s, float *d, int x, int w,            \
+                            float m, float o) {                             \
+        for (; x < w; x++)                                                  \
+            d[x] = s[x] * m + o;                                            \
+    }
+
+#define TAIL_PA_F32(name, packed_t)                                         \
+    static inline void name(packed_t *d, float *s, int x, int w,            \
+                            float m, float o, uint32_t p_max) {             \
+        for (; x < w; x++)                                                  \
+            d[x] = MPCLAMP(lrint((s[x] + o) * m), 0, (packed_t)p_max);      \
+    }
+
+TAIL_UN_F32(tail_un_f32_8,  uint8_t)
+TAIL_UN_F32(tail_un_f32_16, uint16_t)
+TAIL_PA_F32(tail_pa_f32_8,  uint8_t)
+TAIL_PA_F32(tail_pa_f32_16, uint16_t)
+
+#if REPACK_X86
+
+#define LOAD128(p)      _mm_loadu_si128((const __m128i *)(p))
+#define STORE128(p, v)  _mm_storeu_si128((__m128i *)(p), v)
+#define LOAD256(p)      _mm256_loadu_si256((const __m256i *)(p))
+#define STORE256(p, v)  _mm256_storeu_si256((__m256i *)(p), v)
+
+// Restores the element order after a 256 bit pack instruction (which packs
+// within each 128 bit lane).
+#define AVX2_FIX_PACK(v) _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0))
+
+TARGET_SSE4 static void un_cc8_sse4(void *src, void *dst[], int w)
+{
+    uint8_t *s = src, *d0 = dst[0], *d1 = dst[1];
+    const __m128i mask = _mm_set1_epi16(0xFF);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i a = LOAD128(s + x * 2);
+        __m128i b = LOAD128(s + x * 2 + 16);
+        STORE128(d0 + x, _mm_packus_epi16(_mm_and_si128(a, mask),
+                                          _mm_and_si128(b, mask)));
+        STORE128(d1 + x, _mm_packus_epi16(_mm_srli_epi16(a, 8),
+                                          _mm_srli_epi16(b, 8)));
+    }
+    tail_un_cc8(s, d0, d1, x, w);
+}
+
+TARGET_SSE4 static void pa_cc8_sse4(void *dst, void *src[], int w)
+{
+    uint8_t *d = dst, *s0 = src[0], *s1 = src[1];
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i c0 = LOAD128(s0 + x);
+        __m128i c1 = LOAD128(s1 + x);
+        STORE128(d + x * 2,      _mm_unpacklo_epi8(c0, c1));
+        STORE128(d + x * 2 + 16, _mm_unpackhi_epi8(c0, c1));
+    }
+    tail_pa_cc8(d, s0, s1, x, w);
+}
+
+TARGET_SSE4 static void un_cc16_sse4(void *src, void *dst[], int w)
+{
+    uint16_t *s = src, *d0 = dst[0], *d1 = dst[1];
+    const __m128i mask = _mm_set1_epi32(0xFFFF);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i a = LOAD128(s + x * 2);
+        __m128i b = LOAD128(s + x * 2 + 8);
+        STORE128(d0 + x, _mm_packus_epi32(_mm_and_si128(a, mask),
+                                          _mm_and_si128(b, mask)));
+        STORE128(d1 + x, _mm_packus_epi32(_mm_srli_epi32(a, 16),
+                                          _mm_srli_epi32(b, 16)));
+    }
+    tail_un_cc16(s, d0, d1, x, w);
+}
+
+TARGET_SSE4 static void pa_cc16_sse4(void *dst, void *src[], int w)
+{
+    uint16_t *d = dst, *s0 = src[0], *s1 = src[1];
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i c0 = LOAD128(s0 + x);
+        __m128i c1 = LOAD128(s1 + x);
+        STORE128(d + x * 2,     _mm_unpacklo_epi16(c0, c1));
+        STORE128(d + x * 2 + 8, _mm_unpackhi_epi16(c0, c1));
+    }
+    tail_pa_cc16(d, s0, s1, x, w);
+}
+
+TARGET_SSE4 static void un_cccc8_sse4(void *src, void *dst[], int w)
+{
+    uint8_t *s = src;
+    // Group each component within 4 pixels: c0 c0 c0 c0 c1 c1 c1 c1 ...
+    const __m128i shuf = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13,
+                                       2, 6, 10, 14, 3, 7, 11, 15);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i v0 = _mm_shuffle_epi8(LOAD128(s + x * 4 +  0), shuf);
+        __m128i v1 = _mm_shuffle_epi8(LOAD128(s + x * 4 + 16), shuf);
+        __m128i v2 = _mm_shuffle_epi8(LOAD128(s + x * 4 + 32), shuf);
+        __m128i v3 = _mm_shuffle_epi8(LOAD128(s + x * 4 + 48), shuf);
+        // 4x4 transpose of 32 bit elements.
+        __m128i t0 = _mm_unpacklo_epi32(v0, v1);
+        __m128i t1 = _mm_unpacklo_epi32(v2, v3);
+        __m128i t2 = _mm_unpackhi_epi32(v0, v1);
+        __m128i t3 = _mm_unpackhi_epi32(v2, v3);
+        STORE128((uint8_t *)dst[0] + x, _mm_unpacklo_epi64(t0, t1));
+        STORE128((uint8_t *)dst[1] + x, _mm_unpackhi_epi64(t0, t1));
+        STORE128((uint8_t *)dst[2] + x, _mm_unpacklo_epi64(t2, t3));
+        STORE128((uint8_t *)dst[3] + x, _mm_unpackhi_epi64(t2, t3));
+    }
+    tail_un_cccc8(s, dst, x, w);
+}
+
+TARGET_SSE4 static void pa_cccc8_sse4(void *dst, void *src[], int w)
+{
+    uint8_t *d = dst;
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i c0 = LOAD128((uint8_t *)src[0] + x);
+        __m128i c1 = LOAD128((uint8_t *)src[1] + x);
+        __m128i c2 = LOAD128((uint8_t *)src[2] + x);
+        __m128i c3 = LOAD128((uint8_t *)src[3] + x);
+        __m128i lo01 = _mm_unpacklo_epi8(c0, c1);
+        __m128i hi01 = _mm_unpackhi_epi8(c0, c1);
+        __m128i lo23 = _mm_unpacklo_epi8(c2, c3);
+        __m128i hi23 = _mm_unpackhi_epi8(c2, c3);
+        STORE128(d + x * 4 +  0, _mm_unpacklo_epi16(lo01, lo23));
+        STORE128(d + x * 4 + 16, _mm_unpackhi_epi16(lo01, lo23));
+        STORE128(d + x * 4 + 32, _mm_unpacklo_epi16(hi01, hi23));
+        STORE128(d + x * 4 + 48, _mm_unpackhi_epi16(hi01, hi23));
+    }
+    tail_pa_cccc8(d, src, x, w);
+}
+
+TARGET_SSE4 static void bswap16_sse4(void *dst, void *src, int w)
+{
+    uint16_t *d = dst, *s = src;
+    const __m128i shuf = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                       9, 8, 11, 10, 13, 12, 15, 14);
+    int x = 0;
+    for (; x + 8 <= w; x += 8)
+        STORE128(d + x, _mm_shuffle_epi8(LOAD128(s + x), shuf));
+    tail_bswap16(d, s, x, w);
+}
+
+TARGET_SSE4 static void bswap32_sse4(void *dst, void *src, int w)
+{
+    uint32_t *d = dst, *s = src;
+    const __m128i shuf = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                       11, 10, 9, 8, 15, 14, 13, 12);
+    int x = 0;
+    for (; x + 4 <= w; x += 4)
+        STORE128(d + x, _mm_shuffle_epi8(LOAD128(s + x), shuf));
+    tail_bswap32(d, s, x, w);
+}
+
+TARGET_SSE4 static void un_f32_8_sse4(void *src, float *dst, int w, float m,
+                                      float o, uint32_t unused)
+{
+    uint8_t *s = src;
+    const __m128 vm = _mm_set1_ps(m), vo = _mm_set1_ps(o);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i v = LOAD128(s + x);
+        for (int n = 0; n < 4; n++) {
+            __m128 f = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(v));
+            _mm_storeu_ps(dst + x + n * 4, _mm_add_ps(_mm_mul_ps(f, vm), vo));
+            v = _mm_srli_si128(v, 4);
+        }
+    }
+    tail_un_f32_8(s, dst, x, w, m, o);
+}
+
+TARGET_SSE4 static void un_f32_16_sse4(void *src, float *dst, int w, float m,
+                                       float o, uint32_t unused)
+{
+    uint16_t *s = src;
+    const __m128 vm = _mm_set1_ps(m), vo = _mm_set1_ps(o);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i v = LOAD128(s + x);
+        __m128 f0 = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(v));
+        __m128 f1 = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(v, 8)));
+        _mm_storeu_ps(dst + x + 0, _mm_add_ps(_mm_mul_ps(f0, vm), vo));
+        _mm_storeu_ps(dst + x + 4, _mm_add_ps(_mm_mul_ps(f1, vm), vo));
+    }
+    tail_un_f32_16(s, dst, x, w, m, o);
+}
+
+// Convert 4 floats to clamped integers. _mm_cvtps_epi32() rounds like lrint()
+// with the default rounding mode. Clamp before converting, because it returns
+// INT_MIN for NaN and out of range values. _mm_max_ps() returns the second
+// operand if either is NaN, so NaN becomes 0, like with the C code on x86.
+TARGET_SSE4 static inline __m128i pa_f32_sse4(float *s, __m128 vm, __m128 vo,
+                                              __m128 vmax)
+{
+    __m128 f = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(s), vo), vm);
+    f = _mm_min_ps(_mm_max_ps(f, _mm_setzero_ps()), vmax);
+    return _mm_cvtps_epi32(f);
+}
+
+TARGET_SSE4 static void pa_f32_8_sse4(void *dst, float *src, int w, float m,
+                                      float o, uint32_t p_max)
+{
+    uint8_t *d = dst;
+    const __m128 vm = _mm_set1_ps(m), vo = _mm_set1_ps(o);
+    const __m128 vmax = _mm_set1_ps(MPMIN(p_max, UINT8_MAX));
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i i0 = pa_f32_sse4(src + x +  0, vm, vo, vmax);
+        __m128i i1 = pa_f32_sse4(src + x +  4, vm, vo, vmax);
+        __m128i i2 = pa_f32_sse4(src + x +  8, vm, vo, vmax);
+        __m128i i3 = pa_f32_sse4(src + x + 12, vm, vo, vmax);
+        STORE128(d + x, _mm_packus_epi16(_mm_packus_epi32(i0, i1),
+                                         _mm_packus_epi32(i2, i3)));
+    }
+    tail_pa_f32_8(d, src, x, w, m, o, p_max);
+}
+
+TARGET_SSE4 static void pa_f32_16_sse4(void *dst, float *src, int w, float m,
+                                       float o, uint32_t p_max)
+{
+    uint16_t *d = dst;
+    const __m128 vm = _mm_set1_ps(m), vo = _mm_set1_ps(o);
+    const __m128 vmax = _mm_set1_ps(MPMIN(p_max, UINT16_MAX));
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m128i i0 = pa_f32_sse4(src + x + 0, vm, vo, vmax);
+        __m128i i1 = pa_f32_sse4(src + x + 4, vm, vo, vmax);
+        STORE128(d + x, _mm_packus_epi32(i0, i1));
+    }
+    tail_pa_f32_16(d, src, x, w, m, o, p_max);
+}
+
+TARGET_AVX2 static void un_cc8_avx2(void *src, void *dst[], int w)
+{
+    uint8_t *s = src, *d0 = dst[0], *d1 = dst[1];
+    const __m256i mask = _mm256_set1_epi16(0xFF);
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i a = LOAD256(s + x * 2);
+        __m256i b = LOAD256(s + x * 2 + 32);
+        __m256i c0 = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+                                         _mm256_and_si256(b, mask));
+        __m256i c1 = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+                                         _mm256_srli_epi16(b, 8));
+        STORE256(d0 + x, AVX2_FIX_PACK(c0));
+        STORE256(d1 + x, AVX2_FIX_PACK(c1));
+    }
+    tail_un_cc8(s, d0, d1, x, w);
+}
+
+TARGET_AVX2 static void pa_cc8_avx2(void *dst, void *src[], int w)
+{
+    uint8_t *d = dst, *s0 = src[0], *s1 = src[1];
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i c0 = LOAD256(s0 + x);
+        __m256i c1 = LOAD256(s1 + x);
+        __m256i lo = _mm256_unpacklo_epi8(c0, c1);
+        __m256i hi = _mm256_unpackhi_epi8(c0, c1);
+        STORE256(d + x * 2,      _mm256_permute2x128_si256(lo, hi, 0x20));
+        STORE256(d + x * 2 + 32, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    tail_pa_cc8(d, s0, s1, x, w);
+}
+
+TARGET_AVX2 static void un_cc16_avx2(void *src, void *dst[], int w)
+{
+    uint16_t *s = src, *d0 = dst[0], *d1 = dst[1];
+    const __m256i mask = _mm256_set1_epi32(0xFFFF);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m256i a = LOAD256(s + x * 2);
+        __m256i b = LOAD256(s + x * 2 + 16);
+        __m256i c0 = _mm256_packus_epi32(_mm256_and_si256(a, mask),
+                                         _mm256_and_si256(b, mask));
+        __m256i c1 = _mm256_packus_epi32(_mm256_srli_epi32(a, 16),
+                                         _mm256_srli_epi32(b, 16));
+        STORE256(d0 + x, AVX2_FIX_PACK(c0));
+        STORE256(d1 + x, AVX2_FIX_PACK(c1));
+    }
+    tail_un_cc16(s, d0, d1, x, w);
+}
+
+TARGET_AVX2 static void pa_cc16_avx2(void *dst, void *src[], int w)
+{
+    uint16_t *d = dst, *s0 = src[0], *s1 = src[1];
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m256i c0 = LOAD256(s0 + x);
+        __m256i c1 = LOAD256(s1 + x);
+        __m256i lo = _mm256_unpacklo_epi16(c0, c1);
+        __m256i hi = _mm256_unpackhi_epi16(c0, c1);
+        STORE256(d + x * 2,      _mm256_permute2x128_si256(lo, hi, 0x20));
+        STORE256(d + x * 2 + 16, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    tail_pa_cc16(d, s0, s1, x, w);
+}
+
+TARGET_AVX2 static void bswap16_avx2(void *dst, void *src, int w)
+{
+    uint16_t *d = dst, *s = src;
+    const __m256i shuf = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+                                          9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6,
+                                          9, 8, 11, 10, 13, 12, 15, 14);
+    int x = 0;
+    for (; x + 16 <= w; x += 16)
+        STORE256(d + x, _mm256_shuffle_epi8(LOAD256(s + x), shuf));
+    tail_bswap16(d, s, x, w);
+}
+
+TARGET_AVX2 static void un_f32_8_avx2(void *src, float *dst, int w, float m,
+                                      float o, uint32_t unused)
+{
+    uint8_t *s = src;
+    const __m256 vm = _mm256_set1_ps(m), vo = _mm256_set1_ps(o);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i v = LOAD128(s + x);
+        __m256 f0 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v));
+        __m256 f1 = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+        _mm256_storeu_ps(dst + x + 0, _mm256_add_ps(_mm256_mul_ps(f0, vm), vo));
+        _mm256_storeu_ps(dst + x + 8, _mm256_add_ps(_mm256_mul_ps(f1, vm), vo));
+    }
+    tail_un_f32_8(s, dst, x, w, m, o);
+}
+
+TARGET_AVX2 static void un_f32_16_avx2(void *src, float *dst, int w, float m,
+                                       float o, uint32_t unused)
+{
+    uint16_t *s = src;
+    const __m256 vm = _mm256_set1_ps(m), vo = _mm256_set1_ps(o);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m256i v = LOAD256(s + x);
+        __m256 f0 = _mm256_cvtepi32_ps(
+            _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)));
+        __m256 f1 = _mm256_cvtepi32_ps(
+            _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)));
+        _mm256_storeu_ps(dst + x + 0, _mm256_add_ps(_mm256_mul_ps(f0, vm), vo));
+        _mm256_storeu_ps(dst + x + 8, _mm256_add_ps(_mm256_mul_ps(f1, vm), vo));
+    }
+    tail_un_f32_16(s, dst, x, w, m, o);
+}
+
+// See pa_f32_sse4().
+TARGET_AVX2 static inline __m256i pa_f32_avx2(float *s, __m256 vm, __m256 vo,
+                                              __m256 vmax)
+{
+    __m256 f = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(s), vo), vm);
+    f = _mm256_min_ps(_mm256_max_ps(f, _mm256_setzero_ps()), vmax);
+    return _mm256_cvtps_epi32(f);
+}
+
+TARGET_AVX2 static void pa_f32_8_avx2(void *dst, float *src, int w, float m,
+                                      float o, uint32_t p_max)
+{
+    uint8_t *d = dst;
+    const __m256 vm = _mm256_set1_ps(m), vo = _mm256_set1_ps(o);
+    const __m256 vmax = _mm256_set1_ps(MPMIN(p_max, UINT8_MAX));
+    // Undo the lane interleaving of the two pack steps (32 bit granularity).
+    const __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i i0 = pa_f32_avx2(src + x +  0, vm, vo, vmax);
+        __m256i i1 = pa_f32_avx2(src + x +  8, vm, vo, vmax);
+        __m256i i2 = pa_f32_avx2(src + x + 16, vm, vo, vmax);
+        __m256i i3 = pa_f32_avx2(src + x + 24, vm, vo, vmax);
+        __m256i p = _mm256_packus_epi16(_mm256_packus_epi32(i0, i1),
+                                        _mm256_packus_epi32(i2, i3));
+        STORE256(d + x, _mm256_permutevar8x32_epi32(p, perm));
+    }
+    tail_pa_f32_8(d, src, x, w, m, o, p_max);
+}
+
+TARGET_AVX2 static void pa_f32_16_avx2(void *dst, float *src, int w, float m,
+                                       float o, uint32_t p_max)
+{
+    uint16_t *d = dst;
+    const __m256 vm = _mm256_set1_ps(m), vo = _mm256_set1_ps(o);
+    const __m256 vmax = _mm256_set1_ps(MPMIN(p_max, UINT16_MAX));
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m256i i0 = pa_f32_avx2(src + x + 0, vm, vo, vmax);
+        __m256i i1 = pa_f32_avx2(src + x + 8, vm, vo, vmax);
+        STORE256(d + x, AVX2_FIX_PACK(_mm256_packus_epi32(i0, i1)));
+    }
+    tail_pa_f32_16(d, src, x, w, m, o, p_max);
+}
+
+#endif // REPACK_X86
+
+#if REPACK_NEON
+
+static void un_cc8_neon(void *src, void *dst[], int w)
+{
+    uint8_t *s = src, *d0 = dst[0], *d1 = dst[1];
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        uint8x16x2_t v = vld2q_u8(s + x * 2);
+        vst1q_u8(d0 + x, v.val[0]);
+        vst1q_u8(d1 + x, v.val[1]);
+    }
+    tail_un_cc8(s, d0, d1, x, w);
+}
+
+static void pa_cc8_neon(void *dst, void *src[], int w)
+{
+    uint8_t *d = dst, *s0 = src[0], *s1 = src[1];
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        uint8x16x2_t v = {{ vld1q_u8(s0 + x), vld1q_u8(s1 + x) }};
+        vst2q_u8(d + x * 2, v);
+    }
+    tail_pa_cc8(d, s0, s1, x, w);
+}
+
+static void un_cc16_neon(void *src, void *dst[], int w)
+{
+    uint16_t *s = src, *d0 = dst[0], *d1 = dst[1];
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint16x8x2_t v = vld2q_u16(s + x * 2);
+        vst1q_u16(d0 + x, v.val[0]);
+        vst1q_u16(d1 + x, v.val[1]);
+    }
+    tail_un_cc16(s, d0, d1, x, w);
+}
+
+static void pa_cc16_neon(void *dst, void *src[], int w)
+{
+    uint16_t *d = dst, *s0 = src[0], *s1 = src[1];
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint16x8x2_t v = {{ vld1q_u16(s0 + x), vld1q_u16(s1 + x) }};
+        vst2q_u16(d + x * 2, v);
+    }
+    tail_pa_cc16(d, s0, s1, x, w);
+}
+
+static void un_cccc8_neon(void *src, void *dst[], int w)
+{
+    uint8_t *s = src;
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        uint8x16x4_t v = vld4q_u8(s + x * 4);
+        for (int c = 0; c < 4; c++)
+            vst1q_u8((uint8_t *)dst[c] + x, v.val[c]);
+    }
+    tail_un_cccc8(s, dst, x, w);
+}
+
+static void pa_cccc8_neon(void *dst, void *src[], int w)
+{
+    uint8_t *d = dst;
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        uint8x16x4_t v;
+        for (int c = 0; c < 4; c++)
+            v.val[c] = vld1q_u8((uint8_t *)src[c] + x);
+        vst4q_u8(d + x * 4, v);
+    }
+    tail_pa_cccc8(d, src, x, w);
+}
+
+static void bswap16_neon(void *dst, void *src, int w)
+{
+    uint16_t *d = dst, *s = src;
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint8x16_t v = vld1q_u8((uint8_t *)(s + x));
+        vst1q_u8((uint8_t *)(d + x), vrev16q_u8(v));
+    }
+    tail_bswap16(d, s, x, w);
+}
+
+static void bswap32_neon(void *dst, void *src, int w)
+{
+    uint32_t *d = dst, *s = src;
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        uint8x16_t v = vld1q_u8((uint8_t *)(s + x));
+        vst1q_u8((uint8_t *)(d + x), vrev32q_u8(v));
+    }
+    tail_bswap32(d, s, x, w);
+}
+
+static inline float32x4_t un_f32_neon(uint16x4_t v, float m, float o)
+{
+    float32x4_t f = vcvtq_f32_u32(vmovl_u16(v));
+    return vaddq_f32(vmulq_n_f32(f, m), vdupq_n_f32(o));
+}
+
+static void un_f32_8_neon(void *src, float *dst, int w, float m, float o,
+                          uint32_t unused)
+{
+    uint8_t *s = src;
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint16x8_t v = vmovl_u8(vld1_u8(s + x));
+        vst1q_f32(dst + x + 0, un_f32_neon(vget_low_u16(v), m, o));
+        vst1q_f32(dst + x + 4, un_f32_neon(vget_high_u16(v), m, o));
+    }
+    tail_un_f32_8(s, dst, x, w, m, o);
+}
+
+static void un_f32_16_neon(void *src, float *dst, int w, float m, float o,
+                           uint32_t unused)
+{
+    uint16_t *s = src;
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        uint16x8_t v = vld1q_u16(s + x);
+        vst1q_f32(dst + x + 0, un_f32_neon(vget_low_u16(v), m, o));
+        vst1q_f32(dst + x + 4, un_f32_neon(vget_high_u16(v), m, o));
+    }
+    tail_un_f32_16(s, dst, x, w, m, o);
+}
+
+// Convert 8 floats to clamped 16 bit integers. vcvtnq_s32_f32() rounds to
+// nearest even like lrint() with the default rounding mode. It saturates and
+// returns 0 for NaN, so clamping the result is enough.
+static inline uint16x8_t pa_f32_neon(float *s, float m, float o,
+                                     int32x4_t vmax)
+{
+    uint16x4_t r[2];
+    for (int n = 0; n < 2; n++) {
+        float32x4_t f = vaddq_f32(vld1q_f32(s + n * 4), vdupq_n_f32(o));
+        int32x4_t i = vcvtnq_s32_f32(vmulq_n_f32(f, m));
+        i = vminq_s32(vmaxq_s32(i, vdupq_n_s32(0)), vmax);
+        r[n] = vmovn_u32(vreinterpretq_u32_s32(i));
+    }
+    return vcombine_u16(r[0], r[1]);
+}
+
+static void pa_f32_8_neon(void *dst, float *src, int w, float m, float o,
+                          uint32_t p_max)
+{
+    uint8_t *d = dst;
+    const int32x4_t vmax = vdupq_n_s32(MPMIN(p_max, UINT8_MAX));
+    int x = 0;
+    for (; x + 8 <= w; x += 8)
+        vst1_u8(d + x, vmovn_u16(pa_f32_neon(src + x, m, o, vmax)));
+    tail_pa_f32_8(d, src, x, w, m, o, p_max);
+}
+
+static void pa_f32_16_neon(void *dst, float *src, int w, float m, float o,
+                           uint32_t p_max)
+{
+    uint16_t *d = dst;
+    const int32x4_t vmax = vdupq_n_s32(MPMIN(p_max, UINT16_MAX));
+    int x = 0;
+    for (; x + 8 <= w; x += 8)
+        vst1q_u16(d + x, pa_f32_neon(src + x, m, o, vmax));
+    tail_pa_f32_16(d, src, x, w, m, o, p_max);
+}
+
+#endif // REPACK_NEON
+
+// Entries are tried in order; the first one supported by the CPU is used.
+struct simd_scanline {
+    int packed_width;       // see struct regular_repacker
+    int component_width;
+    int num_components;
+    int cpu_flag;           // AV_CPU_FLAG_*
+    mp_repack_scanline_fn pa, un;
+};
+
+static const struct simd_scanline simd_scanlines[] = {
+#if REPACK_X86
+    {16, 8,  2, AV_CPU_FLAG_AVX2, pa_cc8_avx2,    un_cc8_avx2},
+    {16, 8,  2, AV_CPU_FLAG_SSE4, pa_cc8_sse4,    un_cc8_sse4},
+    {32, 16, 2, AV_CPU_FLAG_AVX2, pa_cc16_avx2,   un_cc16_avx2},
+    {32, 16, 2, AV_CPU_FLAG_SSE4, pa_cc16_sse4,   un_cc16_sse4},
+    {32, 8,  4, AV_CPU_FLAG_SSE4, pa_cccc8_sse4,  un_cccc8_sse4},
+#endif
+#if REPACK_NEON
+    {16, 8,  2, AV_CPU_FLAG_NEON, pa_cc8_neon,    un_cc8_neon},
+    {32, 16, 2, AV_CPU_FLAG_NEON, pa_cc16_neon,   un_cc16_neon},
+    {32, 8,  4, AV_CPU_FLAG_NEON, pa_cccc8_neon,  un_cccc8_neon},
+#endif
+    {0}
+};
+
+struct simd_float {
+    int component_size;
+    int cpu_flag;
+    mp_repack_float_fn pa, un;
+};
+
+static const struct simd_float simd_floats[] = {
+#if REPACK_X86
+    {1, AV_CPU_FLAG_AVX2, pa_f32_8_avx2,  un_f32_8_avx2},
+    {1, AV_CPU_FLAG_SSE4, pa_f32_8_sse4,  un_f32_8_sse4},
+    {2, AV_CPU_FLAG_AVX2, pa_f32_16_avx2, un_f32_16_avx2},
+    {2, AV_CPU_FLAG_SSE4, pa_f32_16_sse4, un_f32_16_sse4},
+#endif
+#if REPACK_NEON
+    {1, AV_CPU_FLAG_NEON, pa_f32_8_neon,  un_f32_8_neon},
+    {2, AV_CPU_FLAG_NEON, pa_f32_16_neon, un_f32_16_neon},
+#endif
+    {0}
+};
+
+struct simd_bswap {
+    int endian_size;
+    int cpu_flag;
+    mp_repack_bswap_fn fn;
+};
+
+static const struct simd_bswap simd_bswaps[] = {
+#if REPACK_X86
+    {2, AV_CPU_FLAG_AVX2, bswap16_avx2},
+    {2, AV_CPU_FLAG_SSE4, bswap16_sse4},
+    {4, AV_CPU_FLAG_SSE4, bswap32_sse4},
+#endif
+#if REPACK_NEON
+    {2, AV_CPU_FLAG_NEON, bswap16_neon},
+    {4, AV_CPU_FLAG_NEON, bswap32_neon},
+#endif
+    {0}
+};
+
+mp_repack_scanline_fn mp_repack_simd_get_scanline(bool pack, int packed_width,
+                                                  int component_width,
+                                                  int num_components,
+                                                  int prepadding)
+{
+    if (prepadding)
+        return NULL;
+
+    int cpu_flags = av_get_cpu_flags();
+    for (int n = 0; simd_scanlines[n].packed_width; n++) {
+        const struct simd_scanline *e = &simd_scanlines[n];
+        if (e->packed_width == packed_width &&
+            e->component_width == component_width &&
+            e->num_components == num_components &&
+            (cpu_flags & e->cpu_flag))
+            return pack ? e->pa : e->un;
+    }
+    return NULL;
+}
+
+mp_repack_float_fn mp_repack_simd_get_float(bool pack, int component_size)
+{
+    int cpu_flags = av_get_cpu_flags();
+    for (int n = 0; simd_floats[n].component_size; n++) {
+        const struct simd_float *e = &simd_floats[n];
+        if (e->component_size == component_size && (cpu_flags & e->cpu_flag))
+            return pack ? e->pa : e->un;
+    }
+    return NULL;
+}
+
+mp_repack_bswap_fn mp_repack_simd_get_bswap(int endian_size)
+{
+    int cpu_flags = av_get_cpu_flags();
+    for (int n = 0; simd_bswaps[n].endian_size; n++) {
+        const struct simd_bswap *e = &simd_bswaps[n];
+        if (e->endian_size == endian_size && (cpu_flags & e->cpu_flag))
+            return e->fn;
+    }
+    return NULL;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Internal to repack.c. These have the same semantics as the scalar C
+// functions in repack.c, but may be faster on some CPUs.
+
+// Same as the pa_*/un_* functions in regular_repackers.
+typedef void (*mp_repack_scanline_fn)(void *a, void *b[], int w);
+
+// Same as the pa_f32_*/un_f32_* functions.
+typedef void (*mp_repack_float_fn)(void *a, float *b, int w, float m, float o,
+                                   uint32_t p_max);
+
+// Swap endian of num_words words (size depends on the function) from src to
+// dst. src and dst may be the same pointer.
+typedef void (*mp_repack_bswap_fn)(void *dst, void *src, int num_words);
+
+// Return a SIMD implementation of a "regular" packer/unpacker (see struct
+// regular_repacker in repack.c), or NULL if there is none for the running CPU.
+mp_repack_scanline_fn mp_repack_simd_get_scanline(bool pack, int packed_width,
+                                                  int component_width,
+                                                  int num_components,
+                                                  int prepadding);
+
+// Return a SIMD implementation of an integer<->float32 packer/unpacker for the
+// given integer component size (1 or 2 bytes), or NULL.
+mp_repack_float_fn mp_repack_simd_get_float(bool pack, int component_size);
+
+// Return a SIMD implementation for swapping words of the given size (2 or 4
+// bytes), or NULL.
+mp_repack_bswap_fn mp_repack_simd_get_bswap(int endian_size);
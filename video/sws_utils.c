@@ -20,6 +20,8 @@
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/bswap.h>
+#include <libavutil/cpu.h>
+#include <libavutil/frame.h>
 #include <libavutil/opt.h>
 #if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 37, 100)
 #include <libavutil/pixdesc.h>
@@ -37,12 +39,20 @@
 #include "fmt-conversion.h"
 #include "csputils.h"
 #include "common/msg.h"
+#include "misc/thread_pool.h"
 #include "osdep/endian.h"
 
 #if HAVE_ZIMG
 #include "zimg.h"
 #endif
 
+// sws_send_slice()/sws_receive_slice() are required for slice threading.
+#define HAVE_SWS_SLICES \
+    (LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100))
+
+// Minimum height of a destination band, to keep the per-slice overhead low.
+#define MIN_SLICE_H 64
+
 //global sws_flags from the command line
 struct sws_opts {
     int scaler;
@@ -55,6 +65,7 @@ struct sws_opts {
     bool fast;
     bool bitexact;
     bool zimg;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct sws_opts
@@ -81,6 +92,7 @@ const struct m_sub_options sws_conf = {
         {"fast", OPT_BOOL(fast)},
         {"bitexact", OPT_BOOL(bitexact)},
         {"allow-zimg", OPT_BOOL(zimg)},
+        {"threads", OPT_CHOICE(threads, {"auto", 0}), M_RANGE(1, 64)},
         {0}
     },
     .size = sizeof(struct sws_opts),
@@ -117,6 +129,7 @@ static void mp_sws_update_from_cmdline(struct mp_sws_context *ctx)
         ctx->flags |= SWS_BITEXACT;
 
     ctx->allow_zimg = opts->zimg;
+    ctx->threads = opts->threads;
 }
 
 bool mp_sws_supported_format(int imgfmt)
@@ -172,13 +185,36 @@ static bool cache_valid(struct mp_sws_context *ctx)
            mp_image_params_equal(&ctx->dst, &old->dst) &&
            ctx->flags == old->flags &&
            ctx->allow_zimg == old->allow_zimg &&
+           ctx->threads == old->threads &&
            ctx->force_scaler == old->force_scaler &&
            (!ctx->opts_cache || !m_config_cache_update(ctx->opts_cache));
 }
 
+// One horizontal band of the destination image. Each band has its own
+// SwsContext, configured the same way as mp_sws_context.sws.
+struct mp_sws_slice {
+    struct SwsContext *sws; // for the first slice, this is ctx->sws
+    int y, h;               // destination rows covered by this slice
+    AVFrame *src, *dst;     // set for the duration of mp_sws_scale()
+    bool error;
+};
+
+static void destroy_slices(struct mp_sws_context *ctx)
+{
+    for (int n = 0; n < ctx->num_slices; n++) {
+        if (n > 0)
+            sws_freeContext(ctx->slices[n]->sws);
+        talloc_free(ctx->slices[n]);
+    }
+    TA_FREEP(&ctx->slices);
+    ctx->num_slices = 0;
+}
+
 static void free_mp_sws(void *p)
 {
     struct mp_sws_context *ctx = p;
+    destroy_slices(ctx);
+    TA_FREEP(&ctx->tp);
     sws_freeContext(ctx->sws);
     sws_freeFilter(ctx->src_filter);
     sws_freeFilter(ctx->dst_filter);
@@ -194,6 +230,7 @@ struct mp_sws_context *mp_sws_alloc(void *talloc_ctx)
     *ctx = (struct mp_sws_context) {
         .log = mp_null_log,
         .flags = SWS_BILINEAR,
+        .threads = 1,
         .force_reload = true,
         .params = {SWS_PARAM_DEFAULT, SWS_PARAM_DEFAULT},
         .cached = talloc_zero(ctx, struct mp_sws_context),
@@ -228,6 +265,212 @@ void mp_sws_enable_cmdline_opts(struct mp_sws_context *ctx, struct mpv_global *g
 #endif
 }
 
+// Create a libswscale context for the given (sanitized) parameters.
+static struct SwsContext *create_sws(struct mp_sws_context *ctx,
+                                     struct mp_image_params *src,
+                                     struct mp_image_params *dst,
+                                     int flags, bool *supports_csp)
+{
+    struct SwsContext *sws = sws_alloc_context();
+    if (!sws)
+        return NULL;
+
+    enum AVPixelFormat s_fmt = imgfmt2pixfmt(src->imgfmt);
+    enum AVPixelFormat d_fmt = imgfmt2pixfmt(dst->imgfmt);
+
+    int s_csp = mp_csp_to_sws_colorspace(src->color.space);
+    int s_range = src->color.levels == MP_CSP_LEVELS_PC;
+
+    int d_csp = mp_csp_to_sws_colorspace(dst->color.space);
+    int d_range = dst->color.levels == MP_CSP_LEVELS_PC;
+
+    av_opt_set_int(sws, "sws_flags", flags, 0);
+
+    av_opt_set_int(sws, "srcw", src->w, 0);
+    av_opt_set_int(sws, "srch", src->h, 0);
+    av_opt_set_int(sws, "src_format", s_fmt, 0);
+
+    av_opt_set_int(sws, "dstw", dst->w, 0);
+    av_opt_set_int(sws, "dsth", dst->h, 0);
+    av_opt_set_int(sws, "dst_format", d_fmt, 0);
+
+    av_opt_set_double(sws, "param0", ctx->params[0], 0);
+    av_opt_set_double(sws, "param1", ctx->params[1], 0);
+
+    int cr_src = mp_chroma_location_to_av(src->chroma_location);
+    int cr_dst = mp_chroma_location_to_av(dst->chroma_location);
+    int cr_xpos, cr_ypos;
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 37, 100)
+    if (av_chroma_location_enum_to_pos(&cr_xpos, &cr_ypos, cr_src) >= 0) {
+        av_opt_set_int(sws, "src_h_chr_pos", cr_xpos, 0);
+        av_opt_set_int(sws, "src_v_chr_pos", cr_ypos, 0);
+    }
+    if (av_chroma_location_enum_to_pos(&cr_xpos, &cr_ypos, cr_dst) >= 0) {
+        av_opt_set_int(sws, "dst_h_chr_pos", cr_xpos, 0);
+        av_opt_set_int(sws, "dst_v_chr_pos", cr_ypos, 0);
+    }
+#else
+    if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_src) >= 0) {
+        av_opt_set_int(sws, "src_h_chr_pos", cr_xpos, 0);
+        av_opt_set_int(sws, "src_v_chr_pos", cr_ypos, 0);
+    }
+    if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_dst) >= 0) {
+        av_opt_set_int(sws, "dst_h_chr_pos", cr_xpos, 0);
+        av_opt_set_int(sws, "dst_v_chr_pos", cr_ypos, 0);
+    }
+#endif
+
+    // This can fail even with normal operation, e.g. if a conversion path
+    // simply does not support these settings.
+    int r =
+        sws_setColorspaceDetails(sws, sws_getCoefficients(s_csp), s_range,
+                                 sws_getCoefficients(d_csp), d_range,
+                                 0, 1 << 16, 1 << 16);
+    *supports_csp = r >= 0;
+
+    if (sws_init_context(sws, ctx->src_filter, ctx->dst_filter) < 0) {
+        sws_freeContext(sws);
+        return NULL;
+    }
+
+    return sws;
+}
+
+// Split the destination into horizontal bands, each with its own SwsContext,
+// if more than one thread is allowed. ctx->sws is used for the first band.
+// On failure, this silently falls back to unthreaded scaling.
+static void setup_slices(struct mp_sws_context *ctx,
+                         struct mp_image_params *src,
+                         struct mp_image_params *dst)
+{
+#if HAVE_SWS_SLICES
+    int slices = ctx->threads;
+    if (slices < 1)
+        slices = av_cpu_count();
+    slices = MPCLAMP(slices, 1, 64);
+
+    // Slices must start on chroma row boundaries of the destination format.
+    int align = sws_receive_slice_alignment(ctx->sws);
+    int slice_h = MPMAX((dst->h + slices - 1) / slices, MIN_SLICE_H);
+    slice_h = (slice_h + align - 1) / align * align;
+    slices = (dst->h + slice_h - 1) / slice_h;
+
+    int threads = slices - 1;
+    if (threads != ctx->current_thread_count) {
+        // Just destroy and recreate all - dumb and costly, but rarely happens.
+        TA_FREEP(&ctx->tp);
+        ctx->current_thread_count = 0;
+        if (threads) {
+            MP_VERBOSE(ctx, "using %d threads for scaling\n", threads);
+            ctx->tp = mp_thread_pool_create(NULL, threads, threads, threads);
+            if (!ctx->tp)
+                return;
+            ctx->current_thread_count = threads;
+        }
+    }
+
+    if (slices < 2)
+        return;
+
+    for (int n = 0; n < slices; n++) {
+        struct mp_sws_slice *st = talloc_zero(ctx, struct mp_sws_slice);
+        MP_TARRAY_APPEND(ctx, ctx->slices, ctx->num_slices, st);
+
+        st->y = n * slice_h;
+        st->h = MPMIN(slice_h, dst->h - st->y);
+        st->sws = ctx->sws;
+        if (n > 0) {
+            // Don't print the same context information for every slice.
+            bool supports_csp;
+            st->sws = create_sws(ctx, src, dst, ctx->flags & ~SWS_PRINT_INFO,
+                                 &supports_csp);
+            if (!st->sws) {
+                MP_VERBOSE(ctx, "could not create slice contexts\n");
+                destroy_slices(ctx);
+                return;
+            }
+        }
+    }
+#endif
+}
+
+#if HAVE_SWS_SLICES
+static void noop_free(void *opaque, uint8_t *data)
+{
+}
+
+// Return an AVFrame that points to img's planes without copying them. The
+// frame must not outlive img. The dummy buffer reference is needed because
+// libswscale calls av_frame_ref() on the frames, which would copy non-refcounted
+// data.
+static AVFrame *wrap_frame(struct mp_image *img)
+{
+    AVFrame *frame = av_frame_alloc();
+    if (!frame)
+        return NULL;
+
+    frame->format = imgfmt2pixfmt(img->imgfmt);
+    frame->width = img->w;
+    frame->height = img->h;
+    for (int p = 0; p < MP_MAX_PLANES; p++) {
+        frame->data[p] = img->planes[p];
+        frame->linesize[p] = img->stride[p];
+    }
+
+    frame->buf[0] = av_buffer_create(img->planes[0], 1, noop_free, NULL, 0);
+    if (!frame->buf[0])
+        av_frame_free(&frame);
+    return frame;
+}
+
+static void scale_slice(struct mp_sws_slice *st)
+{
+    st->error = sws_frame_start(st->sws, st->dst, st->src) < 0 ||
+                sws_send_slice(st->sws, 0, st->src->height) < 0 ||
+                sws_receive_slice(st->sws, st->y, st->h) < 0;
+    sws_frame_end(st->sws);
+}
+
+static void scale_slice_thread(void *ptr, int index)
+{
+    struct mp_sws_context *ctx = ptr;
+
+    scale_slice(ctx->slices[index]);
+}
+
+// Scale all slices in parallel. Returns false if anything failed (in which
+// case the destination image is in an undefined state).
+static bool scale_slices(struct mp_sws_context *ctx, struct mp_image *dst,
+                         struct mp_image *src)
+{
+    AVFrame *src_frame = wrap_frame(src);
+    AVFrame *dst_frame = wrap_frame(dst);
+    bool ok = src_frame && dst_frame;
+
+    if (ok) {
+        for (int n = 0; n < ctx->num_slices; n++) {
+            struct mp_sws_slice *st = ctx->slices[n];
+            st->src = src_frame;
+            st->dst = dst_frame;
+        }
+
+        mp_thread_pool_parallel_for(ctx->tp, ctx->num_slices,
+                                    scale_slice_thread, ctx);
+
+        for (int n = 0; n < ctx->num_slices; n++) {
+            struct mp_sws_slice *st = ctx->slices[n];
+
+            ok &= !st->error;
+            st->src = st->dst = NULL;
+        }
+    }
+
+    av_frame_free(&src_frame);
+    av_frame_free(&dst_frame);
+    return ok;
+}
+#endif
+
 // Reinitialize (if needed) - return error code.
 // Optional, but possibly useful to avoid having to handle mp_sws_scale errors.
 int mp_sws_reinit(struct mp_sws_context *ctx)
@@ -241,6 +484,7 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     if (ctx->opts_cache)
         mp_sws_update_from_cmdline(ctx);
 
+    destroy_slices(ctx);
     sws_freeContext(ctx->sws);
     ctx->sws = NULL;
     ctx->zimg_ok = false;
@@ -268,10 +512,6 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
         return -1;
     }
 
-    ctx->sws = sws_alloc_context();
-    if (!ctx->sws)
-        return -1;
-
     mp_image_params_guess_csp(&src); // sanitize colorspace/colorlevels
     mp_image_params_guess_csp(&dst);
 
@@ -289,59 +529,12 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
         return -1;
     }
 
-    int s_csp = mp_csp_to_sws_colorspace(src.color.space);
-    int s_range = src.color.levels == MP_CSP_LEVELS_PC;
-
-    int d_csp = mp_csp_to_sws_colorspace(dst.color.space);
-    int d_range = dst.color.levels == MP_CSP_LEVELS_PC;
-
-    av_opt_set_int(ctx->sws, "sws_flags", ctx->flags, 0);
-
-    av_opt_set_int(ctx->sws, "srcw", src.w, 0);
-    av_opt_set_int(ctx->sws, "srch", src.h, 0);
-    av_opt_set_int(ctx->sws, "src_format", s_fmt, 0);
-
-    av_opt_set_int(ctx->sws, "dstw", dst.w, 0);
-    av_opt_set_int(ctx->sws, "dsth", dst.h, 0);
-    av_opt_set_int(ctx->sws, "dst_format", d_fmt, 0);
-
-    av_opt_set_double(ctx->sws, "param0", ctx->params[0], 0);
-    av_opt_set_double(ctx->sws, "param1", ctx->params[1], 0);
-
-    int cr_src = mp_chroma_location_to_av(src.chroma_location);
-    int cr_dst = mp_chroma_location_to_av(dst.chroma_location);
-    int cr_xpos, cr_ypos;
-#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 37, 100)
-    if (av_chroma_location_enum_to_pos(&cr_xpos, &cr_ypos, cr_src) >= 0) {
-        av_opt_set_int(ctx->sws, "src_h_chr_pos", cr_xpos, 0);
-        av_opt_set_int(ctx->sws, "src_v_chr_pos", cr_ypos, 0);
-    }
-    if (av_chroma_location_enum_to_pos(&cr_xpos, &cr_ypos, cr_dst) >= 0) {
-        av_opt_set_int(ctx->sws, "dst_h_chr_pos", cr_xpos, 0);
-        av_opt_set_int(ctx->sws, "dst_v_chr_pos", cr_ypos, 0);
-    }
-#else
-    if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_src) >= 0) {
-        av_opt_set_int(ctx->sws, "src_h_chr_pos", cr_xpos, 0);
-        av_opt_set_int(ctx->sws, "src_v_chr_pos", cr_ypos, 0);
-    }
-    if (avcodec_enum_to_chroma_pos(&cr_xpos, &cr_ypos, cr_dst) >= 0) {
-        av_opt_set_int(ctx->sws, "dst_h_chr_pos", cr_xpos, 0);
-        av_opt_set_int(ctx->sws, "dst_v_chr_pos", cr_ypos, 0);
-    }
-#endif
-
-    // This can fail even with normal operation, e.g. if a conversion path
-    // simply does not support these settings.
-    int r =
-        sws_setColorspaceDetails(ctx->sws, sws_getCoefficients(s_csp), s_range,
-                                 sws_getCoefficients(d_csp), d_range,
-                                 0, 1 << 16, 1 << 16);
-    ctx->supports_csp = r >= 0;
-
-    if (sws_init_context(ctx->sws, ctx->src_filter, ctx->dst_filter) < 0)
+    ctx->sws = create_sws(ctx, &src, &dst, ctx->flags, &ctx->supports_csp);
+    if (!ctx->sws)
         return -1;
 
+    setup_slices(ctx, &src, &dst);
+
 #if HAVE_ZIMG
 success:
 #endif
@@ -427,8 +620,22 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
     if (a_src != src)
         mp_image_copy(a_src, src);
 
-    sws_scale(ctx->sws, (const uint8_t *const *) a_src->planes, a_src->stride,
-              0, a_src->h, a_dst->planes, a_dst->stride);
+    bool done = false;
+#if HAVE_SWS_SLICES
+    if (ctx->num_slices) {
+        done = scale_slices(ctx, a_dst, a_src);
+        if (!done) {
+            // E.g. some special conversion paths might not support slices.
+            MP_VERBOSE(ctx, "slice-threaded scaling failed, disabling it.\n");
+            destroy_slices(ctx);
+        }
+    }
+#endif
+
+    if (!done) {
+        sws_scale(ctx->sws, (const uint8_t *const *) a_src->planes, a_src->stride,
+                  0, a_src->h, a_dst->planes, a_dst->stride);
+    }
 
     if (a_dst != dst)
         mp_image_copy(dst, a_dst);
@@ -36,6 +36,7 @@ struct mp_sws_context {
     // mp_sws_scale() will handle the changes transparently.
     int flags;
     bool allow_zimg; // use zimg if available (ignores filters and all)
+    int threads; // max. number of slices for libswscale (0 = auto)
     bool force_reload;
     // These are also implicitly set by mp_sws_scale(), and thus optional.
     // Setting them before that call makes sense when using mp_sws_reinit().
@@ -64,6 +65,10 @@ struct mp_sws_context {
     struct mp_zimg_context *zimg;
     bool zimg_ok;
     struct mp_image *aligned_src, *aligned_dst;
+    struct mp_sws_slice **slices; // only set if slice threading is used
+    int num_slices;
+    struct mp_thread_pool *tp;
+    int current_thread_count;
 };
 
 struct mp_sws_context *mp_sws_alloc(void *talloc_ctx);
@@ -23,7 +23,6 @@
 #include "common/msg.h"
 #include "csputils.h"
 #include "misc/thread_pool.h"
-#include "misc/thread_tools.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "repack.h"
@@ -87,7 +86,6 @@ struct mp_zimg_state {
     struct mp_zimg_repack *dst;
     int slice_y, slice_h; // y start position, height of target slice
     double scale_y;
-    struct mp_waiter thread_waiter;
 };
 
 struct mp_zimg_repack {
@@ -654,12 +652,11 @@ static void do_convert(struct mp_zimg_state *st)
                               repack_entrypoint, st->dst);
 }
 
-static void do_convert_thread(void *ptr)
+static void do_convert_slice(void *ptr, int index)
 {
-    struct mp_zimg_state *st = ptr;
+    struct mp_zimg_context *ctx = ptr;
 
-    do_convert(st);
-    mp_waiter_wakeup(&st->thread_waiter, 0);
+    do_convert(ctx->states[index]);
 }
 
 bool mp_zimg_convert(struct mp_zimg_context *ctx, struct mp_image *dst,
@@ -682,23 +679,7 @@ bool mp_zimg_convert(struct mp_zimg_context *ctx, struct mp_image *dst,
         }
     }
 
-    for (int n = 1; n < ctx->num_states; n++) {
-        struct mp_zimg_state *st = ctx->states[n];
-
-        st->thread_waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
-
-        bool r = mp_thread_pool_run(ctx->tp, do_convert_thread, st);
-        // This is guaranteed by the API; and unrolling would be inconvenient.
-        assert(r);
-    }
-
-    do_convert(ctx->states[0]);
-
-    for (int n = 1; n < ctx->num_states; n++) {
-        struct mp_zimg_state *st = ctx->states[n];
-
-        mp_waiter_wait(&st->thread_waiter);
-    }
+    mp_thread_pool_parallel_for(ctx->tp, ctx->num_states, do_convert_slice, ctx);
 
     return true;
 }
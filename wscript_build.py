@@ -355,6 +355,7 @@ def build(ctx):
         ( "filters/f_output_chain.c" ),
         ( "filters/f_swresample.c" ),
         ( "filters/f_swscale.c" ),
+        ( "filters/f_threaded.c" ),
         ( "filters/f_utils.c" ),
         ( "filters/filter.c" ),
         ( "filters/frame.c" ),
@@ -371,6 +372,7 @@ def build(ctx):
 
         ## Misc
         ( "misc/bstr.c" ),
+        ( "misc/cbor.c" ),
         ( "misc/charset_conv.c" ),
         ( "misc/dispatch.c" ),
         ( "misc/jni.c",                          "android" ),
@@ -589,6 +591,7 @@ def build(ctx):
         ( "video/out/win_state.c"),
         ( "video/out/x11_common.c",              "x11" ),
         ( "video/repack.c" ),
+        ( "video/repack_simd.c" ),
         ( "video/sws_utils.c" ),
         ( "video/zimg.c",                        "zimg" ),
         ( "video/vaapi.c",                       "vaapi" ),